@@ -0,0 +1,475 @@
+#include "Mirror.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/SelfCheck.h"
+
+using namespace DirectX;
+
+bool PortalFrustum::Intersects(const BoundingBox& boxW)const
+{
+	// Outside as soon as the box is entirely in front of one of the planes.
+	for(const XMFLOAT4& p : Planes)
+	{
+		if(boxW.Intersects(XMLoadFloat4(&p)) == FRONT)
+			return false;
+	}
+
+	return true;
+}
+
+bool PortalFrustum::Separates(const std::vector<XMFLOAT3>& pointsW)const
+{
+	for(size_t i = 1; i < Planes.size(); ++i)
+	{
+		XMVECTOR plane = XMLoadFloat4(&Planes[i]);
+
+		bool allOutside = true;
+		for(const XMFLOAT3& p : pointsW)
+			allOutside &= XMVectorGetX(XMPlaneDotCoord(plane, XMLoadFloat3(&p))) >= -1e-4f;
+
+		if(allOutside)
+			return true;
+	}
+
+	return false;
+}
+
+Mirror Mirror::FromTriangles(const std::vector<XMFLOAT3>& positions)
+{
+	assert(positions.size() >= 3);
+
+	XMVECTOR p0 = XMLoadFloat3(&positions[0]);
+	XMVECTOR p1 = XMLoadFloat3(&positions[1]);
+	XMVECTOR p2 = XMLoadFloat3(&positions[2]);
+
+	// With clockwise winding in a left handed system the cross product of the
+	// first two edges points out of the front face.
+	XMVECTOR n = XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+
+	Mirror mirror;
+	XMStoreFloat4(&mirror.Plane, XMPlaneFromPointNormal(p0, n));
+	BoundingBox::CreateFromPoints(mirror.Bounds, positions.size(), positions.data(), sizeof(XMFLOAT3));
+
+	// The outline is the set of distinct vertices sorted by angle around the
+	// centroid, measured in a basis lying in the mirror plane.
+	for(const XMFLOAT3& p : positions)
+	{
+		bool duplicate = false;
+		for(const XMFLOAT3& q : mirror.Outline)
+			duplicate |= XMVector3NearEqual(XMLoadFloat3(&p), XMLoadFloat3(&q), XMVectorReplicate(1e-4f));
+
+		if(!duplicate)
+			mirror.Outline.push_back(p);
+	}
+
+	XMVECTOR centroid = XMVectorZero();
+	for(const XMFLOAT3& p : mirror.Outline)
+		centroid += XMLoadFloat3(&p);
+	centroid /= (float)mirror.Outline.size();
+
+	XMVECTOR u = XMVector3Normalize(p0 - centroid);
+	XMVECTOR v = XMVector3Cross(n, u);
+
+	auto angle = [&](const XMFLOAT3& p)
+	{
+		XMVECTOR d = XMLoadFloat3(&p) - centroid;
+		return atan2f(XMVectorGetX(XMVector3Dot(d, v)), XMVectorGetX(XMVector3Dot(d, u)));
+	};
+	std::sort(mirror.Outline.begin(), mirror.Outline.end(),
+		[&](const XMFLOAT3& a, const XMFLOAT3& b) { return angle(a) < angle(b); });
+
+	return mirror;
+}
+
+bool Mirror::FacesEye(const XMFLOAT3& eyePosW)const
+{
+	XMVECTOR plane = XMLoadFloat4(&Plane);
+	XMVECTOR eye = XMLoadFloat3(&eyePosW);
+	return XMVectorGetX(XMPlaneDotCoord(plane, eye)) > 0.0f;
+}
+
+bool Mirror::Intersects(const BoundingFrustum& frustumW)const
+{
+	return frustumW.Contains(Bounds) != DISJOINT;
+}
+
+PortalFrustum Mirror::BuildPortal(const XMFLOAT3& eyePosW)const
+{
+	PortalFrustum portal;
+
+	// The mirror plane is the near plane; its normal already points toward the eye,
+	// which is out of the volume.
+	portal.Planes.push_back(Plane);
+
+	XMVECTOR eye = XMLoadFloat3(&eyePosW);
+	XMVECTOR center = XMLoadFloat3(&Bounds.Center);
+	for(size_t i = 0; i < Outline.size(); ++i)
+	{
+		XMVECTOR a = XMLoadFloat3(&Outline[i]);
+		XMVECTOR b = XMLoadFloat3(&Outline[(i + 1) % Outline.size()]);
+
+		// Plane through the eye and the edge, flipped if needed so the mirror
+		// surface is behind it.
+		XMVECTOR plane = XMPlaneFromPoints(eye, a, b);
+		if(XMVectorGetX(XMPlaneDotCoord(plane, center)) > 0.0f)
+			plane = -plane;
+
+		XMFLOAT4 p;
+		XMStoreFloat4(&p, plane);
+		portal.Planes.push_back(p);
+	}
+
+	return portal;
+}
+
+Mirror Mirror::Transformed(FXMMATRIX M)const
+{
+	Mirror mirror;
+
+	// Planes transform by the inverse transpose.
+	XMMATRIX invTranspose = XMMatrixTranspose(XMMatrixInverse(&XMMatrixDeterminant(M), M));
+	XMStoreFloat4(&mirror.Plane, XMPlaneNormalize(XMPlaneTransform(XMLoadFloat4(&Plane), invTranspose)));
+
+	Bounds.Transform(mirror.Bounds, M);
+
+	mirror.Outline.resize(Outline.size());
+	for(size_t i = 0; i < Outline.size(); ++i)
+		XMStoreFloat3(&mirror.Outline[i], XMVector3TransformCoord(XMLoadFloat3(&Outline[i]), M));
+
+	return mirror;
+}
+
+float Mirror::ProjectedArea(FXMMATRIX viewProj)const
+{
+	std::vector<XMFLOAT2> ndc(Outline.size());
+	for(size_t i = 0; i < Outline.size(); ++i)
+	{
+		XMVECTOR h = XMVector4Transform(XMVectorSetW(XMLoadFloat3(&Outline[i]), 1.0f), viewProj);
+
+		float w = XMVectorGetW(h);
+		if(w <= 1e-4f)
+			return 1.0f;
+
+		ndc[i] = XMFLOAT2(XMVectorGetX(h) / w, XMVectorGetY(h) / w);
+	}
+
+	// Shoelace formula; the outline is convex and ordered.  NDC spans 2x2 units.
+	float area = 0.0f;
+	for(size_t i = 0; i < ndc.size(); ++i)
+	{
+		const XMFLOAT2& a = ndc[i];
+		const XMFLOAT2& b = ndc[(i + 1) % ndc.size()];
+		area += a.x*b.y - b.x*a.y;
+	}
+
+	return MathHelper::Min(0.125f*fabsf(area), 1.0f);
+}
+
+void BuildReflectionTree(
+	const std::vector<Mirror>& mirrors,
+	const XMFLOAT3& eyePosW,
+	const BoundingFrustum& frustumW,
+	const XMFLOAT4X4& viewProj,
+	const ReflectionTreeSettings& settings,
+	std::vector<ReflectionNode>& nodes)
+{
+	nodes.clear();
+
+	XMMATRIX VP = XMLoadFloat4x4(&viewProj);
+	int maxDepth = MathHelper::Clamp(settings.MaxDepth, 1, 255);
+
+	// Breadth first: nodes[next] is the next node whose children are looked for.
+	for(int parent = -1, next = 0; parent < (int)nodes.size(); parent = next++)
+	{
+		XMMATRIX surfaceTransform = XMMatrixIdentity();
+		int depth = 1;
+		if(parent >= 0)
+		{
+			// Small images are not followed any deeper.
+			if(nodes[parent].Depth >= maxDepth || nodes[parent].ProjectedArea < settings.MinProjectedArea)
+				continue;
+
+			surfaceTransform = XMLoadFloat4x4(&nodes[parent].Reflect);
+			depth = nodes[parent].Depth + 1;
+		}
+
+		for(int i = 0; i < (int)mirrors.size() && (int)nodes.size() < settings.MaxNodes; ++i)
+		{
+			// A mirror seen in itself faces away from the eye; skip the work.
+			if(parent >= 0 && nodes[parent].MirrorIndex == i)
+				continue;
+
+			Mirror image = parent >= 0 ? mirrors[i].Transformed(surfaceTransform) : mirrors[i];
+			if(!image.IsVisible(eyePosW, frustumW))
+				continue;
+
+			// Deeper mirrors must also be seen through every mirror above them.
+			if(parent >= 0 && !nodes[parent].Portal.Intersects(image.Bounds))
+				continue;
+
+			ReflectionNode node;
+			node.MirrorIndex = i;
+			node.Parent = parent;
+			node.Depth = depth;
+			XMStoreFloat4x4(&node.SurfaceTransform, surfaceTransform);
+			node.Plane = image.Plane;
+
+			// Reflect about the mirror in world space, then carry the result
+			// through the chain of mirrors the mirror itself is seen in.
+			XMMATRIX R = XMMatrixReflect(XMLoadFloat4(&mirrors[i].Plane));
+			XMStoreFloat4x4(&node.Reflect, R * surfaceTransform);
+
+			node.Portal = image.BuildPortal(eyePosW);
+			if(parent >= 0)
+			{
+				const std::vector<XMFLOAT4>& parentPlanes = nodes[parent].Portal.Planes;
+				node.Portal.Planes.insert(node.Portal.Planes.end(), parentPlanes.begin(), parentPlanes.end());
+			}
+			node.ProjectedArea = image.ProjectedArea(VP);
+
+			if(parent >= 0)
+				nodes[parent].Children.push_back((int)nodes.size());
+			nodes.push_back(std::move(node));
+		}
+	}
+}
+
+bool RunReflectionTreeSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	// A square mirror from its corners, listed clockwise seen from the reflecting
+	// side, split into two triangles the way the room geometry is.
+	auto square = [](XMFLOAT3 a, XMFLOAT3 b, XMFLOAT3 c, XMFLOAT3 d)
+	{
+		return Mirror::FromTriangles({ a, b, c, a, c, d });
+	};
+
+	// Two 8 x 8 mirrors facing each other, like the demo's corridor pair: at z = 0
+	// facing +z and at z = 8 facing -z.
+	Mirror front = square({ -4.0f, -4.0f, 0.0f }, { 4.0f, -4.0f, 0.0f }, { 4.0f, 4.0f, 0.0f }, { -4.0f, 4.0f, 0.0f });
+	Mirror back = square({ 4.0f, 4.0f, 8.0f }, { 4.0f, -4.0f, 8.0f }, { -4.0f, -4.0f, 8.0f }, { -4.0f, 4.0f, 8.0f });
+	checks.Check(front.Plane.z > 0.99f && back.Plane.z < -0.99f, "the mirrors do not face each other", "setup");
+
+	// Half way between them, looking at the front mirror with the app's projection.
+	XMFLOAT3 eyePos(0.0f, 0.0f, 4.0f);
+	XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eyePos), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, 4.0f / 3.0f, 1.0f, 1000.0f);
+
+	BoundingFrustum frustum;
+	BoundingFrustum::CreateFromMatrix(frustum, proj);
+	BoundingFrustum frustumW;
+	frustum.Transform(frustumW, XMMatrixInverse(&XMMatrixDeterminant(view), view));
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, view * proj);
+
+	std::vector<ReflectionNode> nodes;
+	auto build = [&](const std::vector<Mirror>& mirrors, int maxDepth, int maxNodes, float minProjectedArea)
+	{
+		ReflectionTreeSettings settings;
+		settings.MaxDepth = maxDepth;
+		settings.MaxNodes = maxNodes;
+		settings.MinProjectedArea = minProjectedArea;
+		BuildReflectionTree(mirrors, eyePos, frustumW, viewProj, settings, nodes);
+	};
+
+	std::vector<Mirror> pair = { front, back };
+
+	// The back mirror is behind the eye, so the tree is a single chain: the front
+	// mirror, the back one seen in it, the front one seen in that, and so on.
+	const int depths[] = { 1, 3, 4 };
+	for(int maxDepth : depths)
+	{
+		char testCase[32];
+		sprintf_s(testCase, "max depth %d", maxDepth);
+
+		build(pair, maxDepth, 64, 0.0f);
+		checks.Check((int)nodes.size() == maxDepth, "wrong node count", testCase);
+
+		for(size_t i = 0; i < nodes.size(); ++i)
+		{
+			const ReflectionNode& node = nodes[i];
+			checks.Check(node.MirrorIndex == (int)(i % 2), "the chain does not alternate between the mirrors", testCase);
+			checks.Check(node.Parent == (int)i - 1 && node.Depth == (int)i + 1, "wrong parent or depth", testCase);
+			checks.Check(XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&node.Plane), XMLoadFloat3(&eyePos))) > 0.0f,
+				"mirror image plane does not face the eye", testCase);
+
+			if(i + 1 < nodes.size())
+			{
+				checks.Check(node.Children.size() == 1 && node.Children[0] == (int)i + 1,
+					"wrong children", testCase);
+			}
+			else
+			{
+				checks.Check(node.Children.empty(), "a node past the depth limit", testCase);
+			}
+		}
+
+		// A point between the mirrors, at z = 6, is seen through the chain at
+		// z = -6, -10, -22, -26: each mirror in turn adds twice its distance.
+		const float seenZ[] = { -6.0f, -10.0f, -22.0f, -26.0f };
+		for(size_t i = 0; i < nodes.size() && i < _countof(seenZ); ++i)
+		{
+			XMVECTOR p = XMVector3TransformCoord(XMVectorSet(1.0f, 2.0f, 6.0f, 1.0f), XMLoadFloat4x4(&nodes[i].Reflect));
+			checks.Check(XMVector3NearEqual(p, XMVectorSet(1.0f, 2.0f, seenZ[i], 1.0f), XMVectorReplicate(1e-3f)),
+				"point reflected to the wrong place", testCase);
+		}
+	}
+
+	// The node budget cuts the chain short.
+	build(pair, 4, 2, 0.0f);
+	checks.Check(nodes.size() == 2, "node budget not respected", "max nodes 2");
+
+	// Images are 4, 12, 20 and 28 units away and cover 1 (clamped), 0.49, 0.17 and
+	// 0.09 of the viewport.  The third one is drawn but not followed.
+	build(pair, 8, 64, 0.3f);
+	checks.Check(nodes.size() == 3, "projected area cutoff not respected", "min area 0.3");
+	for(size_t i = 1; i < nodes.size(); ++i)
+		checks.Check(nodes[i].ProjectedArea < nodes[i - 1].ProjectedArea, "deeper images not smaller", "min area 0.3");
+
+	// A small front mirror, and a back mirror off to the side: its image is in the
+	// camera frustum and faces the eye, but is not seen through the front mirror.
+	// With the back mirror centered the same image is seen.
+	Mirror smallFront = square({ -1.0f, -1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { -1.0f, 1.0f, 0.0f });
+	Mirror sideBack = square({ 6.0f, 1.0f, 8.0f }, { 6.0f, -1.0f, 8.0f }, { 4.0f, -1.0f, 8.0f }, { 4.0f, 1.0f, 8.0f });
+	Mirror centerBack = square({ 1.0f, 1.0f, 8.0f }, { 1.0f, -1.0f, 8.0f }, { -1.0f, -1.0f, 8.0f }, { -1.0f, 1.0f, 8.0f });
+
+	Mirror sideImage = sideBack.Transformed(XMMatrixReflect(XMLoadFloat4(&smallFront.Plane)));
+	checks.Check(sideImage.IsVisible(eyePos, frustumW), "the culled image is not in the camera frustum", "culled child");
+
+	build({ smallFront, sideBack }, 4, 64, 0.0f);
+	checks.Check(nodes.size() == 1 && nodes[0].Children.empty(), "image outside the parent's portal not culled", "culled child");
+
+	build({ smallFront, centerBack }, 2, 64, 0.0f);
+	checks.Check(nodes.size() == 2 && nodes[0].Children.size() == 1, "image inside the parent's portal culled", "culled child");
+
+	// Portals of mirrors seen side by side separate them; a larger mirror around
+	// the small one does not.
+	Mirror beside = square({ 5.0f, -1.0f, 0.0f }, { 7.0f, -1.0f, 0.0f }, { 7.0f, 1.0f, 0.0f }, { 5.0f, 1.0f, 0.0f });
+	PortalFrustum smallPortal = smallFront.BuildPortal(eyePos);
+	checks.Check(smallPortal.Separates(beside.Outline), "mirrors side by side overlap", "screen overlap");
+	checks.Check(!smallPortal.Separates(front.Outline), "mirror around a mirror does not overlap it", "screen overlap");
+
+	return checks.Finish("Reflection tree");
+}
+
+bool RunObliqueClipSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	// The app's projection.
+	const float nearZ = 1.0f;
+	const float farZ = 1000.0f;
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, 4.0f / 3.0f, nearZ, farZ);
+	XMFLOAT4X4 P;
+	XMStoreFloat4x4(&P, proj);
+
+	// A plane the eye is not behind leaves the projection alone.
+	{
+		XMFLOAT4X4 unchanged;
+		XMStoreFloat4x4(&unchanged, MathHelper::ObliqueProjection(proj, XMVectorSet(0.0f, 0.0f, -1.0f, 10.0f)));
+
+		bool same = true;
+		for(int i = 0; i < 4; ++i)
+		{
+			for(int j = 0; j < 4; ++j)
+				same &= unchanged.m[i][j] == P.m[i][j];
+		}
+		checks.Check(same, "a plane in front of the eye changed the projection", "no tilt");
+	}
+
+	const float tilts[] = { 0.0f, 30.0f, 60.0f, 80.0f };
+	for(float tilt : tilts)
+	{
+		char tiltCase[32];
+		sprintf_s(tiltCase, "%.0f degrees", tilt);
+
+		// A mirror 10 units ahead and off center, turned away from facing the eye
+		// about an axis that is neither x nor y, so both signs of the far corner
+		// matter.  The axis lies in the mirror.
+		XMVECTOR center = XMVectorSet(1.0f, -0.5f, 10.0f, 1.0f);
+		XMVECTOR axis = XMVector3Normalize(XMVectorSet(1.0f, 0.4f, 0.0f, 0.0f));
+		XMVECTOR toEye = XMVector3TransformNormal(XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f),
+			XMMatrixRotationAxis(axis, XMConvertToRadians(tilt)));
+		XMVECTOR across = XMVector3Cross(toEye, axis);
+
+		// The reference clip: the reflected pass keeps what is behind the mirror,
+		// so the plane's normal points away from the eye.
+		XMVECTOR clipPlane = XMPlaneFromPointNormal(center, -toEye);
+		XMMATRIX oblique = MathHelper::ObliqueProjection(proj, clipPlane);
+
+		// Points of the original frustum from the near plane to the far plane.  Clip
+		// z must have the sign of the distance to the plane, and be proportional to
+		// it, and nothing behind the mirror may reach past the far plane.
+		int wrongSide = 0;
+		int farClipped = 0;
+		float minScale = MathHelper::Infinity;
+		float maxScale = 0.0f;
+		for(int i = 0; i < 9; ++i)
+		{
+			for(int j = 0; j < 9; ++j)
+			{
+				for(int k = 0; k < 40; ++k)
+				{
+					float x = -0.95f + 0.2375f*i;
+					float y = -0.95f + 0.2375f*j;
+					float z = 1.01f*nearZ*powf(0.99f*farZ / (1.01f*nearZ), k / 39.0f);
+					XMVECTOR p = XMVectorSet(x*z / P._11, y*z / P._22, z, 1.0f);
+
+					// Too close to the plane to tell apart in single precision.
+					float distance = XMVectorGetX(XMPlaneDotCoord(clipPlane, p));
+					if(fabsf(distance) < 1e-3f*z)
+						continue;
+
+					XMVECTOR clip = XMVector4Transform(p, oblique);
+					float clipZ = XMVectorGetZ(clip);
+					float clipW = XMVectorGetW(clip);
+
+					if((clipZ > 0.0f) != (distance > 0.0f))
+					{
+						++wrongSide;
+						continue;
+					}
+
+					minScale = MathHelper::Min(minScale, clipZ / distance);
+					maxScale = MathHelper::Max(maxScale, clipZ / distance);
+
+					if(distance > 0.0f && clipZ > clipW*(1.0f + 1e-5f))
+						++farClipped;
+				}
+			}
+		}
+		checks.Check(wrongSide == 0, "clip z on the wrong side of the reference plane", tiltCase);
+		checks.Check(maxScale - minScale <= 1e-3f*maxScale, "clip z not proportional to the distance to the reference plane", tiltCase);
+		checks.Check(farClipped == 0, "points behind the mirror clipped by the far plane", tiltCase);
+
+		// Points on the mirror land on the near plane.
+		float mirrorDepth = 0.0f;
+		for(int u = -8; u <= 8; ++u)
+		{
+			for(int v = -8; v <= 8; ++v)
+			{
+				XMVECTOR p = center + axis*(float)u + across*(float)v;
+				if(XMVectorGetZ(p) < nearZ)
+					continue;
+
+				XMVECTOR clip = XMVector4Transform(p, oblique);
+				mirrorDepth = MathHelper::Max(mirrorDepth, fabsf(XMVectorGetZ(clip) / XMVectorGetW(clip)));
+			}
+		}
+		checks.Check(mirrorDepth < 1e-4f, "points on the mirror off the near plane", tiltCase);
+
+		// Along any view ray the slope of NDC z with distance is proportional to
+		// _43, so the ratio is the depth resolution relative to the app's projection.
+		// The mirror is farther than the near plane, so nothing is lost up to here.
+		XMFLOAT4X4 O;
+		XMStoreFloat4x4(&O, oblique);
+		float resolution = O._43 / P._43;
+		checks.Check(resolution >= 1.0f, "depth resolution below the app's projection", tiltCase);
+
+		checks.Note("  %.0f degrees: eye %.2f behind the plane, NDC z on the mirror within %.1e, depth resolution %.2fx\n",
+			tilt, -XMVectorGetW(clipPlane), mirrorDepth, resolution);
+	}
+
+	return checks.Finish("Oblique near plane clipping");
+}
@@ -0,0 +1,130 @@
+//***************************************************************************************
+// Mirror.h
+//
+// A planar mirror and the per-frame tests that decide whether its reflection pass
+// has to run at all, and which reflected items can be seen through it.  Also
+// builds the tree of reflection passes for mirrors seen in other mirrors.  None
+// of this touches D3D, so it can be driven from test code.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+// The volume seen through a mirror: bounded by the mirror plane (near) and one
+// plane through the eye for every edge of the mirror outline.  The plane normals
+// point out of the volume.
+struct PortalFrustum
+{
+	std::vector<DirectX::XMFLOAT4> Planes;
+
+	// True if the box is at least partially inside the volume.
+	bool Intersects(const DirectX::BoundingBox& boxW)const;
+
+	// True if the points all lie outside one of the planes through the eye, so a
+	// convex surface with those corners never shares a pixel with the mirror on
+	// screen.  The mirror plane itself is not used: a surface behind the mirror is
+	// still covered by it.
+	bool Separates(const std::vector<DirectX::XMFLOAT3>& pointsW)const;
+};
+
+struct Mirror
+{
+	// Plane of the mirror; the normal points to the reflecting side.
+	DirectX::XMFLOAT4 Plane = { 0.0f, 0.0f, -1.0f, 0.0f };
+
+	// World space bounds of the mirror surface.
+	DirectX::BoundingBox Bounds;
+
+	// Convex outline of the mirror surface, ordered around its centroid.
+	std::vector<DirectX::XMFLOAT3> Outline;
+
+	// Builds the mirror from its triangle list.  The first triangle must be front
+	// facing (clockwise seen from the reflecting side).
+	static Mirror FromTriangles(const std::vector<DirectX::XMFLOAT3>& positions);
+
+	// True if the eye is on the reflecting side of the plane.
+	bool FacesEye(const DirectX::XMFLOAT3& eyePosW)const;
+
+	// True if the mirror surface is at least partially inside the frustum.
+	bool Intersects(const DirectX::BoundingFrustum& frustumW)const;
+
+	bool IsVisible(const DirectX::XMFLOAT3& eyePosW, const DirectX::BoundingFrustum& frustumW)const
+	{
+		return FacesEye(eyePosW) && Intersects(frustumW);
+	}
+
+	// The volume behind the mirror that the eye can see through it.  Only valid
+	// when FacesEye(eyePosW) is true.
+	PortalFrustum BuildPortal(const DirectX::XMFLOAT3& eyePosW)const;
+
+	// The mirror as seen after transforming the world by M (e.g. its image in
+	// another mirror).
+	Mirror Transformed(DirectX::FXMMATRIX M)const;
+
+	// Area of the mirror outline on screen as a fraction of the viewport (not
+	// clipped to it).  1 if the outline reaches behind the eye.
+	float ProjectedArea(DirectX::FXMMATRIX viewProj)const;
+};
+
+struct ReflectionTreeSettings
+{
+	// Deepest chain of mirrors followed (1 = no mirrors seen in mirrors).  The
+	// stencil buffer holds the depth, so at most 255.
+	int MaxDepth = 3;
+
+	// Total reflection passes per frame.
+	int MaxNodes = 64;
+
+	// Mirror images smaller than this fraction of the viewport are not followed
+	// any deeper; their own reflection is still drawn.
+	float MinProjectedArea = 0.002f;
+};
+
+// One reflection pass: the contents seen through a mirror, itself possibly seen
+// through a chain of other mirrors.
+struct ReflectionNode
+{
+	int MirrorIndex = -1;
+	int Parent = -1;
+	int Depth = 1;
+
+	// Applied after the world matrix: to the mirror surface to find where it is
+	// seen (the parent's Reflect), and to the reflected items.
+	DirectX::XMFLOAT4X4 SurfaceTransform;
+	DirectX::XMFLOAT4X4 Reflect;
+
+	// Plane of the mirror image the eye sees, normal toward the eye.  The
+	// reflected pass clips everything in front of it.
+	DirectX::XMFLOAT4 Plane;
+
+	// Volume seen through this mirror and all its ancestors.
+	PortalFrustum Portal;
+	float ProjectedArea = 0.0f;
+
+	std::vector<int> Children;
+};
+
+// Builds the reflection passes for one frame, shallowest first, so the node
+// budget is spent on the most visible reflections.  A child always comes after
+// its parent in the output.
+void BuildReflectionTree(
+	const std::vector<Mirror>& mirrors,
+	const DirectX::XMFLOAT3& eyePosW,
+	const DirectX::BoundingFrustum& frustumW,
+	const DirectX::XMFLOAT4X4& viewProj,
+	const ReflectionTreeSettings& settings,
+	std::vector<ReflectionNode>& nodes);
+
+// Builds the reflection trees of a pair of facing mirrors and checks the node
+// count under the depth limit, the node budget and the projected area cutoff,
+// the alternating chain and its reflections, and that a mirror image outside its
+// parent's portal is culled.  Returns false and says why in report if any check
+// fails.
+bool RunReflectionTreeSelfCheck(std::string& report);
+
+// Projects points on both sides of mirror planes at several tilts with
+// MathHelper::ObliqueProjection and checks the sign of clip space z against the
+// signed distance to the plane, and the depth resolution against the app's own
+// projection.  Returns false and says why in report if any check fails.
+bool RunObliqueClipSelfCheck(std::string& report);
@@ -0,0 +1,469 @@
+#include "MirrorPass.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/SelfCheck.h"
+
+MirrorPassSimulator::MirrorPassSimulator(const std::vector<MirrorPassNode>& nodes, bool depthCleared) :
+	mNodes(nodes), mPixels(nodes.size()), mDepthCleared(depthCleared)
+{
+	for(Pixel& px : mPixels)
+		px.Depth = depthCleared ? DepthKind::Far : DepthKind::Scene;
+}
+
+void MirrorPassSimulator::SetPipeline(MirrorPipeline pipeline)
+{
+	mPipeline = pipeline;
+	++mCounts.PipelineChanges;
+}
+
+void MirrorPassSimulator::SetStencilRef(UINT ref)
+{
+	mStencilRef = (int)ref;
+	++mCounts.StencilRefs;
+}
+
+void MirrorPassSimulator::SetViewport(bool farDepth)
+{
+	mFarViewport = farDepth;
+	++mCounts.ViewportChanges;
+}
+
+void MirrorPassSimulator::SetPassConstants(int node)
+{
+	mPassConstants = node;
+	++mCounts.ConstantBinds;
+}
+
+void MirrorPassSimulator::DrawMirror(int node)
+{
+	++mCounts.MirrorDraws;
+
+	char line[200];
+	const MirrorPassNode& n = mNodes[node];
+
+	// The surface is where the parent's pass sees it.
+	if(mPassConstants != n.Parent)
+	{
+		sprintf_s(line, "mirror of node %d drawn with the pass constants of %d", node, mPassConstants);
+		Fail(line);
+		return;
+	}
+
+	if(mPipeline == MirrorPipeline::DrawReflections || mPipeline == MirrorPipeline::DrawReflectionsUnflipped ||
+		mPipeline == MirrorPipeline::Count)
+	{
+		sprintf_s(line, "mirror of node %d drawn without a mirror pipeline", node);
+		Fail(line);
+		return;
+	}
+
+	// The surface is seen through Depth - 1 mirrors; the depth reset draws both sides.
+	bool seenFlipped = (n.Depth - 1) % 2 == 1;
+	if(mPipeline != MirrorPipeline::ResetDepth && Flipped(mPipeline) != seenFlipped)
+	{
+		sprintf_s(line, "mirror of node %d culled by the winding of its pipeline", node);
+		Fail(line);
+		return;
+	}
+
+	for(int p = 0; p < (int)mPixels.size(); ++p)
+	{
+		if(!Covers(node, p))
+			continue;
+
+		Pixel& px = mPixels[p];
+
+		// The mirror is in front of the scene behind it and of the parent's
+		// reflection it is seen in; other depths cannot be compared with it.
+		bool depthPasses = !mFarViewport &&
+			(px.Depth == DepthKind::Scene || px.Depth == DepthKind::Far ||
+			(px.Depth == DepthKind::Reflected && px.DepthNode == n.Parent));
+		bool stencilPasses = px.Stencil == mStencilRef;
+
+		switch(mPipeline)
+		{
+		case MirrorPipeline::MarkStencil:
+			if(depthPasses)
+				px.Stencil = mStencilRef;
+			break;
+
+		case MirrorPipeline::IncrStencil:
+		case MirrorPipeline::IncrStencilFlipped:
+			if(depthPasses && stencilPasses)
+				++px.Stencil;
+			break;
+
+		case MirrorPipeline::DecrStencil:
+		case MirrorPipeline::DecrStencilFlipped:
+			if(stencilPasses)
+			{
+				px.Stencil = MathHelper::Max(px.Stencil - 1, 0);
+				px.Depth = mFarViewport ? DepthKind::Far : DepthKind::Surface;
+				px.DepthNode = node;
+			}
+			break;
+
+		case MirrorPipeline::ResetDepth:
+		case MirrorPipeline::RestoreDepth:
+			if(stencilPasses)
+			{
+				px.Depth = mFarViewport ? DepthKind::Far : DepthKind::Surface;
+				px.DepthNode = node;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		// Shadows own the top two bits of the stencil.
+		if(px.Stencil >= 0x40)
+		{
+			sprintf_s(line, "mirror of node %d raised the stencil to %d", node, px.Stencil);
+			Fail(line);
+		}
+	}
+}
+
+void MirrorPassSimulator::DrawReflections(int node)
+{
+	++mCounts.ReflectionDraws;
+
+	char line[200];
+	const MirrorPassNode& n = mNodes[node];
+
+	if(mPassConstants != node)
+	{
+		sprintf_s(line, "reflections of node %d drawn with the pass constants of %d", node, mPassConstants);
+		Fail(line);
+		return;
+	}
+
+	if(mPipeline != MirrorPipeline::DrawReflections && mPipeline != MirrorPipeline::DrawReflectionsUnflipped)
+	{
+		sprintf_s(line, "reflections of node %d drawn without a reflection pipeline", node);
+		Fail(line);
+		return;
+	}
+
+	// The reflected items are seen through Depth mirrors.
+	if(Flipped(mPipeline) != (n.Depth % 2 == 1))
+	{
+		sprintf_s(line, "reflections of node %d culled by the winding of their pipeline", node);
+		Fail(line);
+		return;
+	}
+
+	for(int p = 0; p < (int)mPixels.size(); ++p)
+	{
+		if(!Covers(node, p))
+			continue;
+
+		// The reflection's depths only compare with the far plane and its own.
+		Pixel& px = mPixels[p];
+		bool depthPasses = !mFarViewport &&
+			(px.Depth == DepthKind::Far || (px.Depth == DepthKind::Reflected && px.DepthNode == node));
+		if(depthPasses && px.Stencil == mStencilRef)
+		{
+			px.Color = node;
+			px.Depth = DepthKind::Reflected;
+			px.DepthNode = node;
+		}
+	}
+}
+
+bool MirrorPassSimulator::Finish(MirrorStencilMode mode, std::string& report)
+{
+	char line[200];
+
+	for(int p = 0; p < (int)mPixels.size(); ++p)
+	{
+		const Pixel& px = mPixels[p];
+
+		// A node without work shows the reflection it is seen in.
+		int shown = p;
+		while(shown >= 0 && !mNodes[shown].HasWork)
+			shown = mNodes[shown].Parent;
+
+		if(px.Color != shown)
+		{
+			sprintf_s(line, "node %d shows the reflection of %d instead of %d", p, px.Color, shown);
+			Fail(line);
+		}
+
+		int root = p;
+		while(mNodes[root].Parent >= 0)
+			root = mNodes[root].Parent;
+
+		// The transparent mirrors are blended over their own depth.
+		DepthKind depth = mDepthCleared ? DepthKind::Far : DepthKind::Scene;
+		if(mNodes[root].HasWork)
+			depth = DepthKind::Surface;
+
+		if(px.Depth != depth || (depth == DepthKind::Surface && px.DepthNode != root))
+		{
+			sprintf_s(line, "node %d left depth %d of node %d behind", p, (int)px.Depth, px.DepthNode);
+			Fail(line);
+		}
+
+		int stencil = 0;
+		if(mode == MirrorStencilMode::SingleMark && mNodes[p].HasWork)
+			stencil = p + 1;
+
+		if(px.Stencil != stencil)
+		{
+			sprintf_s(line, "node %d left stencil %d instead of %d", p, px.Stencil, stencil);
+			Fail(line);
+		}
+	}
+
+	const size_t maxLines = 8;
+	for(size_t i = 0; i < mErrors.size() && i < maxLines; ++i)
+		report += "    " + mErrors[i] + "\n";
+
+	return mErrors.empty();
+}
+
+bool MirrorPassSimulator::Covers(int node, int pixel)const
+{
+	for(int n = pixel; n >= 0; n = mNodes[n].Parent)
+	{
+		if(n == node)
+			return true;
+	}
+	return false;
+}
+
+bool MirrorPassSimulator::Flipped(MirrorPipeline pipeline)const
+{
+	return pipeline == MirrorPipeline::IncrStencilFlipped ||
+		pipeline == MirrorPipeline::DecrStencilFlipped ||
+		pipeline == MirrorPipeline::DrawReflections;
+}
+
+void MirrorPassSimulator::Fail(const std::string& what)
+{
+	mErrors.push_back(what);
+}
+
+void MirrorPass::Record(MirrorStencilMode mode, const std::vector<MirrorPassNode>& nodes,
+	MirrorPassCommandList& cmdList)
+{
+	bool anyWork = false;
+	for(const MirrorPassNode& node : nodes)
+		anyWork |= node.HasWork;
+
+	if(!anyWork)
+		return;
+
+	if(mode == MirrorStencilMode::Nested)
+	{
+		// The stencil holds how many mirrors deep each pixel is.
+		for(int i = 0; i < (int)nodes.size() && nodes[i].Depth == 1; ++i)
+			RecordNode(i, nodes, cmdList);
+		return;
+	}
+
+	// Mark every mirror with its own stencil value (node index + 1).  The stencil
+	// ref is not part of the pipeline, so this costs no pipeline changes.  Nothing
+	// has been drawn yet, so the depth behind the mirrors is already at the far
+	// plane the reflections' oblique projections need, and opaque items in front
+	// of a mirror will cover its reflection when they are drawn.
+	cmdList.SetPassConstants(MainPassConstants);
+	cmdList.SetPipeline(MirrorPipeline::MarkStencil);
+	for(int i = 0; i < (int)nodes.size(); ++i)
+	{
+		assert(nodes[i].Depth == 1);
+		if(!nodes[i].HasWork)
+			continue;
+
+		cmdList.SetStencilRef((UINT)i + 1);
+		cmdList.DrawMirror(i);
+	}
+
+	// Draw each reflection only where the stencil buffer holds its mirror's value.
+	cmdList.SetPipeline(MirrorPipeline::DrawReflections);
+	for(int i = 0; i < (int)nodes.size(); ++i)
+	{
+		if(!nodes[i].HasWork)
+			continue;
+
+		cmdList.SetPassConstants(i);
+		cmdList.SetStencilRef((UINT)i + 1);
+		cmdList.DrawReflections(i);
+	}
+
+	// Write the mirror depths so the rest of the frame sees the mirrors: items
+	// behind them are hidden and the transparent mirrors blend over them.
+	cmdList.SetPassConstants(MainPassConstants);
+	cmdList.SetPipeline(MirrorPipeline::RestoreDepth);
+	for(int i = 0; i < (int)nodes.size(); ++i)
+	{
+		if(!nodes[i].HasWork)
+			continue;
+
+		cmdList.SetStencilRef((UINT)i + 1);
+		cmdList.DrawMirror(i);
+	}
+}
+
+void MirrorPass::RecordNode(int node, const std::vector<MirrorPassNode>& nodes, MirrorPassCommandList& cmdList)
+{
+	const MirrorPassNode& n = nodes[node];
+	if(!n.HasWork)
+		return;
+
+	// Every reflection flips the winding.  The mirror surface is seen through
+	// Depth - 1 mirrors and the reflected items through Depth.
+	bool surfaceFlipped = (n.Depth - 1) % 2 == 1;
+	bool contentsFlipped = n.Depth % 2 == 1;
+
+	// Raise the stencil from Depth - 1 to Depth where this mirror is seen.  The
+	// surface is placed by the parent's pass constants.
+	cmdList.SetPassConstants(n.Parent);
+	cmdList.SetStencilRef(n.Depth - 1);
+	cmdList.SetPipeline(surfaceFlipped ? MirrorPipeline::IncrStencilFlipped : MirrorPipeline::IncrStencil);
+	cmdList.DrawMirror(node);
+
+	// The reflection uses an oblique projection; start it from the far plane.
+	cmdList.SetStencilRef(n.Depth);
+	cmdList.SetViewport(true);
+	cmdList.SetPipeline(MirrorPipeline::ResetDepth);
+	cmdList.DrawMirror(node);
+	cmdList.SetViewport(false);
+
+	// Draw the reflection only where the stencil buffer holds this depth.
+	cmdList.SetPassConstants(node);
+	cmdList.SetPipeline(contentsFlipped ? MirrorPipeline::DrawReflections : MirrorPipeline::DrawReflectionsUnflipped);
+	cmdList.DrawReflections(node);
+
+	// Mirrors seen in this mirror come after it.
+	for(int child = node + 1; child < (int)nodes.size(); ++child)
+	{
+		if(nodes[child].Parent == node)
+			RecordNode(child, nodes, cmdList);
+	}
+
+	// Lower the stencil back to Depth - 1 so siblings see their parent's value,
+	// and put back the mirror's depth as the parent pass sees it.
+	cmdList.SetPassConstants(n.Parent);
+	cmdList.SetStencilRef(n.Depth);
+	cmdList.SetPipeline(surfaceFlipped ? MirrorPipeline::DecrStencilFlipped : MirrorPipeline::DecrStencil);
+	cmdList.DrawMirror(node);
+}
+
+bool MirrorPass::ValidateCommandSequence(std::string& report)
+{
+	SelfCheck checks(report);
+
+	auto summary = [&](const char* scene, const char* mode, const MirrorPassCommandCounts& c)
+	{
+		checks.Note("  %s, %s: %u mirror draws, %u reflection draws, %u pipeline changes\n",
+			scene, mode, c.MirrorDraws, c.ReflectionDraws, c.PipelineChanges);
+	};
+
+	// Work flags as the app sets them: a node with items of its own, and every
+	// ancestor of one, has work.
+	auto makeTree = [](const std::vector<int>& parents, const std::vector<bool>& items)
+	{
+		std::vector<MirrorPassNode> nodes(parents.size());
+		for(size_t i = 0; i < nodes.size(); ++i)
+		{
+			nodes[i].Parent = parents[i];
+			nodes[i].Depth = parents[i] >= 0 ? nodes[parents[i]].Depth + 1 : 1;
+		}
+		for(int i = (int)nodes.size() - 1; i >= 0; --i)
+		{
+			nodes[i].HasWork = nodes[i].HasWork || items[i];
+			if(nodes[i].HasWork && nodes[i].Parent >= 0)
+				nodes[nodes[i].Parent].HasWork = true;
+		}
+		return nodes;
+	};
+
+	// Four mirrors seen directly, one of them without reflected items.  The single
+	// mark pass runs before the opaque pass, the nested one after it.
+	{
+		const char* scene = "4 mirrors";
+		std::vector<MirrorPassNode> nodes = makeTree({ -1, -1, -1, -1 }, { true, true, false, true });
+
+		MirrorPassSimulator single(nodes, true);
+		MirrorPass::Record(MirrorStencilMode::SingleMark, nodes, single);
+		checks.Check(single.Finish(MirrorStencilMode::SingleMark, report), "single mark: stencil or depth sequence", scene);
+
+		MirrorPassSimulator nested(nodes, false);
+		MirrorPass::Record(MirrorStencilMode::Nested, nodes, nested);
+		checks.Check(nested.Finish(MirrorStencilMode::Nested, report), "nested: stencil or depth sequence", scene);
+
+		const MirrorPassCommandCounts& s = single.Counts();
+		const MirrorPassCommandCounts& n = nested.Counts();
+		checks.Check(s.ReflectionDraws == 3 && n.ReflectionDraws == 3, "one reflection draw per mirror with work", scene);
+		checks.Check(s.PipelineChanges == 3, "single mark: three pipelines", scene);
+		checks.Check(s.MirrorDraws == 2*3, "single mark: a mark and a depth draw per mirror with work", scene);
+		checks.Check(s.PipelineChanges < n.PipelineChanges, "single mark changes pipelines less often than nested", scene);
+		checks.Check(s.MirrorDraws < n.MirrorDraws, "single mark draws the mirrors less often than nested", scene);
+
+		summary(scene, "single mark", s);
+		summary(scene, "nested", n);
+	}
+
+	// Mirrors seen in mirrors down to depth 4, with nodes whose only work is below
+	// them and a leaf without items.
+	{
+		const char* scene = "nested tree";
+		std::vector<MirrorPassNode> nodes = makeTree(
+			{ -1, -1, 0, 0, 1, 2, 2, 5, 5 },
+			{ true, false, false, true, true, false, false, false, true });
+
+		MirrorPassSimulator nested(nodes, false);
+		MirrorPass::Record(MirrorStencilMode::Nested, nodes, nested);
+		checks.Check(nested.Finish(MirrorStencilMode::Nested, report), "nested: stencil or depth sequence", scene);
+		checks.Check(nested.Counts().ReflectionDraws == 7, "one reflection draw per node with work", scene);
+
+		summary(scene, "nested", nested.Counts());
+	}
+
+	// Nothing to reflect records nothing.
+	{
+		const char* scene = "no work";
+		std::vector<MirrorPassNode> nodes = makeTree({ -1, -1 }, { false, false });
+
+		MirrorPassSimulator single(nodes, true);
+		MirrorPass::Record(MirrorStencilMode::SingleMark, nodes, single);
+		checks.Check(single.Finish(MirrorStencilMode::SingleMark, report), "single mark: stencil or depth sequence", scene);
+		checks.Check(single.Counts().PipelineChanges == 0 && single.Counts().MirrorDraws == 0, "no commands", scene);
+	}
+
+	// The simulator itself must catch a broken sequence: reflections drawn without
+	// resetting the depth behind the mirror first.
+	{
+		const char* scene = "no depth reset";
+		std::vector<MirrorPassNode> nodes = makeTree({ -1 }, { true });
+
+		MirrorPassSimulator broken(nodes, false);
+		broken.SetPassConstants(MainPassConstants);
+		broken.SetPipeline(MirrorPipeline::MarkStencil);
+		broken.SetStencilRef(1);
+		broken.DrawMirror(0);
+		broken.SetPassConstants(0);
+		broken.SetPipeline(MirrorPipeline::DrawReflections);
+		broken.DrawReflections(0);
+
+		std::string ignored;
+		checks.Check(!broken.Finish(MirrorStencilMode::SingleMark, ignored), "the missing reset is not caught", scene);
+	}
+
+	// The single mark pass has no reset of its own, so it must not run after the
+	// opaque pass.
+	{
+		const char* scene = "single mark after opaque";
+		std::vector<MirrorPassNode> nodes = makeTree({ -1, -1 }, { true, true });
+
+		MirrorPassSimulator late(nodes, false);
+		MirrorPass::Record(MirrorStencilMode::SingleMark, nodes, late);
+
+		std::string ignored;
+		checks.Check(!late.Finish(MirrorStencilMode::SingleMark, ignored), "drawing over the scene depth is not caught", scene);
+	}
+
+	return checks.Finish("Mirror pass command sequence");
+}
@@ -0,0 +1,170 @@
+//***************************************************************************************
+// MirrorPass.h
+//
+// Records the stencil passes that draw the reflections of a frame's reflection tree,
+// either marking every mirror at once with its own stencil value or walking the tree
+// with the stencil holding how many mirrors deep each pixel is.  The commands go
+// through MirrorPassCommandList: the app forwards them to its D3D12 command list,
+// and MirrorPassSimulator plays them back on a model of the stencil and depth
+// buffers without a device.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+enum class MirrorStencilMode
+{
+	// Every mirror marked in one pass with stencil value node index + 1.  Only for
+	// trees without mirrors seen in mirrors, and recorded before the opaque pass.
+	SingleMark,
+
+	// Mark, reflect and clear each mirror in turn, recursing into the mirrors seen
+	// in it.
+	Nested
+};
+
+// The pipelines of the mirror passes.  Flipped ones treat counterclockwise
+// triangles as front facing, for surfaces seen through an odd number of mirrors.
+enum class MirrorPipeline
+{
+	MarkStencil,
+	IncrStencil,
+	IncrStencilFlipped,
+	DecrStencil,
+	DecrStencilFlipped,
+	ResetDepth,
+	RestoreDepth,
+	DrawReflections,
+	DrawReflectionsUnflipped,
+	Count
+};
+
+// Stands for the main pass constants where a node is expected.
+const int MainPassConstants = -1;
+
+// What the mirror passes need to know about a node of the reflection tree.  A
+// child always comes after its parent.
+struct MirrorPassNode
+{
+	int Parent = -1;
+	int Depth = 1;
+
+	// The node or one of its descendants has reflected items; nodes without work
+	// are skipped.
+	bool HasWork = false;
+};
+
+class MirrorPassCommandList
+{
+public:
+	virtual ~MirrorPassCommandList() = default;
+
+	virtual void SetPipeline(MirrorPipeline pipeline) = 0;
+	virtual void SetStencilRef(UINT ref) = 0;
+
+	// The screen viewport, or the same viewport with its depth range collapsed
+	// onto the far plane.
+	virtual void SetViewport(bool farDepth) = 0;
+
+	// Pass constants of a node, or MainPassConstants.
+	virtual void SetPassConstants(int node) = 0;
+
+	// The surface of the node's mirror, placed by the bound pass constants.
+	virtual void DrawMirror(int node) = 0;
+
+	// The reflected items seen through the node's mirror.
+	virtual void DrawReflections(int node) = 0;
+};
+
+struct MirrorPassCommandCounts
+{
+	UINT PipelineChanges = 0;
+	UINT StencilRefs = 0;
+	UINT ViewportChanges = 0;
+	UINT ConstantBinds = 0;
+	UINT MirrorDraws = 0;
+	UINT ReflectionDraws = 0;
+};
+
+// Stand-in command list that plays the commands back on one pixel per node: the
+// pixel where that node's mirror is the deepest mirror seen.  It sees every mirror
+// of the node's chain and nothing else.  Depth is tracked by what wrote it, since
+// depths from different passes cannot be compared.
+class MirrorPassSimulator : public MirrorPassCommandList
+{
+public:
+	// depthCleared: the pass runs before anything else is drawn, so the depth
+	// behind the mirrors is still at the far plane.
+	MirrorPassSimulator(const std::vector<MirrorPassNode>& nodes, bool depthCleared);
+
+	virtual void SetPipeline(MirrorPipeline pipeline)override;
+	virtual void SetStencilRef(UINT ref)override;
+	virtual void SetViewport(bool farDepth)override;
+	virtual void SetPassConstants(int node)override;
+	virtual void DrawMirror(int node)override;
+	virtual void DrawReflections(int node)override;
+
+	const MirrorPassCommandCounts& Counts()const { return mCounts; }
+
+	// Checks what the pass left behind: every drawn node's reflection where its
+	// mirror is seen, the stencil values mode leaves for the passes after it, and
+	// the mirror depths back for the transparent mirrors.  Appends a line per
+	// failure (the first few) to report and returns false if there are any.
+	bool Finish(MirrorStencilMode mode, std::string& report);
+
+private:
+	enum class DepthKind
+	{
+		Scene,
+		Far,
+		Surface,
+		Reflected
+	};
+
+	struct Pixel
+	{
+		int Stencil = 0;
+		DepthKind Depth = DepthKind::Scene;
+		int DepthNode = -1;
+
+		// Node whose reflection was drawn last, or -1.
+		int Color = -1;
+	};
+
+	bool Covers(int node, int pixel)const;
+	bool Flipped(MirrorPipeline pipeline)const;
+	void Fail(const std::string& what);
+
+	const std::vector<MirrorPassNode>& mNodes;
+	std::vector<Pixel> mPixels;
+	bool mDepthCleared = false;
+
+	MirrorPipeline mPipeline = MirrorPipeline::Count;
+	int mStencilRef = 0;
+	bool mFarViewport = false;
+	int mPassConstants = -2;
+
+	MirrorPassCommandCounts mCounts;
+	std::vector<std::string> mErrors;
+};
+
+class MirrorPass
+{
+public:
+	// Records the reflection passes of the nodes that have work.  SingleMark is
+	// recorded into the cleared depth buffer, before the opaque pass, and leaves
+	// its stencil values in place for the rest of the frame.  Nested is recorded
+	// after the opaque pass and leaves the stencil at 0.  Both leave each mirror's
+	// own depth behind it.
+	static void Record(MirrorStencilMode mode, const std::vector<MirrorPassNode>& nodes,
+		MirrorPassCommandList& cmdList);
+
+	// Records made up trees in both modes into a MirrorPassSimulator and checks
+	// the stencil and depth sequence and the command counts.  Returns false and
+	// says why in report if any check fails.
+	static bool ValidateCommandSequence(std::string& report);
+
+private:
+	static void RecordNode(int node, const std::vector<MirrorPassNode>& nodes, MirrorPassCommandList& cmdList);
+};
@@ -0,0 +1,155 @@
+#include "PlanarShadow.h"
+
+using namespace DirectX;
+
+ShadowLight ShadowLight::Directional(const XMFLOAT3& direction)
+{
+	ShadowLight light;
+	light.ToLight = XMFLOAT4(-direction.x, -direction.y, -direction.z, 0.0f);
+	return light;
+}
+
+ShadowLight ShadowLight::Point(const XMFLOAT3& position)
+{
+	ShadowLight light;
+	light.ToLight = XMFLOAT4(position.x, position.y, position.z, 1.0f);
+	return light;
+}
+
+void PlanarShadowSystem::ClearReceivers()
+{
+	mReceivers.clear();
+}
+
+int PlanarShadowSystem::AddReceiver(const ShadowReceiver& receiver)
+{
+	// Receivers are usually flat boxes.  Pad them so shadows that land exactly on
+	// the surface are not lost to rounding.
+	ShadowReceiver padded = receiver;
+	float pad = receiver.Offset + 1e-3f;
+	padded.Bounds.Extents.x += pad;
+	padded.Bounds.Extents.y += pad;
+	padded.Bounds.Extents.z += pad;
+
+	mReceivers.push_back(padded);
+	return (int)mReceivers.size() - 1;
+}
+
+const XMFLOAT4X4& PlanarShadowSystem::ShadowMatrix(int receiver, int light)const
+{
+	return mShadowMatrices[receiver*mLightCount + light];
+}
+
+void PlanarShadowSystem::Update(
+	const std::vector<ShadowCaster>& casters,
+	const std::vector<ShadowLight>& lights,
+	const BoundingFrustum& frustumW,
+	std::vector<ShadowInstance>& instances)
+{
+	instances.clear();
+
+	// The shadow matrices only depend on the receiver and the light, so they are
+	// built once per frame and shared by every caster.
+	mLightCount = (int)lights.size();
+	mShadowMatrices.resize(mReceivers.size()*lights.size());
+	mLightFacesReceiver.resize(mReceivers.size()*lights.size());
+
+	for(size_t r = 0; r < mReceivers.size(); ++r)
+	{
+		XMVECTOR plane = XMLoadFloat4(&mReceivers[r].Plane);
+		XMMATRIX lift = XMMatrixTranslationFromVector(plane * mReceivers[r].Offset);
+
+		for(size_t l = 0; l < lights.size(); ++l)
+		{
+			XMVECTOR toLight = XMLoadFloat4(&lights[l].ToLight);
+
+			// For a point light this is its distance above the plane; for a
+			// directional light the cosine between the plane normal and the light.
+			mLightFacesReceiver[r*lights.size() + l] = XMVectorGetX(XMPlaneDot(plane, toLight)) > 0.0f;
+			XMStoreFloat4x4(&mShadowMatrices[r*lights.size() + l], XMMatrixShadow(plane, toLight) * lift);
+		}
+	}
+
+	for(size_t c = 0; c < casters.size(); ++c)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&casters[c].World);
+
+		BoundingBox casterW;
+		casters[c].Bounds.Transform(casterW, world);
+
+		XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+		casterW.GetCorners(corners);
+
+		for(size_t r = 0; r < mReceivers.size(); ++r)
+		{
+			const ShadowReceiver& receiver = mReceivers[r];
+			XMVECTOR plane = XMLoadFloat4(&receiver.Plane);
+
+			mStats.Candidates += lights.size();
+
+			// A caster entirely behind the receiver casts nothing on it.
+			if(casterW.Intersects(plane) == BACK)
+			{
+				mStats.CulledFacing += lights.size();
+				continue;
+			}
+
+			for(size_t l = 0; l < lights.size(); ++l)
+			{
+				if(!mLightFacesReceiver[r*lights.size() + l])
+				{
+					++mStats.CulledFacing;
+					continue;
+				}
+
+				// A point light has to be above the whole caster, or the
+				// projection flips through infinity.
+				const XMFLOAT4& toLight = lights[l].ToLight;
+				if(toLight.w != 0.0f)
+				{
+					float lightHeight = XMVectorGetX(XMPlaneDotCoord(plane, XMLoadFloat4(&toLight)));
+					bool below = true;
+					for(const XMFLOAT3& corner : corners)
+						below &= XMVectorGetX(XMPlaneDotCoord(plane, XMLoadFloat3(&corner))) < lightHeight;
+
+					if(!below)
+					{
+						++mStats.CulledFacing;
+						continue;
+					}
+				}
+
+				// The shadow of the caster bounds bounds the shadow of the caster.
+				XMMATRIX S = XMLoadFloat4x4(&mShadowMatrices[r*lights.size() + l]);
+
+				XMFLOAT3 projected[BoundingBox::CORNER_COUNT];
+				for(size_t i = 0; i < BoundingBox::CORNER_COUNT; ++i)
+					XMStoreFloat3(&projected[i], XMVector3TransformCoord(XMLoadFloat3(&corners[i]), S));
+
+				BoundingBox shadowW;
+				BoundingBox::CreateFromPoints(shadowW, BoundingBox::CORNER_COUNT, projected, sizeof(XMFLOAT3));
+
+				if(!receiver.Bounds.Intersects(shadowW))
+				{
+					++mStats.CulledOffReceiver;
+					continue;
+				}
+
+				if(!frustumW.Intersects(shadowW))
+				{
+					++mStats.CulledOffScreen;
+					continue;
+				}
+
+				ShadowInstance instance;
+				instance.Caster = (int)c;
+				instance.Receiver = (int)r;
+				instance.Light = (int)l;
+				XMStoreFloat4x4(&instance.World, world * S);
+				instances.push_back(instance);
+			}
+		}
+	}
+
+	mStats.Instances += instances.size();
+}
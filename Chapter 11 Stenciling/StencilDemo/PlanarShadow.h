@@ -0,0 +1,90 @@
+//***************************************************************************************
+// PlanarShadow.h
+//
+// Planar projected shadows for any number of casters, receiver planes and lights.
+// Each frame the system builds one shadow matrix per (receiver, light) pair and
+// then one shadow instance per caster that lands on a receiver and can be seen.
+// Like Mirror.h it does not touch D3D; the app owns the render items and draws
+// the instances.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+struct ShadowReceiver
+{
+	// Plane the shadows are flattened onto; the normal points to the lit side.
+	DirectX::XMFLOAT4 Plane = { 0.0f, 1.0f, 0.0f, 0.0f };
+
+	// World space bounds of the receiving surface.
+	DirectX::BoundingBox Bounds;
+
+	// Distance the shadow is lifted off the plane to avoid z-fighting.
+	float Offset = 0.001f;
+};
+
+struct ShadowLight
+{
+	// Direction to the light with w = 0, or the light position with w = 1.  This
+	// is the light vector XMMatrixShadow expects.
+	DirectX::XMFLOAT4 ToLight = { 0.0f, 1.0f, 0.0f, 0.0f };
+
+	static ShadowLight Directional(const DirectX::XMFLOAT3& direction);
+	static ShadowLight Point(const DirectX::XMFLOAT3& position);
+};
+
+struct ShadowCaster
+{
+	// Local space bounds and world matrix of the casting item.
+	DirectX::BoundingBox Bounds;
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+};
+
+// One flattened copy of a caster.
+struct ShadowInstance
+{
+	int Caster = -1;
+	int Receiver = -1;
+	int Light = -1;
+	DirectX::XMFLOAT4X4 World;
+};
+
+struct PlanarShadowStats
+{
+	UINT64 Candidates = 0;            // caster x receiver x light
+	UINT64 Instances = 0;
+	UINT64 CulledFacing = 0;          // light or caster on the unlit side of the plane
+	UINT64 CulledOffReceiver = 0;     // shadow lands outside the receiver bounds
+	UINT64 CulledOffScreen = 0;       // shadow outside the view frustum
+};
+
+class PlanarShadowSystem
+{
+public:
+	void ClearReceivers();
+	int AddReceiver(const ShadowReceiver& receiver);
+	const std::vector<ShadowReceiver>& Receivers()const { return mReceivers; }
+
+	// Fills instances with the visible shadows of every caster on every receiver
+	// for every light.  frustumW is the camera frustum in world space.
+	void Update(
+		const std::vector<ShadowCaster>& casters,
+		const std::vector<ShadowLight>& lights,
+		const DirectX::BoundingFrustum& frustumW,
+		std::vector<ShadowInstance>& instances);
+
+	// Shadow matrices of the last Update, receiver major.
+	const DirectX::XMFLOAT4X4& ShadowMatrix(int receiver, int light)const;
+
+	const PlanarShadowStats& Stats()const { return mStats; }
+	void ResetStats() { mStats = PlanarShadowStats(); }
+
+private:
+	std::vector<ShadowReceiver> mReceivers;
+	std::vector<DirectX::XMFLOAT4X4> mShadowMatrices;
+	std::vector<bool> mLightFacesReceiver;
+	int mLightCount = 0;
+
+	PlanarShadowStats mStats;
+};
@@ -46,6 +46,7 @@ cbuffer cbPass : register(b1)
     float4x4 gInvProj;
     float4x4 gViewProj;
     float4x4 gInvViewProj;
+    float4x4 gReflect;
     float3 gEyePosW;
     float cbPerObjectPad1;
     float2 gRenderTargetSize;
@@ -95,12 +96,13 @@ VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
 	
-    // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    // Transform to world space, then through the pass's mirror (identity outside
+    // the reflection passes).
+    float4 posW = mul(mul(float4(vin.PosL, 1.0f), gWorld), gReflect);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(mul(vin.NormalL, (float3x3)gWorld), (float3x3)gReflect);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
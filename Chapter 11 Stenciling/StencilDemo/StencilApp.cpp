@@ -6,7 +6,12 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/TaskGraph.h"
+#include "../../Common/SelfCheck.h"
 #include "FrameResource.h"
+#include "Mirror.h"
+#include "MirrorPass.h"
+#include "PlanarShadow.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -17,6 +22,31 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Submeshes of the room geometry that are mirrors.  Each one gets a Mirror and a
+// render item.  The six box faces reflect outward; the corridor pair on either
+// side faces inward, so the two show each other over and over.
+const char* const gMirrorSubmeshes[] =
+{
+	"mirrorFront", "mirrorBack", "mirrorLeft", "mirrorRight", "mirrorTop", "mirrorBottom",
+	"mirrorCorridorEast", "mirrorCorridorWest"
+};
+
+// Reflection passes per frame; each has its own pass constants (1 + node index).
+const int gMaxReflectionNodes = 64;
+
+// Deepest chain of mirrors seen in mirrors.
+const int gMaxReflectionDepth = 4;
+
+// Every light in the main pass casts planar shadows.
+const int gNumShadowLights = 3;
+
+// The mirror passes keep their stencil values below these bits.  A receiver's
+// visible surface is marked with gShadowReceiverStencil while its shadows are
+// drawn, so they stop at its edges, and gShadowDrawnStencil keeps a pixel from
+// being shadowed twice.
+const UINT gShadowReceiverStencil = 0x40;
+const UINT gShadowDrawnStencil = 0x80;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -49,39 +79,21 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Object space bounds, used to cull reflected items.
+	BoundingBox Bounds;
 };
 
 enum class RenderLayer : int
 {
 	Opaque = 0,
-	MirrorsTop,
-	MirrorsBottom,
-	MirrorsRight,
-	MirrorsLeft,
-	MirrorsFront,
-	MirrorsBack,
-	ReflectedTop,
-	ReflectedBottom,
-	ReflectedRight,
-	ReflectedLeft,
-	ReflectedFront,
-	ReflectedBack,
+	Mirrors,
+	Reflected,
 	Transparent,
 	Shadow,
 	Count
 };
 
-enum class ReflectionSide : int
-{
-	Front = 0,
-	Back,
-	Left,
-	Right,
-	Top,
-	Bottom,
-	Count
-};
-
 class StencilApp : public D3DApp
 {
 public:
@@ -103,11 +115,15 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
+	void UpdateMirrorVisibility(const GameTimer& gt);
+	void LogReflectionStats(const char* label);
+	void UpdateShadows(const GameTimer& gt);
+	void RunShadowBenchmark();
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
-	void UpdateReflectedPassCB(const GameTimer& gt);
+	void UpdateReflectedPassCBs(const GameTimer& gt);
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -120,13 +136,15 @@ private:
     void BuildMaterials();
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
-	void LoadReflectedItems(RenderItem* item, int* renderItemCount);
-	XMVECTOR FindMirrorPlane(ReflectionSide side);
-	XMMATRIX FindMirrorOffset(ReflectionSide side);
-	XMMATRIX IsPastMirrorPlane(XMMATRIX worldMatrix, ReflectionSide side);
+	void DrawRenderItem(ID3D12GraphicsCommandList* cmdList, const RenderItem* ri);
+	void DrawReflections(MirrorStencilMode mode, D3D12_GPU_VIRTUAL_ADDRESS passCBAddress);
+	void SetPipelineState(const std::string& name);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
+	// Forwards the commands of the mirror passes to mCommandList.
+	class MirrorPassRecorder;
+
 private:
 
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
@@ -148,11 +166,32 @@ private:
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
 	// Cache render items of interest.
-	std::vector<RenderItem*> mReflectedSkulls[(int)ReflectionSide::Count];
 	std::vector<RenderItem*> mSkulls;
-	RenderItem* mShadowedSkullRitem = nullptr;
 	int mSelectedItemIndex = 0;
 
+	// Planar shadows of the skulls on the mirrors and the floor from every light.
+	// The visible instances are drawn with render items from a fixed pool, which
+	// has room for every caster x receiver x light combination, grouped by
+	// receiver.  mShadowReceiverRitems draws the surface of each receiver.
+	struct ShadowBatch
+	{
+		int Receiver;
+		size_t First;
+		size_t Count;
+	};
+
+	PlanarShadowSystem mShadows;
+	std::vector<ShadowCaster> mShadowCasters;
+	std::vector<ShadowLight> mShadowLights;
+	std::vector<ShadowInstance> mShadowInstances;
+	std::vector<RenderItem*> mShadowRitems;
+	std::vector<RenderItem*> mShadowReceiverRitems;
+	std::vector<ShadowBatch> mShadowBatches;
+	UINT64 mShadowFrames = 0;
+
+	// Time the shadow update with 100 casters on the first frame (-shadowbench).
+	bool mShadowBenchmark = false;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
@@ -160,7 +199,6 @@ private:
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
     PassConstants mMainPassCB;
-	PassConstants mReflectedPassCB;
 
 	std::vector<XMFLOAT3> mSkullTranslations;
 	XMFLOAT3 mSkullTranslation = { 0.0f, 0.0f, -5.0f };
@@ -174,6 +212,52 @@ private:
     float mRadius = 12.0f;
 
     POINT mLastMousePos;
+
+	// Mark all mirrors with distinct stencil values in one pass instead of
+	// marking, reflecting and clearing each mirror in turn.
+	bool mSingleMarkStencil = true;
+	int mReportedStencilMode = -1;
+
+	// Mirrors in gMirrorSubmeshes order and their surface render items.
+	std::vector<Mirror> mMirrors;
+	std::vector<RenderItem*> mMirrorRitems;
+	BoundingFrustum mCamFrustum;
+	BoundingFrustum mCamFrustumW;
+
+	// mScreenViewport with its depth range collapsed onto the far plane.
+	D3D12_VIEWPORT mFarDepthViewport;
+
+	// This frame's reflection passes, including mirrors seen in mirrors, and for
+	// each node the reflected items seen through it.  A node without items is still
+	// drawn if one of its descendants has some.
+	ReflectionTreeSettings mReflectionSettings;
+	std::vector<ReflectionNode> mReflectionTree;
+	std::vector<std::vector<RenderItem*>> mNodeReflections;
+	std::vector<MirrorPassNode> mMirrorPassNodes;
+	int mDeepestNode = 0;
+
+	// Two of the mirrors with work may cover the same pixel, so they cannot
+	// share one stencil mark pass.
+	bool mMirrorsOverlap = false;
+
+	// Target frame time for the reflection node budget.
+	float mReflectionTargetMs = 1000.0f / 60.0f;
+
+	// Reflection passes run, reflected draws per depth and reflected items culled,
+	// for the averages per frame.
+	UINT64 mReflectionPasses = 0;
+	UINT64 mReflectionPassFrames = 0;
+	UINT64 mReflectionDrawsPerDepth[gMaxReflectionDepth + 1] = {};
+	UINT64 mCulledReflectionDraws = 0;
+	UINT64 mCulledReflectionTriangles = 0;
+
+	// Orbit the camera continuously and report once per revolution (-mirrororbit).
+	bool mOrbitCamera = false;
+	float mOrbitAngle = 0.0f;
+
+	// Per frame command counts, for comparing the stencil modes.
+	UINT mFrameDrawCalls = 0;
+	UINT mFramePsoSwitches = 0;
 };
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
@@ -184,6 +268,22 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// Headless self-checks: each runs instead of the app when its flag is given.
+	int exitCode = 0;
+
+	// Check the oblique near plane used by the reflection passes and exit.
+	if(SelfCheck::RunIfRequested(L"-obliquecheck", L"ObliqueClipCheck.log", RunObliqueClipSelfCheck, exitCode))
+		return exitCode;
+
+	// Check the reflection tree built for a pair of facing mirrors and exit.
+	if(SelfCheck::RunIfRequested(L"-reflectiontreecheck", L"ReflectionTreeCheck.log", RunReflectionTreeSelfCheck, exitCode))
+		return exitCode;
+
+	// Check the stencil and depth sequence of the mirror passes and exit.  This
+	// records into a simulator, so it needs no window or device.
+	if(SelfCheck::RunIfRequested(L"-mirrorpasscheck", L"MirrorPassCheck.log", MirrorPass::ValidateCommandSequence, exitCode))
+		return exitCode;
+
     try
     {
         StencilApp theApp(hInstance);
@@ -202,12 +302,29 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 StencilApp::StencilApp(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {
+	mOrbitCamera = wcsstr(GetCommandLineW(), L"-mirrororbit") != nullptr;
+	mShadowBenchmark = wcsstr(GetCommandLineW(), L"-shadowbench") != nullptr;
+
+	mReflectionSettings.MaxDepth = gMaxReflectionDepth;
+	mReflectionSettings.MaxNodes = gMaxReflectionNodes;
 }
 
 StencilApp::~StencilApp()
 {
     if(md3dDevice != nullptr)
         FlushCommandQueue();
+
+	if(mReflectionPassFrames > 0)
+		LogReflectionStats("Per frame on exit");
+
+	if(mShadowFrames > 0)
+	{
+		const PlanarShadowStats& stats = mShadows.Stats();
+		double frames = (double)mShadowFrames;
+		LOG_INFO("Planar shadows per frame: {} candidates, {} drawn, culled {} facing away, {} off receiver, {} off screen",
+			(double)stats.Candidates / frames, (double)stats.Instances / frames, (double)stats.CulledFacing / frames,
+			(double)stats.CulledOffReceiver / frames, (double)stats.CulledOffScreen / frames);
+	}
 }
 
 bool StencilApp::Initialize()
@@ -241,6 +358,19 @@ bool StencilApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+	// The initialization commands have executed, so the intermediate upload buffers
+	// and the system memory copies of the meshes are no longer needed.
+	for(auto& e : mGeometries)
+	{
+		e.second->DisposeUploaders();
+		e.second->ApplyCpuGeometryPolicy(CpuGeometryPolicy::ReleaseAll);
+	}
+	for(auto& e : mTextures)
+		e.second->UploadHeap = nullptr;
+
+	MemoryStats::MarkSteadyState();
+	MemoryStats::OutputReport();
+
     return true;
 }
  
@@ -251,12 +381,19 @@ void StencilApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
+
+	mFarDepthViewport = mScreenViewport;
+	mFarDepthViewport.MinDepth = 1.0f;
+	mFarDepthViewport.MaxDepth = 1.0f;
 }
 
 void StencilApp::Update(const GameTimer& gt)
 {
     OnKeyboardInput(gt);
 	UpdateCamera(gt);
+	UpdateMirrorVisibility(gt);
 
     // Cycle through the circular frame resource array.
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -276,7 +413,10 @@ void StencilApp::Update(const GameTimer& gt)
 	UpdateObjectCBs(gt);
 	UpdateMaterialCBs(gt);
 	UpdateMainPassCB(gt);
-	UpdateReflectedPassCB(gt);
+	UpdateShadows(gt);
+
+	// The reflected pass constants are only read by the reflection passes.
+	UpdateReflectedPassCBs(gt);
 }
 
 void StencilApp::Draw(const GameTimer& gt)
@@ -290,6 +430,8 @@ void StencilApp::Draw(const GameTimer& gt)
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+	mFrameDrawCalls = 0;
+	mFramePsoSwitches = 0;
 
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -310,117 +452,55 @@ void StencilApp::Draw(const GameTimer& gt)
 
 	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
 
-	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+
+	// With no mirrors seen in mirrors, and no two mirrors overlapping on screen,
+	// every mirror can be marked at once and each pixel holds exactly one mirror's
+	// value.  That pass goes first, while the depth buffer is still clear.
+	MirrorStencilMode mirrorMode = mSingleMarkStencil && mDeepestNode == 1 && !mMirrorsOverlap ?
+		MirrorStencilMode::SingleMark : MirrorStencilMode::Nested;
+	if(mirrorMode == MirrorStencilMode::SingleMark)
+	{
+		DrawReflections(mirrorMode, passCB->GetGPUVirtualAddress());
+		SetPipelineState("opaque");
+	}
 
 	// Draw opaque items--floors, walls, skull.
-	auto passCB = mCurrFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
 	
-	// Mark the visible mirror pixels in the stencil buffer with the value 1
-
-	// Front
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsFront]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::ReflectedFront]);
-
-	// clear stencil
-	mCommandList->OMSetStencilRef(0);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsFront]);
-
-	// Back
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsBack]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::ReflectedBack]);
-
-	// clear stencil
-	mCommandList->OMSetStencilRef(0);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsBack]);
-
-	// Left
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsLeft]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::ReflectedLeft]);
-
-	// clear stencil
-	mCommandList->OMSetStencilRef(0);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsLeft]);
-
-	// Right
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsRight]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::ReflectedRight]);
-
-	// clear stencil
-	mCommandList->OMSetStencilRef(0);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsRight]);
-
-	// Top
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsTop]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::ReflectedTop]);
-
-	// clear stencil
-	mCommandList->OMSetStencilRef(0);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsTop]);
-
-	// Bottom
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::MirrorsBottom]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::ReflectedBottom]);
+	// Draw the reflections through the mirrors, marking them over the scene.
+	if(mirrorMode == MirrorStencilMode::Nested)
+		DrawReflections(mirrorMode, passCB->GetGPUVirtualAddress());
 
 	// Restore main pass constants and stencil ref.
 	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 	mCommandList->OMSetStencilRef(0);
 
 	// Draw mirror with transparency so reflection blends through.
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
+	SetPipelineState("transparent");
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
 
-	// Draw shadows
-	// mCommandList->SetPipelineState(mPSOs["shadow"].Get());
-	// DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Shadow]);
+	// Draw the planar shadows a receiver at a time: mark the receiver's visible
+	// surface, draw its shadows where it is marked, then clear the mark.  The
+	// stencil also keeps overlapping shadows, from one caster or from several
+	// lights, from darkening a pixel twice.
+	mCommandList->OMSetStencilRef(gShadowReceiverStencil);
+	const auto& shadowLayer = mRitemLayer[(int)RenderLayer::Shadow];
+	for(const ShadowBatch& batch : mShadowBatches)
+	{
+		const RenderItem* receiver = mShadowReceiverRitems[batch.Receiver];
+
+		SetPipelineState("markShadowReceiver");
+		DrawRenderItem(mCommandList.Get(), receiver);
+
+		SetPipelineState("shadow");
+		for(size_t i = batch.First; i < batch.First + batch.Count; ++i)
+			DrawRenderItem(mCommandList.Get(), shadowLayer[i]);
+
+		SetPipelineState("clearShadowReceiver");
+		DrawRenderItem(mCommandList.Get(), receiver);
+	}
 	
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -442,6 +522,86 @@ void StencilApp::Draw(const GameTimer& gt)
 
     // Notify the fence when the GPU completes commands up to this fence point.
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	// Report the cost of the current stencil mode whenever it changes.
+	if((int)mSingleMarkStencil != mReportedStencilMode)
+	{
+		mReportedStencilMode = (int)mSingleMarkStencil;
+		LOG_INFO("Mirror stencil mode: {}, {} draws, {} PSO switches per frame",
+			mSingleMarkStencil ? "single mark" : "mark/reflect/clear", mFrameDrawCalls, mFramePsoSwitches);
+	}
+}
+
+class StencilApp::MirrorPassRecorder : public MirrorPassCommandList
+{
+public:
+	MirrorPassRecorder(StencilApp& app, D3D12_GPU_VIRTUAL_ADDRESS passCBAddress) :
+		mApp(app), mPassCBAddress(passCBAddress)
+	{
+	}
+
+	virtual void SetPipeline(MirrorPipeline pipeline)override
+	{
+		static const char* const psos[(int)MirrorPipeline::Count] =
+		{
+			"markStencilMirrors",
+			"incrStencilMirrors",
+			"incrStencilMirrorsFlipped",
+			"decrStencilMirrors",
+			"decrStencilMirrorsFlipped",
+			"resetMirrorDepth",
+			"restoreMirrorDepth",
+			"drawStencilReflections",
+			"drawStencilReflectionsUnflipped"
+		};
+		mApp.SetPipelineState(psos[(int)pipeline]);
+	}
+
+	virtual void SetStencilRef(UINT ref)override
+	{
+		mApp.mCommandList->OMSetStencilRef(ref);
+	}
+
+	virtual void SetViewport(bool farDepth)override
+	{
+		mApp.mCommandList->RSSetViewports(1, farDepth ? &mApp.mFarDepthViewport : &mApp.mScreenViewport);
+	}
+
+	virtual void SetPassConstants(int node)override
+	{
+		// Each node has its own pass constants (1 + node index), with its reflection
+		// matrix and the lights reflected about its mirrors.
+		UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+		mApp.mCommandList->SetGraphicsRootConstantBufferView(2, mPassCBAddress + (1 + node)*passCBByteSize);
+	}
+
+	virtual void DrawMirror(int node)override
+	{
+		mApp.DrawRenderItem(mApp.mCommandList.Get(), mApp.mMirrorRitems[mApp.mReflectionTree[node].MirrorIndex]);
+	}
+
+	virtual void DrawReflections(int node)override
+	{
+		// The vertex shader applies the reflection, so the reflected items are the
+		// ordinary render items.
+		mApp.DrawRenderItems(mApp.mCommandList.Get(), mApp.mNodeReflections[node]);
+	}
+
+private:
+	StencilApp& mApp;
+	D3D12_GPU_VIRTUAL_ADDRESS mPassCBAddress = 0;
+};
+
+void StencilApp::DrawReflections(MirrorStencilMode mode, D3D12_GPU_VIRTUAL_ADDRESS passCBAddress)
+{
+	MirrorPassRecorder recorder(*this, passCBAddress);
+	MirrorPass::Record(mode, mMirrorPassNodes, recorder);
+}
+
+void StencilApp::SetPipelineState(const std::string& name)
+{
+	mCommandList->SetPipelineState(mPSOs[name].Get());
+	++mFramePsoSwitches;
 }
 
 void StencilApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -497,6 +657,10 @@ void StencilApp::OnKeyboardInput(const GameTimer& gt)
 
 	const float dt = gt.DeltaTime();
 
+	// Hold M to use the nested portal path (mark/reflect/clear per mirror) even
+	// when no mirror is seen in another mirror.
+	mSingleMarkStencil = !(GetAsyncKeyState('M') & 0x8000);
+
 	if (GetAsyncKeyState('1') & 0x8000)
 		mSelectedItemIndex = 0;
 
@@ -531,122 +695,260 @@ void StencilApp::OnKeyboardInput(const GameTimer& gt)
 	XMMATRIX skullWorld = skullRotate * skullScale * skullOffset;
 	XMStoreFloat4x4(&mSkulls[mSelectedItemIndex]->World, skullWorld);
 
-	for (int j = 0; j < (int)ReflectionSide::Count; ++j)
+	mSkulls[mSelectedItemIndex]->NumFramesDirty = gNumFrameResources;
+}
+
+void StencilApp::UpdateCamera(const GameTimer& gt)
+{
+	if(mOrbitCamera)
 	{
-		// Update reflection world matrix.
-		XMVECTOR mirrorPlane = FindMirrorPlane((ReflectionSide)j);
-		XMMATRIX invisiblePastPlane;
-		XMMATRIX R = XMMatrixReflect(mirrorPlane);
-		XMMATRIX T = FindMirrorOffset((ReflectionSide)j);
-		XMMATRIX pastMirrorPlane = IsPastMirrorPlane(skullWorld * R * T, (ReflectionSide)j);
-		XMStoreFloat4x4(&mReflectedSkulls[j][mSelectedItemIndex]->World, skullWorld * R * T * pastMirrorPlane);
+		// One revolution every 10 seconds.
+		float dTheta = 0.2f*MathHelper::Pi*gt.DeltaTime();
+		mTheta += dTheta;
+		mOrbitAngle += dTheta;
+
+		if(mOrbitAngle >= 2.0f*MathHelper::Pi)
+		{
+			LogReflectionStats("Per frame over one orbit");
+			mReflectionPasses = 0;
+			mReflectionPassFrames = 0;
+			for(UINT64& draws : mReflectionDrawsPerDepth)
+				draws = 0;
+			mCulledReflectionDraws = 0;
+			mCulledReflectionTriangles = 0;
+			mOrbitAngle = 0.0f;
+		}
 	}
 
-	// Update shadow world matrix.
-	XMVECTOR shadowPlane = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // xz plane
-	XMVECTOR toMainLight = -XMLoadFloat3(&mMainPassCB.Lights[0].Direction);
-	XMMATRIX S = XMMatrixShadow(shadowPlane, toMainLight);
-	XMMATRIX shadowOffsetY = XMMatrixTranslation(0.0f, 0.001f, 0.0f);
-	XMStoreFloat4x4(&mShadowedSkullRitem->World, skullWorld * S * shadowOffsetY);
+	// Convert Spherical to Cartesian coordinates.
+	mEyePos.x = mRadius*sinf(mPhi)*cosf(mTheta);
+	mEyePos.z = mRadius*sinf(mPhi)*sinf(mTheta);
+	mEyePos.y = mRadius*cosf(mPhi);
+
+	// Build the view matrix.
+	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
+	XMVECTOR target = XMVectorZero();
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
+	XMStoreFloat4x4(&mView, view);
+}
 
-	mSkulls[mSelectedItemIndex]->NumFramesDirty = gNumFrameResources;
+void StencilApp::UpdateMirrorVisibility(const GameTimer& gt)
+{
+	// Bring the view space frustum into world space.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
 
-	for (int i = 0; i < (int)ReflectionSide::Count; ++i)
+	mCamFrustum.Transform(mCamFrustumW, invView);
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, view * XMLoadFloat4x4(&mProj));
+
+	// Spend fewer reflection passes while frames are over budget and win them
+	// back one at a time once there is time left.
+	float frameMs = 1000.0f*gt.DeltaTime();
+	if(frameMs > mReflectionTargetMs)
+		mReflectionSettings.MaxNodes = MathHelper::Max(mReflectionSettings.MaxNodes*3/4, 1);
+	else
+		mReflectionSettings.MaxNodes = MathHelper::Min(mReflectionSettings.MaxNodes + 1, gMaxReflectionNodes);
+
+	// A mirror seen from behind or outside the frustum (or outside the mirrors it is
+	// seen through) shows nothing.  There is no separate occlusion test: the mirror
+	// surfaces are see-through and the skulls are too small to hide one.
+	BuildReflectionTree(mMirrors, mEyePos, mCamFrustumW, viewProj, mReflectionSettings, mReflectionTree);
+
+	if(mNodeReflections.size() < mReflectionTree.size())
+		mNodeReflections.resize(mReflectionTree.size());
+	mMirrorPassNodes.resize(mReflectionTree.size());
+	for(size_t i = 0; i < mReflectionTree.size(); ++i)
 	{
-		mReflectedSkulls[i][mSelectedItemIndex]->NumFramesDirty = gNumFrameResources;
+		mMirrorPassNodes[i].Parent = mReflectionTree[i].Parent;
+		mMirrorPassNodes[i].Depth = mReflectionTree[i].Depth;
+		mMirrorPassNodes[i].HasWork = false;
 	}
 
-	mShadowedSkullRitem->NumFramesDirty = gNumFrameResources;
-}
+	// Only reflected items inside the volume seen through the mirror (and its
+	// ancestors) are drawn.  This also drops reflections of items behind the
+	// mirror, which would otherwise appear in front of it.
+	for(size_t i = 0; i < mReflectionTree.size(); ++i)
+	{
+		const ReflectionNode& node = mReflectionTree[i];
+		XMMATRIX R = XMLoadFloat4x4(&node.Reflect);
 
-XMVECTOR StencilApp::FindMirrorPlane(ReflectionSide side)
-{
+		std::vector<RenderItem*>& reflections = mNodeReflections[i];
+		reflections.clear();
+		for(RenderItem* ri : mRitemLayer[(int)RenderLayer::Reflected])
+		{
+			BoundingBox worldBounds;
+			ri->Bounds.Transform(worldBounds, XMLoadFloat4x4(&ri->World) * R);
+
+			if(node.Portal.Intersects(worldBounds))
+			{
+				reflections.push_back(ri);
+			}
+			else
+			{
+				++mCulledReflectionDraws;
+				mCulledReflectionTriangles += ri->IndexCount / 3;
+			}
+		}
+	}
+
+	// Children come after their parents, so one backward sweep marks every node
+	// that has items of its own or below it.  Nodes without work are skipped.
+	mDeepestNode = 0;
+	for(int i = (int)mReflectionTree.size() - 1; i >= 0; --i)
+	{
+		if(!mNodeReflections[i].empty())
+			mMirrorPassNodes[i].HasWork = true;
+		if(!mMirrorPassNodes[i].HasWork)
+			continue;
+
+		const ReflectionNode& node = mReflectionTree[i];
+		if(node.Parent >= 0)
+			mMirrorPassNodes[node.Parent].HasWork = true;
+
+		mDeepestNode = MathHelper::Max(mDeepestNode, node.Depth);
+		mReflectionDrawsPerDepth[node.Depth] += mNodeReflections[i].size();
+		++mReflectionPasses;
+	}
 
-	switch (side)
+	// The corridor mirrors are seen behind the box faces, so depth 1 mirrors can
+	// cover the same pixels.  Two mirrors seen directly do not overlap on screen
+	// when one lies outside an edge plane of the other's portal.
+	mMirrorsOverlap = false;
+	for(size_t i = 0; i < mReflectionTree.size() && !mMirrorsOverlap; ++i)
 	{
-	case ReflectionSide::Top:
-		return XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // xz plane
-	case ReflectionSide::Bottom:
-		return XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // xz plane
-	case ReflectionSide::Back:
-		return XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-	case ReflectionSide::Front:
-		return XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-	case ReflectionSide::Left:
-		return XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f); // yz plane
-	case ReflectionSide::Right:
-		return XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f); // yz plane
+		const ReflectionNode& a = mReflectionTree[i];
+		if(a.Depth != 1 || !mMirrorPassNodes[i].HasWork)
+			continue;
+
+		for(size_t j = i + 1; j < mReflectionTree.size() && !mMirrorsOverlap; ++j)
+		{
+			const ReflectionNode& b = mReflectionTree[j];
+			if(b.Depth != 1 || !mMirrorPassNodes[j].HasWork)
+				continue;
+
+			mMirrorsOverlap = !a.Portal.Separates(mMirrors[b.MirrorIndex].Outline) &&
+				!b.Portal.Separates(mMirrors[a.MirrorIndex].Outline);
+		}
 	}
+
+	++mReflectionPassFrames;
 }
 
-XMMATRIX StencilApp::FindMirrorOffset(ReflectionSide side)
+void StencilApp::LogReflectionStats(const char* label)
 {
-	switch (side)
+	double frames = (double)mReflectionPassFrames;
+
+	char line[256];
+	sprintf_s(line, "%s (%llu frames): %.2f reflection passes, %.2f reflected draws and %.2f triangles culled\n"
+		"  reflected draws by depth:",
+		label, (unsigned long long)mReflectionPassFrames, (double)mReflectionPasses / frames,
+		(double)mCulledReflectionDraws / frames, (double)mCulledReflectionTriangles / frames);
+	std::string report = line;
+
+	for(int d = 1; d <= gMaxReflectionDepth; ++d)
 	{
-	case ReflectionSide::Top:
-		return XMMatrixTranslation(0.0f, 8.0f, 0.0f);
-	case ReflectionSide::Bottom:
-		return XMMatrixTranslation(0.0f, -8.0f, 0.0f);
-	case ReflectionSide::Back:
-		return XMMatrixTranslation(0.0f, 0.0f, 16.0f);
-	case ReflectionSide::Front:
-		return XMMatrixTranslation(0.0f, 0.0f, 0.0f);
-	case ReflectionSide::Left:
-		return XMMatrixTranslation(-8.0f, 0.0f, 0.0f);
-	case ReflectionSide::Right:
-		return XMMatrixTranslation(8.0f, 0.0f, 0.0f);
+		sprintf_s(line, " %d: %.2f", d, (double)mReflectionDrawsPerDepth[d] / frames);
+		report += line;
 	}
+
+	Log::WriteText(LogLevel::Info, report);
 }
 
-XMMATRIX StencilApp::IsPastMirrorPlane(XMMATRIX worldMatrix, ReflectionSide side)
+void StencilApp::UpdateShadows(const GameTimer& gt)
 {
-	XMFLOAT4X4 w;
-	XMStoreFloat4x4(&w, worldMatrix);
-	switch (side) 
+	for(size_t i = 0; i < mSkulls.size(); ++i)
+	{
+		mShadowCasters[i].Bounds = mSkulls[i]->Bounds;
+		mShadowCasters[i].World = mSkulls[i]->World;
+	}
+
+	// The spot light casts like a point light; its cone is ignored.
+	mShadowLights[0] = ShadowLight::Directional(mMainPassCB.Lights[0].Direction);
+	mShadowLights[1] = ShadowLight::Point(mMainPassCB.Lights[1].Position);
+	mShadowLights[2] = ShadowLight::Point(mMainPassCB.Lights[2].Position);
+
+	if(mShadowBenchmark)
 	{
-	case ReflectionSide::Top:
-		if (w._42 > 4)
-			return XMMatrixScaling(0.0f, 0.0f, 0.0f);
-		break;
-	case ReflectionSide::Bottom:
-		if (w._42 < -4)
-			return XMMatrixScaling(0.0f, 0.0f, 0.0f);
-		break;
-	case ReflectionSide::Left:
-		if (w._41 < -4)
-			return XMMatrixScaling(0.0f, 0.0f, 0.0f);
-		break;
-	case ReflectionSide::Right:
-		if (w._41 > 4)
-			return XMMatrixScaling(0.0f, 0.0f, 0.0f);
-		break;
-	case ReflectionSide::Front:
-		if (w._43 < 0)
-			return XMMatrixScaling(0.0f, 0.0f, 0.0f);
-		break;
-	case ReflectionSide::Back:
-		if (w._43 > 8)
-			return XMMatrixScaling(0.0f, 0.0f, 0.0f);
-		break;
+		RunShadowBenchmark();
+		mShadowBenchmark = false;
 	}
 
-	return XMMatrixScaling(1.0f, 1.0f, 1.0f);
+	mShadows.Update(mShadowCasters, mShadowLights, mCamFrustumW, mShadowInstances);
+	++mShadowFrames;
+
+	// Each receiver is marked once for all of its shadows.
+	std::stable_sort(mShadowInstances.begin(), mShadowInstances.end(),
+		[](const ShadowInstance& a, const ShadowInstance& b) { return a.Receiver < b.Receiver; });
+
+	// The shadow instances change every frame, so their object constants are
+	// written here instead of going through NumFramesDirty.
+	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+	auto& shadowLayer = mRitemLayer[(int)RenderLayer::Shadow];
+	shadowLayer.clear();
+	mShadowBatches.clear();
+
+	size_t count = std::min<size_t>(mShadowInstances.size(), mShadowRitems.size());
+	for(size_t i = 0; i < count; ++i)
+	{
+		const ShadowInstance& instance = mShadowInstances[i];
+		const RenderItem* caster = mSkulls[instance.Caster];
+
+		RenderItem* ri = mShadowRitems[i];
+		ri->World = instance.World;
+		ri->Geo = caster->Geo;
+		ri->IndexCount = caster->IndexCount;
+		ri->StartIndexLocation = caster->StartIndexLocation;
+		ri->BaseVertexLocation = caster->BaseVertexLocation;
+
+		ObjectConstants objConstants;
+		XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(XMLoadFloat4x4(&ri->World)));
+		XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&ri->TexTransform)));
+		currObjectCB->CopyData(ri->ObjCBIndex, objConstants);
+
+		if(mShadowBatches.empty() || mShadowBatches.back().Receiver != instance.Receiver)
+			mShadowBatches.push_back({ instance.Receiver, shadowLayer.size(), 0 });
+		++mShadowBatches.back().Count;
+
+		shadowLayer.push_back(ri);
+	}
 }
 
-void StencilApp::UpdateCamera(const GameTimer& gt)
+void StencilApp::RunShadowBenchmark()
 {
-	// Convert Spherical to Cartesian coordinates.
-	mEyePos.x = mRadius*sinf(mPhi)*cosf(mTheta);
-	mEyePos.z = mRadius*sinf(mPhi)*sinf(mTheta);
-	mEyePos.y = mRadius*cosf(mPhi);
+	// 100 skull sized casters scattered in and around the room, lit by the scene
+	// lights and seen from the current camera.  A copy of the system is used so
+	// the per-frame stats are not disturbed.
+	const int casterCount = 100;
+	const int iterations = 1000;
+
+	std::vector<ShadowCaster> casters(casterCount);
+	for(ShadowCaster& caster : casters)
+	{
+		caster.Bounds = mSkulls[0]->Bounds;
+		XMMATRIX world = XMMatrixScaling(0.45f, 0.45f, 0.45f) * XMMatrixTranslation(
+			MathHelper::RandF(-10.0f, 10.0f), MathHelper::RandF(-6.0f, 6.0f), MathHelper::RandF(-10.0f, 18.0f));
+		XMStoreFloat4x4(&caster.World, world);
+	}
 
-	// Build the view matrix.
-	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
-	XMVECTOR target = XMVectorZero();
-	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	PlanarShadowSystem system = mShadows;
+	system.ResetStats();
 
-	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
-	XMStoreFloat4x4(&mView, view);
+	std::vector<ShadowInstance> instances;
+
+	LARGE_INTEGER freq, start, end;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+	for(int i = 0; i < iterations; ++i)
+		system.Update(casters, mShadowLights, mCamFrustumW, instances);
+	QueryPerformanceCounter(&end);
+
+	double usPerUpdate = 1e6 * (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart / iterations;
+	LOG_INFO("Planar shadow update, {} casters x {} lights x {} receivers: {} us, {} shadows",
+		casterCount, (int)mShadowLights.size(), (int)system.Receivers().size(), usPerUpdate, (int)instances.size());
 }
 
 void StencilApp::AnimateMaterials(const GameTimer& gt)
@@ -742,63 +1044,102 @@ void StencilApp::UpdateMainPassCB(const GameTimer& gt)
 	currPassCB->CopyData(0, mMainPassCB);
 }
 
-void StencilApp::UpdateReflectedPassCB(const GameTimer& gt)
+void StencilApp::UpdateReflectedPassCBs(const GameTimer& gt)
 {
-	mReflectedPassCB = mMainPassCB;
+	// Reflection node i uses pass constants 1 + i: the main pass with the node's
+	// accumulated reflection matrix and the lights reflected the same way.  Only
+	// nodes that are drawn this frame are written.
+	auto currPassCB = mCurrFrameResource->PassCB.get();
 
-	XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-	XMMATRIX R = XMMatrixReflect(mirrorPlane);
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
 
-	// Reflect the lighting.
-	for(int i = 0; i < 3; ++i)
+	PassConstants reflectedPassCB = mMainPassCB;
+	for(size_t node = 0; node < mReflectionTree.size(); ++node)
 	{
-		XMVECTOR lightDir = XMLoadFloat3(&mMainPassCB.Lights[i].Direction);
-		XMVECTOR lightPos = XMLoadFloat3(&mMainPassCB.Lights[i].Position);
-		XMVECTOR reflectedLightDir = XMVector3TransformNormal(lightDir, R);
-		XMVECTOR reflectedLightPos = XMVector3TransformNormal(lightPos, R);
-		XMStoreFloat3(&mReflectedPassCB.Lights[i].Direction, reflectedLightDir);
-		XMStoreFloat3(&mReflectedPassCB.Lights[i].Position, reflectedLightPos);
-	}
+		if(!mMirrorPassNodes[node].HasWork)
+			continue;
+
+		XMMATRIX R = XMLoadFloat4x4(&mReflectionTree[node].Reflect);
+		XMStoreFloat4x4(&reflectedPassCB.Reflect, XMMatrixTranspose(R));
+
+		// The near plane is the mirror, so reflected geometry between the eye and
+		// the mirror is clipped by the hardware.  The depths are not comparable
+		// with the main pass; the mirror passes start from the far plane behind the
+		// mirror.
+		XMVECTOR clipPlaneV = XMPlaneTransform(-XMLoadFloat4(&mReflectionTree[node].Plane), XMMatrixTranspose(invView));
+		XMMATRIX obliqueProj = MathHelper::ObliqueProjection(proj, clipPlaneV);
+		XMMATRIX viewProj = XMMatrixMultiply(view, obliqueProj);
+		XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(obliqueProj), obliqueProj);
+		XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+		XMStoreFloat4x4(&reflectedPassCB.Proj, XMMatrixTranspose(obliqueProj));
+		XMStoreFloat4x4(&reflectedPassCB.InvProj, XMMatrixTranspose(invProj));
+		XMStoreFloat4x4(&reflectedPassCB.ViewProj, XMMatrixTranspose(viewProj));
+		XMStoreFloat4x4(&reflectedPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+
+		// Reflect the lighting.
+		for(int i = 0; i < 3; ++i)
+		{
+			XMVECTOR lightDir = XMLoadFloat3(&mMainPassCB.Lights[i].Direction);
+			XMVECTOR lightPos = XMLoadFloat3(&mMainPassCB.Lights[i].Position);
+			XMVECTOR reflectedLightDir = XMVector3TransformNormal(lightDir, R);
+			XMVECTOR reflectedLightPos = XMVector3TransformCoord(lightPos, R);
+			XMStoreFloat3(&reflectedPassCB.Lights[i].Direction, reflectedLightDir);
+			XMStoreFloat3(&reflectedPassCB.Lights[i].Position, reflectedLightPos);
+		}
 
-	// Reflected pass stored in index 1
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(1, mReflectedPassCB);
+		currPassCB->CopyData(1 + (int)node, reflectedPassCB);
+	}
 }
 
 void StencilApp::LoadTextures()
 {
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"../../Textures/bricks3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
-
-	auto checkboardTex = std::make_unique<Texture>();
-	checkboardTex->Name = "checkboardTex";
-	checkboardTex->Filename = L"../../Textures/checkboard.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), checkboardTex->Filename.c_str(),
-		checkboardTex->Resource, checkboardTex->UploadHeap));
-
-	auto iceTex = std::make_unique<Texture>();
-	iceTex->Name = "iceTex";
-	iceTex->Filename = L"../../Textures/ice.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), iceTex->Filename.c_str(),
-		iceTex->Resource, iceTex->UploadHeap));
-
-	auto white1x1Tex = std::make_unique<Texture>();
-	white1x1Tex->Name = "white1x1Tex";
-	white1x1Tex->Filename = L"../../Textures/white1x1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), white1x1Tex->Filename.c_str(),
-		white1x1Tex->Resource, white1x1Tex->UploadHeap));
-
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[checkboardTex->Name] = std::move(checkboardTex);
-	mTextures[iceTex->Name] = std::move(iceTex);
-	mTextures[white1x1Tex->Name] = std::move(white1x1Tex);
+	std::vector<std::string> texNames =
+	{
+		"bricksTex",
+		"checkboardTex",
+		"iceTex",
+		"white1x1Tex"
+	};
+
+	std::vector<std::wstring> texFilenames =
+	{
+		L"../../Textures/bricks3.dds",
+		L"../../Textures/checkboard.dds",
+		L"../../Textures/ice.dds",
+		L"../../Textures/white1x1.dds"
+	};
+
+	// The files are read and laid out in parallel; the resources are created and
+	// their uploads recorded on this thread, which owns mCommandList.
+	std::vector<DirectX::DDSTextureData> texData(texNames.size());
+
+	TaskGraph loads;
+	for(int i = 0; i < (int)texNames.size(); ++i)
+	{
+		loads.Add("Load " + texNames[i], [&texData, &texFilenames, i]()
+		{
+			ThrowIfFailed(DirectX::LoadDDSTextureData12(texFilenames[i].c_str(), texData[i]));
+		});
+	}
+	loads.Run();
+
+	Log::WriteText(LogLevel::Info, loads.Report());
+	LOG_INFO("Texture files loaded in {} ms, {} ms if loaded one after another ({}x)",
+		loads.WallMs(), loads.SumTaskMs(), loads.SumTaskMs() / loads.WallMs());
+
+	for(int i = 0; i < (int)texNames.size(); ++i)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = texNames[i];
+		tex->Filename = texFilenames[i];
+		ThrowIfFailed(DirectX::CreateDDSTextureFromData12(md3dDevice.Get(),
+			mCommandList.Get(), texData[i],
+			tex->Resource, tex->UploadHeap));
+
+		mTextures[tex->Name] = std::move(tex);
+	}
 }
 
 void StencilApp::BuildRootSignature()
@@ -931,7 +1272,7 @@ void StencilApp::BuildRoomGeometry()
     //  /   Floor      /
 	// /--------------/
 
-	std::array<Vertex, 8> vertices =
+	std::array<Vertex, 20> vertices =
 	{
 		//// Floor: Observe we tile texture coordinates.
 		//Vertex(-3.5f, 0.0f, -10.0f, 0.0f, 1.0f, 0.0f, 0.0f, 4.0f), // 0 
@@ -964,10 +1305,28 @@ void StencilApp::BuildRoomGeometry()
 		Vertex(4.0f, 4.0f, 8.0f, 0.0f, -1.0f, 0.0f, 1.0f, 1.0f), // new
 		Vertex(-4.0f, 4.0f, 8.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f),
 		Vertex(-4.0f, -4.0f, 8.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
-		Vertex(4.0f, -4.0f, 8.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f)
+		Vertex(4.0f, -4.0f, 8.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+
+		// Corridor mirrors, far enough out that the orbiting camera is always
+		// between them.
+		Vertex(14.0f, -4.0f, -4.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f), // 8
+		Vertex(14.0f, 4.0f, -4.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(14.0f, 4.0f, 12.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+		Vertex(14.0f, -4.0f, 12.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+		Vertex(-14.0f, -4.0f, -4.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f), // 12
+		Vertex(-14.0f, 4.0f, -4.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+		Vertex(-14.0f, 4.0f, 12.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(-14.0f, -4.0f, 12.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+
+		// Floor below the box, between the corridor mirrors.  It is not a mirror,
+		// only a shadow receiver.
+		Vertex(-12.0f, -6.0f, -10.0f, 0.0f, 1.0f, 0.0f, 0.0f, 8.0f), // 16
+		Vertex(-12.0f, -6.0f, 20.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(12.0f, -6.0f, 20.0f, 0.0f, 1.0f, 0.0f, 6.0f, 0.0f),
+		Vertex(12.0f, -6.0f, -10.0f, 0.0f, 1.0f, 0.0f, 6.0f, 8.0f)
 	};
 
-	std::array<std::int16_t, 36> indices = 
+	std::array<std::int16_t, 54> indices = 
 	{
 		//// Floor
 		//0, 1, 2,	
@@ -1009,7 +1368,19 @@ void StencilApp::BuildRoomGeometry()
 
 		// Mirror bottom
 		0, 3, 6,
-		7, 6, 3
+		7, 6, 3,
+
+		// Corridor mirror east (faces -x)
+		8, 11, 10,
+		8, 10, 9,
+
+		// Corridor mirror west (faces +x)
+		12, 13, 14,
+		12, 14, 15,
+
+		// Floor
+		16, 17, 18,
+		16, 18, 19
 	};
 
 	//SubmeshGeometry floorSubmesh;
@@ -1052,6 +1423,21 @@ void StencilApp::BuildRoomGeometry()
 	mirrorBottomSubmesh.StartIndexLocation = 30;
 	mirrorBottomSubmesh.BaseVertexLocation = 0;
 
+	SubmeshGeometry mirrorCorridorEastSubmesh;
+	mirrorCorridorEastSubmesh.IndexCount = 6;
+	mirrorCorridorEastSubmesh.StartIndexLocation = 36;
+	mirrorCorridorEastSubmesh.BaseVertexLocation = 0;
+
+	SubmeshGeometry mirrorCorridorWestSubmesh;
+	mirrorCorridorWestSubmesh.IndexCount = 6;
+	mirrorCorridorWestSubmesh.StartIndexLocation = 42;
+	mirrorCorridorWestSubmesh.BaseVertexLocation = 0;
+
+	SubmeshGeometry floorSubmesh;
+	floorSubmesh.IndexCount = 6;
+	floorSubmesh.StartIndexLocation = 48;
+	floorSubmesh.BaseVertexLocation = 0;
+
     const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
     const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
@@ -1081,6 +1467,34 @@ void StencilApp::BuildRoomGeometry()
 	geo->DrawArgs["mirrorRight"] = mirrorRightSubmesh;
 	geo->DrawArgs["mirrorBack"] = mirrorBackSubmesh;
 	geo->DrawArgs["mirrorBottom"] = mirrorBottomSubmesh;
+	geo->DrawArgs["mirrorCorridorEast"] = mirrorCorridorEastSubmesh;
+	geo->DrawArgs["mirrorCorridorWest"] = mirrorCorridorWestSubmesh;
+	geo->DrawArgs["floor"] = floorSubmesh;
+
+	// Planes and bounds of the mirrors for the visibility tests.
+	for(const char* name : gMirrorSubmeshes)
+	{
+		const SubmeshGeometry& submesh = geo->DrawArgs[name];
+
+		std::vector<XMFLOAT3> positions;
+		for(UINT j = 0; j < submesh.IndexCount; ++j)
+			positions.push_back(vertices[indices[submesh.StartIndexLocation + j]].Pos);
+
+		mMirrors.push_back(Mirror::FromTriangles(positions));
+
+		// The mirrors also receive the skull shadows on their reflecting side.
+		ShadowReceiver receiver;
+		receiver.Plane = mMirrors.back().Plane;
+		receiver.Bounds = mMirrors.back().Bounds;
+		mShadows.AddReceiver(receiver);
+	}
+
+	// The floor receives them after the mirrors, so receiver i < mirror count is
+	// mirror i (see BuildRenderItems).
+	ShadowReceiver floorReceiver;
+	floorReceiver.Plane = XMFLOAT4(0.0f, 1.0f, 0.0f, 6.0f);
+	floorReceiver.Bounds = BoundingBox(XMFLOAT3(0.0f, -6.0f, 5.0f), XMFLOAT3(12.0f, 0.0f, 15.0f));
+	mShadows.AddReceiver(floorReceiver);
 
 	mGeometries[geo->Name] = std::move(geo);
 }
@@ -1091,7 +1505,7 @@ void StencilApp::BuildSkullGeometry()
 	
 	if(!fin)
 	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+		LOG_ERROR("Models/skull.txt not found.");
 		return;
 	}
 
@@ -1103,6 +1517,12 @@ void StencilApp::BuildSkullGeometry()
 	fin >> ignore >> tcount;
 	fin >> ignore >> ignore >> ignore >> ignore;
 	
+	XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+	XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+
+	XMVECTOR vMin = XMLoadFloat3(&vMinf3);
+	XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+
 	std::vector<Vertex> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
@@ -1111,8 +1531,16 @@ void StencilApp::BuildSkullGeometry()
 
 		// Model does not have texture coordinates, so just zero them out.
 		vertices[i].TexC = { 0.0f, 0.0f };
+
+		XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
+		vMin = XMVectorMin(vMin, P);
+		vMax = XMVectorMax(vMax, P);
 	}
 
+	BoundingBox bounds;
+	XMStoreFloat3(&bounds.Center, 0.5f*(vMin + vMax));
+	XMStoreFloat3(&bounds.Extents, 0.5f*(vMax - vMin));
+
 	fin >> ignore;
 	fin >> ignore;
 	fin >> ignore;
@@ -1157,6 +1585,7 @@ void StencilApp::BuildSkullGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	submesh.Bounds = bounds;
 
 	geo->DrawArgs["skull"] = submesh;
 
@@ -1239,6 +1668,10 @@ void StencilApp::BuildPSOs()
 	transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
+
+	// The mirrors are blended over their own depth, which the reflection passes
+	// write back when they are done.
+	transparentPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
 
 	//
@@ -1301,6 +1734,68 @@ void StencilApp::BuildPSOs()
 	drawReflectionsPsoDesc.RasterizerState.FrontCounterClockwise = true;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&drawReflectionsPsoDesc, IID_PPV_ARGS(&mPSOs["drawStencilReflections"])));
 
+	// An even number of reflections restores the original winding.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC drawUnflippedReflectionsPsoDesc = drawReflectionsPsoDesc;
+	drawUnflippedReflectionsPsoDesc.RasterizerState.FrontCounterClockwise = false;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&drawUnflippedReflectionsPsoDesc, IID_PPV_ARGS(&mPSOs["drawStencilReflectionsUnflipped"])));
+
+	//
+	// PSOs for nested mirrors: raise or lower the stencil value by one where it
+	// equals the ref, for mirrors seen through an even or odd number of mirrors.
+	//
+
+	D3D12_DEPTH_STENCIL_DESC nestedMirrorDSS = mirrorDSS;
+	nestedMirrorDSS.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_EQUAL;
+	nestedMirrorDSS.BackFace.StencilFunc = D3D12_COMPARISON_FUNC_EQUAL;
+
+	const struct
+	{
+		const char* Name;
+		D3D12_STENCIL_OP PassOp;
+		BOOL FrontCounterClockwise;
+	} nestedMirrorPsos[] =
+	{
+		{ "incrStencilMirrors", D3D12_STENCIL_OP_INCR, false },
+		{ "incrStencilMirrorsFlipped", D3D12_STENCIL_OP_INCR, true },
+		{ "decrStencilMirrors", D3D12_STENCIL_OP_DECR, false },
+		{ "decrStencilMirrorsFlipped", D3D12_STENCIL_OP_DECR, true }
+	};
+
+	for(const auto& pso : nestedMirrorPsos)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC nestedMirrorPsoDesc = markMirrorsPsoDesc;
+		nestedMirrorPsoDesc.DepthStencilState = nestedMirrorDSS;
+		nestedMirrorPsoDesc.DepthStencilState.FrontFace.StencilPassOp = pso.PassOp;
+		nestedMirrorPsoDesc.DepthStencilState.BackFace.StencilPassOp = pso.PassOp;
+		nestedMirrorPsoDesc.RasterizerState.FrontCounterClockwise = pso.FrontCounterClockwise;
+
+		// Unmarking also writes the mirror's depth back over its reflection.
+		if(pso.PassOp == D3D12_STENCIL_OP_DECR)
+		{
+			nestedMirrorPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+			nestedMirrorPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+		}
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&nestedMirrorPsoDesc, IID_PPV_ARGS(&mPSOs[pso.Name])));
+	}
+
+	//
+	// PSOs that overwrite the depth where the stencil equals the ref: to the far
+	// plane (drawn with mFarDepthViewport) before a reflection is drawn behind a
+	// mirror, and back to the mirror's own depth afterwards.
+	//
+
+	D3D12_DEPTH_STENCIL_DESC mirrorDepthDSS = reflectionsDSS;
+	mirrorDepthDSS.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC resetMirrorDepthPsoDesc = markMirrorsPsoDesc;
+	resetMirrorDepthPsoDesc.DepthStencilState = mirrorDepthDSS;
+	resetMirrorDepthPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&resetMirrorDepthPsoDesc, IID_PPV_ARGS(&mPSOs["resetMirrorDepth"])));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC restoreMirrorDepthPsoDesc = markMirrorsPsoDesc;
+	restoreMirrorDepthPsoDesc.DepthStencilState = mirrorDepthDSS;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&restoreMirrorDepthPsoDesc, IID_PPV_ARGS(&mPSOs["restoreMirrorDepth"])));
+
 	//
 	// PSO for shadow objects
 	//
@@ -1311,23 +1806,53 @@ void StencilApp::BuildPSOs()
 	shadowDSS.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
 	shadowDSS.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
 	shadowDSS.StencilEnable = true;
-	shadowDSS.StencilReadMask = 0xff;
-	shadowDSS.StencilWriteMask = 0xff;
+
+	// The mirror passes leave their values in the low bits of the stencil buffer,
+	// so shadows only test the top two.  With ref gShadowReceiverStencil a shadow
+	// passes on the marked receiver where no shadow has been drawn yet, and sets
+	// gShadowDrawnStencil so every later one fails.
+	shadowDSS.StencilReadMask = gShadowReceiverStencil | gShadowDrawnStencil;
+	shadowDSS.StencilWriteMask = gShadowDrawnStencil;
 
 	shadowDSS.FrontFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
 	shadowDSS.FrontFace.StencilDepthFailOp = D3D12_STENCIL_OP_KEEP;
-	shadowDSS.FrontFace.StencilPassOp = D3D12_STENCIL_OP_INCR;
+	shadowDSS.FrontFace.StencilPassOp = D3D12_STENCIL_OP_INVERT;
 	shadowDSS.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_EQUAL;
 
 	// We are not rendering backfacing polygons, so these settings do not matter.
 	shadowDSS.BackFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
 	shadowDSS.BackFace.StencilDepthFailOp = D3D12_STENCIL_OP_KEEP;
-	shadowDSS.BackFace.StencilPassOp = D3D12_STENCIL_OP_INCR;
+	shadowDSS.BackFace.StencilPassOp = D3D12_STENCIL_OP_INVERT;
 	shadowDSS.BackFace.StencilFunc = D3D12_COMPARISON_FUNC_EQUAL;
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC shadowPsoDesc = transparentPsoDesc;
 	shadowPsoDesc.DepthStencilState = shadowDSS;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&shadowPsoDesc, IID_PPV_ARGS(&mPSOs["shadow"])));
+
+	//
+	// PSOs for marking a shadow receiver and clearing the mark.
+	//
+
+	// The receiver has already been drawn, so LESS_EQUAL passes exactly where it
+	// is visible.  Only gShadowReceiverStencil is written.
+	D3D12_DEPTH_STENCIL_DESC receiverDSS = mirrorDSS;
+	receiverDSS.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+	receiverDSS.StencilReadMask = 0xff;
+	receiverDSS.StencilWriteMask = gShadowReceiverStencil;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC markReceiverPsoDesc = markMirrorsPsoDesc;
+	markReceiverPsoDesc.DepthStencilState = receiverDSS;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&markReceiverPsoDesc, IID_PPV_ARGS(&mPSOs["markShadowReceiver"])));
+
+	// The shadows wrote depth just above the receiver, so the mark is cleared
+	// without a depth test; no other receiver is marked at the time.
+	receiverDSS.DepthEnable = false;
+	receiverDSS.FrontFace.StencilPassOp = D3D12_STENCIL_OP_ZERO;
+	receiverDSS.BackFace.StencilPassOp = D3D12_STENCIL_OP_ZERO;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC clearReceiverPsoDesc = markMirrorsPsoDesc;
+	clearReceiverPsoDesc.DepthStencilState = receiverDSS;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&clearReceiverPsoDesc, IID_PPV_ARGS(&mPSOs["clearShadowReceiver"])));
 }
 
 void StencilApp::BuildFrameResources()
@@ -1335,7 +1860,7 @@ void StencilApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            2, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            1 + gMaxReflectionNodes, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
     }
 }
 
@@ -1403,6 +1928,7 @@ void StencilApp::BuildRenderItems()
 	floorRitem->StartIndexLocation = floorRitem->Geo->DrawArgs["floor"].StartIndexLocation;
 	floorRitem->BaseVertexLocation = floorRitem->Geo->DrawArgs["floor"].BaseVertexLocation;
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(floorRitem.get());
+	RenderItem* floor = floorRitem.get();
 
     auto wallsRitem = std::make_unique<RenderItem>();
 	wallsRitem->World = MathHelper::Identity4x4();
@@ -1426,15 +1952,16 @@ void StencilApp::BuildRenderItems()
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(skullRitem.get());
 	mSkulls.push_back(skullRitem.get());
 	mSkullTranslations.emplace_back(0.0f, 0.0f, -4.0f);
 
-	// Reflected skull will have different world matrix, so it needs to be its own render item.
-	LoadReflectedItems(skullRitem.get(), &objCBIndex);
+	// The skull is drawn again through every mirror, reflected by the pass constants.
+	mRitemLayer[(int)RenderLayer::Reflected].push_back(skullRitem.get());
 
 	auto skullRitem2 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&skullRitem2->World, XMMatrixScaling(0.45f, 0.45f, 0.45f) * XMMatrixTranslation(0.0f, 0.0f, 10.0f));
+	XMStoreFloat4x4(&skullRitem2->World, XMMatrixScaling(0.45f, 0.45f, 0.45f) * XMMatrixTranslation(0.0f, 0.0f, 12.0f));
 	skullRitem2->TexTransform = MathHelper::Identity4x4();
 	skullRitem2->ObjCBIndex = objCBIndex++;
 	skullRitem2->Mat = mMaterials["skullMat"].get();
@@ -1443,159 +1970,69 @@ void StencilApp::BuildRenderItems()
 	skullRitem2->IndexCount = skullRitem2->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem2->StartIndexLocation = skullRitem2->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem2->BaseVertexLocation = skullRitem2->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem2->Bounds = skullRitem2->Geo->DrawArgs["skull"].Bounds;
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(skullRitem2.get());
 	mSkulls.push_back(skullRitem2.get());
 	mSkullTranslations.emplace_back(0.0f, 0.0f, 12.0f);
 
-	// Reflected skull will have different world matrix, so it needs to be its own render item.
-	LoadReflectedItems(skullRitem2.get(), &objCBIndex);
-
-	// Shadowed skull will have different world matrix, so it needs to be its own render item.
-	auto shadowedSkullRitem = std::make_unique<RenderItem>();
-	*shadowedSkullRitem = *skullRitem;
-	shadowedSkullRitem->ObjCBIndex = objCBIndex++;
-	shadowedSkullRitem->Mat = mMaterials["shadowMat"].get();
-	mShadowedSkullRitem = shadowedSkullRitem.get();
-	mRitemLayer[(int)RenderLayer::Shadow].push_back(shadowedSkullRitem.get());
-
-	auto mirrorFrontRItem = std::make_unique<RenderItem>();
-	mirrorFrontRItem->World = MathHelper::Identity4x4();
-	mirrorFrontRItem->TexTransform = MathHelper::Identity4x4();
-	mirrorFrontRItem->ObjCBIndex = objCBIndex++;
-	mirrorFrontRItem->Mat = mMaterials["icemirror"].get();
-	mirrorFrontRItem->Geo = mGeometries["roomGeo"].get();
-	mirrorFrontRItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mirrorFrontRItem->IndexCount = mirrorFrontRItem->Geo->DrawArgs["mirrorFront"].IndexCount;
-	mirrorFrontRItem->StartIndexLocation = mirrorFrontRItem->Geo->DrawArgs["mirrorFront"].StartIndexLocation;
-	mirrorFrontRItem->BaseVertexLocation = mirrorFrontRItem->Geo->DrawArgs["mirrorFront"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::MirrorsFront].push_back(mirrorFrontRItem.get());
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorFrontRItem.get());
-
-	auto mirrorTopRItem = std::make_unique<RenderItem>();
-	mirrorTopRItem->World = MathHelper::Identity4x4();
-	mirrorTopRItem->TexTransform = MathHelper::Identity4x4();
-	mirrorTopRItem->ObjCBIndex = objCBIndex++;
-	mirrorTopRItem->Mat = mMaterials["icemirror"].get();
-	mirrorTopRItem->Geo = mGeometries["roomGeo"].get();
-	mirrorTopRItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mirrorTopRItem->IndexCount = mirrorTopRItem->Geo->DrawArgs["mirrorTop"].IndexCount;
-	mirrorTopRItem->StartIndexLocation = mirrorTopRItem->Geo->DrawArgs["mirrorTop"].StartIndexLocation;
-	mirrorTopRItem->BaseVertexLocation = mirrorTopRItem->Geo->DrawArgs["mirrorTop"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::MirrorsTop].push_back(mirrorTopRItem.get());
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorTopRItem.get());
-
-	auto mirrorLeftRItem = std::make_unique<RenderItem>();
-	mirrorLeftRItem->World = MathHelper::Identity4x4();
-	mirrorLeftRItem->TexTransform = MathHelper::Identity4x4();
-	mirrorLeftRItem->ObjCBIndex = objCBIndex++;
-	mirrorLeftRItem->Mat = mMaterials["icemirror"].get();
-	mirrorLeftRItem->Geo = mGeometries["roomGeo"].get();
-	mirrorLeftRItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mirrorLeftRItem->IndexCount = mirrorLeftRItem->Geo->DrawArgs["mirrorLeft"].IndexCount;
-	mirrorLeftRItem->StartIndexLocation = mirrorLeftRItem->Geo->DrawArgs["mirrorLeft"].StartIndexLocation;
-	mirrorLeftRItem->BaseVertexLocation = mirrorLeftRItem->Geo->DrawArgs["mirrorLeft"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::MirrorsLeft].push_back(mirrorLeftRItem.get());
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorLeftRItem.get());
-
-	auto mirrorRightRItem = std::make_unique<RenderItem>();
-	mirrorRightRItem->World = MathHelper::Identity4x4();
-	mirrorRightRItem->TexTransform = MathHelper::Identity4x4();
-	mirrorRightRItem->ObjCBIndex = objCBIndex++;
-	mirrorRightRItem->Mat = mMaterials["icemirror"].get();
-	mirrorRightRItem->Geo = mGeometries["roomGeo"].get();
-	mirrorRightRItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mirrorRightRItem->IndexCount = mirrorRightRItem->Geo->DrawArgs["mirrorRight"].IndexCount;
-	mirrorRightRItem->StartIndexLocation = mirrorRightRItem->Geo->DrawArgs["mirrorRight"].StartIndexLocation;
-	mirrorRightRItem->BaseVertexLocation = mirrorRightRItem->Geo->DrawArgs["mirrorRight"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::MirrorsRight].push_back(mirrorRightRItem.get());
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorRightRItem.get());
-
-	auto mirrorBackRItem = std::make_unique<RenderItem>();
-	mirrorBackRItem->World = MathHelper::Identity4x4();
-	mirrorBackRItem->TexTransform = MathHelper::Identity4x4();
-	mirrorBackRItem->ObjCBIndex = objCBIndex++;
-	mirrorBackRItem->Mat = mMaterials["icemirror"].get();
-	mirrorBackRItem->Geo = mGeometries["roomGeo"].get();
-	mirrorBackRItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mirrorBackRItem->IndexCount = mirrorBackRItem->Geo->DrawArgs["mirrorBack"].IndexCount;
-	mirrorBackRItem->StartIndexLocation = mirrorBackRItem->Geo->DrawArgs["mirrorBack"].StartIndexLocation;
-	mirrorBackRItem->BaseVertexLocation = mirrorBackRItem->Geo->DrawArgs["mirrorBack"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::MirrorsBack].push_back(mirrorBackRItem.get());
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorBackRItem.get());
-
-	auto mirrorBottomRItem = std::make_unique<RenderItem>();
-	mirrorBottomRItem->World = MathHelper::Identity4x4();
-	mirrorBottomRItem->TexTransform = MathHelper::Identity4x4();
-	mirrorBottomRItem->ObjCBIndex = objCBIndex++;
-	mirrorBottomRItem->Mat = mMaterials["icemirror"].get();
-	mirrorBottomRItem->Geo = mGeometries["roomGeo"].get();
-	mirrorBottomRItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mirrorBottomRItem->IndexCount = mirrorBottomRItem->Geo->DrawArgs["mirrorBottom"].IndexCount;
-	mirrorBottomRItem->StartIndexLocation = mirrorBottomRItem->Geo->DrawArgs["mirrorBottom"].StartIndexLocation;
-	mirrorBottomRItem->BaseVertexLocation = mirrorBottomRItem->Geo->DrawArgs["mirrorBottom"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::MirrorsBottom].push_back(mirrorBottomRItem.get());
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorBottomRItem.get());
+	mRitemLayer[(int)RenderLayer::Reflected].push_back(skullRitem2.get());
 
 	mAllRitems.push_back(std::move(floorRitem));
 	mAllRitems.push_back(std::move(wallsRitem));
 	mAllRitems.push_back(std::move(skullRitem));
 	mAllRitems.push_back(std::move(skullRitem2));
-	mAllRitems.push_back(std::move(shadowedSkullRitem));
-	mAllRitems.push_back(std::move(mirrorFrontRItem));
-	mAllRitems.push_back(std::move(mirrorTopRItem));
-	mAllRitems.push_back(std::move(mirrorLeftRItem));
-	mAllRitems.push_back(std::move(mirrorRightRItem));
-	mAllRitems.push_back(std::move(mirrorBackRItem));
-	mAllRitems.push_back(std::move(mirrorBottomRItem));
+
+	// Shadow render items get their geometry and world matrix from the shadow
+	// instance they draw each frame (see UpdateShadows).
+	mShadowCasters.resize(mSkulls.size());
+	mShadowLights.resize(gNumShadowLights);
+
+	size_t shadowCount = mSkulls.size() * mShadows.Receivers().size() * gNumShadowLights;
+	for(size_t i = 0; i < shadowCount; ++i)
+	{
+		auto shadowRitem = std::make_unique<RenderItem>();
+		*shadowRitem = *mSkulls[0];
+		shadowRitem->ObjCBIndex = objCBIndex++;
+		shadowRitem->Mat = mMaterials["shadowMat"].get();
+		shadowRitem->NumFramesDirty = 0;
+		mShadowRitems.push_back(shadowRitem.get());
+
+		mAllRitems.push_back(std::move(shadowRitem));
+	}
+
+	for(const char* name : gMirrorSubmeshes)
+	{
+		auto mirrorRitem = std::make_unique<RenderItem>();
+		mirrorRitem->World = MathHelper::Identity4x4();
+		mirrorRitem->TexTransform = MathHelper::Identity4x4();
+		mirrorRitem->ObjCBIndex = objCBIndex++;
+		mirrorRitem->Mat = mMaterials["icemirror"].get();
+		mirrorRitem->Geo = mGeometries["roomGeo"].get();
+		mirrorRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		mirrorRitem->IndexCount = mirrorRitem->Geo->DrawArgs[name].IndexCount;
+		mirrorRitem->StartIndexLocation = mirrorRitem->Geo->DrawArgs[name].StartIndexLocation;
+		mirrorRitem->BaseVertexLocation = mirrorRitem->Geo->DrawArgs[name].BaseVertexLocation;
+		mRitemLayer[(int)RenderLayer::Mirrors].push_back(mirrorRitem.get());
+		mRitemLayer[(int)RenderLayer::Transparent].push_back(mirrorRitem.get());
+		mMirrorRitems.push_back(mirrorRitem.get());
+
+		mAllRitems.push_back(std::move(mirrorRitem));
+	}
+
+	// The surfaces marked in the stencil under each receiver's shadows, in the
+	// order BuildRoomGeometry added the receivers.
+	mShadowReceiverRitems = mMirrorRitems;
+	mShadowReceiverRitems.push_back(floor);
 }
 
-void StencilApp::LoadReflectedItems(RenderItem* item, int* renderItemCount)
+void StencilApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-	auto reflectedSkullFrontRitem = std::make_unique<RenderItem>();
-	*reflectedSkullFrontRitem = *item;
-	reflectedSkullFrontRitem->ObjCBIndex =  (*renderItemCount)++;
-	mRitemLayer[(int)RenderLayer::ReflectedFront].push_back(reflectedSkullFrontRitem.get());
-	mReflectedSkulls[(int)ReflectionSide::Front].push_back(reflectedSkullFrontRitem.get());
-
-	auto reflectedSkullBackRitem = std::make_unique<RenderItem>();
-	*reflectedSkullBackRitem = *item;
-	reflectedSkullBackRitem->ObjCBIndex = (*renderItemCount)++;
-	mRitemLayer[(int)RenderLayer::ReflectedBack].push_back(reflectedSkullBackRitem.get());
-	mReflectedSkulls[(int)ReflectionSide::Back].push_back(reflectedSkullBackRitem.get());
-
-	auto reflectedSkullLeftRitem = std::make_unique<RenderItem>();
-	*reflectedSkullLeftRitem = *item;
-	reflectedSkullLeftRitem->ObjCBIndex = (*renderItemCount)++;
-	mRitemLayer[(int)RenderLayer::ReflectedLeft].push_back(reflectedSkullLeftRitem.get());
-	mReflectedSkulls[(int)ReflectionSide::Left].push_back(reflectedSkullLeftRitem.get());
-
-	auto reflectedSkullRightRitem = std::make_unique<RenderItem>();
-	*reflectedSkullRightRitem = *item;
-	reflectedSkullRightRitem->ObjCBIndex = (*renderItemCount)++;
-	mRitemLayer[(int)RenderLayer::ReflectedRight].push_back(reflectedSkullRightRitem.get());
-	mReflectedSkulls[(int)ReflectionSide::Right].push_back(reflectedSkullRightRitem.get());
-
-	auto reflectedSkullTopRitem = std::make_unique<RenderItem>();
-	*reflectedSkullTopRitem = *item;
-	reflectedSkullTopRitem->ObjCBIndex = (*renderItemCount)++;
-	mRitemLayer[(int)RenderLayer::ReflectedTop].push_back(reflectedSkullTopRitem.get());
-	mReflectedSkulls[(int)ReflectionSide::Top].push_back(reflectedSkullTopRitem.get());
-
-	auto reflectedSkullBottomRitem = std::make_unique<RenderItem>();
-	*reflectedSkullBottomRitem = *item;
-	reflectedSkullBottomRitem->ObjCBIndex = (*renderItemCount)++;
-	mRitemLayer[(int)RenderLayer::ReflectedBottom].push_back(reflectedSkullBottomRitem.get());
-	mReflectedSkulls[(int)ReflectionSide::Bottom].push_back(reflectedSkullBottomRitem.get());
-
-	mAllRitems.push_back(std::move(reflectedSkullFrontRitem));
-	mAllRitems.push_back(std::move(reflectedSkullBackRitem));
-	mAllRitems.push_back(std::move(reflectedSkullLeftRitem));
-	mAllRitems.push_back(std::move(reflectedSkullRightRitem));
-	mAllRitems.push_back(std::move(reflectedSkullTopRitem));
-	mAllRitems.push_back(std::move(reflectedSkullBottomRitem));
+    // For each render item...
+    for(size_t i = 0; i < ritems.size(); ++i)
+        DrawRenderItem(cmdList, ritems[i]);
 }
 
-void StencilApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void StencilApp::DrawRenderItem(ID3D12GraphicsCommandList* cmdList, const RenderItem* ri)
 {
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
     UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
@@ -1603,27 +2040,23 @@ void StencilApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
 	auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
+    cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+    cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+    cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+	CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+    D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+	D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+	cmdList->SetGraphicsRootDescriptorTable(0, tex);
+    cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
+    cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+    cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+	++mFrameDrawCalls;
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> StencilApp::GetStaticSamplers()
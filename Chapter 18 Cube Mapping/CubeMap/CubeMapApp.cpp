@@ -7,7 +7,10 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/TaskGraph.h"
+#include "../../Common/SelfCheck.h"
 #include "FrameResource.h"
+#include "StreamedTextures.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -18,6 +21,9 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Bytes of streamed mips uploaded a frame at most.
+const UINT64 gMipStreamBudget = 1024*1024;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -84,6 +90,7 @@ private:
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdateTextureStreaming();
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -94,6 +101,7 @@ private:
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
+	void StartTextureStreaming();
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 
@@ -127,6 +135,21 @@ private:
 
 	UINT mSkyTexHeapIndex = 0;
 
+	// The bricks and tile textures stream in, mip tail first.  Their materials draw
+	// with the white texture until the tail is resident, then with the mips resident.
+	struct StreamedMaterial
+	{
+		Material* Mat = nullptr;
+		int Texture = -1;
+		UINT SrvHeapIndex = 0;
+		int ResidentMip = -1;
+	};
+
+	std::unique_ptr<StreamedTextures> mStreamedTextures;
+	std::unique_ptr<MipStreamer> mMipStreamer;
+	std::vector<StreamedMaterial> mStreamedMaterials;
+	bool mStreamReported = false;
+
     PassConstants mMainPassCB;
 
 	Camera mCamera;
@@ -142,6 +165,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// Headless self-check: runs instead of the app when its flag is given.
+	int exitCode = 0;
+
+	// Check the mip streaming schedule with a stand-in uploader and exit.
+	if(SelfCheck::RunIfRequested(L"-mipstreamcheck", L"MipStreamCheck.log", MipStreamer::RunSelfCheck, exitCode))
+		return exitCode;
+
     try
     {
         CubeMapApp theApp(hInstance);
@@ -164,6 +194,10 @@ CubeMapApp::CubeMapApp(HINSTANCE hInstance)
 
 CubeMapApp::~CubeMapApp()
 {
+	// Stop reading before the GPU lets go of the streamed textures.
+	mMipStreamer = nullptr;
+    if(md3dDevice != nullptr)
+        FlushCommandQueue();
 }
 
 bool CubeMapApp::Initialize()
@@ -187,6 +221,7 @@ bool CubeMapApp::Initialize()
     BuildShapeGeometry();
     BuildSkullGeometry();
 	BuildMaterials();
+	StartTextureStreaming();
     BuildRenderItems();
     BuildFrameResources();
     BuildPSOs();
@@ -199,6 +234,19 @@ bool CubeMapApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+	// The initialization commands have executed, so the intermediate upload buffers
+	// and the system memory copies of the meshes are no longer needed.
+	for(auto& e : mGeometries)
+	{
+		e.second->DisposeUploaders();
+		e.second->ApplyCpuGeometryPolicy(CpuGeometryPolicy::ReleaseAll);
+	}
+	for(auto& e : mTextures)
+		e.second->UploadHeap = nullptr;
+
+	MemoryStats::MarkSteadyState();
+	MemoryStats::OutputReport();
+
     return true;
 }
  
@@ -245,6 +293,8 @@ void CubeMapApp::Draw(const GameTimer& gt)
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
 
+	UpdateTextureStreaming();
+
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
 
@@ -411,6 +461,11 @@ void CubeMapApp::UpdateMaterialBuffer(const GameTimer& gt)
 			matData.Roughness = mat->Roughness;
 			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
 			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
+			for(auto& s : mStreamedMaterials)
+			{
+				if(s.Mat == mat)
+					matData.DiffuseMinLod = (float)std::max<int>(s.ResidentMip, 0);
+			}
 
 			currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
 
@@ -455,35 +510,124 @@ void CubeMapApp::UpdateMainPassCB(const GameTimer& gt)
 	currPassCB->CopyData(0, mMainPassCB);
 }
 
+void CubeMapApp::UpdateTextureStreaming()
+{
+	// Uploads are recorded into this frame's command list, which the fence reaches
+	// at the end of Draw.
+	mStreamedTextures->BeginFrame(mCommandList.Get(), mCurrentFence + 1);
+	mMipStreamer->Update(gMipStreamBudget);
+
+	for(auto& s : mStreamedMaterials)
+	{
+		int mip = mStreamedTextures->ResidentMip(s.Texture);
+		if(mip != s.ResidentMip)
+		{
+			s.ResidentMip = mip;
+			s.Mat->DiffuseSrvHeapIndex = s.SrvHeapIndex;
+			s.Mat->NumFramesDirty = gNumFrameResources;
+		}
+	}
+
+	if(!mStreamReported && mMipStreamer->Done())
+	{
+		Log::WriteText(LogLevel::Info, mMipStreamer->Report());
+		mStreamReported = true;
+	}
+}
+
 void CubeMapApp::LoadTextures()
 {
+	// bricks2.dds and tile.dds are streamed in by StartTextureStreaming.
     std::vector<std::string> texNames =
     {
-        "bricksDiffuseMap",
-        "tileDiffuseMap",
-        "defaultDiffuseMap",
-        "skyCubeMap"
+        "defaultDiffuseMap"
     };
 
     std::vector<std::wstring> texFilenames =
     {
-        L"../../Textures/bricks2.dds",
-        L"../../Textures/tile.dds",
-        L"../../Textures/white1x1.dds",
-        L"../../Textures/grasscube1024.dds"
+        L"../../Textures/white1x1.dds"
     };
 
+	// Reading, validating and laying out each file touches no D3D object, so the
+	// files load in parallel.  Creating the resources records into mCommandList,
+	// so that stays on this thread.
+	std::vector<DirectX::DDSTextureData> texData(texNames.size());
+
+	TaskGraph loads;
+	for(int i = 0; i < (int)texNames.size(); ++i)
+	{
+		loads.Add("Load " + texNames[i], [&texData, &texFilenames, i]()
+		{
+			ThrowIfFailed(DirectX::LoadDDSTextureData12(texFilenames[i].c_str(), texData[i]));
+		});
+	}
+	loads.Run();
+
+	Log::WriteText(LogLevel::Info, loads.Report());
+	LOG_INFO("Texture files loaded in {} ms, {} ms if loaded one after another ({}x)",
+		loads.WallMs(), loads.SumTaskMs(), loads.SumTaskMs() / loads.WallMs());
+
     for (int i = 0; i < (int)texNames.size(); ++i)
     {
         auto texMap = std::make_unique<Texture>();
         texMap->Name = texNames[i];
         texMap->Filename = texFilenames[i];
-        ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-            mCommandList.Get(), texMap->Filename.c_str(),
+        ThrowIfFailed(DirectX::CreateDDSTextureFromData12(md3dDevice.Get(),
+            mCommandList.Get(), texData[i],
             texMap->Resource, texMap->UploadHeap));
 
         mTextures[texMap->Name] = std::move(texMap);
     }
+
+	// The sky cube map is the one large file, so rather than holding it in memory
+	// and copying it again into the upload heap, it is read straight into the upload
+	// heap.
+	auto skyMap = std::make_unique<Texture>();
+	skyMap->Name = "skyCubeMap";
+	skyMap->Filename = L"../../Textures/grasscube1024.dds";
+
+	LARGE_INTEGER start, end, freq;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+
+	DirectX::DDSDirectLoadStats skyStats;
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFileDirect12(md3dDevice.Get(),
+		mCommandList.Get(), skyMap->Filename.c_str(),
+		skyMap->Resource, skyMap->UploadHeap, 0, nullptr, &skyStats));
+
+	QueryPerformanceCounter(&end);
+	LOG_INFO("skyCubeMap read into its upload heap in {} ms: {} bytes copied ({} read in place, {} through a scratch buffer)",
+		1000.0*(double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart,
+		skyStats.BytesReadInPlace + 2*skyStats.BytesStaged, skyStats.BytesReadInPlace, skyStats.BytesStaged);
+
+	// For comparison, the same file through memory: read whole, then copied into the
+	// upload heap.  The copy stays alive until the initialization commands execute.
+	if(wcsstr(GetCommandLineW(), L"-texturecopybench") != nullptr)
+	{
+		QueryPerformanceCounter(&start);
+
+		DirectX::DDSTextureData data;
+		auto skyCopy = std::make_unique<Texture>();
+		skyCopy->Name = "skyCubeMapCopy";
+		skyCopy->Filename = skyMap->Filename;
+		ThrowIfFailed(DirectX::LoadDDSTextureData12(skyCopy->Filename.c_str(), data));
+		ThrowIfFailed(DirectX::CreateDDSTextureFromData12(md3dDevice.Get(),
+			mCommandList.Get(), data, skyCopy->Resource, skyCopy->UploadHeap));
+
+		QueryPerformanceCounter(&end);
+
+		UINT64 texelBytes = 0;
+		for(auto& subresource : data.Subresources)
+			texelBytes += subresource.SlicePitch;
+
+		LOG_INFO("skyCubeMap read through memory in {} ms: {} bytes copied ({} read, {} copied to the upload heap)",
+			1000.0*(double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart,
+			data.FileSize + texelBytes, data.FileSize, texelBytes);
+
+		mTextures[skyCopy->Name] = std::move(skyCopy);
+	}
+
+	mTextures[skyMap->Name] = std::move(skyMap);
 }
 
 void CubeMapApp::BuildRootSignature()
@@ -547,26 +691,24 @@ void CubeMapApp::BuildDescriptorHeaps()
 	//
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 
-	auto bricksTex = mTextures["bricksDiffuseMap"]->Resource;
-	auto tileTex = mTextures["tileDiffuseMap"]->Resource;
 	auto whiteTex = mTextures["defaultDiffuseMap"]->Resource;
 	auto skyTex = mTextures["skyCubeMap"]->Resource;
 
+	// The streamed bricks and tile textures write their views with their mip
+	// tails; until then their slots hold null views.
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = bricksTex->GetDesc().Format;
+	srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = bricksTex->GetDesc().MipLevels;
+	srvDesc.Texture2D.MipLevels = 1;
 	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-	md3dDevice->CreateShaderResourceView(bricksTex.Get(), &srvDesc, hDescriptor);
+	md3dDevice->CreateShaderResourceView(nullptr, &srvDesc, hDescriptor);
 
 	// next descriptor
 	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
 
-	srvDesc.Format = tileTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = tileTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(tileTex.Get(), &srvDesc, hDescriptor);
+	md3dDevice->CreateShaderResourceView(nullptr, &srvDesc, hDescriptor);
 
 	// next descriptor
 	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
@@ -740,7 +882,7 @@ void CubeMapApp::BuildSkullGeometry()
 
     if (!fin)
     {
-        MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+        LOG_ERROR("Models/skull.txt not found.");
         return;
     }
 
@@ -900,7 +1042,7 @@ void CubeMapApp::BuildMaterials()
     auto bricks0 = std::make_unique<Material>();
     bricks0->Name = "bricks0";
     bricks0->MatCBIndex = 0;
-    bricks0->DiffuseSrvHeapIndex = 0;
+    bricks0->DiffuseSrvHeapIndex = 2; // streamed into 0
     bricks0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
     bricks0->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
     bricks0->Roughness = 0.3f;
@@ -908,7 +1050,7 @@ void CubeMapApp::BuildMaterials()
     auto tile0 = std::make_unique<Material>();
     tile0->Name = "tile0";
     tile0->MatCBIndex = 1;
-    tile0->DiffuseSrvHeapIndex = 1;
+    tile0->DiffuseSrvHeapIndex = 2; // streamed into 1
     tile0->DiffuseAlbedo = XMFLOAT4(0.9f, 0.9f, 0.9f, 1.0f);
     tile0->FresnelR0 = XMFLOAT3(0.2f, 0.2f, 0.2f);
     tile0->Roughness = 0.1f;
@@ -944,6 +1086,35 @@ void CubeMapApp::BuildMaterials()
     mMaterials["sky"] = std::move(sky);
 }
 
+void CubeMapApp::StartTextureStreaming()
+{
+	std::vector<std::string> matNames = { "bricks0", "tile0" };
+	std::vector<std::wstring> texFilenames =
+	{
+		L"../../Textures/bricks2.dds",
+		L"../../Textures/tile.dds"
+	};
+
+	mStreamedTextures = std::make_unique<StreamedTextures>(md3dDevice.Get(), mFence.Get());
+
+	for(int i = 0; i < (int)matNames.size(); ++i)
+	{
+		CD3DX12_CPU_DESCRIPTOR_HANDLE srv(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		srv.Offset(i, mCbvSrvDescriptorSize);
+
+		StreamedMaterial s;
+		s.Mat = mMaterials[matNames[i]].get();
+		s.Texture = mStreamedTextures->Add(texFilenames[i], srv);
+		s.SrvHeapIndex = i;
+		mStreamedMaterials.push_back(s);
+	}
+
+	// Reads start at once on the streaming thread; uploads wait for the first frame.
+	mMipStreamer = std::make_unique<MipStreamer>(*mStreamedTextures);
+	for(auto& s : mStreamedMaterials)
+		mMipStreamer->Add(s.Texture);
+}
+
 void CubeMapApp::BuildRenderItems()
 {
 	auto skyRitem = std::make_unique<RenderItem>();
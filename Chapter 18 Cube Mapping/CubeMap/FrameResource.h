@@ -50,7 +50,9 @@ struct MaterialData
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
 
 	UINT DiffuseMapIndex = 0;
-	UINT MaterialPad0;
+
+	// Mips larger than this may still be streaming in, so are not sampled.
+	float DiffuseMinLod = 0.0f;
 	UINT MaterialPad1;
 	UINT MaterialPad2;
 };
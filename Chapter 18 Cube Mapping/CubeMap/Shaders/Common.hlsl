@@ -25,7 +25,7 @@ struct MaterialData
 	float    Roughness;
 	float4x4 MatTransform;
 	uint     DiffuseMapIndex;
-	uint     MatPad0;
+	float    DiffuseMinLod;
 	uint     MatPad1;
 	uint     MatPad2;
 };
@@ -66,8 +66,15 @@ float4 PS(VertexOut pin) : SV_Target
 	float  roughness = matData.Roughness;
 	uint diffuseTexIndex = matData.DiffuseMapIndex;
 
-	// Dynamically look up the texture in the array.
-	diffuseAlbedo *= gDiffuseMap[diffuseTexIndex].Sample(gsamAnisotropicWrap, pin.TexC);
+	// Dynamically look up the texture in the array.  Where the mip picked would be
+	// finer than DiffuseMinLod, the gradients are scaled up to clamp it, so mips not
+	// streamed in yet are never sampled.
+	float2 texDx = ddx(pin.TexC);
+	float2 texDy = ddy(pin.TexC);
+	float lod = gDiffuseMap[diffuseTexIndex].CalculateLevelOfDetail(gsamAnisotropicWrap, pin.TexC);
+	float gradScale = exp2(max(matData.DiffuseMinLod - lod, 0.0f));
+	diffuseAlbedo *= gDiffuseMap[diffuseTexIndex].SampleGrad(gsamAnisotropicWrap, pin.TexC,
+		gradScale*texDx, gradScale*texDy);
 	
     // Interpolating normal can unnormalize it, so renormalize it.
     pin.NormalW = normalize(pin.NormalW);
@@ -0,0 +1,122 @@
+//***************************************************************************************
+// StreamedTextures.cpp
+//***************************************************************************************
+
+#include "StreamedTextures.h"
+
+StreamedTextures::StreamedTextures(ID3D12Device* device, ID3D12Fence* fence) :
+	md3dDevice(device), mFence(fence)
+{
+}
+
+int StreamedTextures::Add(const std::wstring& filename, D3D12_CPU_DESCRIPTOR_HANDLE srv)
+{
+	Texture t;
+	t.Filename = filename;
+	t.Srv = srv;
+	mTextures.push_back(std::move(t));
+
+	return (int)mTextures.size() - 1;
+}
+
+void StreamedTextures::BeginFrame(ID3D12GraphicsCommandList* cmdList, UINT64 frameFence)
+{
+	mCommandList = cmdList;
+	mFrameFence = frameFence;
+}
+
+MipStreamRead StreamedTextures::Read(int texture, size_t maxsize)
+{
+	Texture& t = mTextures[texture];
+
+	MipStreamRead read;
+	HRESULT hr = DirectX::LoadDDSMips12(md3dDevice, t.Filename.c_str(), maxsize, t.ReadMip, t.Read);
+	if(FAILED(hr))
+	{
+		LOG_ERROR("Streaming {} failed with HRESULT {}.", t.Filename, (int)hr);
+		return read;
+	}
+
+	if(t.Read.MipCount > 0)
+		t.ReadMip = t.Read.FirstMip;
+
+	read.Succeeded = true;
+	read.Bytes = t.Read.Stats.BytesReadInPlace + t.Read.Stats.BytesStaged;
+	read.Last = t.Read.MipCount > 0 && t.Read.FirstMip == 0;
+	return read;
+}
+
+uint64_t StreamedTextures::Upload(int texture)
+{
+	Texture& t = mTextures[texture];
+	const DirectX::DDSMipUpload& mips = t.Read;
+
+	if(mips.MipCount == 0)
+		return mFrameFence;
+
+	if(t.Resource == nullptr)
+	{
+		// The whole texture is made with its tail, and its view written before any
+		// material draws from it; later stages only fill in mips.
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&mips.Desc,
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(t.Resource.GetAddressOf())));
+		MemoryStats::Track(MemoryCategory::Texture, t.Resource.Get());
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = mips.Desc.Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = mips.Desc.MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+		md3dDevice->CreateShaderResourceView(t.Resource.Get(), &srvDesc, t.Srv);
+
+		DirectX::CopyDDSMips12(mCommandList, t.Resource.Get(), mips);
+
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(t.Resource.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	}
+	else
+	{
+		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+		for(UINT i = 0; i < mips.MipCount; ++i)
+		{
+			barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(t.Resource.Get(),
+				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST, mips.FirstMip + i));
+		}
+		mCommandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+
+		DirectX::CopyDDSMips12(mCommandList, t.Resource.Get(), mips);
+
+		for(auto& b : barriers)
+			std::swap(b.Transition.StateBefore, b.Transition.StateAfter);
+		mCommandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+	}
+
+	// The upload heap must outlive the copy.
+	t.UploadHeap = mips.UploadHeap;
+	t.Read.UploadHeap = nullptr;
+	t.UploadedMip = mips.FirstMip;
+
+	return mFrameFence;
+}
+
+uint64_t StreamedTextures::CompletedFence()
+{
+	return mFence->GetCompletedValue();
+}
+
+void StreamedTextures::MakeResident(int texture)
+{
+	Texture& t = mTextures[texture];
+	if(t.Resource == nullptr)
+		return;
+
+	t.ResidentMip = (int)t.UploadedMip;
+	t.UploadHeap = nullptr;
+}
@@ -0,0 +1,66 @@
+//***************************************************************************************
+// StreamedTextures.h
+//
+// The MipStreamUploader of the demo: reads a 2D DDS texture's mips straight into an
+// upload heap on the streaming thread, copies them into a texture of the full size
+// on the render thread, and reports the largest mip that may be sampled.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/MipStreamer.h"
+
+class StreamedTextures : public MipStreamUploader
+{
+public:
+	StreamedTextures(ID3D12Device* device, ID3D12Fence* fence);
+
+	StreamedTextures(const StreamedTextures& rhs)=delete;
+	StreamedTextures& operator=(const StreamedTextures& rhs)=delete;
+
+	// Returns the texture's number for MipStreamer::Add.  The view of the whole
+	// texture is written to srv with its first stage.  Add every texture before
+	// streaming any.
+	int Add(const std::wstring& filename, D3D12_CPU_DESCRIPTOR_HANDLE srv);
+
+	// Before MipStreamer::Update each frame: uploads are recorded into cmdList,
+	// which signals frameFence once it has executed.
+	void BeginFrame(ID3D12GraphicsCommandList* cmdList, UINT64 frameFence);
+
+	// The largest mip that has reached the GPU, or -1 while none has.  Sample with
+	// a minimum LOD of this.
+	int ResidentMip(int texture)const { return mTextures[texture].ResidentMip; }
+
+	MipStreamRead Read(int texture, size_t maxsize)override;
+	uint64_t Upload(int texture)override;
+	uint64_t CompletedFence()override;
+	void MakeResident(int texture)override;
+
+private:
+	struct Texture
+	{
+		std::wstring Filename;
+		D3D12_CPU_DESCRIPTOR_HANDLE Srv = {};
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
+
+		// The last read, and the upload heap of the last upload until it executes.
+		DirectX::DDSMipUpload Read;
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+
+		// Mips from ReadMip on have been read, 0 before the first read; mips from
+		// UploadedMip on have been uploaded.
+		UINT ReadMip = 0;
+		UINT UploadedMip = 0;
+		int ResidentMip = -1;
+	};
+
+	ID3D12Device* md3dDevice = nullptr;
+	ID3D12Fence* mFence = nullptr;
+
+	ID3D12GraphicsCommandList* mCommandList = nullptr;
+	UINT64 mFrameFence = 0;
+
+	std::vector<Texture> mTextures;
+};
@@ -0,0 +1,57 @@
+#include "CubeFaceDependencies.h"
+
+using namespace DirectX;
+
+void CubeFaceDependencies::SetViews(const XMFLOAT4X4 viewProj[6])
+{
+	mCuller.ClearViews();
+	for(int i = 0; i < 6; ++i)
+		mCuller.AddView(viewProj[i]);
+
+	mViewsChanged = true;
+}
+
+void CubeFaceDependencies::SetItem(int item, const BoundingBox& boundsW)
+{
+	while(mCuller.ItemCount() <= item)
+	{
+		mCuller.AddItem(BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f)));
+		mItemFaces.push_back(0);
+	}
+
+	mCuller.SetItem(item, boundsW);
+	mChangedItems.push_back(item);
+}
+
+UINT CubeFaceDependencies::Update()
+{
+	if(!mViewsChanged && mChangedItems.empty())
+		return 0;
+
+	mCuller.Cull();
+
+	// An item dirties the faces it has left as well as the ones it has entered.
+	UINT dirty = mViewsChanged ? AllFaces : 0;
+	for(int item : mChangedItems)
+		dirty |= mItemFaces[item] | (UINT)mCuller.Mask(item);
+
+	for(int item = 0; item < mCuller.ItemCount(); ++item)
+		mItemFaces[item] = (UINT)mCuller.Mask(item);
+
+	mViewsChanged = false;
+	mChangedItems.clear();
+
+	return dirty;
+}
+
+int CubeFaceDependencies::FaceItemCount(int face)const
+{
+	int count = 0;
+	for(UINT faces : mItemFaces)
+	{
+		if(faces & (1u << face))
+			++count;
+	}
+
+	return count;
+}
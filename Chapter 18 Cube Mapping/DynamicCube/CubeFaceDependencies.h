@@ -0,0 +1,41 @@
+//***************************************************************************************
+// CubeFaceDependencies.h
+//
+// Tracks which items each face of a dynamic cube map sees, so a face only needs to be
+// redrawn when one of its items changes.  An item that moves dirties the faces it
+// was in and the faces it is now in.  No D3D dependencies.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/MultiViewCuller.h"
+
+class CubeFaceDependencies
+{
+public:
+	static const UINT AllFaces = 0x3F;
+
+	// Sets the frustums of the six faces.  Every face is dirty on the next Update.
+	void SetViews(const DirectX::XMFLOAT4X4 viewProj[6]);
+
+	// Records that item changed this frame and where it now is.  Items are
+	// indexed from 0 and may be added in any order.
+	void SetItem(int item, const DirectX::BoundingBox& boundsW);
+
+	// Returns the faces that changed since the last call, bit i for face i.
+	UINT Update();
+
+	// Faces whose frustum intersects item's bounds.
+	UINT ItemFaces(int item)const { return mItemFaces[item]; }
+
+	// Items in face's frustum.
+	int FaceItemCount(int face)const;
+
+private:
+	MultiViewCuller mCuller;
+	bool mViewsChanged = false;
+
+	std::vector<UINT> mItemFaces;
+	std::vector<int> mChangedItems;
+};
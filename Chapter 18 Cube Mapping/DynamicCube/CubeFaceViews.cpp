@@ -0,0 +1,87 @@
+#include "CubeFaceViews.h"
+
+using namespace DirectX;
+
+bool CubeFaceViews::Update(const XMFLOAT3& center, float fovY, float nearZ, float farZ, float targetSize)
+{
+	if(mVersion != 0 &&
+		center.x == mCenter.x && center.y == mCenter.y && center.z == mCenter.z &&
+		fovY == mFovY && nearZ == mNearZ && farZ == mFarZ && targetSize == mTargetSize)
+	{
+		return false;
+	}
+
+	mCenter = center;
+	mFovY = fovY;
+	mNearZ = nearZ;
+	mFarZ = farZ;
+	mTargetSize = targetSize;
+
+	Camera camera;
+	camera.SetLens(fovY, 1.0f, nearZ, farZ);
+
+	// The projection is the same for every face.
+	XMMATRIX proj = camera.GetProj();
+	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+
+	for(int i = 0; i < 6; ++i)
+	{
+		LookAtCubeFace(camera, center, i);
+		camera.UpdateViewMatrix();
+
+		XMMATRIX view = camera.GetView();
+		XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+		XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+		PassConstants& passCB = mPassCB[i];
+		XMStoreFloat4x4(&passCB.View, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&passCB.InvView, XMMatrixTranspose(invView));
+		XMStoreFloat4x4(&passCB.Proj, XMMatrixTranspose(proj));
+		XMStoreFloat4x4(&passCB.InvProj, XMMatrixTranspose(invProj));
+		XMStoreFloat4x4(&passCB.ViewProj, XMMatrixTranspose(viewProj));
+		XMStoreFloat4x4(&passCB.InvViewProj, XMMatrixTranspose(invViewProj));
+		passCB.EyePosW = center;
+		passCB.RenderTargetSize = XMFLOAT2(targetSize, targetSize);
+		passCB.InvRenderTargetSize = XMFLOAT2(1.0f / targetSize, 1.0f / targetSize);
+		passCB.NearZ = nearZ;
+		passCB.FarZ = farZ;
+
+		XMStoreFloat4x4(&mViewProj[i], viewProj);
+	}
+
+	++mVersion;
+	return true;
+}
+
+void CubeFaceViews::LookAtCubeFace(Camera& camera, const XMFLOAT3& center, int face)
+{
+	float x = center.x;
+	float y = center.y;
+	float z = center.z;
+
+	// Look along each coordinate axis.
+	XMFLOAT3 targets[6] =
+	{
+		XMFLOAT3(x + 1.0f, y, z), // +X
+		XMFLOAT3(x - 1.0f, y, z), // -X
+		XMFLOAT3(x, y + 1.0f, z), // +Y
+		XMFLOAT3(x, y - 1.0f, z), // -Y
+		XMFLOAT3(x, y, z + 1.0f), // +Z
+		XMFLOAT3(x, y, z - 1.0f)  // -Z
+	};
+
+	// Use world up vector (0,1,0) for all directions except +Y/-Y.  In these cases, we
+	// are looking down +Y or -Y, so we need a different "up" vector.
+	XMFLOAT3 ups[6] =
+	{
+		XMFLOAT3(0.0f, 1.0f, 0.0f),  // +X
+		XMFLOAT3(0.0f, 1.0f, 0.0f),  // -X
+		XMFLOAT3(0.0f, 0.0f, -1.0f), // +Y
+		XMFLOAT3(0.0f, 0.0f, +1.0f), // -Y
+		XMFLOAT3(0.0f, 1.0f, 0.0f),	 // +Z
+		XMFLOAT3(0.0f, 1.0f, 0.0f)	 // -Z
+	};
+
+	camera.LookAt(center, targets[face], ups[face]);
+}
@@ -0,0 +1,47 @@
+//***************************************************************************************
+// CubeFaceViews.h
+//
+// The per view constants of the six faces of a cube map captured from a point.  They
+// only depend on the center, the lens and the target size, so they are rebuilt when
+// one of those changes instead of every frame.  Each rebuild bumps Version(), which
+// frame resources compare against to skip copying constants they already hold.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/Camera.h"
+#include "FrameResource.h"
+
+class CubeFaceViews
+{
+public:
+	// Rebuilds all six faces if any parameter differs from the last call; returns
+	// true if it did.
+	bool Update(const DirectX::XMFLOAT3& center, float fovY, float nearZ, float farZ, float targetSize);
+
+	// Transposed, ready to be copied to a constant buffer.
+	const PassConstants& PassCB(int face)const { return mPassCB[face]; }
+
+	// Untransposed, for culling.
+	const DirectX::XMFLOAT4X4& ViewProj(int face)const { return mViewProj[face]; }
+
+	const DirectX::XMFLOAT3& Center()const { return mCenter; }
+
+	// 0 until the first Update.
+	UINT Version()const { return mVersion; }
+
+	// Points camera down the given face's axis from center.
+	static void LookAtCubeFace(Camera& camera, const DirectX::XMFLOAT3& center, int face);
+
+private:
+	DirectX::XMFLOAT3 mCenter = { 0.0f, 0.0f, 0.0f };
+	float mFovY = 0.0f;
+	float mNearZ = 0.0f;
+	float mFarZ = 0.0f;
+	float mTargetSize = 0.0f;
+
+	PassConstants mPassCB[6];
+	DirectX::XMFLOAT4X4 mViewProj[6];
+
+	UINT mVersion = 0;
+};
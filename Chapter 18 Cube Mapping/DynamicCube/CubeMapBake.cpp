@@ -0,0 +1,497 @@
+#include "CubeMapBake.h"
+#include "../../Common/SelfCheck.h"
+#include <climits>
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t DDSMagic = 0x20534444; // "DDS "
+	const std::uint32_t FourCCDX10 = 0x30315844; // "DX10"
+
+	// The parts of the DDS file format a cube map needs; see DDSTextureLoader.cpp.
+	struct DDSPixelFormat
+	{
+		std::uint32_t Size;
+		std::uint32_t Flags;
+		std::uint32_t FourCC;
+		std::uint32_t RGBBitCount;
+		std::uint32_t RBitMask;
+		std::uint32_t GBitMask;
+		std::uint32_t BBitMask;
+		std::uint32_t ABitMask;
+	};
+
+	struct DDSHeader
+	{
+		std::uint32_t Size;
+		std::uint32_t Flags;
+		std::uint32_t Height;
+		std::uint32_t Width;
+		std::uint32_t PitchOrLinearSize;
+		std::uint32_t Depth;
+		std::uint32_t MipMapCount;
+		std::uint32_t Reserved1[11];
+		DDSPixelFormat PixelFormat;
+		std::uint32_t Caps;
+		std::uint32_t Caps2;
+		std::uint32_t Caps3;
+		std::uint32_t Caps4;
+		std::uint32_t Reserved2;
+	};
+
+	struct DDSHeaderDXT10
+	{
+		std::uint32_t DxgiFormat;
+		std::uint32_t ResourceDimension;
+		std::uint32_t MiscFlag;
+		std::uint32_t ArraySize;
+		std::uint32_t MiscFlags2;
+	};
+
+	static_assert(sizeof(DDSHeader) == 124, "DDS header size mismatch");
+	static_assert(sizeof(DDSHeaderDXT10) == 20, "DDS DX10 header size mismatch");
+
+	const std::uint32_t DDSDCaps = 0x1;
+	const std::uint32_t DDSDHeight = 0x2;
+	const std::uint32_t DDSDWidth = 0x4;
+	const std::uint32_t DDSDPitch = 0x8;
+	const std::uint32_t DDSDPixelFormat = 0x1000;
+	const std::uint32_t DDSDMipMapCount = 0x20000;
+	const std::uint32_t DDSDLinearSize = 0x80000;
+	const std::uint32_t DDPFFourCC = 0x4;
+	const std::uint32_t DDSCapsComplex = 0x8;
+	const std::uint32_t DDSCapsTexture = 0x1000;
+	const std::uint32_t DDSCapsMipMap = 0x400000;
+	const std::uint32_t DDSCaps2CubeMapAllFaces = 0x200 | 0xFC00;
+	const std::uint32_t ResourceDimensionTexture2D = 3;
+	const std::uint32_t ResourceMiscTextureCube = 0x4;
+
+	double NowMs()
+	{
+		static LARGE_INTEGER freq = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return 1000.0 * (double)now.QuadPart / (double)freq.QuadPart;
+	}
+
+	UINT MipCount(UINT size, const CubeBakeSettings& settings)
+	{
+		UINT count = 1;
+		if(settings.GenerateMips)
+		{
+			while((size >> count) > 0)
+				++count;
+		}
+		return count;
+	}
+
+	UINT BlockCount(UINT size)
+	{
+		return std::max<UINT>(1, (size + 3) / 4);
+	}
+
+	size_t MipDataSize(UINT size, const CubeBakeSettings& settings)
+	{
+		if(settings.Compress)
+			return (size_t)BlockCount(size) * BlockCount(size) * 8;
+		return (size_t)size * size * 4;
+	}
+
+	// 2x2 box filter.
+	std::vector<std::uint8_t> Downsample(const std::vector<std::uint8_t>& src, UINT size)
+	{
+		UINT half = size / 2;
+		std::vector<std::uint8_t> dst((size_t)half * half * 4);
+		for(UINT y = 0; y < half; ++y)
+		{
+			for(UINT x = 0; x < half; ++x)
+			{
+				const std::uint8_t* s0 = &src[((size_t)(2*y) * size + 2*x) * 4];
+				const std::uint8_t* s1 = s0 + (size_t)size * 4;
+				std::uint8_t* d = &dst[((size_t)y * half + x) * 4];
+				for(int c = 0; c < 4; ++c)
+					d[c] = (std::uint8_t)((s0[c] + s0[c + 4] + s1[c] + s1[c + 4] + 2) / 4);
+			}
+		}
+		return dst;
+	}
+
+	std::uint16_t Pack565(const int rgb[3])
+	{
+		int r = (rgb[0] * 31 + 127) / 255;
+		int g = (rgb[1] * 63 + 127) / 255;
+		int b = (rgb[2] * 31 + 127) / 255;
+		return (std::uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void Unpack565(std::uint16_t c, int rgb[3])
+	{
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// Four colour BC1 with the endpoints at the corners of the texels' bounding box,
+	// inset a little and flipped onto the diagonal the colours lie along.
+	void EncodeBC1Block(const std::uint8_t texels[16][4], std::uint8_t block[8])
+	{
+		int lo[3] = { 255, 255, 255 };
+		int hi[3] = { 0, 0, 0 };
+		int mean[3] = { 0, 0, 0 };
+		for(int i = 0; i < 16; ++i)
+		{
+			for(int c = 0; c < 3; ++c)
+			{
+				lo[c] = std::min<int>(lo[c], texels[i][c]);
+				hi[c] = std::max<int>(hi[c], texels[i][c]);
+				mean[c] += texels[i][c];
+			}
+		}
+
+		int covRG = 0, covBG = 0;
+		for(int i = 0; i < 16; ++i)
+		{
+			int g = 16 * texels[i][1] - mean[1];
+			covRG += (16 * texels[i][0] - mean[0]) * g;
+			covBG += (16 * texels[i][2] - mean[2]) * g;
+		}
+		if(covRG < 0)
+			std::swap(lo[0], hi[0]);
+		if(covBG < 0)
+			std::swap(lo[2], hi[2]);
+
+		for(int c = 0; c < 3; ++c)
+		{
+			int inset = (hi[c] - lo[c]) / 16;
+			hi[c] -= inset;
+			lo[c] += inset;
+		}
+
+		std::uint16_t c0 = Pack565(hi);
+		std::uint16_t c1 = Pack565(lo);
+		if(c0 < c1)
+			std::swap(c0, c1);
+
+		// Four colour mode needs c0 > c1; a flat block uses c0 throughout.
+		std::uint32_t indices = 0;
+		if(c0 != c1)
+		{
+			int palette[4][3];
+			Unpack565(c0, palette[0]);
+			Unpack565(c1, palette[1]);
+			for(int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+			}
+
+			for(int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				int bestError = INT_MAX;
+				for(int p = 0; p < 4; ++p)
+				{
+					int error = 0;
+					for(int c = 0; c < 3; ++c)
+					{
+						int d = texels[i][c] - palette[p][c];
+						error += d * d;
+					}
+					if(error < bestError)
+					{
+						best = p;
+						bestError = error;
+					}
+				}
+				indices |= (std::uint32_t)best << (2 * i);
+			}
+		}
+
+		block[0] = (std::uint8_t)(c0 & 0xFF);
+		block[1] = (std::uint8_t)(c0 >> 8);
+		block[2] = (std::uint8_t)(c1 & 0xFF);
+		block[3] = (std::uint8_t)(c1 >> 8);
+		for(int i = 0; i < 4; ++i)
+			block[4 + i] = (std::uint8_t)(indices >> (8 * i));
+	}
+
+	void DecodeBC1Block(const std::uint8_t block[8], std::uint8_t texels[16][4])
+	{
+		std::uint16_t c0 = (std::uint16_t)(block[0] | (block[1] << 8));
+		std::uint16_t c1 = (std::uint16_t)(block[2] | (block[3] << 8));
+		int palette[4][3];
+		Unpack565(c0, palette[0]);
+		Unpack565(c1, palette[1]);
+		for(int c = 0; c < 3; ++c)
+		{
+			if(c0 > c1)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		std::uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((std::uint32_t)block[7] << 24);
+		for(int i = 0; i < 16; ++i)
+		{
+			int p = (indices >> (2 * i)) & 3;
+			for(int c = 0; c < 3; ++c)
+				texels[i][c] = (std::uint8_t)palette[p][c];
+			texels[i][3] = 255;
+		}
+	}
+
+	// Appends the BC1 blocks of a size*size image.  Images smaller than a block
+	// repeat their edge texels.
+	void CompressBC1(const std::vector<std::uint8_t>& image, UINT size, std::vector<std::uint8_t>& out)
+	{
+		UINT blocks = BlockCount(size);
+		for(UINT by = 0; by < blocks; ++by)
+		{
+			for(UINT bx = 0; bx < blocks; ++bx)
+			{
+				std::uint8_t texels[16][4];
+				for(UINT i = 0; i < 16; ++i)
+				{
+					UINT x = std::min<UINT>(bx * 4 + i % 4, size - 1);
+					UINT y = std::min<UINT>(by * 4 + i / 4, size - 1);
+					const std::uint8_t* t = &image[((size_t)y * size + x) * 4];
+					for(int c = 0; c < 4; ++c)
+						texels[i][c] = t[c];
+				}
+
+				std::uint8_t block[8];
+				EncodeBC1Block(texels, block);
+				out.insert(out.end(), block, block + 8);
+			}
+		}
+	}
+
+}
+
+std::wstring CubeMapBake::CachePath(const std::wstring& directory, std::uint64_t sceneHash,
+	const XMFLOAT3& centerW, const CubeBakeSettings& settings)
+{
+	std::uint64_t hash = d3dUtil::HashBytes(&sceneHash, sizeof(sceneHash));
+	hash = d3dUtil::HashBytes(&centerW.x, sizeof(float), hash);
+	hash = d3dUtil::HashBytes(&centerW.y, sizeof(float), hash);
+	hash = d3dUtil::HashBytes(&centerW.z, sizeof(float), hash);
+	hash = d3dUtil::HashBytes(&settings.Size, sizeof(UINT), hash);
+	hash = d3dUtil::HashBytes(&settings.GenerateMips, sizeof(bool), hash);
+	hash = d3dUtil::HashBytes(&settings.Compress, sizeof(bool), hash);
+
+	wchar_t name[64];
+	swprintf_s(name, L"cube_%016llx.dds", (unsigned long long)hash);
+	return directory + L"/" + name;
+}
+
+size_t CubeMapBake::DataSize(UINT size, const CubeBakeSettings& settings)
+{
+	size_t bytes = 0;
+	UINT mipCount = MipCount(size, settings);
+	for(UINT level = 0; level < mipCount; ++level)
+		bytes += MipDataSize(std::max<UINT>(1, size >> level), settings);
+	return 6 * bytes;
+}
+
+void CubeMapBake::EncodeFace(const std::vector<std::uint8_t>& face, UINT size,
+	const CubeBakeSettings& settings, std::vector<std::uint8_t>& data)
+{
+	UINT mipCount = MipCount(size, settings);
+	data.clear();
+	data.reserve(DataSize(size, settings) / 6);
+
+	std::vector<std::uint8_t> mip = face;
+	UINT mipSize = size;
+	for(UINT level = 0; level < mipCount; ++level)
+	{
+		if(level > 0)
+		{
+			mip = Downsample(mip, mipSize);
+			mipSize /= 2;
+		}
+
+		if(settings.Compress)
+			CompressBC1(mip, mipSize, data);
+		else
+			data.insert(data.end(), mip.begin(), mip.end());
+	}
+}
+
+bool CubeMapBake::WriteCubeDDS(const std::wstring& filename, const std::vector<std::uint8_t> faces[6],
+	UINT size, const CubeBakeSettings& settings)
+{
+	std::vector<std::uint8_t> data[6];
+	for(int face = 0; face < 6; ++face)
+		EncodeFace(faces[face], size, settings, data[face]);
+
+	return WriteEncodedCubeDDS(filename, data, size, settings);
+}
+
+bool CubeMapBake::WriteEncodedCubeDDS(const std::wstring& filename, const std::vector<std::uint8_t> data[6],
+	UINT size, const CubeBakeSettings& settings)
+{
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = DDSDCaps | DDSDHeight | DDSDWidth | DDSDPixelFormat | DDSDMipMapCount |
+		(settings.Compress ? DDSDLinearSize : DDSDPitch);
+	header.Height = size;
+	header.Width = size;
+	header.PitchOrLinearSize = settings.Compress ? (std::uint32_t)MipDataSize(size, settings) : size * 4;
+	header.MipMapCount = MipCount(size, settings);
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = DDPFFourCC;
+	header.PixelFormat.FourCC = FourCCDX10;
+	header.Caps = DDSCapsComplex | DDSCapsTexture | (header.MipMapCount > 1 ? DDSCapsMipMap : 0);
+	header.Caps2 = DDSCaps2CubeMapAllFaces;
+
+	DDSHeaderDXT10 header10 = {};
+	header10.DxgiFormat = settings.Compress ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_R8G8B8A8_UNORM;
+	header10.ResourceDimension = ResourceDimensionTexture2D;
+	header10.MiscFlag = ResourceMiscTextureCube;
+	header10.ArraySize = 1;
+
+	size_t slash = filename.find_last_of(L"/\\");
+	if(slash != std::wstring::npos)
+		CreateDirectoryW(filename.substr(0, slash).c_str(), nullptr);
+
+	std::ofstream fout(filename, std::ios::binary);
+	if(!fout)
+		return false;
+
+	fout.write((const char*)&DDSMagic, sizeof(DDSMagic));
+	fout.write((const char*)&header, sizeof(header));
+	fout.write((const char*)&header10, sizeof(header10));
+	// Every face, then every mip of it: the order a DDS cube map is stored in.
+	for(int face = 0; face < 6; ++face)
+		fout.write((const char*)data[face].data(), data[face].size());
+
+	return !fout.fail();
+}
+
+bool CubeMapBake::RunSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	//
+	// Faces like a captured scene: smooth gradients with a few hard edges.
+	//
+	const UINT size = 256;
+	std::vector<std::uint8_t> faces[6];
+	for(int face = 0; face < 6; ++face)
+	{
+		faces[face].resize((size_t)size * size * 4);
+		for(UINT y = 0; y < size; ++y)
+		{
+			for(UINT x = 0; x < size; ++x)
+			{
+				std::uint8_t* t = &faces[face][((size_t)y * size + x) * 4];
+				bool edge = ((x / 37) + (y / 53) + face) % 5 == 0;
+				t[0] = (std::uint8_t)(edge ? 240 : (x * 255) / size);
+				t[1] = (std::uint8_t)(edge ? 40 : (y * 255) / size);
+				t[2] = (std::uint8_t)(40 * face);
+				t[3] = 255;
+			}
+		}
+	}
+
+	//
+	// BC1 quality on mip 0 of every face.
+	//
+	{
+		double squaredError = 0.0;
+		for(int face = 0; face < 6; ++face)
+		{
+			std::vector<std::uint8_t> blocks;
+			CompressBC1(faces[face], size, blocks);
+			checks.Check(blocks.size() == MipDataSize(size, CubeBakeSettings()), "BC1 is 8 bytes per 4x4 block");
+
+			for(UINT b = 0; b < blocks.size() / 8; ++b)
+			{
+				std::uint8_t texels[16][4];
+				DecodeBC1Block(&blocks[b * 8], texels);
+
+				UINT bx = b % (size / 4), by = b / (size / 4);
+				for(UINT i = 0; i < 16; ++i)
+				{
+					const std::uint8_t* t = &faces[face][((size_t)(by * 4 + i / 4) * size + bx * 4 + i % 4) * 4];
+					for(int c = 0; c < 3; ++c)
+					{
+						double d = (double)texels[i][c] - t[c];
+						squaredError += d * d;
+					}
+				}
+			}
+		}
+
+		double mse = squaredError / (6.0 * size * size * 3.0);
+		double psnr = 10.0 * log10(255.0 * 255.0 / std::max<double>(mse, 1e-9));
+		checks.Check(psnr > 30.0, "BC1 keeps the faces above 30 dB PSNR");
+
+		checks.Note("  BC1: %.1f dB PSNR over six %ux%u faces\n", psnr, size, size);
+	}
+
+	//
+	// Write both variants and read the headers back.
+	//
+	CubeBakeSettings variants[2];
+	variants[1].Compress = false;
+	for(const CubeBakeSettings& settings : variants)
+	{
+		const std::wstring filename = L"CubeBakeCheck.dds";
+
+		double start = NowMs();
+		bool written = WriteCubeDDS(filename, faces, size, settings);
+		double ms = NowMs() - start;
+		checks.Check(written, "the bake is written");
+
+		std::vector<std::uint8_t> bytes;
+		bool read = d3dUtil::ReadFileBytes(filename, bytes);
+		_wremove(filename.c_str());
+
+		size_t expected = sizeof(std::uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDXT10) + DataSize(size, settings);
+		checks.Check(read && bytes.size() == expected, "the file holds the headers and every face and mip");
+		if(!read || bytes.size() < sizeof(std::uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDXT10))
+			continue;
+
+		const DDSHeader* header = (const DDSHeader*)&bytes[4];
+		const DDSHeaderDXT10* header10 = (const DDSHeaderDXT10*)&bytes[4 + sizeof(DDSHeader)];
+		checks.Check(*(const std::uint32_t*)&bytes[0] == DDSMagic, "the file starts with the DDS magic");
+		checks.Check(header->Width == size && header->Height == size, "the header holds the face size");
+		checks.Check(header->MipMapCount == 9, "a 256 face has 9 mips");
+		checks.Check((header->Caps2 & DDSCaps2CubeMapAllFaces) == DDSCaps2CubeMapAllFaces, "the header marks all six faces");
+		checks.Check(header10->MiscFlag == ResourceMiscTextureCube && header10->ArraySize == 1, "the DX10 header marks one cube");
+		checks.Check(header10->DxgiFormat == (settings.Compress ? (std::uint32_t)DXGI_FORMAT_BC1_UNORM : (std::uint32_t)DXGI_FORMAT_R8G8B8A8_UNORM),
+			"the DX10 header holds the format");
+
+		checks.Note("  %s bake: %zu bytes, written in %.1f ms\n",
+			settings.Compress ? "BC1" : "R8G8B8A8", bytes.size(), ms);
+	}
+
+	//
+	// The cache key.
+	//
+	{
+		CubeBakeSettings settings;
+		XMFLOAT3 center(0.0f, 3.0f, 0.0f);
+		XMFLOAT3 moved(0.0f, 3.5f, 0.0f);
+		std::wstring path = CachePath(L"BakedCubeMaps", 1234, center, settings);
+		checks.Check(path == CachePath(L"BakedCubeMaps", 1234, center, settings), "the same scene and center give the same bake");
+		checks.Check(path != CachePath(L"BakedCubeMaps", 1235, center, settings), "a scene change gives a new bake");
+		checks.Check(path != CachePath(L"BakedCubeMaps", 1234, moved, settings), "a new center gives a new bake");
+
+		CubeBakeSettings larger = settings;
+		larger.Size *= 2;
+		checks.Check(path != CachePath(L"BakedCubeMaps", 1234, center, larger), "a new face size gives a new bake");
+	}
+
+	return checks.Finish("Cube map bake");
+}
@@ -0,0 +1,53 @@
+//***************************************************************************************
+// CubeMapBake.h
+//
+// Writes the six faces of a captured cube map to a cube DDS file that
+// CreateDDSTextureFromFile12 loads like any other cube map, optionally with a box
+// filtered mip chain and BC1 compressed.  Bakes are cached under a name hashed from
+// the scene content and the capture position.  No D3D dependencies.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+struct CubeBakeSettings
+{
+	// Face size the bake is captured at, a power of two.  The live cube map is held
+	// at this size while it is captured, whatever the resolution policy picks.
+	UINT Size = 512;
+
+	bool GenerateMips = true;
+
+	// BC1 (4 bits per texel) instead of R8G8B8A8_UNORM.  Alpha is dropped.
+	bool Compress = true;
+};
+
+class CubeMapBake
+{
+public:
+	// Path of the bake of the scene hashed to sceneHash seen from centerW.  The
+	// hash must cover everything the bake shows: content, placement and materials.
+	static std::wstring CachePath(const std::wstring& directory, std::uint64_t sceneHash,
+		const DirectX::XMFLOAT3& centerW, const CubeBakeSettings& settings);
+
+	// faces[i] holds face i as size*size tightly packed R8G8B8A8 texels; size must be
+	// a power of two.  Creates the file's directory if needed.  Returns false if the
+	// file cannot be written.
+	static bool WriteCubeDDS(const std::wstring& filename, const std::vector<std::uint8_t> faces[6],
+		UINT size, const CubeBakeSettings& settings);
+
+	// The two halves of WriteCubeDDS, so the faces can be encoded in parallel:
+	// EncodeFace fills data with the mip chain of one face as the file stores it,
+	// and WriteEncodedCubeDDS writes the six of them.
+	static void EncodeFace(const std::vector<std::uint8_t>& face, UINT size,
+		const CubeBakeSettings& settings, std::vector<std::uint8_t>& data);
+	static bool WriteEncodedCubeDDS(const std::wstring& filename, const std::vector<std::uint8_t> data[6],
+		UINT size, const CubeBakeSettings& settings);
+
+	// Bytes of texel data a bake of the given size holds, over all faces and mips.
+	static size_t DataSize(UINT size, const CubeBakeSettings& settings);
+
+	// Compresses, writes and reads back synthetic faces and returns a report.
+	static bool RunSelfCheck(std::string& report);
+};
@@ -0,0 +1,224 @@
+#include "CubeMapPass.h"
+#include "../../Common/SelfCheck.h"
+
+UINT CubePassCommandCounts::Total()const
+{
+	return RenderTargetClears + DepthClears + RenderTargetBinds + ConstantBinds + PipelineChanges + Draws;
+}
+
+void CubePassCommandCounter::ClearRenderTarget(int face)
+{
+	++mCounts.RenderTargetClears;
+}
+
+void CubePassCommandCounter::ClearDepth(int face)
+{
+	++mCounts.DepthClears;
+}
+
+void CubePassCommandCounter::SetRenderTarget(int face)
+{
+	++mCounts.RenderTargetBinds;
+}
+
+void CubePassCommandCounter::SetPassConstants(int face)
+{
+	++mCounts.ConstantBinds;
+}
+
+void CubePassCommandCounter::SetFaceConstants()
+{
+	++mCounts.ConstantBinds;
+}
+
+void CubePassCommandCounter::SetPipeline(int layer)
+{
+	++mCounts.PipelineChanges;
+}
+
+void CubePassCommandCounter::DrawItem(int item, UINT instanceCount, UINT faceList)
+{
+	++mCounts.Draws;
+	mCounts.Instances += instanceCount;
+
+	UINT seen = 0;
+	for(UINT n = 0; n < instanceCount; ++n)
+	{
+		UINT face = (faceList >> (3*n)) & 7;
+		if(face >= 6 || (seen & (1u << face)))
+		{
+			++mCounts.BadFaceLists;
+			return;
+		}
+		seen |= 1u << face;
+	}
+}
+
+UINT CubeMapPass::PackFaces(UINT faceMask)
+{
+	UINT faceList = 0;
+	UINT shift = 0;
+	for(UINT face = 0; face < 6; ++face)
+	{
+		if(faceMask & (1u << face))
+		{
+			faceList |= face << shift;
+			shift += 3;
+		}
+	}
+	return faceList;
+}
+
+UINT CubeMapPass::FaceCount(UINT faceMask)
+{
+	UINT count = 0;
+	for(; faceMask != 0; faceMask &= faceMask - 1)
+		++count;
+	return count;
+}
+
+void CubeMapPass::Record(CubePassMode mode, const int faces[], int faceCount,
+	const std::vector<CubePassItem>& items, CubePassCommandList& cmdList)
+{
+	if(faceCount == 0)
+		return;
+
+	if(mode == CubePassMode::PerFace)
+	{
+		for(int f = 0; f < faceCount; ++f)
+		{
+			const int face = faces[f];
+
+			cmdList.ClearRenderTarget(face);
+			cmdList.ClearDepth(face);
+			cmdList.SetRenderTarget(face);
+			cmdList.SetPassConstants(face);
+
+			int layer = -1;
+			for(size_t i = 0; i < items.size(); ++i)
+			{
+				if((items[i].FaceMask & (1u << face)) == 0)
+					continue;
+
+				if(items[i].Layer != layer)
+				{
+					layer = items[i].Layer;
+					cmdList.SetPipeline(layer);
+				}
+
+				cmdList.DrawItem((int)i, 1, (UINT)face);
+			}
+		}
+		return;
+	}
+
+	// Only the scheduled slices are cleared so the others keep their contents.
+	// Depth is scratch, so the whole array is cleared at once.
+	UINT scheduled = 0;
+	for(int f = 0; f < faceCount; ++f)
+	{
+		scheduled |= 1u << faces[f];
+		cmdList.ClearRenderTarget(faces[f]);
+	}
+
+	cmdList.ClearDepth(AllCubeFaces);
+	cmdList.SetRenderTarget(AllCubeFaces);
+	cmdList.SetPassConstants(faces[0]);
+	cmdList.SetFaceConstants();
+
+	int layer = -1;
+	for(size_t i = 0; i < items.size(); ++i)
+	{
+		UINT faceMask = items[i].FaceMask & scheduled;
+		if(faceMask == 0)
+			continue;
+
+		if(items[i].Layer != layer)
+		{
+			layer = items[i].Layer;
+			cmdList.SetPipeline(layer);
+		}
+
+		cmdList.DrawItem((int)i, FaceCount(faceMask), PackFaces(faceMask));
+	}
+}
+
+bool CubeMapPass::ValidateCommandCounts(std::string& report)
+{
+	// A scene like the app's: opaque items seen by a few faces each, then the sky
+	// seen by all of them.  A few items are seen by no face at all.
+	std::vector<CubePassItem> items(41);
+	for(size_t i = 0; i < items.size(); ++i)
+	{
+		items[i].Layer = 0;
+		items[i].FaceMask = (UINT)(i*37 + 5) % 64;
+	}
+	items.back().Layer = 1;
+	items.back().FaceMask = 0x3f;
+
+	const int allFaces[] = { 0, 1, 2, 3, 4, 5 };
+	const int threeFaces[] = { 4, 0, 2 };
+	const int oneFace[] = { 5 };
+
+	struct Case
+	{
+		const int* Faces;
+		int FaceCount;
+	};
+	const Case cases[] =
+	{
+		{ allFaces, 6 },
+		{ threeFaces, 3 },
+		{ oneFace, 1 }
+	};
+
+	SelfCheck checks(report);
+
+	for(const Case& c : cases)
+	{
+		char faceCase[32];
+		sprintf_s(faceCase, "%d faces", c.FaceCount);
+
+		UINT scheduled = 0;
+		UINT perFaceDraws = 0;
+		for(int f = 0; f < c.FaceCount; ++f)
+		{
+			scheduled |= 1u << c.Faces[f];
+			for(const CubePassItem& item : items)
+				perFaceDraws += (item.FaceMask >> c.Faces[f]) & 1;
+		}
+
+		UINT visibleItems = 0;
+		for(const CubePassItem& item : items)
+			visibleItems += (item.FaceMask & scheduled) != 0;
+
+		const UINT n = (UINT)c.FaceCount;
+
+		CubePassCommandCounter perFace;
+		Record(CubePassMode::PerFace, c.Faces, c.FaceCount, items, perFace);
+		const CubePassCommandCounts& p = perFace.Counts();
+
+		checks.Check(p.RenderTargetClears == n && p.DepthClears == n, "per face: one clear of each kind per face", faceCase);
+		checks.Check(p.RenderTargetBinds == n && p.ConstantBinds == n, "per face: one target and constant bind per face", faceCase);
+		checks.Check(p.PipelineChanges == 2*n, "per face: two pipelines per face", faceCase);
+		checks.Check(p.Draws == perFaceDraws && p.Instances == perFaceDraws, "per face: one draw per item per face that sees it", faceCase);
+		checks.Check(p.BadFaceLists == 0, "per face: bad face list", faceCase);
+
+		CubePassCommandCounter singlePass;
+		Record(CubePassMode::SinglePass, c.Faces, c.FaceCount, items, singlePass);
+		const CubePassCommandCounts& s = singlePass.Counts();
+
+		checks.Check(s.RenderTargetClears == n && s.DepthClears == 1, "single pass: a clear per face and one depth clear", faceCase);
+		checks.Check(s.RenderTargetBinds == 1 && s.ConstantBinds == 2, "single pass: one target bind and two constant binds", faceCase);
+		checks.Check(s.PipelineChanges == 2, "single pass: two pipelines", faceCase);
+		checks.Check(s.Draws == visibleItems, "single pass: one draw per item seen by any face", faceCase);
+		checks.Check(s.Instances == perFaceDraws, "single pass: one instance per face that sees the item", faceCase);
+		checks.Check(s.BadFaceLists == 0, "single pass: bad face list", faceCase);
+		checks.Check(n == 1 || s.Total() < p.Total(), "single pass records fewer commands", faceCase);
+
+		checks.Note("  %d faces: per face %u commands (%u draws), single pass %u commands (%u draws, %u instances)\n",
+			c.FaceCount, p.Total(), p.Draws, s.Total(), s.Draws, s.Instances);
+	}
+
+	return checks.Finish("Cube pass command counts");
+}
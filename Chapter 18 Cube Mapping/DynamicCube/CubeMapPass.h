@@ -0,0 +1,107 @@
+//***************************************************************************************
+// CubeMapPass.h
+//
+// Records the commands that draw the scene into the dynamic cube map, either as one
+// pass per face or as a single pass over the cube bound as a 6 slice render target
+// array, where each draw is instanced across the faces that can see the item.  The
+// commands go through CubePassCommandList: the app forwards them to its D3D12
+// command list, and CubePassCommandCounter counts them without a device.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+enum class CubePassMode
+{
+	PerFace,
+	SinglePass
+};
+
+// Stands for the whole render target array where a face is expected.
+const int AllCubeFaces = -1;
+
+struct CubePassItem
+{
+	// Items are drawn in order; the pipeline is changed when the layer changes.
+	int Layer = 0;
+
+	// Bit i is set when cube face i can see the item.
+	UINT FaceMask = 0x3f;
+};
+
+class CubePassCommandList
+{
+public:
+	virtual ~CubePassCommandList() = default;
+
+	virtual void ClearRenderTarget(int face) = 0;
+	virtual void ClearDepth(int face) = 0;
+	virtual void SetRenderTarget(int face) = 0;
+
+	// Pass constants of one face.  The single pass binds those of its first face
+	// for the lighting and eye position all faces share.
+	virtual void SetPassConstants(int face) = 0;
+
+	// View-projection matrices of all faces, read by the single pass shaders.
+	virtual void SetFaceConstants() = 0;
+
+	virtual void SetPipeline(int layer) = 0;
+
+	// Draws item instanceCount times; instance n goes to face (faceList >> 3n) & 7.
+	virtual void DrawItem(int item, UINT instanceCount, UINT faceList) = 0;
+};
+
+struct CubePassCommandCounts
+{
+	UINT RenderTargetClears = 0;
+	UINT DepthClears = 0;
+	UINT RenderTargetBinds = 0;
+	UINT ConstantBinds = 0;
+	UINT PipelineChanges = 0;
+	UINT Draws = 0;
+	UINT Instances = 0;
+
+	// Draws whose face list names a face twice or a face that does not exist.
+	UINT BadFaceLists = 0;
+
+	// Commands recorded, counting a draw as one command.
+	UINT Total()const;
+};
+
+// Stand-in command list that counts what would have been recorded.
+class CubePassCommandCounter : public CubePassCommandList
+{
+public:
+	virtual void ClearRenderTarget(int face)override;
+	virtual void ClearDepth(int face)override;
+	virtual void SetRenderTarget(int face)override;
+	virtual void SetPassConstants(int face)override;
+	virtual void SetFaceConstants()override;
+	virtual void SetPipeline(int layer)override;
+	virtual void DrawItem(int item, UINT instanceCount, UINT faceList)override;
+
+	const CubePassCommandCounts& Counts()const { return mCounts; }
+	void Reset() { mCounts = CubePassCommandCounts(); }
+
+private:
+	CubePassCommandCounts mCounts;
+};
+
+class CubeMapPass
+{
+public:
+	// Faces set in faceMask, lowest first, three bits each.
+	static UINT PackFaces(UINT faceMask);
+	static UINT FaceCount(UINT faceMask);
+
+	// Records the cube map pass for the faces scheduled this frame.  Faces that
+	// are not scheduled keep what they were last rendered with.
+	static void Record(CubePassMode mode, const int faces[], int faceCount,
+		const std::vector<CubePassItem>& items, CubePassCommandList& cmdList);
+
+	// Records made up scenes in both modes into a CubePassCommandCounter and
+	// checks the counts against what each mode should issue.  Returns false and
+	// says why in report if any check fails.
+	static bool ValidateCommandCounts(std::string& report);
+};
@@ -0,0 +1,68 @@
+#include "CubeMapReadback.h"
+
+CubeMapReadback::CubeMapReadback(ID3D12Device* device)
+{
+	md3dDevice = device;
+}
+
+void CubeMapReadback::RecordCopy(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* cubeMap)
+{
+	D3D12_RESOURCE_DESC desc = cubeMap->GetDesc();
+	mSize = (UINT)desc.Width;
+	mFormat = desc.Format;
+
+	// The faces one after another, each placed where a copy may write it.
+	UINT64 offset = 0;
+	for(int face = 0; face < 6; ++face)
+	{
+		UINT subresource = D3D12CalcSubresource(0, face, 0, desc.MipLevels, desc.DepthOrArraySize);
+
+		UINT64 bytes = 0;
+		md3dDevice->GetCopyableFootprints(&desc, subresource, 1, offset, &mFootprints[face], nullptr, nullptr, &bytes);
+		offset = mFootprints[face].Offset + bytes;
+		offset = (offset + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~(UINT64)(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+	}
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(offset),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mReadbackBuffer)));
+
+	for(int face = 0; face < 6; ++face)
+	{
+		UINT subresource = D3D12CalcSubresource(0, face, 0, desc.MipLevels, desc.DepthOrArraySize);
+
+		CD3DX12_TEXTURE_COPY_LOCATION dst(mReadbackBuffer.Get(), mFootprints[face]);
+		CD3DX12_TEXTURE_COPY_LOCATION src(cubeMap, subresource);
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+}
+
+void CubeMapReadback::ReadFaces(std::vector<std::uint8_t> faces[6])
+{
+	// The cube maps are 32 bits per texel.
+	UINT rowBytes = mSize * 4;
+
+	std::uint8_t* mapped = nullptr;
+	ThrowIfFailed(mReadbackBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mapped)));
+
+	// Rows in the buffer are padded to the copy pitch alignment.
+	for(int face = 0; face < 6; ++face)
+	{
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = mFootprints[face];
+
+		faces[face].resize((size_t)rowBytes * mSize);
+		for(UINT y = 0; y < mSize; ++y)
+		{
+			memcpy(&faces[face][(size_t)y * rowBytes],
+				mapped + footprint.Offset + (UINT64)y * footprint.Footprint.RowPitch, rowBytes);
+		}
+	}
+
+	D3D12_RANGE written = { 0, 0 };
+	mReadbackBuffer->Unmap(0, &written);
+	mReadbackBuffer = nullptr;
+}
@@ -0,0 +1,39 @@
+//***************************************************************************************
+// CubeMapReadback.h
+//
+// Copies the top mip of the six faces of a cube map into a readback buffer, so they
+// can be read on the CPU once the copy has executed.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+class CubeMapReadback
+{
+public:
+	CubeMapReadback(ID3D12Device* device);
+
+	CubeMapReadback(const CubeMapReadback& rhs)=delete;
+	CubeMapReadback& operator=(const CubeMapReadback& rhs)=delete;
+
+	// Records the copies.  cubeMap must be in a state copies can read from, such as
+	// GENERIC_READ.
+	void RecordCopy(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* cubeMap);
+
+	// Once the commands of RecordCopy have executed: fills faces[i] with face i,
+	// size*size tightly packed 32 bit texels, and frees the readback buffer.
+	void ReadFaces(std::vector<std::uint8_t> faces[6]);
+
+	UINT Size()const { return mSize; }
+	DXGI_FORMAT Format()const { return mFormat; }
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mSize = 0;
+	DXGI_FORMAT mFormat = DXGI_FORMAT_UNKNOWN;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT mFootprints[6];
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadbackBuffer = nullptr;
+};
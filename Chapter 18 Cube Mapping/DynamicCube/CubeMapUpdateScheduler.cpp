@@ -0,0 +1,163 @@
+#include "CubeMapUpdateScheduler.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Faces hidden from view still come round, just less often.
+	const float MinFaceWeight = 0.05f;
+
+	int FaceFromDirection(const XMFLOAT3& d)
+	{
+		float ax = fabsf(d.x), ay = fabsf(d.y), az = fabsf(d.z);
+		if(ax >= ay && ax >= az)
+			return d.x >= 0.0f ? 0 : 1;
+		if(ay >= az)
+			return d.y >= 0.0f ? 2 : 3;
+		return d.z >= 0.0f ? 4 : 5;
+	}
+}
+
+void CubeMapUpdateScheduler::SetFacesPerFrame(int count)
+{
+	mFacesPerFrame = MathHelper::Clamp(count, 1, 6);
+}
+
+void CubeMapUpdateScheduler::Invalidate()
+{
+	for(CubeFaceState& face : mFaces)
+		face.Valid = false;
+}
+
+void CubeMapUpdateScheduler::InvalidateFaces(UINT faceMask)
+{
+	for(int i = 0; i < 6; ++i)
+	{
+		if(faceMask & (1u << i))
+			mFaces[i].Dirty = true;
+	}
+}
+
+int CubeMapUpdateScheduler::BeginFrame(const float faceWeights[6], int faces[6])
+{
+	++mFrame;
+
+	int count = 0;
+	bool taken[6] = {};
+
+	// Faces with nothing in them are drawn whatever the budget.
+	for(int i = 0; i < 6; ++i)
+	{
+		if(!mFaces[i].Valid)
+		{
+			faces[count++] = i;
+			taken[i] = true;
+		}
+	}
+
+	int budget = mFacesPerFrame - count;
+
+	if(mSchedule == CubeFaceSchedule::RoundRobin ||
+		(mSchedule == CubeFaceSchedule::VisibleFirst && faceWeights == nullptr))
+	{
+		for(int n = 0; n < 6 && budget > 0; ++n)
+		{
+			int face = mNextFace;
+			mNextFace = (mNextFace + 1) % 6;
+			if(taken[face])
+				continue;
+
+			faces[count++] = face;
+			taken[face] = true;
+			--budget;
+		}
+	}
+	else
+	{
+		// The face that is most visible and has waited longest goes first.  On
+		// change, faces that see nothing new are not candidates at all.
+		bool changedOnly = mSchedule == CubeFaceSchedule::OnChange;
+		for(; budget > 0; --budget)
+		{
+			int best = -1;
+			float bestScore = -1.0f;
+			for(int i = 0; i < 6; ++i)
+			{
+				if(taken[i] || (changedOnly && !mFaces[i].Dirty))
+					continue;
+
+				float weight = faceWeights != nullptr ? faceWeights[i] : 0.0f;
+				float age = (float)(mFrame - mFaces[i].LastUpdateFrame);
+				float score = (weight + MinFaceWeight) * age;
+				if(score > bestScore)
+				{
+					best = i;
+					bestScore = score;
+				}
+			}
+
+			if(best < 0)
+				break;
+
+			faces[count++] = best;
+			taken[best] = true;
+		}
+	}
+
+	mFacesSkipped += 6 - count;
+	return count;
+}
+
+void CubeMapUpdateScheduler::FaceRendered(int face, const XMFLOAT3& capturePosW)
+{
+	mFaces[face].CapturePosW = capturePosW;
+	mFaces[face].LastUpdateFrame = mFrame;
+	mFaces[face].Valid = true;
+	mFaces[face].Dirty = false;
+	++mFacesRendered;
+}
+
+void CubeMapUpdateScheduler::SphereFaceWeights(const XMFLOAT3& eyePosW, const XMFLOAT3& centerW, float weights[6])
+{
+	// Normals spread evenly over the sphere (a Fibonacci lattice).
+	static const int SampleCount = 256;
+	static const std::vector<XMFLOAT3> normals = []()
+	{
+		std::vector<XMFLOAT3> n(SampleCount);
+		const float goldenAngle = MathHelper::Pi * (3.0f - sqrtf(5.0f));
+		for(int i = 0; i < SampleCount; ++i)
+		{
+			float y = 1.0f - 2.0f * (i + 0.5f) / SampleCount;
+			float r = sqrtf(1.0f - y*y);
+			n[i] = XMFLOAT3(r*cosf(goldenAngle*i), y, r*sinf(goldenAngle*i));
+		}
+		return n;
+	}();
+
+	for(int i = 0; i < 6; ++i)
+		weights[i] = 0.0f;
+
+	XMVECTOR v = XMVector3Normalize(XMLoadFloat3(&centerW) - XMLoadFloat3(&eyePosW));
+
+	// Every visible point of the sphere shows the cube face its reflection
+	// vector points into, weighted by the screen area it covers.
+	float total = 0.0f;
+	for(const XMFLOAT3& normal : normals)
+	{
+		XMVECTOR n = XMLoadFloat3(&normal);
+		float cosTheta = -XMVectorGetX(XMVector3Dot(n, v));
+		if(cosTheta <= 0.0f)
+			continue;
+
+		XMFLOAT3 r;
+		XMStoreFloat3(&r, XMVector3Reflect(v, n));
+		weights[FaceFromDirection(r)] += cosTheta;
+		total += cosTheta;
+	}
+
+	if(total > 0.0f)
+	{
+		for(int i = 0; i < 6; ++i)
+			weights[i] /= total;
+	}
+}
@@ -0,0 +1,83 @@
+//***************************************************************************************
+// CubeMapUpdateScheduler.h
+//
+// Decides which faces of a dynamic cube map are re-rendered each frame.  Faces are
+// refreshed round robin, or by how much of the reflector's image they cover and
+// how long ago they were drawn, or only once something they see has changed.  Each
+// face remembers where it was captured from.  No D3D dependencies.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+enum class CubeFaceSchedule
+{
+	RoundRobin,
+	VisibleFirst,
+
+	// Like VisibleFirst, but only faces marked by InvalidateFaces() are redrawn.
+	OnChange
+};
+
+struct CubeFaceState
+{
+	// Cube camera position when the face was last rendered.
+	DirectX::XMFLOAT3 CapturePosW = { 0.0f, 0.0f, 0.0f };
+	UINT64 LastUpdateFrame = 0;
+
+	// False until the face has been rendered, and again after Invalidate().
+	bool Valid = false;
+
+	// Set by InvalidateFaces() when something the face sees has changed.
+	bool Dirty = false;
+};
+
+class CubeMapUpdateScheduler
+{
+public:
+	// Faces refreshed per frame, 1 to 6.
+	void SetFacesPerFrame(int count);
+	int FacesPerFrame()const { return mFacesPerFrame; }
+
+	void SetSchedule(CubeFaceSchedule schedule) { mSchedule = schedule; }
+	CubeFaceSchedule Schedule()const { return mSchedule; }
+
+	// Marks every face as needing a redraw, e.g. after the cube map is resized.
+	// Invalid faces are drawn on the next frame regardless of the budget.
+	void Invalidate();
+
+	// Marks the faces in faceMask (bit i for face i) as out of date.  Unlike
+	// Invalidate() they still wait for the per frame budget.
+	void InvalidateFaces(UINT faceMask);
+
+	// Starts a frame and writes the faces to render into faces; returns how many.
+	// faceWeights[i] is face i's share of the reflector's image and is only read
+	// by the VisibleFirst schedule (it may be null otherwise).
+	int BeginFrame(const float faceWeights[6], int faces[6]);
+
+	// Call for every face returned by BeginFrame once it has been recorded.
+	void FaceRendered(int face, const DirectX::XMFLOAT3& capturePosW);
+
+	const CubeFaceState& Face(int face)const { return mFaces[face]; }
+
+	UINT64 Frames()const { return mFrame; }
+	UINT64 FacesRendered()const { return mFacesRendered; }
+
+	// Faces left as they were, summed over every frame.
+	UINT64 FacesSkipped()const { return mFacesSkipped; }
+
+	// Share of a mirrored sphere's visible image that reflects each cube face, as
+	// seen from eyePosW.  The weights add up to 1.
+	static void SphereFaceWeights(const DirectX::XMFLOAT3& eyePosW, const DirectX::XMFLOAT3& centerW, float weights[6]);
+
+private:
+	CubeFaceState mFaces[6];
+	CubeFaceSchedule mSchedule = CubeFaceSchedule::RoundRobin;
+	int mFacesPerFrame = 6;
+	int mNextFace = 0;
+
+	UINT64 mFrame = 0;
+	UINT64 mFacesRendered = 0;
+	UINT64 mFacesSkipped = 0;
+};
@@ -35,6 +35,21 @@ CD3DX12_CPU_DESCRIPTOR_HANDLE CubeRenderTarget::Rtv(int faceIndex)
 	return mhCpuRtv[faceIndex];
 }
 
+CD3DX12_CPU_DESCRIPTOR_HANDLE CubeRenderTarget::ArrayRtv()
+{
+	return mhCpuArrayRtv;
+}
+
+UINT CubeRenderTarget::Width()const
+{
+	return mWidth;
+}
+
+UINT CubeRenderTarget::Height()const
+{
+	return mHeight;
+}
+
 D3D12_VIEWPORT CubeRenderTarget::Viewport()const
 {
 	return mViewport;
@@ -47,7 +62,8 @@ D3D12_RECT CubeRenderTarget::ScissorRect()const
 
 void CubeRenderTarget::BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 	                                CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
-	                                CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv[6])
+	                                CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv[6],
+	                                CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuArrayRtv)
 {
 	// Save references to the descriptors. 
 	mhCpuSrv = hCpuSrv;
@@ -56,6 +72,8 @@ void CubeRenderTarget::BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 	for(int i = 0; i < 6; ++i)
 		mhCpuRtv[i] = hCpuRtv[i];
 
+	mhCpuArrayRtv = hCpuArrayRtv;
+
 	//  Create the descriptors
 	BuildDescriptors();
 }
@@ -67,6 +85,9 @@ void CubeRenderTarget::OnResize(UINT newWidth, UINT newHeight)
 		mWidth = newWidth;
 		mHeight = newHeight;
 
+		mViewport = { 0.0f, 0.0f, (float)newWidth, (float)newHeight, 0.0f, 1.0f };
+		mScissorRect = { 0, 0, (int)newWidth, (int)newHeight };
+
 		BuildResource();
 
 		// New resource, so we need new descriptors to that resource.
@@ -105,6 +126,16 @@ void CubeRenderTarget::BuildDescriptors()
 		// Create RTV to ith cubemap face.
 		md3dDevice->CreateRenderTargetView(mCubeMap.Get(), &rtvDesc, mhCpuRtv[i]);
 	}
+
+	// Create RTV to all six faces; SV_RenderTargetArrayIndex picks the face.
+	D3D12_RENDER_TARGET_VIEW_DESC arrayRtvDesc;
+	arrayRtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+	arrayRtvDesc.Format = mFormat;
+	arrayRtvDesc.Texture2DArray.MipSlice = 0;
+	arrayRtvDesc.Texture2DArray.PlaneSlice = 0;
+	arrayRtvDesc.Texture2DArray.FirstArraySlice = 0;
+	arrayRtvDesc.Texture2DArray.ArraySize = 6;
+	md3dDevice->CreateRenderTargetView(mCubeMap.Get(), &arrayRtvDesc, mhCpuArrayRtv);
 }
 
 void CubeRenderTarget::BuildResource()
@@ -136,4 +167,6 @@ void CubeRenderTarget::BuildResource()
 		D3D12_RESOURCE_STATE_GENERIC_READ,
 		nullptr,
 		IID_PPV_ARGS(&mCubeMap)));
+
+	MemoryStats::Track(MemoryCategory::RenderTarget, mCubeMap.Get());
 }
\ No newline at end of file
@@ -31,13 +31,20 @@ public:
 	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv();
 	CD3DX12_CPU_DESCRIPTOR_HANDLE Rtv(int faceIndex);
 
+	// All six faces as a render target array, for drawing every face in one pass.
+	CD3DX12_CPU_DESCRIPTOR_HANDLE ArrayRtv();
+
+	UINT Width()const;
+	UINT Height()const;
+
 	D3D12_VIEWPORT Viewport()const;
 	D3D12_RECT ScissorRect()const;
 
 	void BuildDescriptors(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
-		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv[6]);
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv[6],
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuArrayRtv);
 
 	void OnResize(UINT newWidth, UINT newHeight);
 
@@ -59,6 +66,7 @@ private:
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuRtv[6];
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuArrayRtv;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> mCubeMap = nullptr;
 };
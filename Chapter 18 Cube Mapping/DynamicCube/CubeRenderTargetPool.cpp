@@ -0,0 +1,164 @@
+#include "CubeRenderTargetPool.h"
+
+CubeRenderTargetPool::CubeRenderTargetPool(ID3D12Device* device, DXGI_FORMAT format, DXGI_FORMAT depthFormat,
+	UINT minSize, UINT maxSize)
+{
+	md3dDevice = device;
+	mFormat = format;
+	mDepthFormat = depthFormat;
+	mMinSize = minSize;
+
+	for(UINT size = minSize; size <= maxSize; size *= 2)
+		mTargets.push_back(nullptr);
+}
+
+void CubeRenderTargetPool::SetDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv[6],
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuArrayRtv,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuArrayDsv)
+{
+	mhCpuSrv = hCpuSrv;
+	mhGpuSrv = hGpuSrv;
+	for(int i = 0; i < 6; ++i)
+		mhCpuRtv[i] = hCpuRtv[i];
+	mhCpuArrayRtv = hCpuArrayRtv;
+	mhCpuDsv = hCpuDsv;
+	mhCpuArrayDsv = hCpuArrayDsv;
+}
+
+CubeRenderTarget* CubeRenderTargetPool::Acquire(UINT size)
+{
+	int level = 0;
+	while(level + 1 < (int)mTargets.size() && (mMinSize << (level + 1)) <= size)
+		++level;
+
+	const UINT levelSize = mMinSize << level;
+
+	if(mTargets[level] == nullptr)
+		mTargets[level] = std::make_unique<CubeRenderTarget>(md3dDevice, levelSize, levelSize, mFormat);
+
+	// Larger cube maps go, so the memory held follows the size in use.
+	for(size_t i = level + 1; i < mTargets.size(); ++i)
+		mTargets[i] = nullptr;
+
+	mCurrent = level;
+	mTargets[level]->BuildDescriptors(mhCpuSrv, mhGpuSrv, mhCpuRtv, mhCpuArrayRtv);
+
+	BuildDepthBuffer(levelSize);
+
+	return mTargets[level].get();
+}
+
+CubeRenderTarget* CubeRenderTargetPool::Current()
+{
+	return mCurrent >= 0 ? mTargets[mCurrent].get() : nullptr;
+}
+
+ID3D12Resource* CubeRenderTargetPool::DepthBuffer()
+{
+	return mDepthBuffer.Get();
+}
+
+UINT64 CubeRenderTargetPool::AllocationSize(ID3D12Resource* resource)const
+{
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	return md3dDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
+
+UINT64 CubeRenderTargetPool::ResidentBytes()const
+{
+	UINT64 bytes = 0;
+	for(const auto& target : mTargets)
+	{
+		if(target != nullptr)
+			bytes += AllocationSize(target->Resource());
+	}
+
+	if(mDepthBuffer != nullptr)
+		bytes += AllocationSize(mDepthBuffer.Get());
+
+	return bytes;
+}
+
+std::string CubeRenderTargetPool::Report()const
+{
+	char line[96];
+	std::string report = "Cube map pool:";
+
+	for(size_t i = 0; i < mTargets.size(); ++i)
+	{
+		if(mTargets[i] == nullptr)
+			continue;
+
+		sprintf_s(line, " %u%s %.0f KB,", mTargets[i]->Width(), (int)i == mCurrent ? " (current)" : "",
+			AllocationSize(mTargets[i]->Resource()) / 1024.0);
+		report += line;
+	}
+
+	if(mDepthBuffer != nullptr)
+	{
+		sprintf_s(line, " depth %u %.0f KB,", mDepthSize, AllocationSize(mDepthBuffer.Get()) / 1024.0);
+		report += line;
+	}
+
+	sprintf_s(line, " total %.0f KB", ResidentBytes() / 1024.0);
+	report += line;
+
+	return report;
+}
+
+void CubeRenderTargetPool::BuildDepthBuffer(UINT size)
+{
+	// The depth buffer always matches the largest resident cube map, which is the
+	// current one.
+	if(size == mDepthSize)
+		return;
+
+	D3D12_RESOURCE_DESC depthStencilDesc;
+	depthStencilDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	depthStencilDesc.Alignment = 0;
+	depthStencilDesc.Width = size;
+	depthStencilDesc.Height = size;
+	depthStencilDesc.DepthOrArraySize = 6;
+	depthStencilDesc.MipLevels = 1;
+	depthStencilDesc.Format = mDepthFormat;
+	depthStencilDesc.SampleDesc.Count = 1;
+	depthStencilDesc.SampleDesc.Quality = 0;
+	depthStencilDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	depthStencilDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = mDepthFormat;
+	optClear.DepthStencil.Depth = 1.0f;
+	optClear.DepthStencil.Stencil = 0;
+
+	// Created straight in the state it is used in, so no barrier has to be recorded.
+	mDepthBuffer = nullptr;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&depthStencilDesc,
+		D3D12_RESOURCE_STATE_DEPTH_WRITE,
+		&optClear,
+		IID_PPV_ARGS(mDepthBuffer.GetAddressOf())));
+	MemoryStats::Track(MemoryCategory::RenderTarget, mDepthBuffer.Get());
+
+	mDepthSize = size;
+
+	// One view of the first slice, shared by the faces when drawn one at a time,
+	// and one of every slice for the single pass.
+	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+	dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+	dsvDesc.Format = mDepthFormat;
+	dsvDesc.Texture2DArray.MipSlice = 0;
+	dsvDesc.Texture2DArray.FirstArraySlice = 0;
+	dsvDesc.Texture2DArray.ArraySize = 1;
+	md3dDevice->CreateDepthStencilView(mDepthBuffer.Get(), &dsvDesc, mhCpuDsv);
+
+	dsvDesc.Texture2DArray.ArraySize = 6;
+	md3dDevice->CreateDepthStencilView(mDepthBuffer.Get(), &dsvDesc, mhCpuArrayDsv);
+}
@@ -0,0 +1,68 @@
+//***************************************************************************************
+// CubeRenderTargetPool.h
+//
+// Dynamic cube maps at every power of two size between a minimum and a maximum,
+// sharing one depth buffer.  Acquiring a size makes its cube map current and points
+// the app's descriptors at it.  Sizes larger than the current one are released and
+// the depth buffer shrinks to match, so a small cube map also holds little memory;
+// smaller ones that already exist are kept, which costs at most a third more.
+//***************************************************************************************
+
+#pragma once
+
+#include "CubeRenderTarget.h"
+
+class CubeRenderTargetPool
+{
+public:
+	CubeRenderTargetPool(ID3D12Device* device, DXGI_FORMAT format, DXGI_FORMAT depthFormat,
+		UINT minSize, UINT maxSize);
+
+	CubeRenderTargetPool(const CubeRenderTargetPool& rhs)=delete;
+	CubeRenderTargetPool& operator=(const CubeRenderTargetPool& rhs)=delete;
+
+	// Descriptors the current cube map and the depth buffer are viewed through.
+	// dsv views the first depth slice and arrayDsv all six.
+	void SetDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv[6],
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuArrayRtv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuArrayDsv);
+
+	// Makes the cube map of the given size (rounded to a pool size) current and
+	// returns it.  The GPU must be done with the previous one.
+	CubeRenderTarget* Acquire(UINT size);
+
+	CubeRenderTarget* Current();
+	ID3D12Resource* DepthBuffer();
+
+	// Bytes of GPU memory held by the cube maps and the depth buffer.
+	UINT64 ResidentBytes()const;
+	std::string Report()const;
+
+private:
+	void BuildDepthBuffer(UINT size);
+	UINT64 AllocationSize(ID3D12Resource* resource)const;
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	DXGI_FORMAT mFormat;
+	DXGI_FORMAT mDepthFormat;
+	UINT mMinSize = 0;
+
+	// One entry per size, smallest first; null when not resident.
+	std::vector<std::unique_ptr<CubeRenderTarget>> mTargets;
+	int mCurrent = -1;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDepthBuffer;
+	UINT mDepthSize = 0;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuRtv[6];
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuArrayRtv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDsv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuArrayDsv;
+};
@@ -0,0 +1,150 @@
+#include "CubeResolutionPolicy.h"
+#include "../../Common/SelfCheck.h"
+
+void CubeResolutionPolicy::Reset(UINT size)
+{
+	mSize = size;
+	mIdealSize = 0.0f;
+	mScreenDiameter = 0.0f;
+	mFramesSinceChange = 0;
+	mChanges = 0;
+}
+
+float CubeResolutionPolicy::ScreenDiameter(float radius, float distance, float fovY, float viewportHeight)
+{
+	if(distance <= radius)
+		return viewportHeight;
+
+	// The sphere's silhouette subtends asin(r/d) either side of its center.
+	float sinHalfAngle = radius / distance;
+	float tanHalfAngle = sinHalfAngle / sqrtf(1.0f - sinHalfAngle*sinHalfAngle);
+
+	float diameter = viewportHeight * tanHalfAngle / tanf(0.5f*fovY);
+	return std::min<float>(diameter, viewportHeight);
+}
+
+UINT CubeResolutionPolicy::Update(const CubeResolutionInput& input)
+{
+	const CubeResolutionSettings& s = mSettings;
+
+	UINT maxSize = s.MaxSize;
+	if(input.Cap != 0)
+		maxSize = std::max<UINT>(std::min<UINT>(maxSize, input.Cap), s.MinSize);
+
+	mScreenDiameter = ScreenDiameter(input.Radius, input.Distance, input.FovY, input.ViewportHeight);
+	mIdealSize = input.Distance > s.FarDistance ? (float)s.MinSize : mScreenDiameter * s.TexelsPerPixel;
+
+	++mFramesSinceChange;
+
+	UINT size = mSize;
+
+	// A cap applies right away; it is what keeps the frame within budget.
+	if(size > maxSize)
+	{
+		size = maxSize;
+	}
+	else if(mFramesSinceChange >= s.CooldownFrames)
+	{
+		float ideal = log2f(std::max<float>(mIdealSize, 1.0f));
+		float current = log2f((float)mSize);
+
+		// Stay put unless the ideal size is clearly closer to another power of two.
+		if(fabsf(ideal - current) > 0.5f + s.Hysteresis)
+			size = 1u << (UINT)floorf(ideal + 0.5f);
+	}
+
+	size = MathHelper::Clamp(size, s.MinSize, maxSize);
+
+	if(size != mSize)
+	{
+		mSize = size;
+		mFramesSinceChange = 0;
+		++mChanges;
+	}
+
+	return mSize;
+}
+
+bool CubeResolutionPolicy::RunSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	// The app's mirrored globe: radius 0.9 seen through a 45 degree, 720 pixel view.
+	CubeResolutionInput input;
+	input.Radius = 0.9f;
+	input.FovY = 0.25f*MathHelper::Pi;
+	input.ViewportHeight = 720.0f;
+
+	auto settle = [&](CubeResolutionPolicy& policy, float distance)
+	{
+		input.Distance = distance;
+		for(int i = 0; i < 2*policy.Settings().CooldownFrames + 1; ++i)
+			policy.Update(input);
+		return policy.Size();
+	};
+
+	CubeResolutionPolicy policy;
+	policy.Reset(256);
+
+	// Only a very tall view asks for the largest size.
+	input.ViewportHeight = 2160.0f;
+	UINT largest = settle(policy, 1.5f);
+	checks.Check(largest == policy.Settings().MaxSize, "a reflector filling a 2160 pixel view gets the largest size");
+	input.ViewportHeight = 720.0f;
+
+	UINT nearSize = settle(policy, 1.5f);
+	UINT midSize = settle(policy, 7.0f);
+	UINT farSize = settle(policy, 20.0f);
+	UINT beyondSize = settle(policy, 500.0f);
+
+	checks.Check(midSize < nearSize && farSize < midSize, "the size falls with distance");
+	checks.Check(beyondSize == policy.Settings().MinSize, "a reflector past FarDistance gets the smallest size");
+
+	checks.Note("  2160 pixels at distance 1.5 -> %u; 720 pixels at 1.5 -> %u, 7 -> %u, 20 -> %u, 500 -> %u\n",
+		largest, nearSize, midSize, farSize, beyondSize);
+
+	// Walk away and back again: the size must not grow on the way out.
+	policy.Reset(policy.Settings().MaxSize);
+	UINT previous = policy.Size();
+	bool monotonic = true;
+	for(int i = 0; i <= 1000; ++i)
+	{
+		input.Distance = 1.5f + 0.2f*i;
+		UINT size = policy.Update(input);
+		monotonic &= size <= previous;
+		previous = size;
+	}
+	checks.Check(monotonic, "moving away never increases the size");
+
+	// Hover around the distance where the ideal size crosses a rounding point.
+	// With hysteresis the size may settle once but must not keep switching.
+	float crossing = 0.0f;
+	for(float d = 2.0f; d < 200.0f; d += 0.01f)
+	{
+		float ideal = ScreenDiameter(input.Radius, d, input.FovY, input.ViewportHeight) * policy.Settings().TexelsPerPixel;
+		if(log2f(ideal) < 7.5f)
+		{
+			crossing = d;
+			break;
+		}
+	}
+
+	policy.Reset(128);
+	for(int i = 0; i < 600; ++i)
+	{
+		input.Distance = crossing * (1.0f + 0.15f*sinf(0.37f*i));
+		policy.Update(input);
+	}
+	checks.Check(policy.Changes() <= 1, "no flip-flopping around a rounding point");
+
+	checks.Note("  hovering at distance %.2f: %u changes\n", crossing, policy.Changes());
+
+	// A budget cap wins immediately, even during the cooldown.
+	policy.Reset(policy.Settings().MaxSize);
+	input.Distance = 1.5f;
+	input.Cap = 128;
+	checks.Check(policy.Update(input) == 128, "a cap lowers the size on the same frame");
+	input.Cap = 0;
+
+	return checks.Finish("Cube resolution policy");
+}
@@ -0,0 +1,81 @@
+//***************************************************************************************
+// CubeResolutionPolicy.h
+//
+// Picks the edge length of a dynamic cube map from how large its reflector appears
+// on screen.  The ideal size is rounded to a power of two and only changes once it
+// is clearly past the rounding point and the last change is a while ago, so a
+// reflector hovering at a threshold does not make the cube map flip-flop.  No D3D
+// dependencies.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+struct CubeResolutionSettings
+{
+	UINT MinSize = 64;
+	UINT MaxSize = 1024;
+
+	// Cube face texels wanted per pixel of the reflector's diameter on screen.
+	// A mirrored sphere shows the whole environment, half of it in any direction.
+	float TexelsPerPixel = 0.5f;
+
+	// Reflectors further away than this always get MinSize.
+	float FarDistance = 200.0f;
+
+	// The size only switches once log2 of the ideal size is Hysteresis past the
+	// rounding point, and no sooner than CooldownFrames after the last switch.
+	float Hysteresis = 0.25f;
+	int CooldownFrames = 30;
+};
+
+struct CubeResolutionInput
+{
+	// Bounding sphere radius of the reflector and its distance from the eye.
+	float Radius = 1.0f;
+	float Distance = 10.0f;
+
+	// Vertical field of view (radians) and height in pixels of the main view.
+	float FovY = 0.25f*MathHelper::Pi;
+	float ViewportHeight = 600.0f;
+
+	// Largest size allowed this frame, e.g. by the frame time budget; 0 for none.
+	UINT Cap = 0;
+};
+
+class CubeResolutionPolicy
+{
+public:
+	void SetSettings(const CubeResolutionSettings& settings) { mSettings = settings; }
+	const CubeResolutionSettings& Settings()const { return mSettings; }
+
+	// Starts over at the given size.
+	void Reset(UINT size);
+
+	// Returns the cube map edge length to use this frame.
+	UINT Update(const CubeResolutionInput& input);
+
+	UINT Size()const { return mSize; }
+	float IdealSize()const { return mIdealSize; }
+	float ScreenDiameter()const { return mScreenDiameter; }
+	UINT Changes()const { return mChanges; }
+
+	// Diameter in pixels of a sphere seen from distance; the whole view height
+	// when the eye is inside it.
+	static float ScreenDiameter(float radius, float distance, float fovY, float viewportHeight);
+
+	// Drives the policy with synthetic camera paths and checks it settles on the
+	// expected sizes without flip-flopping.  Returns false and says why in report
+	// if any check fails.
+	static bool RunSelfCheck(std::string& report);
+
+private:
+	CubeResolutionSettings mSettings;
+
+	UINT mSize = 256;
+	float mIdealSize = 0.0f;
+	float mScreenDiameter = 0.0f;
+	int mFramesSinceChange = 0;
+	UINT mChanges = 0;
+};
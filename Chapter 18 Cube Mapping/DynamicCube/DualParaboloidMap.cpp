@@ -0,0 +1,135 @@
+#include "DualParaboloidMap.h"
+
+DualParaboloidMap::DualParaboloidMap(ID3D12Device* device, UINT size,
+	DXGI_FORMAT format, DXGI_FORMAT depthFormat)
+{
+	md3dDevice = device;
+
+	mSize = size;
+	mFormat = format;
+	mDepthFormat = depthFormat;
+
+	mViewport = { 0.0f, 0.0f, (float)size, (float)size, 0.0f, 1.0f };
+	mScissorRect = { 0, 0, (int)size, (int)size };
+
+	BuildResources();
+}
+
+ID3D12Resource* DualParaboloidMap::Resource()
+{
+	return mHemispheres.Get();
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE DualParaboloidMap::Srv()
+{
+	return mhGpuSrv;
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE DualParaboloidMap::Rtv(int hemisphere)
+{
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(mhCpuRtvStart, hemisphere, mRtvDescriptorSize);
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE DualParaboloidMap::Dsv()
+{
+	return mhCpuDsv;
+}
+
+UINT DualParaboloidMap::Size()const
+{
+	return mSize;
+}
+
+D3D12_VIEWPORT DualParaboloidMap::Viewport()const
+{
+	return mViewport;
+}
+
+D3D12_RECT DualParaboloidMap::ScissorRect()const
+{
+	return mScissorRect;
+}
+
+void DualParaboloidMap::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtvStart,
+	UINT rtvDescriptorSize,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv)
+{
+	mhGpuSrv = hGpuSrv;
+	mhCpuRtvStart = hCpuRtvStart;
+	mRtvDescriptorSize = rtvDescriptorSize;
+	mhCpuDsv = hCpuDsv;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = mFormat;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = 2;
+	srvDesc.Texture2DArray.PlaneSlice = 0;
+	srvDesc.Texture2DArray.ResourceMinLODClamp = 0.0f;
+	md3dDevice->CreateShaderResourceView(mHemispheres.Get(), &srvDesc, hCpuSrv);
+
+	for(int i = 0; i < 2; ++i)
+	{
+		D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
+		rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+		rtvDesc.Format = mFormat;
+		rtvDesc.Texture2DArray.MipSlice = 0;
+		rtvDesc.Texture2DArray.PlaneSlice = 0;
+		rtvDesc.Texture2DArray.FirstArraySlice = i;
+		rtvDesc.Texture2DArray.ArraySize = 1;
+		md3dDevice->CreateRenderTargetView(mHemispheres.Get(), &rtvDesc, Rtv(i));
+	}
+
+	md3dDevice->CreateDepthStencilView(mDepthBuffer.Get(), nullptr, mhCpuDsv);
+}
+
+void DualParaboloidMap::BuildResources()
+{
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = mSize;
+	texDesc.Height = mSize;
+	texDesc.DepthOrArraySize = 2;
+	texDesc.MipLevels = 1;
+	texDesc.Format = mFormat;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mHemispheres)));
+	MemoryStats::Track(MemoryCategory::RenderTarget, mHemispheres.Get());
+
+	D3D12_RESOURCE_DESC depthStencilDesc = texDesc;
+	depthStencilDesc.DepthOrArraySize = 1;
+	depthStencilDesc.Format = mDepthFormat;
+	depthStencilDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = mDepthFormat;
+	optClear.DepthStencil.Depth = 1.0f;
+	optClear.DepthStencil.Stencil = 0;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&depthStencilDesc,
+		D3D12_RESOURCE_STATE_DEPTH_WRITE,
+		&optClear,
+		IID_PPV_ARGS(&mDepthBuffer)));
+	MemoryStats::Track(MemoryCategory::RenderTarget, mDepthBuffer.Get());
+}
@@ -0,0 +1,60 @@
+//***************************************************************************************
+// DualParaboloidMap.h
+//
+// A cheaper environment map than a cube map: two hemispheres, each holding everything
+// on one side of the center projected onto a paraboloid, in a 2 slice texture array.
+// The hemispheres are drawn one after another and share a depth buffer.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+class DualParaboloidMap
+{
+public:
+	DualParaboloidMap(ID3D12Device* device, UINT size,
+		DXGI_FORMAT format, DXGI_FORMAT depthFormat);
+
+	DualParaboloidMap(const DualParaboloidMap& rhs)=delete;
+	DualParaboloidMap& operator=(const DualParaboloidMap& rhs)=delete;
+
+	ID3D12Resource* Resource();
+	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv();
+	CD3DX12_CPU_DESCRIPTOR_HANDLE Rtv(int hemisphere);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv();
+
+	UINT Size()const;
+
+	D3D12_VIEWPORT Viewport()const;
+	D3D12_RECT ScissorRect()const;
+
+	// hCpuRtvStart is the first of 2 consecutive RTVs, front hemisphere first.
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtvStart,
+		UINT rtvDescriptorSize,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv);
+
+private:
+	void BuildResources();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mSize = 0;
+	DXGI_FORMAT mFormat;
+	DXGI_FORMAT mDepthFormat;
+
+	D3D12_VIEWPORT mViewport;
+	D3D12_RECT mScissorRect;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuRtvStart;
+	UINT mRtvDescriptorSize = 0;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDsv;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mHemispheres = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDepthBuffer = nullptr;
+};
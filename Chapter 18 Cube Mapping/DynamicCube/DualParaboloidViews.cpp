@@ -0,0 +1,66 @@
+#include "DualParaboloidViews.h"
+
+using namespace DirectX;
+
+bool DualParaboloidViews::Update(const XMFLOAT3& center, float nearZ, float farZ, float targetSize)
+{
+	if(mVersion != 0 &&
+		center.x == mCenter.x && center.y == mCenter.y && center.z == mCenter.z &&
+		nearZ == mNearZ && farZ == mFarZ && targetSize == mTargetSize)
+	{
+		return false;
+	}
+
+	mCenter = center;
+	mNearZ = nearZ;
+	mFarZ = farZ;
+	mTargetSize = targetSize;
+
+	// The front view is a translation; the back one also turns half way around y,
+	// so view space x is mirrored and SampleParaboloid flips it back.
+	XMVECTOR pos = XMLoadFloat3(&center);
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMVECTOR looks[2] =
+	{
+		XMVectorSet(0.0f, 0.0f, +1.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f)
+	};
+
+	for(int i = 0; i < 2; ++i)
+	{
+		XMMATRIX view = XMMatrixLookToLH(pos, looks[i], up);
+		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+		// Nothing reads the projection; keep the matrices well defined anyway.
+		PassConstants& passCB = mPassCB[i];
+		XMStoreFloat4x4(&passCB.View, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&passCB.InvView, XMMatrixTranspose(invView));
+		XMStoreFloat4x4(&passCB.Proj, XMMatrixIdentity());
+		XMStoreFloat4x4(&passCB.InvProj, XMMatrixIdentity());
+		XMStoreFloat4x4(&passCB.ViewProj, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&passCB.InvViewProj, XMMatrixTranspose(invView));
+		passCB.EyePosW = center;
+		passCB.RenderTargetSize = XMFLOAT2(targetSize, targetSize);
+		passCB.InvRenderTargetSize = XMFLOAT2(1.0f / targetSize, 1.0f / targetSize);
+		passCB.NearZ = nearZ;
+		passCB.FarZ = farZ;
+	}
+
+	++mVersion;
+	return true;
+}
+
+UINT DualParaboloidViews::HemisphereMask(const BoundingBox& boundsW)const
+{
+	if(!boundsW.Intersects(BoundingSphere(mCenter, mFarZ)))
+		return 0;
+
+	// Each hemisphere is the half space in front of the plane z = center.z.
+	UINT mask = 0;
+	if(boundsW.Center.z + boundsW.Extents.z >= mCenter.z)
+		mask |= 1;
+	if(boundsW.Center.z - boundsW.Extents.z <= mCenter.z)
+		mask |= 2;
+
+	return mask;
+}
@@ -0,0 +1,45 @@
+//***************************************************************************************
+// DualParaboloidViews.h
+//
+// The per view constants of the two hemispheres of a dual-paraboloid map captured
+// from a point, and the test that culls items to the hemispheres they reach into.
+// Hemisphere 0 looks down +z and hemisphere 1 down -z; the vertex shader does the
+// paraboloid projection, so the passes carry views but no projection.  Like
+// CubeFaceViews, they are only rebuilt when a parameter changes.
+//***************************************************************************************
+
+#pragma once
+
+#include "FrameResource.h"
+
+class DualParaboloidViews
+{
+public:
+	static const UINT BothHemispheres = 0x3;
+
+	// Rebuilds both hemispheres if any parameter differs from the last call;
+	// returns true if it did.
+	bool Update(const DirectX::XMFLOAT3& center, float nearZ, float farZ, float targetSize);
+
+	// Transposed, ready to be copied to a constant buffer.
+	const PassConstants& PassCB(int hemisphere)const { return mPassCB[hemisphere]; }
+
+	const DirectX::XMFLOAT3& Center()const { return mCenter; }
+
+	// 0 until the first Update.
+	UINT Version()const { return mVersion; }
+
+	// Hemispheres boundsW reaches into, bit h for hemisphere h.  Boxes past the
+	// far distance are in neither.
+	UINT HemisphereMask(const DirectX::BoundingBox& boundsW)const;
+
+private:
+	DirectX::XMFLOAT3 mCenter = { 0.0f, 0.0f, 0.0f };
+	float mNearZ = 0.0f;
+	float mFarZ = 0.0f;
+	float mTargetSize = 0.0f;
+
+	PassConstants mPassCB[2];
+
+	UINT mVersion = 0;
+};
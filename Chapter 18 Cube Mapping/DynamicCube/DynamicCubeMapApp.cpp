@@ -7,8 +7,25 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/DynamicResolution.h"
+#include "../../Common/TaskGraph.h"
+#include "../../Common/SelfCheck.h"
+#include "../../Common/MultiViewCuller.h"
+#include "../../Common/TextureCache.h"
 #include "FrameResource.h"
-#include "CubeRenderTarget.h"
+#include "CubeRenderTargetPool.h"
+#include "CubeResolutionPolicy.h"
+#include "CubeMapUpdateScheduler.h"
+#include "CubeFaceDependencies.h"
+#include "CubeMapPass.h"
+#include "ReflectionProbes.h"
+#include "ProbeCubeArray.h"
+#include "CubeFaceViews.h"
+#include "DualParaboloidMap.h"
+#include "DualParaboloidViews.h"
+#include "CubeMapBake.h"
+#include "CubeMapReadback.h"
+#include <thread>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -19,7 +36,36 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
-const UINT CubeMapSize = 512;
+// Largest dynamic cube map size; the resolution controller may pick a smaller one.
+const UINT CubeMapSize = 1024;
+const UINT MinCubeMapSize = 64;
+
+// The main camera and the six cube map faces.
+const int gNumCullViews = 7;
+
+const UINT ReflectionProbeSize = 128;
+
+const UINT ParaboloidMapSize = 512;
+
+// Pass constants: 0 is the main pass, 1-6 the dynamic cube map faces, then six per
+// reflection probe and last the two dual-paraboloid hemispheres.
+int ProbePassIndex(int probe, int face)
+{
+	return 7 + 6*probe + face;
+}
+
+int ParaboloidPassIndex(int probeCount, int hemisphere)
+{
+	return ProbePassIndex(probeCount, 0) + hemisphere;
+}
+
+// The environment maps a dynamic reflector can reflect.  The dual-paraboloid map
+// takes two scene renders instead of six, at lower quality.
+enum class EnvironmentMap
+{
+	Cube,
+	DualParaboloid
+};
 
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
@@ -54,6 +100,15 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Object space bounds, used to cull the item for each view.
+	BoundingBox Bounds;
+
+	// Reflection probes the item reflects, written to its object constants.
+	ProbeAssignment Probes;
+
+	// The map of the scene around it a dynamic reflector reflects.
+	EnvironmentMap EnvMap = EnvironmentMap::Cube;
 };
 
 enum class RenderLayer : int
@@ -88,26 +143,49 @@ private:
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
+	void UpdateFrameCB(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateCubeMapFacePassCBs();
 	void UpdateCameraDistToCube();
-
-	void LoadTextures();
+	void UpdateDynamicResolution(const GameTimer& gt);
+	void UpdateCubeMapResolution();
+	void TrackCubeFaceChanges();
+	void ScheduleCubeMapFaces(const GameTimer& gt);
+	void ScheduleReflectionProbes();
+	void AssignReflectionProbes();
+	void UpdateReflectionProbePassCBs();
+	void ReportPassConstantSavings();
+	void UpdateParaboloidMap();
+	void ReportEnvironmentMapDraws();
+	void CullRenderItems();
+
+	TaskGraph::TaskId LoadTextures(TaskGraph& startup);
     void BuildRootSignature();
 	void BuildDescriptorHeaps();
-	void BuildCubeDepthStencil();
-    void BuildShadersAndInputLayout();
-	void BuildSkullGeometry();
-    void BuildShapeGeometry();
+    std::vector<TaskGraph::TaskId> BuildShadersAndInputLayout(TaskGraph& startup);
+	std::unique_ptr<MeshGeometry> BuildSkullGeometry();
+    std::unique_ptr<MeshGeometry> BuildShapeGeometry();
+	void UploadGeometry(std::unique_ptr<MeshGeometry> geo);
+	std::uint64_t StartupContentHash();
+	std::uint64_t BakedSceneHash(std::uint64_t contentHash);
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void DrawRenderItem(ID3D12GraphicsCommandList* cmdList, const RenderItem* ri, UINT instanceCount);
+	void DrawDynamicReflectors(const std::vector<RenderItem*>& ritems, bool probeCapture);
 	void DrawSceneToCubeMap();
+	void DrawSceneToParaboloidMap();
+	void DrawReflectionProbes();
+	void BuildReflectionProbes();
+	void LoadBakedCubeMap(std::uint64_t sceneHash);
+	void FinishCubeMapBake();
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
-	void BuildCubeFaceCamera(float x, float y, float z);
+
+	// Forwards the commands of the cube map pass to mCommandList.
+	class CubePassRecorder;
 
 private:
 
@@ -119,8 +197,6 @@ private:
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	ComPtr<ID3D12Resource> mCubeDepthStencilBuffer;
-
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
@@ -140,18 +216,133 @@ private:
 
 	RenderItem* mSkullRitem = nullptr;
 
-	std::unique_ptr<CubeRenderTarget> mDynamicCubeMap = nullptr;
+	// Cube maps from MinCubeMapSize to CubeMapSize; mDynamicCubeMap is the one in
+	// use, sized by mCubeResolution from how large the reflector is on screen.
+	std::unique_ptr<CubeRenderTargetPool> mCubeMapPool;
+	CubeRenderTarget* mDynamicCubeMap = nullptr;
+	CubeResolutionPolicy mCubeResolution;
+
+	// The cube depth buffer has a slice per face.  mCubeDSV views the first slice
+	// and is reused by every face when they are drawn one at a time; the single
+	// pass uses all of them through mCubeArrayDSV.
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mCubeDSV;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mCubeArrayDSV;
 
     PassConstants mMainPassCB;
+	FrameConstants mFrameCB;
 
 	Camera mCamera;
-	Camera mCubeMapCamera[6];
+
+	// The dynamic cube map is captured from here.  Its face constants are only
+	// rebuilt when the lens, which follows mDistToCube, or the cube map size changes.
+	XMFLOAT3 mCubeMapCenter = { 0.0f, 3.0f, 0.0f };
+	CubeFaceViews mCubeFaceViews;
+
+	// Face pass constant work, reported every 600 frames against rebuilding and
+	// copying full pass constants for every face drawn.
+	UINT64 mPassStatFrames = 0;
+	UINT64 mPassStatFacesBuilt = 0;
+	UINT64 mPassStatBytesCopied = 0;
+	UINT64 mPassStatFacesBuiltBefore = 0;
+	UINT64 mPassStatBytesCopiedBefore = 0;
 
     POINT mLastMousePos;
 
 	float mDistToCube{ 1.0f };
 	RenderItem* mMirrorCube = nullptr;
+
+	DynamicResolutionController mResolutionController;
+
+	// Faces of the dynamic cube map re-rendered this frame.
+	CubeMapUpdateScheduler mCubeFaceScheduler;
+	int mCubeFaces[6];
+	int mCubeFaceCount = 0;
+
+	// The items each face sees, so a face is only redrawn once one of them, the
+	// lights or the face views change.  mCubeFaceLighting holds the lights the faces
+	// were last drawn with.
+	CubeFaceDependencies mCubeFaceDependencies;
+	FrameConstants mCubeFaceLighting;
+
+	// Culls every item against the main camera and the scheduled cube faces in
+	// one pass.  Items are added in object CB order, so ObjCBIndex is also the
+	// culler item index.  mVisibleRitems holds what the main camera sees and
+	// mCubeFaceMasks the cube faces that see each item.
+	MultiViewCuller mCuller;
+	std::vector<RenderItem*> mVisibleRitems[(int)RenderLayer::Count];
+	std::vector<UINT> mCubeFaceMasks;
+
+	// Probes around the scene, refreshed a few faces per frame into one cube map
+	// array.  Each probe face drawn this frame is culled as view
+	// 1 + mCubeFaceCount + its index in mProbeUpdates.
+	ReflectionProbeSystem mReflectionProbes;
+	std::unique_ptr<ProbeCubeArray> mProbeMaps;
+	std::vector<ProbeFaceUpdate> mProbeUpdates;
+	std::vector<CubeFaceViews> mProbeFaceViews;
+	std::vector<RenderItem*> mProbeFaceRitems;
+	UINT mProbeTexHeapIndex = 0;
+	UINT mBakedTexHeapIndex = 0;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mProbeDSV;
+
+	// The dynamic reflectors' cheaper environment map, captured from mCubeMapCenter
+	// (M and N switch the globe between the cube map and this one).  Both
+	// hemispheres are redrawn every frame a reflector uses it; mParaboloidMasks
+	// holds the hemispheres that see each item.
+	std::unique_ptr<DualParaboloidMap> mParaboloidMap;
+	DualParaboloidViews mParaboloidViews;
+	std::vector<UINT> mParaboloidMasks;
+	UINT mParaboloidTexHeapIndex = 0;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mParaboloidDSV;
+	bool mDrawParaboloidMap = false;
+
+	// Draws recorded into each environment map, reported every 600 frames with
+	// the draws redrawing all of it would take.
+	UINT64 mEnvDrawStatFrames = 0;
+	UINT64 mCubeMapDraws = 0;
+	UINT64 mParaboloidDraws = 0;
+	UINT64 mCubeMapFullDraws = 0;
+	UINT64 mParaboloidFullDraws = 0;
+
+	// Draw the cube map one face at a time, or all faces in one pass with each
+	// draw instanced across the faces that see the item (P and O keys).
+	CubePassMode mCubePassMode = CubePassMode::PerFace;
+	std::vector<CubePassItem> mCubePassItems;
+	std::vector<RenderItem*> mCubePassRitems;
+
+	// Log single pass and per view culling times on start up (-cullbench).
+	bool mCullBenchmark = false;
+
+	// Step the faces per frame through 6, 3, 2, 1 and report the frame time of
+	// each setting (-cubefacesweep).
+	bool mCubeFaceSweep = false;
+	int mSweepStep = 0;
+	int mSweepFrames = 0;
+	double mSweepMs = 0.0;
+	double mSweepBaselineMs = 0.0;
+
+	// Texture files loaded by the start up tasks, kept until the uploads are recorded.
+	std::vector<DirectX::DDSTextureData> mTextureData;
+
+	// The loaded textures, shared through the texture cache, by name.
+	std::unordered_map<std::string, TextureHandle> mCachedTextures;
+
+	// Run the start up tasks on one thread, in order (-serialstartup).
+	bool mSerialStartup = false;
+
+	// -bakecube: reflect the bake of this scene at mCubeBakePath instead of the live
+	// cube map.  Without one, the live cube map is drawn at the bake size without the
+	// skull, copied out once all its faces are drawn and baked when the copy has
+	// executed (mCubeReadbackFence).  mCubeBakeWriter encodes and writes the faces.
+	bool mBakeCube = false;
+	bool mUseBakedCube = false;
+	std::wstring mCubeBakePath;
+	CubeBakeSettings mCubeBakeSettings;
+	std::unique_ptr<CubeMapReadback> mCubeReadback;
+	UINT64 mCubeReadbackFence = 0;
+	std::vector<std::uint8_t> mCubeBakeFaces[6];
+	std::thread mCubeBakeWriter;
+	LARGE_INTEGER mInitStart;
+	bool mFirstFrameDrawn = false;
 };
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
@@ -162,6 +353,30 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// Headless self-checks: each runs instead of the app when its flag is given.
+	int exitCode = 0;
+
+	// Check the cube map pass command counts and exit.  This records into a
+	// counter, so it needs no window or device.
+	if(SelfCheck::RunIfRequested(L"-cubepasscheck", L"CubePassCheck.log", CubeMapPass::ValidateCommandCounts, exitCode))
+		return exitCode;
+
+	// Check reflection probe assignment and scheduling and exit.
+	if(SelfCheck::RunIfRequested(L"-probecheck", L"ReflectionProbeCheck.log", ReflectionProbeSystem::RunSelfCheck, exitCode))
+		return exitCode;
+
+	// Check cube map baking on synthetic faces and exit.
+	if(SelfCheck::RunIfRequested(L"-cubebakecheck", L"CubeBakeCheck.log", CubeMapBake::RunSelfCheck, exitCode))
+		return exitCode;
+
+	// Check the cube map size policy on synthetic camera paths and exit.
+	if(SelfCheck::RunIfRequested(L"-cuberescheck", L"CubeResolutionCheck.log", CubeResolutionPolicy::RunSelfCheck, exitCode))
+		return exitCode;
+
+	// Check the dynamic resolution controller on synthetic frame times and exit.
+	if(SelfCheck::RunIfRequested(L"-drscheck", L"DynamicResolutionCheck.log", DynamicResolutionController::RunSelfCheck, exitCode))
+		return exitCode;
+
     try
     {
         DynamicCubeMapApp theApp(hInstance);
@@ -180,40 +395,105 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 DynamicCubeMapApp::DynamicCubeMapApp(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {
+	DynamicResolutionSettings drsSettings;
+	drsSettings.MinCubeSize = MinCubeMapSize;
+	drsSettings.MaxCubeSize = CubeMapSize;
+	mResolutionController.SetSettings(drsSettings);
+
+	CubeResolutionSettings cubeSettings;
+	cubeSettings.MinSize = MinCubeMapSize;
+	cubeSettings.MaxSize = CubeMapSize;
+	mCubeResolution.SetSettings(cubeSettings);
+	mCubeResolution.Reset(256);
+
+	// Faces are redrawn once what they see changes (C key).
+	mCubeFaceScheduler.SetSchedule(CubeFaceSchedule::OnChange);
+
+	BuildReflectionProbes();
+
+	mSerialStartup = wcsstr(GetCommandLineW(), L"-serialstartup") != nullptr;
+	mCubeFaceSweep = wcsstr(GetCommandLineW(), L"-cubefacesweep") != nullptr;
+	mCullBenchmark = wcsstr(GetCommandLineW(), L"-cullbench") != nullptr;
+	mBakeCube = wcsstr(GetCommandLineW(), L"-bakecube") != nullptr;
 }
 
 DynamicCubeMapApp::~DynamicCubeMapApp()
 {
+	if(mCubeBakeWriter.joinable())
+		mCubeBakeWriter.join();
+
     if(md3dDevice != nullptr)
         FlushCommandQueue();
 }
 
 bool DynamicCubeMapApp::Initialize()
 {
+	QueryPerformanceCounter(&mInitStart);
+
     if(!D3DApp::Initialize())
         return false;
 
     // Reset the command list to prep for initialization commands.
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
-	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
+	// Writing SV_RenderTargetArrayIndex from the vertex shader always works, but
+	// without hardware support the runtime inserts a geometry shader, which costs
+	// more than the single pass saves.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	ThrowIfFailed(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+	bool nativeArrayIndex = options.VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation != FALSE;
+	mCubePassMode = nativeArrayIndex ? CubePassMode::SinglePass : CubePassMode::PerFace;
+	LOG_INFO("Cube map: {} pass (native array index {})", nativeArrayIndex ? "single" : "per face", nativeArrayIndex);
 
-	BuildCubeFaceCamera(0.0f, 3.0f, 0.0f);
+	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
  
-	mDynamicCubeMap = std::make_unique<CubeRenderTarget>(md3dDevice.Get(), 
-		CubeMapSize, CubeMapSize, DXGI_FORMAT_R8G8B8A8_UNORM);
-
-	LoadTextures();
-    BuildRootSignature();
-	BuildDescriptorHeaps();
-	BuildCubeDepthStencil();
-    BuildShadersAndInputLayout();
-	BuildSkullGeometry();
-    BuildShapeGeometry();
-	BuildMaterials();
-    BuildRenderItems();
-    BuildFrameResources();
-    BuildPSOs();
+	mCubeMapPool = std::make_unique<CubeRenderTargetPool>(md3dDevice.Get(),
+		DXGI_FORMAT_R8G8B8A8_UNORM, mDepthStencilFormat, MinCubeMapSize, CubeMapSize);
+
+	mProbeMaps = std::make_unique<ProbeCubeArray>(md3dDevice.Get(), mReflectionProbes.ProbeCount(),
+		ReflectionProbeSize, DXGI_FORMAT_R8G8B8A8_UNORM, mDepthStencilFormat);
+
+	mParaboloidMap = std::make_unique<DualParaboloidMap>(md3dDevice.Get(),
+		ParaboloidMapSize, DXGI_FORMAT_R8G8B8A8_UNORM, mDepthStencilFormat);
+
+	// File reads, shader compiles, mesh generation and PSO creation are independent
+	// of each other, so they run on a thread pool.  Tasks that record into
+	// mCommandList are pinned to this thread, which serializes the upload recording.
+	TaskGraph startup;
+	const auto mainThread = TaskGraph::Affinity::MainThread;
+
+	std::unique_ptr<MeshGeometry> skullGeo;
+	std::unique_ptr<MeshGeometry> shapeGeo;
+
+	auto textures = LoadTextures(startup);
+	auto shaders = BuildShadersAndInputLayout(startup);
+	auto rootSignature = startup.Add("BuildRootSignature", [this]() { BuildRootSignature(); });
+	auto skull = startup.Add("BuildSkullGeometry", [&]() { skullGeo = BuildSkullGeometry(); });
+	auto shapes = startup.Add("BuildShapeGeometry", [&]() { shapeGeo = BuildShapeGeometry(); });
+	auto upload = startup.Add("UploadGeometry", [&]()
+	{
+		UploadGeometry(std::move(skullGeo));
+		UploadGeometry(std::move(shapeGeo));
+	}, { skull, shapes }, mainThread);
+	auto materials = startup.Add("BuildMaterials", [this]() { BuildMaterials(); });
+	auto renderItems = startup.Add("BuildRenderItems", [this]() { BuildRenderItems(); }, { upload, materials });
+
+	std::vector<TaskGraph::TaskId> psoDependencies = shaders;
+	psoDependencies.push_back(rootSignature);
+
+	startup.Add("BuildDescriptorHeaps", [this]() { BuildDescriptorHeaps(); }, { textures });
+	startup.Add("BuildFrameResources", [this]() { BuildFrameResources(); }, { renderItems });
+	startup.Add("BuildPSOs", [this]() { BuildPSOs(); }, psoDependencies);
+
+	startup.Run(0, mSerialStartup);
+
+	Log::WriteText(LogLevel::Info, startup.Report());
+	std::uint64_t contentHash = StartupContentHash();
+	LOG_INFO("Start up content hash ({}): {}", mSerialStartup ? "serial" : "parallel", contentHash);
+	mTextureData.clear();
+
+	if(mBakeCube)
+		LoadBakedCubeMap(BakedSceneHash(contentHash));
 
     // Execute the initialization commands.
     ThrowIfFailed(mCommandList->Close());
@@ -223,23 +503,46 @@ bool DynamicCubeMapApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+	// The initialization commands have executed, so the intermediate upload buffers
+	// and the system memory copies of the meshes are no longer needed.
+	for(auto& e : mGeometries)
+	{
+		e.second->DisposeUploaders();
+		e.second->ApplyCpuGeometryPolicy(CpuGeometryPolicy::ReleaseAll);
+	}
+	for(auto& e : mTextures)
+		e.second->UploadHeap = nullptr;
+	TextureCache::DisposeUploaders();
+
+	MemoryStats::MarkSteadyState();
+	MemoryStats::OutputReport();
+
+	if(mCullBenchmark)
+	{
+		// The views of this app, then with the six mirror passes of the stencil demo added.
+		Log::WriteText(LogLevel::Info, MultiViewCuller::Benchmark(10000, gNumCullViews, 100));
+		Log::WriteText(LogLevel::Info, MultiViewCuller::Benchmark(10000, gNumCullViews + 6, 100));
+	}
+
     return true;
 }
  
 void DynamicCubeMapApp::CreateRtvAndDsvDescriptorHeaps()
 {
-	// Add +6 RTV for cube render target.
+	// Add +6 RTV for the cube render target faces and +1 for all of them, then
+	// +6 for each reflection probe and +2 for the dual-paraboloid hemispheres.
 	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
-	rtvHeapDesc.NumDescriptors = SwapChainBufferCount + 6;
+	rtvHeapDesc.NumDescriptors = SwapChainBufferCount + 9 + 6*mReflectionProbes.ProbeCount();
 	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	rtvHeapDesc.NodeMask = 0;
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
 		&rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
 
-	// Add +1 DSV for cube render target.
+	// Add +2 DSV for cube render target: one slice and all of them, +1 for the
+	// reflection probes and +1 for the dual-paraboloid map.
 	D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
-	dsvHeapDesc.NumDescriptors = 2;
+	dsvHeapDesc.NumDescriptors = 5;
 	dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
 	dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	dsvHeapDesc.NodeMask = 0;
@@ -250,6 +553,21 @@ void DynamicCubeMapApp::CreateRtvAndDsvDescriptorHeaps()
 		mDsvHeap->GetCPUDescriptorHandleForHeapStart(),
 		1,
 		mDsvDescriptorSize);
+
+	mCubeArrayDSV = CD3DX12_CPU_DESCRIPTOR_HANDLE(
+		mDsvHeap->GetCPUDescriptorHandleForHeapStart(),
+		2,
+		mDsvDescriptorSize);
+
+	mProbeDSV = CD3DX12_CPU_DESCRIPTOR_HANDLE(
+		mDsvHeap->GetCPUDescriptorHandleForHeapStart(),
+		3,
+		mDsvDescriptorSize);
+
+	mParaboloidDSV = CD3DX12_CPU_DESCRIPTOR_HANDLE(
+		mDsvHeap->GetCPUDescriptorHandleForHeapStart(),
+		4,
+		mDsvDescriptorSize);
 }
 
 void DynamicCubeMapApp::OnResize()
@@ -262,6 +580,8 @@ void DynamicCubeMapApp::OnResize()
 void DynamicCubeMapApp::Update(const GameTimer& gt)
 {
     OnKeyboardInput(gt);
+	UpdateDynamicResolution(gt);
+	UpdateCubeMapResolution();
 
 	//
 	// Animate the skull around the center sphere.
@@ -294,10 +614,22 @@ void DynamicCubeMapApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	FinishCubeMapBake();
+
 	AnimateMaterials(gt);
+	AssignReflectionProbes();
+	UpdateFrameCB(gt);
+	TrackCubeFaceChanges();
 	UpdateObjectCBs(gt);
 	UpdateMaterialBuffer(gt);
+	ScheduleCubeMapFaces(gt);
+	ScheduleReflectionProbes();
 	UpdateMainPassCB(gt);
+	UpdateReflectionProbePassCBs();
+	UpdateParaboloidMap();
+	ReportPassConstantSavings();
+	ReportEnvironmentMapDraws();
+	CullRenderItems();
 }
 
 void DynamicCubeMapApp::Draw(const GameTimer& gt)
@@ -322,6 +654,10 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt)
 	auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
 	mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
 
+	// Time and lighting are the same for every pass.
+	auto frameCB = mCurrFrameResource->FrameCB->Resource();
+	mCommandList->SetGraphicsRootConstantBufferView(8, frameCB->GetGPUVirtualAddress());
+
 	// Bind the sky cube map.  For our demos, we just use one "world" cube map representing the environment
 	// from far away, so all objects will use the same cube map and we only need to set it once per-frame.  
 	// If we wanted to use "local" cube maps, we would have to change them per-object, or dynamically
@@ -336,7 +672,28 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt)
 	// The root signature knows how many descriptors are expected in the table.
 	mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
+	mCommandList->SetGraphicsRootDescriptorTable(7, mProbeMaps->Srv());
+	mCommandList->SetGraphicsRootDescriptorTable(9, mParaboloidMap->Srv());
+
+	// The probes first, so the dynamic environment maps and the main view reflect
+	// this frame's faces.
+	DrawReflectionProbes();
 	DrawSceneToCubeMap();
+	DrawSceneToParaboloidMap();
+
+	// Once every face holds the scene, copy them out for the bake.
+	if(mCubeReadback != nullptr && mCubeReadbackFence == 0)
+	{
+		bool complete = true;
+		for(int i = 0; i < 6; ++i)
+			complete &= mCubeFaceScheduler.Face(i).Valid;
+
+		if(complete)
+		{
+			mCubeReadback->RecordCopy(mCommandList.Get(), mDynamicCubeMap->Resource());
+			mCubeReadbackFence = mCurrentFence + 1;
+		}
+	}
  
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -356,20 +713,20 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt)
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
 
-	// Use the dynamic cube map for the dynamic reflectors layer.
+	// Use the dynamic cube map, or its bake, for the dynamic reflectors layer.
 	CD3DX12_GPU_DESCRIPTOR_HANDLE dynamicTexDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	dynamicTexDescriptor.Offset(mSkyTexHeapIndex + 1, mCbvSrvUavDescriptorSize);
+	dynamicTexDescriptor.Offset(mUseBakedCube ? mBakedTexHeapIndex : mDynamicTexHeapIndex, mCbvSrvUavDescriptorSize);
 	mCommandList->SetGraphicsRootDescriptorTable(3, dynamicTexDescriptor);
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors]);
+	DrawDynamicReflectors(mVisibleRitems[(int)RenderLayer::OpaqueDynamicReflectors], false);
 
 	// Use the static "background" cube map for the other objects (including the sky)
 	mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	DrawRenderItems(mCommandList.Get(), mVisibleRitems[(int)RenderLayer::Opaque]);
 
 	mCommandList->SetPipelineState(mPSOs["sky"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+	DrawRenderItems(mCommandList.Get(), mVisibleRitems[(int)RenderLayer::Sky]);
 
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -393,6 +750,17 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt)
     // Because we are on the GPU timeline, the new fence point won't be 
     // set until the GPU finishes processing all the commands prior to this Signal().
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	if(!mFirstFrameDrawn)
+	{
+		mFirstFrameDrawn = true;
+
+		LARGE_INTEGER now, freq;
+		QueryPerformanceCounter(&now);
+		QueryPerformanceFrequency(&freq);
+		LOG_INFO("Time to first frame ({} start up): {} ms", mSerialStartup ? "serial" : "parallel",
+			1000.0*(double)(now.QuadPart - mInitStart.QuadPart) / (double)freq.QuadPart);
+	}
 }
 
 void DynamicCubeMapApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -444,6 +812,36 @@ void DynamicCubeMapApp::OnKeyboardInput(const GameTimer& gt)
 
 	UpdateCameraDistToCube();
 
+	// 1-6 set the cube map faces refreshed per frame; R, V and C pick round robin,
+	// visible faces first or changed faces only.
+	for(int i = 1; i <= 6; ++i)
+	{
+		if(GetAsyncKeyState('0' + i) & 0x8000)
+			mCubeFaceScheduler.SetFacesPerFrame(i);
+	}
+
+	if(GetAsyncKeyState('R') & 0x8000)
+		mCubeFaceScheduler.SetSchedule(CubeFaceSchedule::RoundRobin);
+
+	if(GetAsyncKeyState('V') & 0x8000)
+		mCubeFaceScheduler.SetSchedule(CubeFaceSchedule::VisibleFirst);
+
+	if(GetAsyncKeyState('C') & 0x8000)
+		mCubeFaceScheduler.SetSchedule(CubeFaceSchedule::OnChange);
+
+	if(GetAsyncKeyState('P') & 0x8000)
+		mCubePassMode = CubePassMode::PerFace;
+
+	if(GetAsyncKeyState('O') & 0x8000)
+		mCubePassMode = CubePassMode::SinglePass;
+
+	// M and N switch the globe to the cube map or the dual-paraboloid map.
+	if(GetAsyncKeyState('M') & 0x8000)
+		mMirrorCube->EnvMap = EnvironmentMap::Cube;
+
+	if(GetAsyncKeyState('N') & 0x8000)
+		mMirrorCube->EnvMap = EnvironmentMap::DualParaboloid;
+
 	// OutputDebugStringW(L"what\n");
 }
  
@@ -468,6 +866,10 @@ void DynamicCubeMapApp::UpdateObjectCBs(const GameTimer& gt)
 			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
 			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
 			objConstants.MaterialIndex = e->Mat->MatCBIndex;
+			objConstants.Probe0 = e->Probes.Probe0;
+			objConstants.Probe1 = e->Probes.Probe1;
+			objConstants.ProbeWeight0 = e->Probes.Weight0;
+			objConstants.ProbeWeight1 = e->Probes.Weight1;
 
 			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
 
@@ -525,15 +927,6 @@ void DynamicCubeMapApp::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
 	mMainPassCB.NearZ = 1.0f;
 	mMainPassCB.FarZ = 1000.0f;
-	mMainPassCB.TotalTime = gt.TotalTime();
-	mMainPassCB.DeltaTime = gt.DeltaTime();
-	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
-	mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.8f, 0.8f, 0.8f };
-	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[1].Strength = { 0.4f, 0.4f, 0.4f };
-	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
-	mMainPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
 
 	auto currPassCB = mCurrFrameResource->PassCB.get();
 	currPassCB->CopyData(0, mMainPassCB);
@@ -541,43 +934,55 @@ void DynamicCubeMapApp::UpdateMainPassCB(const GameTimer& gt)
 	UpdateCubeMapFacePassCBs();
 }
 
-void DynamicCubeMapApp::UpdateCubeMapFacePassCBs()
+void DynamicCubeMapApp::UpdateFrameCB(const GameTimer& gt)
 {
-	for(int i = 0; i < 6; ++i)
-	{
-		PassConstants cubeFacePassCB = mMainPassCB;
-
-		mCubeMapCamera[i].SetLens(0.5f * XM_PI * (mDistToCube / 10.0f), 1.0f, 0.1f, 1000.0f);
-		mCubeMapCamera[i].UpdateViewMatrix();
-
-		// XMMATRIX scale = XMMatrixScaling(mDistToCube, mDistToCube, mDistToCube);
+	mFrameCB.TotalTime = gt.TotalTime();
+	mFrameCB.DeltaTime = gt.DeltaTime();
+	mFrameCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+	mFrameCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
+	mFrameCB.Lights[0].Strength = { 0.8f, 0.8f, 0.8f };
+	mFrameCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
+	mFrameCB.Lights[1].Strength = { 0.4f, 0.4f, 0.4f };
+	mFrameCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
+	mFrameCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
+
+	mCurrFrameResource->FrameCB->CopyData(0, mFrameCB);
+}
 
-		XMMATRIX view = mCubeMapCamera[i].GetView();
-		XMMATRIX proj = mCubeMapCamera[i].GetProj();
+void DynamicCubeMapApp::UpdateCubeMapFacePassCBs()
+{
+	// TrackCubeFaceChanges has already brought the face views up to date.
+	UINT version = mCubeFaceViews.Version();
+	auto currPassCB = mCurrFrameResource->PassCB.get();
 
-		XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-		XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-		XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+	// Only the faces drawn this frame need pass constants, and only if this frame
+	// resource does not hold the current ones yet.
+	for(int f = 0; f < mCubeFaceCount; ++f)
+	{
+		int i = mCubeFaces[f];
+		if(mCurrFrameResource->CubeFacePassVersion[i] == version)
+			continue;
 
-		XMStoreFloat4x4(&cubeFacePassCB.View, XMMatrixTranspose(view));
-		XMStoreFloat4x4(&cubeFacePassCB.InvView, XMMatrixTranspose(invView));
-		XMStoreFloat4x4(&cubeFacePassCB.Proj, XMMatrixTranspose(proj));
-		XMStoreFloat4x4(&cubeFacePassCB.InvProj, XMMatrixTranspose(invProj));
-		XMStoreFloat4x4(&cubeFacePassCB.ViewProj, XMMatrixTranspose(viewProj));
-		XMStoreFloat4x4(&cubeFacePassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-		cubeFacePassCB.EyePosW = mCubeMapCamera[i].GetPosition3f();
-		cubeFacePassCB.RenderTargetSize = XMFLOAT2((float)CubeMapSize, (float)CubeMapSize);
-		cubeFacePassCB.InvRenderTargetSize = XMFLOAT2(1.0f / CubeMapSize, 1.0f / CubeMapSize);
+		// Cube map pass cbuffers are stored in elements 1-6.
+		currPassCB->CopyData(1 + i, mCubeFaceViews.PassCB(i));
+		mCurrFrameResource->CubeFacePassVersion[i] = version;
+		mPassStatBytesCopied += sizeof(PassConstants);
+	}
 
-		auto currPassCB = mCurrFrameResource->PassCB.get();
+	// The single pass reads the matrices of the scheduled faces from here.
+	if(mCubeFaceCount > 0 && mCurrFrameResource->CubeFaceCBVersion != version)
+	{
+		CubeFaceConstants cubeFaceCB;
+		for(int i = 0; i < 6; ++i)
+			cubeFaceCB.ViewProj[i] = mCubeFaceViews.PassCB(i).ViewProj;
 
-		// Cube map pass cbuffers are stored in elements 1-6.
-		currPassCB->CopyData(1 + i, cubeFacePassCB);
+		mCurrFrameResource->CubeFaceCB->CopyData(0, cubeFaceCB);
+		mCurrFrameResource->CubeFaceCBVersion = version;
+		mPassStatBytesCopied += sizeof(CubeFaceConstants);
 	}
 }
 
-void DynamicCubeMapApp::LoadTextures()
+TaskGraph::TaskId DynamicCubeMapApp::LoadTextures(TaskGraph& startup)
 {
     std::vector<std::string> texNames =
     {
@@ -595,17 +1000,34 @@ void DynamicCubeMapApp::LoadTextures()
         L"../../Textures/grasscube1024.dds"
     };
 
+	// Reading, validating and laying out the files run in parallel; creating the
+	// resources records upload commands, so that part is a single main thread task.
+	mTextureData.resize(texNames.size());
+
+	std::vector<TaskGraph::TaskId> loads;
     for (int i = 0; i < (int)texNames.size(); ++i)
     {
-        auto texMap = std::make_unique<Texture>();
-        texMap->Name = texNames[i];
-        texMap->Filename = texFilenames[i];
-        ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-            mCommandList.Get(), texMap->Filename.c_str(),
-            texMap->Resource, texMap->UploadHeap));
-
-        mTextures[texMap->Name] = std::move(texMap);
+		std::wstring filename = texFilenames[i];
+		DirectX::DDSTextureData* data = &mTextureData[i];
+		loads.push_back(startup.Add("Load " + texNames[i], [filename, data]()
+		{
+			if(FAILED(DirectX::LoadDDSTextureData12(filename.c_str(), *data)))
+				LOG_ERROR("{} not found or not a valid DDS file.", filename);
+		}));
     }
+
+	// The resources come from the texture cache, which creates each distinct file
+	// once along with its SRV.
+	return startup.Add("CreateTextures", [this, texNames, texFilenames]()
+	{
+		for(int i = 0; i < (int)texNames.size(); ++i)
+		{
+			ThrowIfFailed(TextureCache::Load(md3dDevice.Get(), mCommandList.Get(),
+				texFilenames[i], mTextureData[i], mCachedTextures[texNames[i]]));
+		}
+
+		Log::WriteText(LogLevel::Info, TextureCache::Report());
+	}, loads, TaskGraph::Affinity::MainThread);
 }
 
 void DynamicCubeMapApp::BuildRootSignature()
@@ -616,8 +1038,14 @@ void DynamicCubeMapApp::BuildRootSignature()
 	CD3DX12_DESCRIPTOR_RANGE texTable1;
 	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 5, 1, 0);
 
+	CD3DX12_DESCRIPTOR_RANGE probeTable;
+	probeTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 2);
+
+	CD3DX12_DESCRIPTOR_RANGE paraboloidTable;
+	paraboloidTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1, 2);
+
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[10];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
     slotRootParameter[0].InitAsConstantBufferView(0);
@@ -626,11 +1054,23 @@ void DynamicCubeMapApp::BuildRootSignature()
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
 	slotRootParameter[4].InitAsDescriptorTable(1, &texTable1, D3D12_SHADER_VISIBILITY_PIXEL);
 
+	// Cube face matrices and the per draw face list of the single pass cube map.
+	slotRootParameter[5].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	slotRootParameter[6].InitAsConstants(1, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+
+	// The reflection probe cube map array.
+	slotRootParameter[7].InitAsDescriptorTable(1, &probeTable, D3D12_SHADER_VISIBILITY_PIXEL);
+
+	// Time and lighting, shared by every pass.
+	slotRootParameter[8].InitAsConstantBufferView(4);
+
+	// The dual-paraboloid map.
+	slotRootParameter[9].InitAsDescriptorTable(1, &paraboloidTable, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(10, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -659,7 +1099,7 @@ void DynamicCubeMapApp::BuildDescriptorHeaps()
 	// Create the SRV heap.
 	//
 	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 6;
+	srvHeapDesc.NumDescriptors = 8;
 	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
@@ -669,43 +1109,16 @@ void DynamicCubeMapApp::BuildDescriptorHeaps()
 	//
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 
-    auto bricksTex = mTextures["bricksDiffuseMap"]->Resource;
-    auto tileTex = mTextures["tileDiffuseMap"]->Resource;
-    auto whiteTex = mTextures["defaultDiffuseMap"]->Resource;
-    auto skyTex = mTextures["skyCubeMap"]->Resource;
-
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = bricksTex->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = bricksTex->GetDesc().MipLevels;
-	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-	md3dDevice->CreateShaderResourceView(bricksTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
-
-	srvDesc.Format = tileTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = tileTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(tileTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
-
-	srvDesc.Format = whiteTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = whiteTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(whiteTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
+	// The texture cache made the views of the loaded textures; copy them in order.
+	const char* cachedNames[] = { "bricksDiffuseMap", "tileDiffuseMap", "defaultDiffuseMap", "skyCubeMap" };
+	for(const char* name : cachedNames)
+	{
+		md3dDevice->CopyDescriptorsSimple(1, hDescriptor, mCachedTextures[name].Srv(),
+			D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
-	srvDesc.TextureCube.MostDetailedMip = 0;
-	srvDesc.TextureCube.MipLevels = skyTex->GetDesc().MipLevels;
-	srvDesc.TextureCube.ResourceMinLODClamp = 0.0f;
-	srvDesc.Format = skyTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(skyTex.Get(), &srvDesc, hDescriptor);
+		// next descriptor
+		hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
+	}
 	
 	mSkyTexHeapIndex = 3;
 	mDynamicTexHeapIndex = mSkyTexHeapIndex+1;
@@ -721,62 +1134,114 @@ void DynamicCubeMapApp::BuildDescriptorHeaps()
 	for(int i = 0; i < 6; ++i)
 		cubeRtvHandles[i] = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvCpuStart, rtvOffset + i, mRtvDescriptorSize);
 
-	// Dynamic cubemap SRV is after the sky SRV.
-	mDynamicCubeMap->BuildDescriptors(
+	// Dynamic cubemap SRV is after the sky SRV.  Every cube map in the pool is
+	// viewed through the same descriptors, rewritten when the size changes.
+	mCubeMapPool->SetDescriptors(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE(srvCpuStart, mDynamicTexHeapIndex, mCbvSrvUavDescriptorSize),
 		CD3DX12_GPU_DESCRIPTOR_HANDLE(srvGpuStart, mDynamicTexHeapIndex, mCbvSrvUavDescriptorSize),
-		cubeRtvHandles);
+		cubeRtvHandles,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvCpuStart, rtvOffset + 6, mRtvDescriptorSize),
+		mCubeDSV,
+		mCubeArrayDSV);
+
+	mDynamicCubeMap = mCubeMapPool->Acquire(mCubeResolution.Size());
+	Log::WriteText(LogLevel::Info, mCubeMapPool->Report());
+
+	// The probe cube map array SRV takes the last slot; its RTVs follow the cube map's.
+	mProbeTexHeapIndex = mDynamicTexHeapIndex + 1;
+	mProbeMaps->BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(srvCpuStart, mProbeTexHeapIndex, mCbvSrvUavDescriptorSize),
+		CD3DX12_GPU_DESCRIPTOR_HANDLE(srvGpuStart, mProbeTexHeapIndex, mCbvSrvUavDescriptorSize),
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvCpuStart, rtvOffset + 7, mRtvDescriptorSize),
+		mRtvDescriptorSize,
+		mProbeDSV);
+
+	// A baked dynamic cube map, if one is loaded, goes after the probes.
+	mBakedTexHeapIndex = mProbeTexHeapIndex + 1;
+
+	// Then the dual-paraboloid map, whose RTVs follow the probes'.
+	mParaboloidTexHeapIndex = mBakedTexHeapIndex + 1;
+	mParaboloidMap->BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(srvCpuStart, mParaboloidTexHeapIndex, mCbvSrvUavDescriptorSize),
+		CD3DX12_GPU_DESCRIPTOR_HANDLE(srvGpuStart, mParaboloidTexHeapIndex, mCbvSrvUavDescriptorSize),
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvCpuStart, rtvOffset + 7 + 6*mReflectionProbes.ProbeCount(), mRtvDescriptorSize),
+		mRtvDescriptorSize,
+		mParaboloidDSV);
 }
 
-void DynamicCubeMapApp::BuildCubeDepthStencil()
+std::vector<TaskGraph::TaskId> DynamicCubeMapApp::BuildShadersAndInputLayout(TaskGraph& startup)
 {
-	// Create the depth/stencil buffer and view.
-	D3D12_RESOURCE_DESC depthStencilDesc;
-	depthStencilDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	depthStencilDesc.Alignment = 0;
-	depthStencilDesc.Width = CubeMapSize;
-	depthStencilDesc.Height = CubeMapSize;
-	depthStencilDesc.DepthOrArraySize = 1;
-	depthStencilDesc.MipLevels = 1;
-	depthStencilDesc.Format = mDepthStencilFormat;
-	depthStencilDesc.SampleDesc.Count = 1;
-	depthStencilDesc.SampleDesc.Quality = 0;
-	depthStencilDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-	depthStencilDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
-
-	D3D12_CLEAR_VALUE optClear;
-	optClear.Format = mDepthStencilFormat;
-	optClear.DepthStencil.Depth = 1.0f;
-	optClear.DepthStencil.Stencil = 0;
-	ThrowIfFailed(md3dDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&depthStencilDesc,
-		D3D12_RESOURCE_STATE_COMMON,
-		&optClear,
-		IID_PPV_ARGS(mCubeDepthStencilBuffer.GetAddressOf())));
-
-	// Create descriptor to mip level 0 of entire resource using the format of the resource.
-	md3dDevice->CreateDepthStencilView(mCubeDepthStencilBuffer.Get(), nullptr, mCubeDSV);
-
-	// Transition the resource from its initial state to be used as a depth buffer.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mCubeDepthStencilBuffer.Get(),
-		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_DEPTH_WRITE));
-}
+	struct ShaderDesc
+	{
+		const char* Name;
+		const wchar_t* Filename;
+		const D3D_SHADER_MACRO* Defines;
+		const char* EntryPoint;
+		const char* Target;
+	};
 
-void DynamicCubeMapApp::BuildShadersAndInputLayout()
-{
-	const D3D_SHADER_MACRO alphaTestDefines[] =
+	// Static: the compile tasks read it after this function returns.
+	static const D3D_SHADER_MACRO singlePassCubeDefines[] =
 	{
-		"ALPHA_TEST", "1",
+		"SINGLE_PASS_CUBE", "1",
 		NULL, NULL
 	};
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
-	
-	mShaders["skyVS"] = d3dUtil::CompileShader(L"Shaders\\Sky.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["skyPS"] = d3dUtil::CompileShader(L"Shaders\\Sky.hlsl", nullptr, "PS", "ps_5_1");
+	static const D3D_SHADER_MACRO probeCaptureDefines[] =
+	{
+		"NO_REFLECTION_PROBES", "1",
+		NULL, NULL
+	};
+
+	static const D3D_SHADER_MACRO dualParaboloidDefines[] =
+	{
+		"DUAL_PARABOLOID", "1",
+		NULL, NULL
+	};
+
+	static const D3D_SHADER_MACRO paraboloidReflectionDefines[] =
+	{
+		"PARABOLOID_REFLECTION", "1",
+		NULL, NULL
+	};
+
+	static const D3D_SHADER_MACRO probeParaboloidReflectionDefines[] =
+	{
+		"NO_REFLECTION_PROBES", "1",
+		"PARABOLOID_REFLECTION", "1",
+		NULL, NULL
+	};
+
+	const ShaderDesc shaderDescs[] =
+	{
+		{ "standardVS", L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1" },
+		{ "opaquePS",   L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1" },
+		{ "skyVS",      L"Shaders\\Sky.hlsl",     nullptr, "VS", "vs_5_1" },
+		{ "skyPS",      L"Shaders\\Sky.hlsl",     nullptr, "PS", "ps_5_1" },
+		{ "cubeVS",     L"Shaders\\Default.hlsl", singlePassCubeDefines, "VS", "vs_5_1" },
+		{ "cubePS",     L"Shaders\\Default.hlsl", singlePassCubeDefines, "PS", "ps_5_1" },
+		{ "cubeSkyVS",  L"Shaders\\Sky.hlsl",     singlePassCubeDefines, "VS", "vs_5_1" },
+		{ "cubeSkyPS",  L"Shaders\\Sky.hlsl",     singlePassCubeDefines, "PS", "ps_5_1" },
+		{ "probePS",    L"Shaders\\Default.hlsl", probeCaptureDefines, "PS", "ps_5_1" },
+		{ "paraboloidVS",    L"Shaders\\Default.hlsl", dualParaboloidDefines, "VS", "vs_5_1" },
+		{ "paraboloidPS",    L"Shaders\\Default.hlsl", dualParaboloidDefines, "PS", "ps_5_1" },
+		{ "paraboloidSkyVS", L"Shaders\\Sky.hlsl",     dualParaboloidDefines, "VS", "vs_5_1" },
+		{ "paraboloidSkyPS", L"Shaders\\Sky.hlsl",     dualParaboloidDefines, "PS", "ps_5_1" },
+		{ "paraboloidReflectorPS",      L"Shaders\\Default.hlsl", paraboloidReflectionDefines, "PS", "ps_5_1" },
+		{ "probeParaboloidReflectorPS", L"Shaders\\Default.hlsl", probeParaboloidReflectionDefines, "PS", "ps_5_1" }
+	};
+
+	// One task per compile.  The map entries are created here, so the tasks only
+	// assign to their own element and never modify mShaders itself.
+	std::vector<TaskGraph::TaskId> compiles;
+	for(const ShaderDesc& desc : shaderDescs)
+	{
+		ComPtr<ID3DBlob>* byteCode = &mShaders[desc.Name];
+		compiles.push_back(startup.Add(std::string("Compile ") + desc.Name, [byteCode, desc]()
+		{
+			*byteCode = d3dUtil::CompileShader(desc.Filename, desc.Defines, desc.EntryPoint, desc.Target);
+		}));
+	}
 
     mInputLayout =
     {
@@ -784,16 +1249,18 @@ void DynamicCubeMapApp::BuildShadersAndInputLayout()
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
+
+	return compiles;
 }
 
-void DynamicCubeMapApp::BuildSkullGeometry()
+std::unique_ptr<MeshGeometry> DynamicCubeMapApp::BuildSkullGeometry()
 {
 	std::ifstream fin("Models/skull.txt");
 
 	if(!fin)
 	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
-		return;
+		LOG_ERROR("Models/skull.txt not found.");
+		return nullptr;
 	}
 
 	UINT vcount = 0;
@@ -857,12 +1324,6 @@ void DynamicCubeMapApp::BuildSkullGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
@@ -876,10 +1337,10 @@ void DynamicCubeMapApp::BuildSkullGeometry()
 
 	geo->DrawArgs["skull"] = submesh;
 
-	mGeometries[geo->Name] = std::move(geo);
+	return geo;
 }
 
-void DynamicCubeMapApp::BuildShapeGeometry()
+std::unique_ptr<MeshGeometry> DynamicCubeMapApp::BuildShapeGeometry()
 {
     GeometryGenerator geoGen;
 	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
@@ -924,6 +1385,13 @@ void DynamicCubeMapApp::BuildShapeGeometry()
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
 
+	// Bounds of each shape, for culling.
+	const UINT genVertexStride = sizeof(GeometryGenerator::Vertex);
+	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(), &box.Vertices[0].Position, genVertexStride);
+	BoundingBox::CreateFromPoints(gridSubmesh.Bounds, grid.Vertices.size(), &grid.Vertices[0].Position, genVertexStride);
+	BoundingBox::CreateFromPoints(sphereSubmesh.Bounds, sphere.Vertices.size(), &sphere.Vertices[0].Position, genVertexStride);
+	BoundingBox::CreateFromPoints(cylinderSubmesh.Bounds, cylinder.Vertices.size(), &cylinder.Vertices[0].Position, genVertexStride);
+
 	//
 	// Extract the vertex elements we are interested in and pack the
 	// vertices of all the meshes into one vertex buffer.
@@ -984,12 +1452,6 @@ void DynamicCubeMapApp::BuildShapeGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -1000,9 +1462,95 @@ void DynamicCubeMapApp::BuildShapeGeometry()
 	geo->DrawArgs["sphere"] = sphereSubmesh;
 	geo->DrawArgs["cylinder"] = cylinderSubmesh;
 
+	return geo;
+}
+
+void DynamicCubeMapApp::UploadGeometry(std::unique_ptr<MeshGeometry> geo)
+{
+	if(geo == nullptr)
+		return;
+
+	// The CPU stage left the vertex and index data in the system memory copies.
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferByteSize, geo->VertexBufferUploader);
+
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize, geo->IndexBufferUploader);
+
 	mGeometries[geo->Name] = std::move(geo);
 }
 
+std::uint64_t DynamicCubeMapApp::StartupContentHash()
+{
+	// Everything the start up tasks produced on the CPU, in a fixed order, so a
+	// parallel start up can be compared against a -serialstartup run.
+	std::uint64_t hash = d3dUtil::HashBytes(nullptr, 0);
+
+	for(const auto& data : mTextureData)
+		hash = d3dUtil::HashBytes(data.FileData.get(), data.FileSize, hash);
+
+	std::vector<std::string> names;
+	for(auto& e : mGeometries)
+		names.push_back(e.first);
+	std::sort(names.begin(), names.end());
+	for(const std::string& name : names)
+	{
+		MeshGeometry* geo = mGeometries[name].get();
+		hash = d3dUtil::HashBytes(geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferCPU->GetBufferSize(), hash);
+		hash = d3dUtil::HashBytes(geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferCPU->GetBufferSize(), hash);
+	}
+
+	names.clear();
+	for(auto& e : mShaders)
+		names.push_back(e.first);
+	std::sort(names.begin(), names.end());
+	for(const std::string& name : names)
+		hash = d3dUtil::HashBytes(mShaders[name]->GetBufferPointer(), mShaders[name]->GetBufferSize(), hash);
+
+	return hash;
+}
+
+std::uint64_t DynamicCubeMapApp::BakedSceneHash(std::uint64_t contentHash)
+{
+	// The start up content plus where the items drawn into the cube map are placed
+	// and how they are shaded, so moving an item or changing a material gives a new
+	// bake.  The skull moves every frame, so its pose is left out.
+	std::uint64_t hash = contentHash;
+
+	for(RenderLayer layer : { RenderLayer::Opaque, RenderLayer::Sky })
+	{
+		for(RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			if(ri == mSkullRitem)
+				continue;
+
+			hash = d3dUtil::HashBytes(&ri->World, sizeof(XMFLOAT4X4), hash);
+			hash = d3dUtil::HashBytes(&ri->TexTransform, sizeof(XMFLOAT4X4), hash);
+			hash = d3dUtil::HashBytes(&ri->Mat->MatCBIndex, sizeof(int), hash);
+			hash = d3dUtil::HashBytes(&ri->IndexCount, sizeof(UINT), hash);
+			hash = d3dUtil::HashBytes(&ri->StartIndexLocation, sizeof(UINT), hash);
+			hash = d3dUtil::HashBytes(&ri->BaseVertexLocation, sizeof(int), hash);
+		}
+	}
+
+	std::vector<std::string> names;
+	for(auto& e : mMaterials)
+		names.push_back(e.first);
+	std::sort(names.begin(), names.end());
+	for(const std::string& name : names)
+	{
+		const Material* mat = mMaterials[name].get();
+		hash = d3dUtil::HashBytes(&mat->MatCBIndex, sizeof(int), hash);
+		hash = d3dUtil::HashBytes(&mat->DiffuseSrvHeapIndex, sizeof(int), hash);
+		hash = d3dUtil::HashBytes(&mat->DiffuseAlbedo, sizeof(XMFLOAT4), hash);
+		hash = d3dUtil::HashBytes(&mat->FresnelR0, sizeof(XMFLOAT3), hash);
+		hash = d3dUtil::HashBytes(&mat->Roughness, sizeof(float), hash);
+		hash = d3dUtil::HashBytes(&mat->MatTransform, sizeof(XMFLOAT4X4), hash);
+	}
+
+	return hash;
+}
+
 void DynamicCubeMapApp::BuildPSOs()
 {
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
@@ -1060,6 +1608,93 @@ void DynamicCubeMapApp::BuildPSOs()
 	};
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&skyPsoDesc, IID_PPV_ARGS(&mPSOs["sky"])));
 
+	//
+	// PSOs for drawing every cube map face in one pass.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC cubePsoDesc = opaquePsoDesc;
+	cubePsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["cubeVS"]->GetBufferPointer()),
+		mShaders["cubeVS"]->GetBufferSize()
+	};
+	cubePsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["cubePS"]->GetBufferPointer()),
+		mShaders["cubePS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&cubePsoDesc, IID_PPV_ARGS(&mPSOs["cubeOpaque"])));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC cubeSkyPsoDesc = skyPsoDesc;
+	cubeSkyPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["cubeSkyVS"]->GetBufferPointer()),
+		mShaders["cubeSkyVS"]->GetBufferSize()
+	};
+	cubeSkyPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["cubeSkyPS"]->GetBufferPointer()),
+		mShaders["cubeSkyPS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&cubeSkyPsoDesc, IID_PPV_ARGS(&mPSOs["cubeSky"])));
+
+	//
+	// PSO for drawing into the reflection probes, which cannot reflect themselves.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC probePsoDesc = opaquePsoDesc;
+	probePsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["probePS"]->GetBufferPointer()),
+		mShaders["probePS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&probePsoDesc, IID_PPV_ARGS(&mPSOs["probeOpaque"])));
+
+	//
+	// PSOs for drawing the dual-paraboloid hemispheres.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC paraboloidPsoDesc = opaquePsoDesc;
+	paraboloidPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["paraboloidVS"]->GetBufferPointer()),
+		mShaders["paraboloidVS"]->GetBufferSize()
+	};
+	paraboloidPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["paraboloidPS"]->GetBufferPointer()),
+		mShaders["paraboloidPS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&paraboloidPsoDesc, IID_PPV_ARGS(&mPSOs["paraboloidOpaque"])));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC paraboloidSkyPsoDesc = skyPsoDesc;
+	paraboloidSkyPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["paraboloidSkyVS"]->GetBufferPointer()),
+		mShaders["paraboloidSkyVS"]->GetBufferSize()
+	};
+	paraboloidSkyPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["paraboloidSkyPS"]->GetBufferPointer()),
+		mShaders["paraboloidSkyPS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&paraboloidSkyPsoDesc, IID_PPV_ARGS(&mPSOs["paraboloidSky"])));
+
+	//
+	// PSOs for reflectors that reflect the dual-paraboloid map, in the main view and
+	// in the reflection probes.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC paraboloidReflectorPsoDesc = opaquePsoDesc;
+	paraboloidReflectorPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["paraboloidReflectorPS"]->GetBufferPointer()),
+		mShaders["paraboloidReflectorPS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&paraboloidReflectorPsoDesc, IID_PPV_ARGS(&mPSOs["paraboloidReflector"])));
+
+	paraboloidReflectorPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["probeParaboloidReflectorPS"]->GetBufferPointer()),
+		mShaders["probeParaboloidReflectorPS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&paraboloidReflectorPsoDesc, IID_PPV_ARGS(&mPSOs["probeParaboloidReflector"])));
 }
 
 void DynamicCubeMapApp::BuildFrameResources()
@@ -1067,7 +1702,7 @@ void DynamicCubeMapApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            7, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            ParaboloidPassIndex(mReflectionProbes.ProbeCount(), 2), (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
     }
 }
 
@@ -1132,6 +1767,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	skyRitem->IndexCount = skyRitem->Geo->DrawArgs["sphere"].IndexCount;
 	skyRitem->StartIndexLocation = skyRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 	skyRitem->BaseVertexLocation = skyRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	skyRitem->Bounds = skyRitem->Geo->DrawArgs["sphere"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Sky].push_back(skyRitem.get());
 	mAllRitems.push_back(std::move(skyRitem));
@@ -1146,6 +1782,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
 
 	mSkullRitem = skullRitem.get();
 
@@ -1162,6 +1799,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
 	mAllRitems.push_back(std::move(boxRitem));
@@ -1176,6 +1814,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	globeRitem->IndexCount = globeRitem->Geo->DrawArgs["sphere"].IndexCount;
 	globeRitem->StartIndexLocation = globeRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 	globeRitem->BaseVertexLocation = globeRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	globeRitem->Bounds = globeRitem->Geo->DrawArgs["sphere"].Bounds;
 
 	mMirrorCube = globeRitem.get();
 
@@ -1192,6 +1831,7 @@ void DynamicCubeMapApp::BuildRenderItems()
     gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
     gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
     gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	gridRitem->Bounds = gridRitem->Geo->DrawArgs["grid"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 	mAllRitems.push_back(std::move(gridRitem));
@@ -1220,6 +1860,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		leftCylRitem->Bounds = leftCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
@@ -1230,6 +1871,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		rightCylRitem->Bounds = rightCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1240,6 +1882,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		leftSphereRitem->Bounds = leftSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1250,6 +1893,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		rightSphereRitem->Bounds = rightSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		mRitemLayer[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
 		mRitemLayer[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
@@ -1261,33 +1905,107 @@ void DynamicCubeMapApp::BuildRenderItems()
 		mAllRitems.push_back(std::move(leftSphereRitem));
 		mAllRitems.push_back(std::move(rightSphereRitem));
 	}
+
+	for(auto& ri : mAllRitems)
+	{
+		BoundingBox boundsW;
+		ri->Bounds.Transform(boundsW, XMLoadFloat4x4(&ri->World));
+		mCuller.AddItem(boundsW);
+	}
 }
 
 void DynamicCubeMapApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
- 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-
     // For each render item...
     for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
+		DrawRenderItem(cmdList, ritems[i], 1);
+}
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+void DynamicCubeMapApp::DrawRenderItem(ID3D12GraphicsCommandList* cmdList, const RenderItem* ri, UINT instanceCount)
+{
+    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
 
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+    cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+    cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+    cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+    D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+
+	cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+
+    cmdList->DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 }
 
+class DynamicCubeMapApp::CubePassRecorder : public CubePassCommandList
+{
+public:
+	explicit CubePassRecorder(DynamicCubeMapApp& app) : mApp(app)
+	{
+		mSinglePass = app.mCubePassMode == CubePassMode::SinglePass;
+	}
+
+	virtual void ClearRenderTarget(int face)override
+	{
+		mApp.mCommandList->ClearRenderTargetView(mApp.mDynamicCubeMap->Rtv(face), Colors::LightSteelBlue, 0, nullptr);
+	}
+
+	virtual void ClearDepth(int face)override
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE dsv = face == AllCubeFaces ? mApp.mCubeArrayDSV : mApp.mCubeDSV;
+		mApp.mCommandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+	}
+
+	virtual void SetRenderTarget(int face)override
+	{
+		if(face == AllCubeFaces)
+			mApp.mCommandList->OMSetRenderTargets(1, &mApp.mDynamicCubeMap->ArrayRtv(), true, &mApp.mCubeArrayDSV);
+		else
+			mApp.mCommandList->OMSetRenderTargets(1, &mApp.mDynamicCubeMap->Rtv(face), true, &mApp.mCubeDSV);
+	}
+
+	virtual void SetPassConstants(int face)override
+	{
+		// Cube map pass cbuffers are stored in elements 1-6.
+		UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+		auto passCB = mApp.mCurrFrameResource->PassCB->Resource();
+		mApp.mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress() + (1 + face)*passCBByteSize);
+	}
+
+	virtual void SetFaceConstants()override
+	{
+		auto cubeFaceCB = mApp.mCurrFrameResource->CubeFaceCB->Resource();
+		mApp.mCommandList->SetGraphicsRootConstantBufferView(5, cubeFaceCB->GetGPUVirtualAddress());
+	}
+
+	virtual void SetPipeline(int layer)override
+	{
+		const char* pso = layer == (int)RenderLayer::Sky ?
+			(mSinglePass ? "cubeSky" : "sky") :
+			(mSinglePass ? "cubeOpaque" : "opaque");
+		mApp.mCommandList->SetPipelineState(mApp.mPSOs[pso].Get());
+	}
+
+	virtual void DrawItem(int item, UINT instanceCount, UINT faceList)override
+	{
+		if(mSinglePass)
+			mApp.mCommandList->SetGraphicsRoot32BitConstant(6, faceList, 0);
+
+		mApp.DrawRenderItem(mApp.mCommandList.Get(), mApp.mCubePassRitems[item], instanceCount);
+		++mApp.mCubeMapDraws;
+	}
+
+private:
+	DynamicCubeMapApp& mApp;
+	bool mSinglePass = false;
+};
+
 void DynamicCubeMapApp::DrawSceneToCubeMap()
 {
+	if(mCubeFaceCount == 0)
+		return;
+
 	mCommandList->RSSetViewports(1, &mDynamicCubeMap->Viewport());
 	mCommandList->RSSetScissorRects(1, &mDynamicCubeMap->ScissorRect());
 
@@ -1295,30 +2013,36 @@ void DynamicCubeMapApp::DrawSceneToCubeMap()
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDynamicCubeMap->Resource(),
 		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
-	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
-
-	// For each cube map face.
-	for(int i = 0; i < 6; ++i)
+	// The opaque items and then the sky, each with the faces that can see it.  A bake
+	// only holds what BakedSceneHash covers, so the skull is left out of it.
+	bool capturingBake = mCubeReadback != nullptr && mCubeReadbackFence == 0;
+	mCubePassItems.clear();
+	mCubePassRitems.clear();
+	for(RenderLayer layer : { RenderLayer::Opaque, RenderLayer::Sky })
 	{
-		// Clear the back buffer and depth buffer.
-		mCommandList->ClearRenderTargetView(mDynamicCubeMap->Rtv(i), Colors::LightSteelBlue, 0, nullptr);
-		mCommandList->ClearDepthStencilView(mCubeDSV, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-
-		// Specify the buffers we are going to render to.
-		mCommandList->OMSetRenderTargets(1, &mDynamicCubeMap->Rtv(i), true, &mCubeDSV);
-
-		// Bind the pass constant buffer for this cube map face so we use 
-		// the right view/proj matrix for this cube face.
-		auto passCB = mCurrFrameResource->PassCB->Resource();
-		D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1+i)*passCBByteSize;
-		mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+		for(RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			if(capturingBake && ri == mSkullRitem)
+				continue;
+
+			CubePassItem item;
+			item.Layer = (int)layer;
+			item.FaceMask = mCubeFaceMasks[ri->ObjCBIndex];
+			mCubePassItems.push_back(item);
+			mCubePassRitems.push_back(ri);
+		}
+	}
 
-		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	// The faces that are not scheduled keep what they were last rendered with.
+	CubePassRecorder recorder(*this);
+	CubeMapPass::Record(mCubePassMode, mCubeFaces, mCubeFaceCount, mCubePassItems, recorder);
 
-		mCommandList->SetPipelineState(mPSOs["sky"].Get());
-		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+	mCommandList->SetPipelineState(mPSOs["opaque"].Get());
 
-		mCommandList->SetPipelineState(mPSOs["opaque"].Get());
+	for(int f = 0; f < mCubeFaceCount; ++f)
+	{
+		int i = mCubeFaces[f];
+		mCubeFaceScheduler.FaceRendered(i, mCubeFaceViews.Center());
 	}
 
 	// Change back to GENERIC_READ so we can read the texture in a shader.
@@ -1383,40 +2107,209 @@ std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> DynamicCubeMapApp::GetStaticSam
 		anisotropicWrap, anisotropicClamp };
 }
 
-void DynamicCubeMapApp::BuildCubeFaceCamera(float x, float y, float z)
+void DynamicCubeMapApp::UpdateDynamicResolution(const GameTimer& gt)
 {
-	// Generate the cube map about the given position.
-	XMFLOAT3 center(x, y, z);
-	XMFLOAT3 worldUp(0.0f, 1.0f, 0.0f);
-
-	// Look along each coordinate axis.
-	XMFLOAT3 targets[6] =
-	{
-		XMFLOAT3(x + 1.0f, y, z), // +X
-		XMFLOAT3(x - 1.0f, y, z), // -X
-		XMFLOAT3(x, y + 1.0f, z), // +Y
-		XMFLOAT3(x, y - 1.0f, z), // -Y
-		XMFLOAT3(x, y, z + 1.0f), // +Z
-		XMFLOAT3(x, y, z - 1.0f)  // -Z
-	};
+	if(!mResolutionController.Update(gt.DeltaTime()*1000.0f))
+		return;
+
+	const DynamicResolutionTelemetry& t = mResolutionController.Telemetry();
+	LOG_INFO("DRS: {} ms (filtered {} ms), scale {}, cube map {}x{}",
+		t.FrameMs, t.FilteredMs, t.Scale, t.CubeSize, t.CubeSize);
 
-	// Use world up vector (0,1,0) for all directions except +Y/-Y.  In these cases, we
-	// are looking down +Y or -Y, so we need a different "up" vector.
-	XMFLOAT3 ups[6] =
+	// Only the cube map faces scale: the main view renders straight into the back
+	// buffer, with no offscreen target to render smaller and upscale, so its scale
+	// is only logged.  The cube map size is a cap on the one UpdateCubeMapResolution
+	// picks.
+}
+
+void DynamicCubeMapApp::UpdateCubeMapResolution()
+{
+	// World space radius of the mirrored globe.
+	BoundingBox boundsW;
+	mMirrorCube->Bounds.Transform(boundsW, XMLoadFloat4x4(&mMirrorCube->World));
+
+	CubeResolutionInput input;
+	input.Radius = std::max<float>(boundsW.Extents.x, std::max<float>(boundsW.Extents.y, boundsW.Extents.z));
+	input.Distance = mDistToCube;
+	input.FovY = mCamera.GetFovY();
+	input.ViewportHeight = (float)mClientHeight;
+	input.Cap = mResolutionController.CubeMapSize();
+
+	// A bake is captured at its own size, so the file does not depend on how large
+	// the reflector happened to be on screen.
+	UINT size = mCubeResolution.Update(input);
+	if(mCubeReadback != nullptr)
+		size = mCubeBakeSettings.Size;
+
+	if(size == mDynamicCubeMap->Width())
+		return;
+
+	// The old cube map and depth buffer may still be referenced by frames in flight.
+	FlushCommandQueue();
+	mDynamicCubeMap = mCubeMapPool->Acquire(size);
+	mCubeFaceScheduler.Invalidate();
+
+	char text[256];
+	sprintf_s(text, "Cube map %ux%u: reflector %.0f pixels across at distance %.1f, cap %u",
+		size, size, mCubeResolution.ScreenDiameter(), mDistToCube, input.Cap);
+	Log::WriteText(LogLevel::Info, text);
+	Log::WriteText(LogLevel::Info, mCubeMapPool->Report());
+}
+
+void DynamicCubeMapApp::ScheduleCubeMapFaces(const GameTimer& gt)
+{
+	// Nothing reads the cube map while every dynamic reflector uses the
+	// dual-paraboloid map.  Faces that change meanwhile stay dirty until it is drawn.
+	bool cubeInUse = false;
+	for(RenderItem* ri : mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors])
+		cubeInUse |= ri->EnvMap == EnvironmentMap::Cube;
+
+	// The bake stands in for every face.
+	if(mUseBakedCube || !cubeInUse)
 	{
-		XMFLOAT3(0.0f, 1.0f, 0.0f),  // +X
-		XMFLOAT3(0.0f, 1.0f, 0.0f),  // -X
-		XMFLOAT3(0.0f, 0.0f, -1.0f), // +Y
-		XMFLOAT3(0.0f, 0.0f, +1.0f), // -Y
-		XMFLOAT3(0.0f, 1.0f, 0.0f),	 // +Z
-		XMFLOAT3(0.0f, 1.0f, 0.0f)	 // -Z
-	};
+		mCubeFaceCount = 0;
+		return;
+	}
 
-	for(int i = 0; i < 6; ++i)
+	if(mCubeFaceSweep)
 	{
-		mCubeMapCamera[i].LookAt(center, targets[i], ups[i]);
-		mCubeMapCamera[i].SetLens(0.5f*XM_PI, 1.0f, 0.1f, 1000.0f);
-		mCubeMapCamera[i].UpdateViewMatrix();
+		// Warm up for a while, then time 600 frames at each setting.
+		const int sweepFaces[] = { 6, 3, 2, 1 };
+		const int warmupFrames = 120;
+		const int sampleFrames = 600;
+
+		if(mSweepStep < (int)_countof(sweepFaces))
+		{
+			// Every face is redrawn in turn, changed or not.
+			mCubeFaceScheduler.SetSchedule(CubeFaceSchedule::RoundRobin);
+			mCubeFaceScheduler.SetFacesPerFrame(sweepFaces[mSweepStep]);
+
+			if(++mSweepFrames > warmupFrames)
+				mSweepMs += gt.DeltaTime()*1000.0;
+
+			if(mSweepFrames == warmupFrames + sampleFrames)
+			{
+				double ms = mSweepMs / sampleFrames;
+				if(mSweepStep == 0)
+					mSweepBaselineMs = ms;
+
+				LOG_INFO("Cube map {} faces per frame: {} ms per frame ({}% of 6 faces per frame)",
+					sweepFaces[mSweepStep], ms, 100.0*ms / mSweepBaselineMs);
+
+				++mSweepStep;
+				mSweepFrames = 0;
+				mSweepMs = 0.0;
+			}
+		}
+	}
+
+	XMFLOAT3 reflectorPos{ mMirrorCube->World._41, mMirrorCube->World._42, mMirrorCube->World._43 };
+
+	float faceWeights[6];
+	CubeMapUpdateScheduler::SphereFaceWeights(mCamera.GetPosition3f(), reflectorPos, faceWeights);
+	mCubeFaceCount = mCubeFaceScheduler.BeginFrame(faceWeights, mCubeFaces);
+
+	if(mCubeFaceScheduler.Frames() % 600 == 0)
+	{
+		char text[160];
+		sprintf_s(text, "Cube map: %llu faces re-rendered and %llu skipped in %llu frames",
+			mCubeFaceScheduler.FacesRendered(), mCubeFaceScheduler.FacesSkipped(), mCubeFaceScheduler.Frames());
+		Log::WriteText(LogLevel::Info, text);
+	}
+}
+
+void DynamicCubeMapApp::TrackCubeFaceChanges()
+{
+	// The lens follows mDistToCube, so moving the camera changes what every face sees.
+	float cubeSize = (float)mDynamicCubeMap->Width();
+	if(mCubeFaceViews.Update(mCubeMapCenter, 0.5f * XM_PI * (mDistToCube / 10.0f), 0.1f, 1000.0f, cubeSize))
+	{
+		mPassStatFacesBuilt += 6;
+
+		XMFLOAT4X4 viewProj[6];
+		for(int i = 0; i < 6; ++i)
+			viewProj[i] = mCubeFaceViews.ViewProj(i);
+		mCubeFaceDependencies.SetViews(viewProj);
+	}
+
+	// So does a change of lighting.
+	const size_t lightingOffset = offsetof(FrameConstants, AmbientLight);
+	if(memcmp((const char*)&mFrameCB + lightingOffset, (const char*)&mCubeFaceLighting + lightingOffset,
+		sizeof(FrameConstants) - lightingOffset) != 0)
+	{
+		mCubeFaceScheduler.InvalidateFaces(CubeFaceDependencies::AllFaces);
+		mCubeFaceLighting = mFrameCB;
+	}
+
+	// Items changed this frame still have every frame resource to update.  The sky
+	// is one of the items and every face sees it.
+	for(RenderLayer layer : { RenderLayer::Opaque, RenderLayer::Sky })
+	{
+		for(RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			if(ri->NumFramesDirty != gNumFrameResources)
+				continue;
+
+			BoundingBox boundsW;
+			ri->Bounds.Transform(boundsW, XMLoadFloat4x4(&ri->World));
+			mCubeFaceDependencies.SetItem(ri->ObjCBIndex, boundsW);
+		}
+	}
+
+	mCubeFaceScheduler.InvalidateFaces(mCubeFaceDependencies.Update());
+}
+
+void DynamicCubeMapApp::CullRenderItems()
+{
+	// Only the skull moves, but refreshing every box is cheaper than tracking it.
+	for(auto& ri : mAllRitems)
+	{
+		BoundingBox boundsW;
+		ri->Bounds.Transform(boundsW, XMLoadFloat4x4(&ri->World));
+		mCuller.SetItem(ri->ObjCBIndex, boundsW);
+	}
+
+	mCuller.ClearViews();
+
+	// View 0 is the main camera and view 1+f scheduled face mCubeFaces[f].
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, mCamera.GetView() * mCamera.GetProj());
+	mCuller.AddView(viewProj);
+
+	// UpdateCubeMapFacePassCBs has already brought the face views up to date.
+	for(int f = 0; f < mCubeFaceCount; ++f)
+		mCuller.AddView(mCubeFaceViews.ViewProj(mCubeFaces[f]));
+
+	// Then the probe faces drawn this frame.
+	for(const ProbeFaceUpdate& u : mProbeUpdates)
+		mCuller.AddView(mProbeFaceViews[u.Probe].ViewProj(u.Face));
+
+	mCuller.Cull();
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		std::vector<RenderItem*>& visible = mVisibleRitems[layer];
+		visible.clear();
+
+		for(RenderItem* ri : mRitemLayer[layer])
+		{
+			if(mCuller.Visible(ri->ObjCBIndex, 0))
+				visible.push_back(ri);
+		}
+	}
+
+	mCubeFaceMasks.resize(mAllRitems.size());
+	for(auto& ri : mAllRitems)
+	{
+		MultiViewCuller::ViewMask views = mCuller.Mask(ri->ObjCBIndex);
+
+		UINT faceMask = 0;
+		for(int f = 0; f < mCubeFaceCount; ++f)
+		{
+			if(views & ((MultiViewCuller::ViewMask)1 << (1 + f)))
+				faceMask |= 1u << mCubeFaces[f];
+		}
+		mCubeFaceMasks[ri->ObjCBIndex] = faceMask;
 	}
 }
 
@@ -1427,4 +2320,375 @@ void DynamicCubeMapApp::UpdateCameraDistToCube()
 	// Length is stored in all components
 	XMStoreFloat3(&distVector, XMVector3Length(XMLoadFloat3(&cubePosition) - XMLoadFloat3(&mCamera.GetPosition3f())));
 	mDistToCube = distVector.x;
+}
+
+void DynamicCubeMapApp::BuildReflectionProbes()
+{
+	// Three probes down the length of the grid.  Neighbouring influence boxes overlap
+	// by the blend distance, so items between them fade from one probe to the other.
+	// The middle probe is captured from above the mirrored globe.
+	const XMFLOAT3 extents(10.0f, 6.0f, 6.0f);
+	const float blendDistance = 2.0f;
+
+	mReflectionProbes.AddProbe(XMFLOAT3(0.0f, 2.0f, -10.0f), XMFLOAT3(0.0f, 4.0f, -10.0f), extents, blendDistance);
+	mReflectionProbes.AddProbe(XMFLOAT3(0.0f, 5.0f, 0.0f), XMFLOAT3(0.0f, 4.0f, 0.0f), extents, blendDistance);
+	mReflectionProbes.AddProbe(XMFLOAT3(0.0f, 2.0f, 10.0f), XMFLOAT3(0.0f, 4.0f, 10.0f), extents, blendDistance);
+
+	// The probes never move, so their face views are built once.
+	mProbeFaceViews.resize(mReflectionProbes.ProbeCount());
+	for(int i = 0; i < mReflectionProbes.ProbeCount(); ++i)
+	{
+		mProbeFaceViews[i].Update(mReflectionProbes.Probe(i).PositionW, 0.5f*XM_PI, 0.1f, 1000.0f, (float)ReflectionProbeSize);
+		mPassStatFacesBuilt += 6;
+	}
+}
+
+void DynamicCubeMapApp::ScheduleReflectionProbes()
+{
+	ProbeView view;
+	view.EyePosW = mCamera.GetPosition3f();
+	view.LookW = mCamera.GetLook3f();
+	view.FovY = mCamera.GetFovY();
+	view.ViewportHeight = (float)mClientHeight;
+
+	mReflectionProbes.BeginFrame(view, mProbeUpdates);
+
+	if(mReflectionProbes.Frames() % 600 == 0)
+	{
+		char text[160];
+		sprintf_s(text, "Reflection probes: %llu faces in %llu frames (%.2f per frame), oldest face %llu frames",
+			mReflectionProbes.FacesRendered(), mReflectionProbes.Frames(),
+			(double)mReflectionProbes.FacesRendered() / mReflectionProbes.Frames(), mReflectionProbes.OldestFaceAge());
+		Log::WriteText(LogLevel::Info, text);
+	}
+}
+
+void DynamicCubeMapApp::AssignReflectionProbes()
+{
+	// Only the skull moves, but reassigning every item is cheap.  The dynamic
+	// reflectors have their own cube map and the sky reflects nothing.
+	for(RenderItem* ri : mRitemLayer[(int)RenderLayer::Opaque])
+	{
+		BoundingBox boundsW;
+		ri->Bounds.Transform(boundsW, XMLoadFloat4x4(&ri->World));
+
+		ProbeAssignment probes = mReflectionProbes.Assign(boundsW.Center);
+		if(probes != ri->Probes)
+		{
+			ri->Probes = probes;
+			ri->NumFramesDirty = gNumFrameResources;
+		}
+	}
+}
+
+void DynamicCubeMapApp::UpdateReflectionProbePassCBs()
+{
+	if(mCurrFrameResource->ProbePassCBsWritten)
+		return;
+
+	// Every face of every probe, so whichever faces are scheduled later already
+	// have their constants.
+	auto currPassCB = mCurrFrameResource->PassCB.get();
+	for(int probe = 0; probe < mReflectionProbes.ProbeCount(); ++probe)
+	{
+		for(int face = 0; face < 6; ++face)
+		{
+			currPassCB->CopyData(ProbePassIndex(probe, face), mProbeFaceViews[probe].PassCB(face));
+			mPassStatBytesCopied += sizeof(PassConstants);
+		}
+	}
+
+	mCurrFrameResource->ProbePassCBsWritten = true;
+}
+
+void DynamicCubeMapApp::ReportPassConstantSavings()
+{
+	// Before, every face drawn built its view and three inverses and copied pass
+	// constants holding the lights, and the cube face matrices were copied each frame.
+	UINT64 facesDrawn = mCubeFaceCount + mProbeUpdates.size();
+	mPassStatFacesBuiltBefore += facesDrawn;
+	mPassStatBytesCopiedBefore += facesDrawn * (sizeof(PassConstants) + sizeof(FrameConstants)) + sizeof(CubeFaceConstants);
+
+	if(++mPassStatFrames % 600 != 0)
+		return;
+
+	double frames = (double)mPassStatFrames;
+	char text[200];
+	sprintf_s(text, "Face pass constants per frame: %.2f faces built (%.2f before), %.0f bytes copied (%.0f before)",
+		mPassStatFacesBuilt / frames, mPassStatFacesBuiltBefore / frames,
+		mPassStatBytesCopied / frames, mPassStatBytesCopiedBefore / frames);
+	Log::WriteText(LogLevel::Info, text);
+}
+
+void DynamicCubeMapApp::DrawReflectionProbes()
+{
+	if(mProbeUpdates.empty())
+		return;
+
+	mCommandList->RSSetViewports(1, &mProbeMaps->Viewport());
+	mCommandList->RSSetScissorRects(1, &mProbeMaps->ScissorRect());
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mProbeMaps->Resource(),
+		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE skyTexDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	skyTexDescriptor.Offset(mSkyTexHeapIndex, mCbvSrvUavDescriptorSize);
+	CD3DX12_GPU_DESCRIPTOR_HANDLE dynamicTexDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	dynamicTexDescriptor.Offset(mUseBakedCube ? mBakedTexHeapIndex : mDynamicTexHeapIndex, mCbvSrvUavDescriptorSize);
+
+	// The items of a layer the face's culling view sees.
+	auto visibleItems = [this](RenderLayer layer, int view) -> const std::vector<RenderItem*>&
+	{
+		mProbeFaceRitems.clear();
+		for(RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			if(mCuller.Visible(ri->ObjCBIndex, view))
+				mProbeFaceRitems.push_back(ri);
+		}
+		return mProbeFaceRitems;
+	};
+
+	for(size_t k = 0; k < mProbeUpdates.size(); ++k)
+	{
+		const ProbeFaceUpdate& u = mProbeUpdates[k];
+		const int view = 1 + mCubeFaceCount + (int)k;
+
+		D3D12_CPU_DESCRIPTOR_HANDLE rtv = mProbeMaps->Rtv(u.Probe, u.Face);
+		D3D12_CPU_DESCRIPTOR_HANDLE dsv = mProbeMaps->Dsv();
+
+		mCommandList->ClearRenderTargetView(rtv, Colors::LightSteelBlue, 0, nullptr);
+		mCommandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+		mCommandList->OMSetRenderTargets(1, &rtv, true, &dsv);
+
+		mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress() +
+			ProbePassIndex(u.Probe, u.Face)*passCBByteSize);
+
+		mCommandList->SetPipelineState(mPSOs["probeOpaque"].Get());
+
+		mCommandList->SetGraphicsRootDescriptorTable(3, dynamicTexDescriptor);
+		DrawDynamicReflectors(visibleItems(RenderLayer::OpaqueDynamicReflectors, view), true);
+
+		mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
+		DrawRenderItems(mCommandList.Get(), visibleItems(RenderLayer::Opaque, view));
+
+		mCommandList->SetPipelineState(mPSOs["sky"].Get());
+		DrawRenderItems(mCommandList.Get(), visibleItems(RenderLayer::Sky, view));
+	}
+
+	mCommandList->SetPipelineState(mPSOs["opaque"].Get());
+
+	for(const ProbeFaceUpdate& u : mProbeUpdates)
+		mReflectionProbes.FaceRendered(u.Probe, u.Face);
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mProbeMaps->Resource(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
+}
+
+void DynamicCubeMapApp::LoadBakedCubeMap(std::uint64_t sceneHash)
+{
+	mCubeBakePath = CubeMapBake::CachePath(L"BakedCubeMaps", sceneHash, mCubeMapCenter, mCubeBakeSettings);
+
+	auto bakedTex = std::make_unique<Texture>();
+	bakedTex->Name = "bakedCubeMap";
+	bakedTex->Filename = mCubeBakePath;
+	if(FAILED(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(), mCommandList.Get(),
+		bakedTex->Filename.c_str(), bakedTex->Resource, bakedTex->UploadHeap)))
+	{
+		LOG_INFO("No cube map bake at {}; capturing one at {}x{}.", mCubeBakePath,
+			mCubeBakeSettings.Size, mCubeBakeSettings.Size);
+		mCubeReadback = std::make_unique<CubeMapReadback>(md3dDevice.Get());
+		return;
+	}
+
+	auto bakedRes = bakedTex->Resource;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = bakedRes->GetDesc().Format;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MostDetailedMip = 0;
+	srvDesc.TextureCube.MipLevels = bakedRes->GetDesc().MipLevels;
+	srvDesc.TextureCube.ResourceMinLODClamp = 0.0f;
+	md3dDevice->CreateShaderResourceView(bakedRes.Get(), &srvDesc,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), mBakedTexHeapIndex, mCbvSrvUavDescriptorSize));
+
+	mTextures[bakedTex->Name] = std::move(bakedTex);
+	mUseBakedCube = true;
+	LOG_INFO("Reflecting the cube map bake {}; live capture is skipped.", mCubeBakePath);
+}
+
+void DynamicCubeMapApp::FinishCubeMapBake()
+{
+	if(mCubeReadback == nullptr || mCubeReadbackFence == 0 || mFence->GetCompletedValue() < mCubeReadbackFence)
+		return;
+
+	mCubeReadback->ReadFaces(mCubeBakeFaces);
+	UINT size = mCubeReadback->Size();
+	mCubeReadback = nullptr;
+
+	// Encoding takes longer than a frame at the larger sizes, so it runs off the
+	// render thread: a task per face, then the write.  mCubeBakePath, mCubeBakeSettings
+	// and mCubeBakeFaces are not touched again here.
+	mCubeBakeWriter = std::thread([this, size]()
+	{
+		std::vector<std::uint8_t> data[6];
+		bool written = false;
+
+		TaskGraph bake;
+		std::vector<TaskGraph::TaskId> encodes;
+		for(int face = 0; face < 6; ++face)
+		{
+			encodes.push_back(bake.Add("EncodeFace", [this, &data, face, size]()
+			{
+				CubeMapBake::EncodeFace(mCubeBakeFaces[face], size, mCubeBakeSettings, data[face]);
+			}));
+		}
+		bake.Add("WriteCubeDDS", [this, &data, &written, size]()
+		{
+			written = CubeMapBake::WriteEncodedCubeDDS(mCubeBakePath, data, size, mCubeBakeSettings);
+		}, encodes);
+		bake.Run();
+
+		if(written)
+			LOG_INFO("Baked the {}x{} cube map to {} ({} bytes of texels) in {} ms.", size, size, mCubeBakePath,
+				CubeMapBake::DataSize(size, mCubeBakeSettings), bake.WallMs());
+		else
+			LOG_ERROR("Could not write the cube map bake {}.", mCubeBakePath);
+	});
+}
+
+void DynamicCubeMapApp::UpdateParaboloidMap()
+{
+	mDrawParaboloidMap = false;
+	for(RenderItem* ri : mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors])
+		mDrawParaboloidMap |= ri->EnvMap == EnvironmentMap::DualParaboloid;
+
+	// Captured from where the cube map is, so switching maps keeps the reflection
+	// in place.
+	mParaboloidViews.Update(mCubeMapCenter, 0.1f, 1000.0f, (float)mParaboloidMap->Size());
+
+	UINT version = mParaboloidViews.Version();
+	if(mDrawParaboloidMap && mCurrFrameResource->ParaboloidPassVersion != version)
+	{
+		auto currPassCB = mCurrFrameResource->PassCB.get();
+		for(int h = 0; h < 2; ++h)
+		{
+			currPassCB->CopyData(ParaboloidPassIndex(mReflectionProbes.ProbeCount(), h), mParaboloidViews.PassCB(h));
+			mPassStatBytesCopied += sizeof(PassConstants);
+		}
+		mCurrFrameResource->ParaboloidPassVersion = version;
+	}
+
+	// The hemispheres are half spaces rather than frustums, so they are culled here
+	// instead of by mCuller.
+	mParaboloidMasks.resize(mAllRitems.size());
+	for(RenderLayer layer : { RenderLayer::Opaque, RenderLayer::Sky })
+	{
+		for(RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			BoundingBox boundsW;
+			ri->Bounds.Transform(boundsW, XMLoadFloat4x4(&ri->World));
+			mParaboloidMasks[ri->ObjCBIndex] = mParaboloidViews.HemisphereMask(boundsW);
+		}
+	}
+}
+
+void DynamicCubeMapApp::ReportEnvironmentMapDraws()
+{
+	// Redrawing a whole map draws each item once per view that sees it.  The cube
+	// count is for drawing face by face; the single pass instances those draws.
+	for(RenderLayer layer : { RenderLayer::Opaque, RenderLayer::Sky })
+	{
+		for(RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			mCubeMapFullDraws += CubeMapPass::FaceCount(mCubeFaceDependencies.ItemFaces(ri->ObjCBIndex));
+			mParaboloidFullDraws += CubeMapPass::FaceCount(mParaboloidMasks[ri->ObjCBIndex]);
+		}
+	}
+
+	if(++mEnvDrawStatFrames % 600 != 0)
+		return;
+
+	double frames = (double)mEnvDrawStatFrames;
+	char text[240];
+	sprintf_s(text, "Environment map draws per frame: cube map %.2f (%.2f for all 6 faces), dual paraboloid %.2f (%.2f for both hemispheres)",
+		mCubeMapDraws / frames, mCubeMapFullDraws / frames,
+		mParaboloidDraws / frames, mParaboloidFullDraws / frames);
+	Log::WriteText(LogLevel::Info, text);
+}
+
+void DynamicCubeMapApp::DrawDynamicReflectors(const std::vector<RenderItem*>& ritems, bool probeCapture)
+{
+	// Each reflector reads the environment map it uses.  Probe captures cannot
+	// reflect the probes.
+	const char* cubePso = probeCapture ? "probeOpaque" : "opaque";
+	const char* paraboloidPso = probeCapture ? "probeParaboloidReflector" : "paraboloidReflector";
+
+	const char* currentPso = cubePso;
+	for(RenderItem* ri : ritems)
+	{
+		const char* pso = ri->EnvMap == EnvironmentMap::DualParaboloid ? paraboloidPso : cubePso;
+		if(pso != currentPso)
+		{
+			mCommandList->SetPipelineState(mPSOs[pso].Get());
+			currentPso = pso;
+		}
+
+		DrawRenderItem(mCommandList.Get(), ri, 1);
+	}
+
+	// The layers drawn next expect the cube reflectors' PSO.
+	if(currentPso != cubePso)
+		mCommandList->SetPipelineState(mPSOs[cubePso].Get());
+}
+
+void DynamicCubeMapApp::DrawSceneToParaboloidMap()
+{
+	if(!mDrawParaboloidMap)
+		return;
+
+	mCommandList->RSSetViewports(1, &mParaboloidMap->Viewport());
+	mCommandList->RSSetScissorRects(1, &mParaboloidMap->ScissorRect());
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mParaboloidMap->Resource(),
+		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+
+	for(int h = 0; h < 2; ++h)
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE rtv = mParaboloidMap->Rtv(h);
+		D3D12_CPU_DESCRIPTOR_HANDLE dsv = mParaboloidMap->Dsv();
+
+		mCommandList->ClearRenderTargetView(rtv, Colors::LightSteelBlue, 0, nullptr);
+		mCommandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+		mCommandList->OMSetRenderTargets(1, &rtv, true, &dsv);
+
+		mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress() +
+			ParaboloidPassIndex(mReflectionProbes.ProbeCount(), h)*passCBByteSize);
+
+		// Like the cube map, the hemispheres see everything but the dynamic reflectors.
+		for(RenderLayer layer : { RenderLayer::Opaque, RenderLayer::Sky })
+		{
+			mCommandList->SetPipelineState(mPSOs[layer == RenderLayer::Sky ? "paraboloidSky" : "paraboloidOpaque"].Get());
+
+			for(RenderItem* ri : mRitemLayer[(int)layer])
+			{
+				if((mParaboloidMasks[ri->ObjCBIndex] & (1u << h)) == 0)
+					continue;
+
+				DrawRenderItem(mCommandList.Get(), ri, 1);
+				++mParaboloidDraws;
+			}
+		}
+	}
+
+	mCommandList->SetPipelineState(mPSOs["opaque"].Get());
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mParaboloidMap->Resource(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
 }
\ No newline at end of file
@@ -7,8 +7,10 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
     PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
+    FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
 	MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    CubeFaceCB = std::make_unique<UploadBuffer<CubeFaceConstants>>(device, 1, true);
 }
 
 FrameResource::~FrameResource()
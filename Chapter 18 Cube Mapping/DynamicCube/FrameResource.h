@@ -9,7 +9,14 @@ struct ObjectConstants
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 	UINT     MaterialIndex;
+
+	// Reflection probes, nearest first (-1 for none), and their weights.  The
+	// cube map bound to gCubeMap gets the rest.
+	INT      Probe0 = -1;
+	INT      Probe1 = -1;
 	UINT     ObjPad0;
+	float    ProbeWeight0 = 0.0f;
+	float    ProbeWeight1 = 0.0f;
 	UINT     ObjPad1;
 	UINT     ObjPad2;
 };
@@ -28,8 +35,15 @@ struct PassConstants
     DirectX::XMFLOAT2 InvRenderTargetSize = { 0.0f, 0.0f };
     float NearZ = 0.0f;
     float FarZ = 0.0f;
+};
+
+// Constants shared by every pass of a frame, so the per view constants above stay
+// small enough to be cached per cube map face.
+struct FrameConstants
+{
     float TotalTime = 0.0f;
     float DeltaTime = 0.0f;
+    DirectX::XMFLOAT2 cbPerFramePad1 = { 0.0f, 0.0f };
 
     DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
 
@@ -40,6 +54,12 @@ struct PassConstants
     Light Lights[MaxLights];
 };
 
+// View-projection matrix of every cube map face, for the single pass cube map.
+struct CubeFaceConstants
+{
+    DirectX::XMFLOAT4X4 ViewProj[6];
+};
+
 struct MaterialData
 {
 	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -80,11 +100,24 @@ public:
     // We cannot update a cbuffer until the GPU is done processing the commands
     // that reference it.  So each frame needs their own cbuffers.
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+    std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+    std::unique_ptr<UploadBuffer<CubeFaceConstants>> CubeFaceCB = nullptr;
 
 	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
+
+    // Version of the cube map face views last copied to each face's pass constants
+    // and to CubeFaceCB, so unchanged constants are not copied again.
+    UINT CubeFacePassVersion[6] = { 0, 0, 0, 0, 0, 0 };
+    UINT CubeFaceCBVersion = 0;
+
+    // The reflection probes never move, so their pass constants are written once.
+    bool ProbePassCBsWritten = false;
+
+    // Version of the dual-paraboloid views last copied to their pass constants.
+    UINT ParaboloidPassVersion = 0;
 };
\ No newline at end of file
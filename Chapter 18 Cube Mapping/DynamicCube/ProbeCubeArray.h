@@ -0,0 +1,62 @@
+//***************************************************************************************
+// ProbeCubeArray.h
+//
+// The cube maps of every reflection probe in one cube map array, read through a single
+// TextureCubeArray SRV and rendered a face at a time.  The faces share one depth buffer.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+class ProbeCubeArray
+{
+public:
+	ProbeCubeArray(ID3D12Device* device, UINT probeCount, UINT size,
+		DXGI_FORMAT format, DXGI_FORMAT depthFormat);
+
+	ProbeCubeArray(const ProbeCubeArray& rhs)=delete;
+	ProbeCubeArray& operator=(const ProbeCubeArray& rhs)=delete;
+
+	ID3D12Resource* Resource();
+	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv();
+	CD3DX12_CPU_DESCRIPTOR_HANDLE Rtv(int probe, int face);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv();
+
+	UINT ProbeCount()const;
+	UINT Size()const;
+
+	D3D12_VIEWPORT Viewport()const;
+	D3D12_RECT ScissorRect()const;
+
+	// hCpuRtvStart is the first of ProbeCount*6 consecutive RTVs, face by face
+	// within each probe.
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtvStart,
+		UINT rtvDescriptorSize,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv);
+
+private:
+	void BuildResources();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mProbeCount = 0;
+	UINT mSize = 0;
+	DXGI_FORMAT mFormat;
+	DXGI_FORMAT mDepthFormat;
+
+	D3D12_VIEWPORT mViewport;
+	D3D12_RECT mScissorRect;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuRtvStart;
+	UINT mRtvDescriptorSize = 0;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDsv;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCubeArray = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDepthBuffer = nullptr;
+};
@@ -0,0 +1,387 @@
+#include "ReflectionProbes.h"
+#include "CubeResolutionPolicy.h"
+#include "../../Common/SelfCheck.h"
+#include <cfloat>
+
+using namespace DirectX;
+
+namespace
+{
+	double NowMs()
+	{
+		static LARGE_INTEGER freq = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return 1000.0 * (double)now.QuadPart / (double)freq.QuadPart;
+	}
+
+	float Distance(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return sqrtf(dx*dx + dy*dy + dz*dz);
+	}
+}
+
+bool ProbeAssignment::operator==(const ProbeAssignment& rhs)const
+{
+	return Probe0 == rhs.Probe0 && Probe1 == rhs.Probe1 &&
+		Weight0 == rhs.Weight0 && Weight1 == rhs.Weight1;
+}
+
+int ReflectionProbeSystem::AddProbe(const XMFLOAT3& positionW, const XMFLOAT3& influenceCenterW,
+	const XMFLOAT3& influenceExtents, float blendDistance)
+{
+	ReflectionProbe probe;
+	probe.PositionW = positionW;
+	probe.InfluenceCenterW = influenceCenterW;
+	probe.InfluenceExtents = influenceExtents;
+	probe.BlendDistance = blendDistance;
+
+	mProbes.push_back(probe);
+	return (int)mProbes.size() - 1;
+}
+
+float ReflectionProbeSystem::InfluenceWeight(int probe, const XMFLOAT3& posW)const
+{
+	const ReflectionProbe& p = mProbes[probe];
+
+	// Distance to the nearest face of the box, negative outside it.
+	float inside = std::min<float>(
+		p.InfluenceExtents.x - fabsf(posW.x - p.InfluenceCenterW.x), std::min<float>(
+		p.InfluenceExtents.y - fabsf(posW.y - p.InfluenceCenterW.y),
+		p.InfluenceExtents.z - fabsf(posW.z - p.InfluenceCenterW.z)));
+
+	if(inside <= 0.0f)
+		return 0.0f;
+
+	if(p.BlendDistance <= 0.0f)
+		return 1.0f;
+
+	return std::min<float>(inside / p.BlendDistance, 1.0f);
+}
+
+ProbeAssignment ReflectionProbeSystem::Assign(const XMFLOAT3& posW)const
+{
+	ProbeAssignment a;
+	float dist0 = FLT_MAX;
+	float dist1 = FLT_MAX;
+
+	for(int i = 0; i < (int)mProbes.size(); ++i)
+	{
+		float w = InfluenceWeight(i, posW);
+		if(w <= 0.0f)
+			continue;
+
+		float d = Distance(posW, mProbes[i].PositionW);
+		if(d < dist0)
+		{
+			a.Probe1 = a.Probe0;
+			a.Weight1 = a.Weight0;
+			dist1 = dist0;
+
+			a.Probe0 = i;
+			a.Weight0 = w;
+			dist0 = d;
+		}
+		else if(d < dist1)
+		{
+			a.Probe1 = i;
+			a.Weight1 = w;
+			dist1 = d;
+		}
+	}
+
+	// Where the two boxes overlap deeply enough, the probes share the reflection
+	// between them; otherwise the sky makes up the difference.
+	float total = a.Weight0 + a.Weight1;
+	if(total > 1.0f)
+	{
+		a.Weight0 /= total;
+		a.Weight1 /= total;
+	}
+
+	return a;
+}
+
+void ReflectionProbeSystem::Invalidate()
+{
+	for(ReflectionProbe& probe : mProbes)
+	{
+		for(bool& valid : probe.FaceValid)
+			valid = false;
+	}
+}
+
+float ReflectionProbeSystem::Importance(int probe, const ProbeView& view)const
+{
+	const ReflectionProbe& p = mProbes[probe];
+	const ReflectionProbeSettings& s = mSettings;
+
+	float distance = Distance(view.EyePosW, p.InfluenceCenterW);
+
+	float coverage = 0.0f;
+	if(InfluenceWeight(probe, view.EyePosW) > 0.0f)
+	{
+		coverage = 1.0f;
+	}
+	else
+	{
+		const XMFLOAT3& e = p.InfluenceExtents;
+		float radius = sqrtf(e.x*e.x + e.y*e.y + e.z*e.z);
+
+		// Boxes entirely behind the eye cover nothing.
+		float ahead =
+			(p.InfluenceCenterW.x - view.EyePosW.x)*view.LookW.x +
+			(p.InfluenceCenterW.y - view.EyePosW.y)*view.LookW.y +
+			(p.InfluenceCenterW.z - view.EyePosW.z)*view.LookW.z;
+
+		if(ahead > -radius)
+		{
+			float share = CubeResolutionPolicy::ScreenDiameter(radius, distance, view.FovY, view.ViewportHeight) /
+				view.ViewportHeight;
+			coverage = share*share;
+		}
+	}
+
+	return s.CoverageWeight*coverage + s.DistanceWeight*s.DistanceScale / (s.DistanceScale + distance);
+}
+
+int ReflectionProbeSystem::BeginFrame(const ProbeView& view, std::vector<ProbeFaceUpdate>& updates)
+{
+	++mFrame;
+	updates.clear();
+	mCandidates.clear();
+
+	for(int i = 0; i < (int)mProbes.size(); ++i)
+	{
+		const ReflectionProbe& p = mProbes[i];
+		float importance = Importance(i, view);
+
+		for(int face = 0; face < 6; ++face)
+		{
+			ProbeFaceUpdate update;
+			update.Probe = i;
+			update.Face = face;
+
+			if(!p.FaceValid[face])
+			{
+				updates.push_back(update);
+				continue;
+			}
+
+			Candidate c;
+			c.Priority = importance * (float)(mFrame - p.FaceUpdateFrame[face]);
+			c.Update = update;
+			mCandidates.push_back(c);
+		}
+	}
+
+	// Faces never drawn would show garbage, so they take this frame on their own.
+	if(!updates.empty())
+		return (int)updates.size();
+
+	int count = std::min<int>(mSettings.FacesPerFrame, (int)mCandidates.size());
+
+	// Ties go to the lower probe and face, so the order is deterministic.
+	std::partial_sort(mCandidates.begin(), mCandidates.begin() + count, mCandidates.end(),
+		[](const Candidate& a, const Candidate& b)
+	{
+		if(a.Priority != b.Priority)
+			return a.Priority > b.Priority;
+		if(a.Update.Probe != b.Update.Probe)
+			return a.Update.Probe < b.Update.Probe;
+		return a.Update.Face < b.Update.Face;
+	});
+
+	for(int i = 0; i < count; ++i)
+		updates.push_back(mCandidates[i].Update);
+
+	return count;
+}
+
+void ReflectionProbeSystem::FaceRendered(int probe, int face)
+{
+	mProbes[probe].FaceValid[face] = true;
+	mProbes[probe].FaceUpdateFrame[face] = mFrame;
+	++mFacesRendered;
+}
+
+UINT64 ReflectionProbeSystem::OldestFaceAge()const
+{
+	UINT64 oldest = 0;
+	for(const ReflectionProbe& probe : mProbes)
+	{
+		for(int face = 0; face < 6; ++face)
+		{
+			if(probe.FaceValid[face])
+				oldest = std::max<UINT64>(oldest, mFrame - probe.FaceUpdateFrame[face]);
+		}
+	}
+	return oldest;
+}
+
+bool ReflectionProbeSystem::RunSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	//
+	// Assignment: two boxes overlapping by 2 units around x = 0, blending over 2 units.
+	//
+	{
+		ReflectionProbeSystem probes;
+		int a = probes.AddProbe(XMFLOAT3(-5.0f, 0.0f, 0.0f), XMFLOAT3(-5.0f, 0.0f, 0.0f), XMFLOAT3(6.0f, 5.0f, 5.0f), 2.0f);
+		int b = probes.AddProbe(XMFLOAT3(+5.0f, 0.0f, 0.0f), XMFLOAT3(+5.0f, 0.0f, 0.0f), XMFLOAT3(6.0f, 5.0f, 5.0f), 2.0f);
+
+		ProbeAssignment deep = probes.Assign(XMFLOAT3(-8.0f, 0.0f, 0.0f));
+		checks.Check(deep.Probe0 == a && deep.Probe1 == -1 && deep.Weight0 == 1.0f, "deep inside one box uses that probe alone");
+
+		ProbeAssignment overlap = probes.Assign(XMFLOAT3(0.5f, 0.0f, 0.0f));
+		checks.Check(overlap.Probe0 == b && overlap.Probe1 == a, "in the overlap the nearer probe comes first");
+		checks.Check(fabsf(overlap.Weight0 - 0.75f) < 1e-4f && fabsf(overlap.Weight1 - 0.25f) < 1e-4f,
+			"in the overlap the weights follow the depth into each box");
+
+		ProbeAssignment edge = probes.Assign(XMFLOAT3(-5.0f, 0.0f, 4.5f));
+		checks.Check(edge.Probe0 == a && fabsf(edge.Weight0 - 0.25f) < 1e-4f, "near the edge of a box the probe fades to the sky");
+
+		ProbeAssignment outside = probes.Assign(XMFLOAT3(20.0f, 0.0f, 0.0f));
+		checks.Check(outside.Probe0 == -1 && outside.Probe1 == -1, "outside every box only the sky is reflected");
+
+		// Walk through both boxes near their z faces, so the probes and the sky all
+		// take part, and make sure no weight jumps.
+		float maxStep = 0.0f;
+		bool sumsToOne = true;
+		float previous[3] = { 0.0f, 0.0f, 1.0f };
+		for(int i = 0; i <= 2400; ++i)
+		{
+			ProbeAssignment s = probes.Assign(XMFLOAT3(-12.0f + 0.01f*i, 0.0f, 3.5f));
+
+			float weights[3] = { 0.0f, 0.0f, 0.0f };
+			if(s.Probe0 >= 0) weights[s.Probe0] += s.Weight0;
+			if(s.Probe1 >= 0) weights[s.Probe1] += s.Weight1;
+			weights[2] = 1.0f - weights[0] - weights[1];
+
+			for(int w = 0; w < 3; ++w)
+			{
+				sumsToOne &= weights[w] >= -1e-5f;
+				maxStep = std::max<float>(maxStep, fabsf(weights[w] - previous[w]));
+				previous[w] = weights[w];
+			}
+		}
+		checks.Check(sumsToOne, "probe and sky weights are never negative");
+		checks.Check(maxStep < 0.02f, "weights change smoothly across the boxes");
+
+		checks.Note("  assignment: largest weight change per 0.01 units %.4f\n", maxStep);
+	}
+
+	//
+	// Scheduling: three probes in a row, the eye parked in the first.
+	//
+	{
+		ReflectionProbeSystem probes;
+		for(int i = 0; i < 3; ++i)
+		{
+			float z = -30.0f + 30.0f*i;
+			probes.AddProbe(XMFLOAT3(0.0f, 2.0f, z), XMFLOAT3(0.0f, 4.0f, z), XMFLOAT3(10.0f, 6.0f, 16.0f), 2.0f);
+		}
+
+		ProbeView view;
+		view.EyePosW = XMFLOAT3(0.0f, 2.0f, -30.0f);
+		view.LookW = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		view.ViewportHeight = 720.0f;
+
+		std::vector<ProbeFaceUpdate> updates;
+		int first = probes.BeginFrame(view, updates);
+		for(const ProbeFaceUpdate& u : updates)
+			probes.FaceRendered(u.Probe, u.Face);
+		checks.Check(first == 18, "every face is drawn on the first frame");
+
+		const int frames = 600;
+		bool withinBudget = true;
+		int perProbe[3] = { 0, 0, 0 };
+		UINT64 oldest = 0;
+		for(int frame = 0; frame < frames; ++frame)
+		{
+			int count = probes.BeginFrame(view, updates);
+			withinBudget &= count <= probes.Settings().FacesPerFrame;
+
+			for(const ProbeFaceUpdate& u : updates)
+			{
+				probes.FaceRendered(u.Probe, u.Face);
+				++perProbe[u.Probe];
+			}
+
+			if(frame >= frames / 2)
+				oldest = std::max<UINT64>(oldest, probes.OldestFaceAge());
+		}
+
+		checks.Check(withinBudget, "no more faces than the budget after the first frame");
+		checks.Check(perProbe[0] > perProbe[1] && perProbe[1] > perProbe[2], "nearer probes are refreshed more often");
+		checks.Check(perProbe[2] > 0 && oldest < (UINT64)frames / 2, "the furthest probe is still refreshed");
+
+		checks.Note("  schedule, eye in probe 0: frames per face refresh %.1f / %.1f / %.1f, oldest face %llu frames\n",
+			6.0*frames / std::max<int>(perProbe[0], 1), 6.0*frames / std::max<int>(perProbe[1], 1),
+			6.0*frames / std::max<int>(perProbe[2], 1), (unsigned long long)oldest);
+
+		// Turning around puts the probes ahead of the eye out of view.
+		view.EyePosW = XMFLOAT3(0.0f, 2.0f, -60.0f);
+		float ahead = probes.Importance(1, view);
+		view.LookW = XMFLOAT3(0.0f, 0.0f, -1.0f);
+		float behind = probes.Importance(1, view);
+		checks.Check(behind < ahead, "probes behind the eye matter less");
+	}
+
+	//
+	// Throughput: 64 probes and 2000 objects, the eye walking through them.
+	//
+	{
+		ReflectionProbeSystem probes;
+		for(int i = 0; i < 64; ++i)
+		{
+			XMFLOAT3 center(-70.0f + 20.0f*(i % 8), 4.0f, -70.0f + 20.0f*(i / 8));
+			probes.AddProbe(center, center, XMFLOAT3(11.0f, 6.0f, 11.0f), 2.0f);
+		}
+
+		std::vector<XMFLOAT3> objects(2000);
+		for(size_t i = 0; i < objects.size(); ++i)
+			objects[i] = XMFLOAT3(-80.0f + (float)((i*37) % 160), (float)(i % 8), -80.0f + (float)((i*91) % 160));
+
+		ProbeView view;
+		view.ViewportHeight = 720.0f;
+
+		std::vector<ProbeFaceUpdate> updates;
+		const int frames = 200;
+		double scheduleMs = 0.0;
+		double assignMs = 0.0;
+		UINT64 faces = 0;
+		float checksum = 0.0f;
+		for(int frame = 0; frame <= frames; ++frame)
+		{
+			view.EyePosW = XMFLOAT3(-70.0f + 0.7f*frame, 2.0f, -70.0f + 0.7f*frame);
+			view.LookW = XMFLOAT3(0.7071f, 0.0f, 0.7071f);
+
+			double t0 = NowMs();
+			probes.BeginFrame(view, updates);
+			for(const ProbeFaceUpdate& u : updates)
+				probes.FaceRendered(u.Probe, u.Face);
+			double t1 = NowMs();
+			for(const XMFLOAT3& pos : objects)
+				checksum += probes.Assign(pos).Weight0;
+			double t2 = NowMs();
+
+			// The first frame draws everything; time the steady state.
+			if(frame > 0)
+			{
+				scheduleMs += t1 - t0;
+				assignMs += t2 - t1;
+				faces += updates.size();
+			}
+		}
+
+		checks.Check(checksum > 0.0f, "objects are assigned probes");
+
+		checks.Note("  throughput, 64 probes: %.2f faces per frame, schedule %.1f us per frame, assign %.1f ns per object\n",
+			(double)faces / frames, 1000.0*scheduleMs / frames, 1.0e6*assignMs / (frames*objects.size()));
+	}
+
+	return checks.Finish("Reflection probes");
+}
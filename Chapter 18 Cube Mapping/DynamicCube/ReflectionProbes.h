@@ -0,0 +1,133 @@
+//***************************************************************************************
+// ReflectionProbes.h
+//
+// Reflection probes placed around the scene.  Each is a cube map captured from a point
+// and reflected by the objects inside its influence box; near the faces of the box an
+// object fades to the neighbouring probe or to the sky.  A few probe faces are
+// re-rendered per frame, picked by how close and how large on screen the probe is and
+// how long ago the face was drawn.  No D3D dependencies.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+struct ReflectionProbe
+{
+	// Where the cube map is captured from.
+	DirectX::XMFLOAT3 PositionW = { 0.0f, 0.0f, 0.0f };
+
+	// Axis aligned box of the objects using the probe.  The probe's weight falls
+	// from 1 to 0 over the last BlendDistance before each face of the box.
+	DirectX::XMFLOAT3 InfluenceCenterW = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 InfluenceExtents = { 1.0f, 1.0f, 1.0f };
+	float BlendDistance = 1.0f;
+
+	UINT64 FaceUpdateFrame[6] = { 0, 0, 0, 0, 0, 0 };
+
+	// False until the face has been rendered, and again after Invalidate().
+	bool FaceValid[6] = { false, false, false, false, false, false };
+};
+
+// The probes an object reflects, nearest first, and their weights; the sky gets
+// the rest.  A probe index of -1 means none.
+struct ProbeAssignment
+{
+	int Probe0 = -1;
+	int Probe1 = -1;
+	float Weight0 = 0.0f;
+	float Weight1 = 0.0f;
+
+	bool operator==(const ProbeAssignment& rhs)const;
+	bool operator!=(const ProbeAssignment& rhs)const { return !(*this == rhs); }
+};
+
+struct ProbeFaceUpdate
+{
+	int Probe = 0;
+	int Face = 0;
+};
+
+// The main camera, as far as the scheduler is concerned.
+struct ProbeView
+{
+	DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 LookW = { 0.0f, 0.0f, 1.0f };
+	float FovY = 0.25f*MathHelper::Pi;
+	float ViewportHeight = 600.0f;
+};
+
+struct ReflectionProbeSettings
+{
+	// Probe faces re-rendered per frame.  Faces never drawn are all drawn on the
+	// next frame regardless.
+	int FacesPerFrame = 3;
+
+	// A face's priority is its probe's importance times the frames since it was
+	// drawn, so every face is refreshed eventually.  The importance is
+	//   CoverageWeight*coverage + DistanceWeight*DistanceScale/(DistanceScale + distance)
+	// where coverage is the share of the view the influence box covers (1 from
+	// inside it) and distance is from the eye to the box's center.
+	float CoverageWeight = 1.0f;
+	float DistanceWeight = 0.25f;
+	float DistanceScale = 10.0f;
+};
+
+class ReflectionProbeSystem
+{
+public:
+	void SetSettings(const ReflectionProbeSettings& settings) { mSettings = settings; }
+	const ReflectionProbeSettings& Settings()const { return mSettings; }
+
+	// Returns the new probe's index, which is also its slice in the cube map array.
+	int AddProbe(const DirectX::XMFLOAT3& positionW, const DirectX::XMFLOAT3& influenceCenterW,
+		const DirectX::XMFLOAT3& influenceExtents, float blendDistance);
+
+	int ProbeCount()const { return (int)mProbes.size(); }
+	const ReflectionProbe& Probe(int probe)const { return mProbes[probe]; }
+
+	// Weight of a probe at posW: 1 well inside its influence box, 0 outside.
+	float InfluenceWeight(int probe, const DirectX::XMFLOAT3& posW)const;
+
+	// The nearest two probes whose influence boxes contain posW.  Their weights are
+	// scaled down to add up to at most 1.  Place probes so no more than two boxes
+	// overlap; a third would be ignored wherever it is the furthest.
+	ProbeAssignment Assign(const DirectX::XMFLOAT3& posW)const;
+
+	// Marks every probe face as needing a redraw.
+	void Invalidate();
+
+	// Starts a frame and writes the probe faces to render into updates; returns
+	// how many.
+	int BeginFrame(const ProbeView& view, std::vector<ProbeFaceUpdate>& updates);
+
+	// Call for every face returned by BeginFrame once it has been recorded.
+	void FaceRendered(int probe, int face);
+
+	float Importance(int probe, const ProbeView& view)const;
+
+	UINT64 Frames()const { return mFrame; }
+	UINT64 FacesRendered()const { return mFacesRendered; }
+
+	// Frames since the least recently drawn face was drawn.
+	UINT64 OldestFaceAge()const;
+
+	// Checks probe assignment and blending on synthetic scenes and runs the
+	// scheduler along camera paths, reporting the faces refreshed and the CPU time
+	// taken.  Returns false and says why in report if any check fails.
+	static bool RunSelfCheck(std::string& report);
+
+private:
+	struct Candidate
+	{
+		float Priority;
+		ProbeFaceUpdate Update;
+	};
+
+	ReflectionProbeSettings mSettings;
+	std::vector<ReflectionProbe> mProbes;
+	std::vector<Candidate> mCandidates;
+
+	UINT64 mFrame = 0;
+	UINT64 mFacesRendered = 0;
+};
@@ -40,6 +40,12 @@ Texture2D gDiffuseMap[4] : register(t1);
 // The texture array will occupy registers t0, t1, ..., t3 in space0. 
 StructuredBuffer<MaterialData> gMaterialData : register(t0, space1);
 
+// The cube maps of every reflection probe, indexed by probe.
+TextureCubeArray gProbeMaps : register(t0, space2);
+
+// The two hemispheres of a dual-paraboloid map, +z in slice 0 and -z in slice 1.
+Texture2DArray gParaboloidMap : register(t1, space2);
+
 
 SamplerState gsamPointWrap        : register(s0);
 SamplerState gsamPointClamp       : register(s1);
@@ -54,7 +60,13 @@ cbuffer cbPerObject : register(b0)
     float4x4 gWorld;
 	float4x4 gTexTransform;
 	uint gMaterialIndex;
+
+	// Reflection probes, nearest first (-1 for none), and their weights.
+	int gProbe0;
+	int gProbe1;
 	uint gObjPad0;
+	float gProbeWeight0;
+	float gProbeWeight1;
 	uint gObjPad1;
 	uint gObjPad2;
 };
@@ -74,8 +86,14 @@ cbuffer cbPass : register(b1)
     float2 gInvRenderTargetSize;
     float gNearZ;
     float gFarZ;
+};
+
+// Constant data shared by every pass of a frame.
+cbuffer cbFrame : register(b4)
+{
     float gTotalTime;
     float gDeltaTime;
+    float2 cbPerFramePad1;
     float4 gAmbientLight;
 
     // Indices [0, NUM_DIR_LIGHTS) are directional lights;
@@ -85,4 +103,64 @@ cbuffer cbPass : register(b1)
     Light gLights[MaxLights];
 };
 
+// View-projection matrix of each cube map face, for drawing all faces in one pass.
+cbuffer cbCubeFaces : register(b2)
+{
+    float4x4 gCubeViewProj[6];
+};
+
+// Faces the instances of a single pass cube map draw go to, three bits each.
+cbuffer cbCubeFaceList : register(b3)
+{
+    uint gCubeFaceList;
+};
+
+uint CubeFace(uint instanceID)
+{
+    return (gCubeFaceList >> (3 * instanceID)) & 7;
+}
+
+// Projects a view space position onto the paraboloid of the hemisphere in front of
+// the view.  Depth is the distance from the center between gNearZ and gFarZ, and
+// w = 1, so the projection is done here rather than by the rasterizer.
+float4 ParaboloidProject(float3 posV)
+{
+    float dist = length(posV);
+    float3 d = posV / dist;
+    return float4(d.xy / (1.0f + d.z), (dist - gNearZ) / (gFarZ - gNearZ), 1.0f);
+}
+
+// Looks up world space direction r in gParaboloidMap.  The -z hemisphere is viewed
+// turned half way around y, which mirrors x.
+float4 SampleParaboloid(float3 r)
+{
+    r = normalize(r);
+    float slice = r.z >= 0.0f ? 0.0f : 1.0f;
+    float3 d = r.z >= 0.0f ? r : float3(-r.x, r.y, -r.z);
+
+    float2 p = d.xy / (1.0f + d.z);
+    float2 uv = float2(0.5f + 0.5f*p.x, 0.5f - 0.5f*p.y);
+    return gParaboloidMap.SampleLevel(gsamLinearClamp, float3(uv, slice), 0.0f);
+}
+
+// Blends the object's reflection probes with gCubeMap.  Probe captures are drawn
+// into gProbeMaps, so they are compiled with NO_REFLECTION_PROBES.  Reflectors
+// using the dual-paraboloid map are compiled with PARABOLOID_REFLECTION.
+float4 SampleReflection(float3 r)
+{
+#ifdef PARABOLOID_REFLECTION
+    float4 color = SampleParaboloid(r);
+#else
+    float4 color = gCubeMap.Sample(gsamLinearWrap, r);
+#endif
+#ifndef NO_REFLECTION_PROBES
+    color *= 1.0f - gProbeWeight0 - gProbeWeight1;
+    if(gProbe0 >= 0)
+        color += gProbeWeight0 * gProbeMaps.Sample(gsamLinearWrap, float4(r, gProbe0));
+    if(gProbe1 >= 0)
+        color += gProbeWeight1 * gProbeMaps.Sample(gsamLinearWrap, float4(r, gProbe1));
+#endif
+    return color;
+}
+
 
@@ -23,6 +23,9 @@ struct VertexIn
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
+#ifdef SINGLE_PASS_CUBE
+    uint InstanceID : SV_InstanceID;
+#endif
 };
 
 struct VertexOut
@@ -31,6 +34,12 @@ struct VertexOut
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
 	float2 TexC    : TEXCOORD;
+#ifdef SINGLE_PASS_CUBE
+    uint Face      : SV_RenderTargetArrayIndex;
+#endif
+#ifdef DUAL_PARABOLOID
+    float ClipDist : SV_ClipDistance0;
+#endif
 };
 
 VertexOut VS(VertexIn vin)
@@ -48,7 +57,18 @@ VertexOut VS(VertexIn vin)
     vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
 
     // Transform to homogeneous clip space.
+#ifdef SINGLE_PASS_CUBE
+    // Each instance draws into its own cube map face.
+    vout.Face = CubeFace(vin.InstanceID);
+    vout.PosH = mul(posW, gCubeViewProj[vout.Face]);
+#elif defined(DUAL_PARABOLOID)
+    // Into the hemisphere in front of the view; the other half is clipped.
+    float3 posV = mul(posW, gView).xyz;
+    vout.PosH = ParaboloidProject(posV);
+    vout.ClipDist = posV.z;
+#else
     vout.PosH = mul(posW, gViewProj);
+#endif
 	
 	// Output vertex attributes for interpolation across triangle.
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
@@ -88,7 +108,7 @@ float4 PS(VertexOut pin) : SV_Target
 
 	// Add in specular reflections.
 	float3 r = reflect(-toEyeW, pin.NormalW);
-	float4 reflectionColor = gCubeMap.Sample(gsamLinearWrap, r);
+	float4 reflectionColor = SampleReflection(r);
 	float3 fresnelFactor = SchlickFresnel(fresnelR0, pin.NormalW, r);
 	litColor.rgb += shininess * fresnelFactor * reflectionColor.rgb;
 
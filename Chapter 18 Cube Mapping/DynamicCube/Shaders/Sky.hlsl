@@ -10,12 +10,21 @@ struct VertexIn
 	float3 PosL    : POSITION;
 	float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
+#ifdef SINGLE_PASS_CUBE
+    uint InstanceID : SV_InstanceID;
+#endif
 };
 
 struct VertexOut
 {
 	float4 PosH : SV_POSITION;
     float3 PosL : POSITION;
+#ifdef SINGLE_PASS_CUBE
+    uint Face   : SV_RenderTargetArrayIndex;
+#endif
+#ifdef DUAL_PARABOLOID
+    float ClipDist : SV_ClipDistance0;
+#endif
 };
  
 VertexOut VS(VertexIn vin)
@@ -32,7 +41,17 @@ VertexOut VS(VertexIn vin)
 	posW.xyz += gEyePosW;
 
 	// Set z = w so that z/w = 1 (i.e., skydome always on far plane).
+#ifdef SINGLE_PASS_CUBE
+	vout.Face = CubeFace(vin.InstanceID);
+	vout.PosH = mul(posW, gCubeViewProj[vout.Face]).xyww;
+#elif defined(DUAL_PARABOLOID)
+	float3 posV = mul(posW, gView).xyz;
+	vout.PosH = ParaboloidProject(posV);
+	vout.PosH.z = 1.0f;
+	vout.ClipDist = posV.z;
+#else
 	vout.PosH = mul(posW, gViewProj).xyww;
+#endif
 	
 	return vout;
 }
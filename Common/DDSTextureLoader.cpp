@@ -24,6 +24,7 @@
 #include <wrl.h>
 
 #include "DDSTextureLoader.h" 
+#include "MemoryStats.h"
 
 using namespace Microsoft::WRL;
 
@@ -144,33 +145,26 @@ inline void SetDebugObjectName(_In_ ID3D11DeviceChild* resource, _In_ const char
 };
 
 //--------------------------------------------------------------------------------------
-static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
-                                        std::unique_ptr<uint8_t[]>& ddsData,
-                                        DDS_HEADER** header,
-                                        uint8_t** bitData,
-                                        size_t* bitSize
-                                      )
+static HRESULT OpenFileForRead( _In_z_ const wchar_t* fileName,
+                                ScopedHandle& hFile,
+                                LARGE_INTEGER& FileSize
+                              )
 {
-    if (!header || !bitData || !bitSize)
-    {
-        return E_POINTER;
-    }
-
     // open the file
 #if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
-    ScopedHandle hFile( safe_handle( CreateFile2( fileName,
-                                                  GENERIC_READ,
-                                                  FILE_SHARE_READ,
-                                                  OPEN_EXISTING,
-                                                  nullptr ) ) );
+    hFile.reset( safe_handle( CreateFile2( fileName,
+                                           GENERIC_READ,
+                                           FILE_SHARE_READ,
+                                           OPEN_EXISTING,
+                                           nullptr ) ) );
 #else
-    ScopedHandle hFile( safe_handle( CreateFileW( fileName,
-                                                  GENERIC_READ,
-                                                  FILE_SHARE_READ,
-                                                  nullptr,
-                                                  OPEN_EXISTING,
-                                                  FILE_ATTRIBUTE_NORMAL,
-                                                  nullptr ) ) );
+    hFile.reset( safe_handle( CreateFileW( fileName,
+                                           GENERIC_READ,
+                                           FILE_SHARE_READ,
+                                           nullptr,
+                                           OPEN_EXISTING,
+                                           FILE_ATTRIBUTE_NORMAL,
+                                           nullptr ) ) );
 #endif
 
     if ( !hFile )
@@ -179,7 +173,7 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
     }
 
     // Get the file size
-    LARGE_INTEGER FileSize = { 0 };
+    FileSize.QuadPart = 0;
 
 #if (_WIN32_WINNT >= _WIN32_WINNT_VISTA)
     FILE_STANDARD_INFO fileInfo;
@@ -192,6 +186,113 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
     GetFileSizeEx( hFile.get(), &FileSize );
 #endif
 
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT ReadExactly( _In_ HANDLE hFile,
+                            _Out_writes_bytes_(size) void* dest,
+                            _In_ DWORD size
+                          )
+{
+    DWORD BytesRead = 0;
+    if (!ReadFile( hFile, dest, size, &BytesRead, nullptr ))
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    return (BytesRead < size) ? E_FAIL : S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+// The magic number and both headers.
+const size_t DDS_MAX_HEADER_SIZE = sizeof( uint32_t ) + sizeof( DDS_HEADER ) + sizeof( DDS_HEADER_DXT10 );
+
+// Reads and validates the start of a DDS file opened by OpenFileForRead, leaving
+// the texels in the file.  bitOffset is where they start.
+static HRESULT ReadHeaderFromFile( _In_ HANDLE hFile,
+                                   _In_ size_t fileSize,
+                                   _Out_writes_bytes_(DDS_MAX_HEADER_SIZE) uint8_t* headerData,
+                                   DDS_HEADER** header,
+                                   size_t* bitOffset
+                                 )
+{
+    if (!header || !bitOffset)
+    {
+        return E_POINTER;
+    }
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (fileSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) ) )
+    {
+        return E_FAIL;
+    }
+
+    DWORD headerSize = static_cast<DWORD>( std::min<size_t>( fileSize, DDS_MAX_HEADER_SIZE ) );
+    HRESULT hr = ReadExactly( hFile, headerData, headerSize );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t dwMagicNumber = *( const uint32_t* )( headerData );
+    if (dwMagicNumber != DDS_MAGIC)
+    {
+        return E_FAIL;
+    }
+
+    auto hdr = reinterpret_cast<DDS_HEADER*>( headerData + sizeof( uint32_t ) );
+
+    // Verify header to validate DDS file
+    if (hdr->size != sizeof(DDS_HEADER) ||
+        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    {
+        return E_FAIL;
+    }
+
+    // Check for DX10 extension
+    bool bDXT10Header = false;
+    if ((hdr->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
+    {
+        // Must be long enough for both headers and magic value
+        if (fileSize < DDS_MAX_HEADER_SIZE)
+        {
+            return E_FAIL;
+        }
+
+        bDXT10Header = true;
+    }
+
+    *header = hdr;
+    *bitOffset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
+                 + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
+                                        std::unique_ptr<uint8_t[]>& ddsData,
+                                        DDS_HEADER** header,
+                                        uint8_t** bitData,
+                                        size_t* bitSize
+                                      )
+{
+    if (!header || !bitData || !bitSize)
+    {
+        return E_POINTER;
+    }
+
+    ScopedHandle hFile;
+    LARGE_INTEGER FileSize = { 0 };
+    HRESULT hr = OpenFileForRead( fileName, hFile, FileSize );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
     // File is too big for 32-bit allocation, so reject read
     if (FileSize.HighPart > 0)
     {
@@ -1230,91 +1331,58 @@ static HRESULT CreateD3DResources( _In_ ID3D11Device* d3dDevice,
 static HRESULT CreateD3DResources12(
 	ID3D12Device* device,
 	ID3D12GraphicsCommandList* cmdList,
-	_In_ uint32_t resDim,
-	_In_ size_t width,
-	_In_ size_t height,
-	_In_ size_t depth,
-	_In_ size_t mipCount,
-	_In_ size_t arraySize,
-	_In_ DXGI_FORMAT format,
-	_In_ bool forceSRGB,
-	_In_ bool isCubeMap,
-	_In_reads_opt_(mipCount*arraySize) D3D12_SUBRESOURCE_DATA* initData,
+	_In_ const D3D12_RESOURCE_DESC& texDesc,
+	_In_reads_opt_(texDesc.DepthOrArraySize*texDesc.MipLevels) const D3D12_SUBRESOURCE_DATA* initData,
 	ComPtr<ID3D12Resource>& texture,
 	ComPtr<ID3D12Resource>& textureUploadHeap
 	)
 {
-	if (device == nullptr)
+	if (device == nullptr || cmdList == nullptr)
 		return E_POINTER;
 
-	if (forceSRGB)
-		format = MakeSRGB(format);
+	HRESULT hr = device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&texture)
+		);
 
-	HRESULT hr = E_FAIL;
-	switch (resDim)
-	{
-	case D3D12_RESOURCE_DIMENSION_TEXTURE2D:
+	if (FAILED(hr))
 	{
-		D3D12_RESOURCE_DESC texDesc;
-		ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
-		texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-		texDesc.Alignment = 0;
-		texDesc.Width = width;
-		texDesc.Height = (uint32_t)height;
-		texDesc.DepthOrArraySize = (depth > 1) ? (uint16_t)depth : (uint16_t)arraySize;
-		texDesc.MipLevels = (uint16_t)mipCount;
-		texDesc.Format = format;
-		texDesc.SampleDesc.Count = 1;
-		texDesc.SampleDesc.Quality = 0;
-		texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-		texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-		hr = device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&texDesc,
-			D3D12_RESOURCE_STATE_COMMON,
-			nullptr,
-			IID_PPV_ARGS(&texture)
-			);
-
-		if (FAILED(hr))
-		{
-			texture = nullptr;
-			return hr;
-		}
-		else
-		{
-			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
-			const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, num2DSubresources);
-
-			hr = device->CreateCommittedResource(
-				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-				D3D12_HEAP_FLAG_NONE,
-				&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
-				D3D12_RESOURCE_STATE_GENERIC_READ,
-				nullptr,
-				IID_PPV_ARGS(&textureUploadHeap));
-			if (FAILED(hr))
-			{
-				texture = nullptr;
-				return hr;
-			}
-			else
-			{
-				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
-					D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+		texture = nullptr;
+		return hr;
+	}
 
-				// Use Heap-allocating UpdateSubresources implementation for variable number of subresources (which is the case for textures).
-				UpdateSubresources(cmdList, texture.Get(), textureUploadHeap.Get(), 0, 0, num2DSubresources, initData);
+	const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
+	const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, num2DSubresources);
 
-				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
-					D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-			}
-		}
-	} break;
+	hr = device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&textureUploadHeap));
+	if (FAILED(hr))
+	{
+		texture = nullptr;
+		return hr;
 	}
 
+	MemoryStats::Track(MemoryCategory::Texture, texture.Get());
+	MemoryStats::Track(MemoryCategory::UploadHeap, textureUploadHeap.Get());
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+
+	// Use Heap-allocating UpdateSubresources implementation for variable number of subresources (which is the case for textures).
+	UpdateSubresources(cmdList, texture.Get(), textureUploadHeap.Get(), 0, 0, num2DSubresources, initData);
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
 	return hr;
 }
 
@@ -1669,16 +1737,16 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     return hr;
 }
 
-static HRESULT CreateTextureFromDDS12(
-	_In_ ID3D12Device* device,
-	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+// Validates the header and works out the resource description and where each
+// subresource is in bitData.  Creates nothing, so it is safe on any thread.
+static HRESULT LayoutTextureFromDDS12(
 	_In_ const DDS_HEADER* header,
 	_In_reads_bytes_(bitSize) const uint8_t* bitData,
 	_In_ size_t bitSize,
 	_In_ size_t maxsize,
-	_In_ bool forceSRGB,
-	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	_Out_ D3D12_RESOURCE_DESC& texDesc,
+	_Out_ bool& cubeMap,
+	std::vector<D3D12_SUBRESOURCE_DATA>& initData)
 {
 	HRESULT hr = S_OK;
 
@@ -1835,16 +1903,14 @@ static HRESULT CreateTextureFromDDS12(
 		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
 	}
 
-	// Create the texture
-	std::unique_ptr<D3D12_SUBRESOURCE_DATA[]> initData(
-		new (std::nothrow) D3D12_SUBRESOURCE_DATA[mipCount * arraySize]
-		);
-
-	if (!initData)
+	// Only 2D textures and cube maps are created.
+	if (resDim != D3D12_RESOURCE_DIMENSION_TEXTURE2D)
 	{
-		return E_OUTOFMEMORY;
+		return E_FAIL;
 	}
 
+	initData.resize(mipCount * arraySize);
+
 	size_t skipMip = 0;
 	size_t twidth = 0;
 	size_t theight = 0;
@@ -1852,22 +1918,54 @@ static HRESULT CreateTextureFromDDS12(
 
 	hr = FillInitData12(
 		width, height, depth, mipCount, arraySize, format, maxsize, bitSize, bitData,
-		twidth, theight, tdepth, skipMip, initData.get()
+		twidth, theight, tdepth, skipMip, initData.data()
 		);
 
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	initData.resize((mipCount - skipMip) * arraySize);
+
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = twidth;
+	texDesc.Height = (uint32_t)theight;
+	texDesc.DepthOrArraySize = (tdepth > 1) ? (uint16_t)tdepth : (uint16_t)arraySize;
+	texDesc.MipLevels = (uint16_t)(mipCount - skipMip);
+	texDesc.Format = format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	cubeMap = isCubeMap;
+
+	return hr;
+}
+
+static HRESULT CreateTextureFromDDS12(
+	_In_ ID3D12Device* device,
+	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+	_In_ const DDS_HEADER* header,
+	_In_reads_bytes_(bitSize) const uint8_t* bitData,
+	_In_ size_t bitSize,
+	_In_ size_t maxsize,
+	_In_ bool forceSRGB,
+	ComPtr<ID3D12Resource>& texture,
+	ComPtr<ID3D12Resource>& textureUploadHeap)
+{
+	D3D12_RESOURCE_DESC texDesc;
+	bool isCubeMap = false;
+	std::vector<D3D12_SUBRESOURCE_DATA> initData;
+
+	HRESULT hr = LayoutTextureFromDDS12(header, bitData, bitSize, maxsize, texDesc, isCubeMap, initData);
+
 	if (SUCCEEDED(hr))
 	{
-		hr = CreateD3DResources12(
-			device, cmdList,
-			resDim, twidth, theight, tdepth,
-			mipCount - skipMip,
-			arraySize,
-			format,
-			false, // forceSRGB
-			isCubeMap,
-			initData.get(),
-			texture, 
-			textureUploadHeap);
+		hr = CreateD3DResources12(device, cmdList, texDesc, initData.data(), texture, textureUploadHeap);
 	}
 
 	return hr;
@@ -2228,6 +2326,365 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	return hr;
 }
 
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::LoadDDSTextureData12(_In_z_ const wchar_t* szFileName,
+	_Out_ DDSTextureData& data,
+	_In_ size_t maxsize)
+{
+	data.FileData.reset();
+	data.FileSize = 0;
+	data.IsCubeMap = false;
+	data.AlphaMode = DDS_ALPHA_MODE_UNKNOWN;
+	data.Subresources.clear();
+
+	if (!szFileName)
+	{
+		return E_INVALIDARG;
+	}
+
+	DDS_HEADER* header = nullptr;
+	uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	HRESULT hr = LoadTextureDataFromFile(szFileName, data.FileData, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	data.FileSize = (bitData - data.FileData.get()) + bitSize;
+
+	hr = LayoutTextureFromDDS12(header, bitData, bitSize, maxsize, data.Desc, data.IsCubeMap, data.Subresources);
+	if (FAILED(hr))
+	{
+		data.Subresources.clear();
+		return hr;
+	}
+
+	data.AlphaMode = GetAlphaMode(header);
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::CreateDDSTextureFromData12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_ const DDSTextureData& data,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap)
+{
+	texture = nullptr;
+	textureUploadHeap = nullptr;
+
+	if (!device || !cmdList || data.Subresources.empty())
+	{
+		return E_INVALIDARG;
+	}
+
+	return CreateD3DResources12(device, cmdList, data.Desc, data.Subresources.data(), texture, textureUploadHeap);
+}
+
+//--------------------------------------------------------------------------------------
+// A DDS file opened for reading its texels straight into upload memory: the header
+// read and validated, the texture laid out, the texels still in the file.
+struct DDSFileLayout
+{
+	ScopedHandle File;
+	alignas(uint32_t) uint8_t HeaderData[DDS_MAX_HEADER_SIZE];
+	DDS_HEADER* Header = nullptr;
+	size_t BitOffset = 0;
+
+	D3D12_RESOURCE_DESC Desc;
+	bool IsCubeMap = false;
+
+	// The layout only does arithmetic on the texel pointer, so laying out from the
+	// end of the header makes each subresource's pData less BitBase() its offset
+	// from the first texel in the file.
+	std::vector<D3D12_SUBRESOURCE_DATA> Subresources;
+
+	const uint8_t* BitBase()const { return HeaderData + BitOffset; }
+};
+
+static HRESULT LayoutTextureFromFile12(
+	_In_z_ const wchar_t* fileName,
+	_In_ size_t maxsize,
+	DDSFileLayout& layout)
+{
+	LARGE_INTEGER fileSize = { 0 };
+	HRESULT hr = OpenFileForRead(fileName, layout.File, fileSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (fileSize.HighPart > 0)
+	{
+		return E_FAIL;
+	}
+
+	hr = ReadHeaderFromFile(layout.File.get(), fileSize.LowPart, layout.HeaderData, &layout.Header, &layout.BitOffset);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	return LayoutTextureFromDDS12(layout.Header, layout.BitBase(), fileSize.LowPart - layout.BitOffset,
+		maxsize, layout.Desc, layout.IsCubeMap, layout.Subresources);
+}
+
+// Creates an upload heap for subresources [firstSubresource, firstSubresource +
+// numSubresources) of layout.Desc and reads them from the file into it.
+// footprints receives where each one went.
+static HRESULT ReadSubresourcesToUploadHeap12(
+	_In_ ID3D12Device* device,
+	const DDSFileLayout& layout,
+	_In_ UINT firstSubresource,
+	_In_ UINT numSubresources,
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& footprints,
+	ComPtr<ID3D12Resource>& uploadHeap,
+	DDSDirectLoadStats& stats)
+{
+	// Where each subresource goes in the upload heap, rows padded as copies need.
+	footprints.resize(numSubresources);
+	std::vector<UINT> numRows(numSubresources);
+	std::vector<UINT64> rowSizes(numSubresources);
+	UINT64 uploadBufferSize = 0;
+	device->GetCopyableFootprints(&layout.Desc, firstSubresource, numSubresources, 0,
+		footprints.data(), numRows.data(), rowSizes.data(), &uploadBufferSize);
+
+	HRESULT hr = device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&uploadHeap));
+	if (FAILED(hr))
+	{
+		uploadHeap = nullptr;
+		return hr;
+	}
+
+	MemoryStats::Track(MemoryCategory::UploadHeap, uploadHeap.Get());
+
+	uint8_t* mapped = nullptr;
+	hr = uploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mapped));
+	if (FAILED(hr))
+	{
+		uploadHeap = nullptr;
+		return hr;
+	}
+
+	// Upload memory is write-combined, so it is only ever written, never read back.
+	// Subresources whose rows the footprint keeps tightly packed (all but the small
+	// mips) are read straight into place; the others go through a scratch buffer.
+	// A volume mip holds Depth slices, one after the other in both the file and
+	// the footprint.
+	std::vector<uint8_t> scratch;
+	for (UINT i = 0; i < numSubresources && SUCCEEDED(hr); ++i)
+	{
+		const D3D12_SUBRESOURCE_DATA& src = layout.Subresources[firstSubresource + i];
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = footprints[i];
+		const UINT depth = footprint.Footprint.Depth;
+		const UINT64 destSlicePitch = (UINT64)footprint.Footprint.RowPitch * numRows[i];
+
+		LARGE_INTEGER offset;
+		offset.QuadPart = layout.BitOffset + (reinterpret_cast<const uint8_t*>(src.pData) - layout.BitBase());
+		if (!SetFilePointerEx(layout.File.get(), offset, nullptr, FILE_BEGIN))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+			break;
+		}
+
+		uint8_t* dest = mapped + footprint.Offset;
+		DWORD bytes = static_cast<DWORD>(src.SlicePitch * depth);
+		if (footprint.Footprint.RowPitch == static_cast<UINT>(src.RowPitch) &&
+			destSlicePitch == static_cast<UINT64>(src.SlicePitch))
+		{
+			hr = ReadExactly(layout.File.get(), dest, bytes);
+			stats.BytesReadInPlace += bytes;
+		}
+		else
+		{
+			scratch.resize(bytes);
+			hr = ReadExactly(layout.File.get(), scratch.data(), bytes);
+			for (UINT z = 0; z < depth && SUCCEEDED(hr); ++z)
+			{
+				for (UINT y = 0; y < numRows[i]; ++y)
+				{
+					memcpy(dest + z * destSlicePitch + (UINT64)y * footprint.Footprint.RowPitch,
+						scratch.data() + (size_t)z * src.SlicePitch + (size_t)y * src.RowPitch, (size_t)rowSizes[i]);
+				}
+			}
+			stats.BytesStaged += bytes;
+		}
+	}
+
+	uploadHeap->Unmap(0, nullptr);
+
+	if (FAILED(hr))
+	{
+		uploadHeap = nullptr;
+	}
+
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::CreateDDSTextureFromFileDirect12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_z_ const wchar_t* szFileName,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode,
+	_Out_opt_ DDSDirectLoadStats* stats)
+{
+	texture = nullptr;
+	textureUploadHeap = nullptr;
+	if (alphaMode)
+	{
+		*alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+	}
+	if (stats)
+	{
+		*stats = DDSDirectLoadStats();
+	}
+
+	if (!device || !cmdList || !szFileName)
+	{
+		return E_INVALIDARG;
+	}
+
+	DDSFileLayout layout;
+	HRESULT hr = LayoutTextureFromFile12(szFileName, maxsize, layout);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	hr = device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&layout.Desc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&texture));
+	if (FAILED(hr))
+	{
+		texture = nullptr;
+		return hr;
+	}
+
+	// A volume's depth is not a subresource index: it has one subresource per mip.
+	const UINT numSubresources = layout.Desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ?
+		layout.Desc.MipLevels : layout.Desc.DepthOrArraySize * layout.Desc.MipLevels;
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;
+	DDSDirectLoadStats loadStats;
+	hr = ReadSubresourcesToUploadHeap12(device, layout, 0, numSubresources, footprints, textureUploadHeap, loadStats);
+	if (FAILED(hr))
+	{
+		texture = nullptr;
+		return hr;
+	}
+
+	MemoryStats::Track(MemoryCategory::Texture, texture.Get());
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+
+	for (UINT i = 0; i < numSubresources; ++i)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture.Get(), i);
+		CD3DX12_TEXTURE_COPY_LOCATION src(textureUploadHeap.Get(), footprints[i]);
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	if (alphaMode)
+	{
+		*alphaMode = GetAlphaMode(layout.Header);
+	}
+	if (stats)
+	{
+		*stats = loadStats;
+	}
+
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::LoadDDSMips12(_In_ ID3D12Device* device,
+	_In_z_ const wchar_t* szFileName,
+	_In_ size_t maxsize,
+	_In_ UINT endMip,
+	_Out_ DDSMipUpload& mips)
+{
+	mips = DDSMipUpload();
+
+	if (!device || !szFileName)
+	{
+		return E_INVALIDARG;
+	}
+
+	DDSFileLayout layout;
+	HRESULT hr = LayoutTextureFromFile12(szFileName, 0, layout);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// With one 2D slice, subresource i is mip i.
+	if (layout.IsCubeMap || layout.Desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D ||
+		layout.Desc.DepthOrArraySize != 1)
+	{
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+
+	mips.Desc = layout.Desc;
+
+	// The largest mip no larger than maxsize, as FillInitData12 picks it.
+	UINT firstMip = 0;
+	if (maxsize && layout.Desc.MipLevels > 1)
+	{
+		while (firstMip + 1 < layout.Desc.MipLevels &&
+			(std::max<UINT64>(layout.Desc.Width >> firstMip, 1) > maxsize ||
+			 std::max<UINT>(layout.Desc.Height >> firstMip, 1) > maxsize))
+		{
+			++firstMip;
+		}
+	}
+
+	if (endMip == 0 || endMip > layout.Desc.MipLevels)
+	{
+		endMip = layout.Desc.MipLevels;
+	}
+
+	mips.FirstMip = firstMip;
+	if (firstMip >= endMip)
+	{
+		return S_OK;
+	}
+	mips.MipCount = endMip - firstMip;
+
+	return ReadSubresourcesToUploadHeap12(device, layout, firstMip, mips.MipCount,
+		mips.Footprints, mips.UploadHeap, mips.Stats);
+}
+
+//--------------------------------------------------------------------------------------
+void DirectX::CopyDDSMips12(_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_ ID3D12Resource* texture,
+	_In_ const DDSMipUpload& mips)
+{
+	for (UINT i = 0; i < mips.MipCount; ++i)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture, mips.FirstMip + i);
+		CD3DX12_TEXTURE_COPY_LOCATION src(mips.UploadHeap.Get(), mips.Footprints[i]);
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            ID3D11DeviceContext* d3dContext,
@@ -32,6 +32,9 @@
 
 #pragma warning(pop)
 
+#include <memory>
+#include <vector>
+
 #if defined(_MSC_VER) && (_MSC_VER<1610) && !defined(_In_reads_)
 #define _In_reads_(exp)
 #define _Out_writes_(exp)
@@ -92,6 +95,96 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// A DDS file read, validated and laid out by LoadDDSTextureData12, ready for
+	// CreateDDSTextureFromData12.
+	struct DDSTextureData
+	{
+		std::unique_ptr<uint8_t[]> FileData;
+		size_t FileSize = 0;
+
+		D3D12_RESOURCE_DESC Desc = {};
+		bool IsCubeMap = false;
+		DDS_ALPHA_MODE AlphaMode = DDS_ALPHA_MODE_UNKNOWN;
+
+		// One per subresource of Desc, pointing into FileData.
+		std::vector<D3D12_SUBRESOURCE_DATA> Subresources;
+	};
+
+	// CreateDDSTextureFromFile12 in two stages.  The first touches no D3D object,
+	// so several files can be loaded at once on worker threads; the second creates
+	// the resource and records the upload, on the thread recording cmdList.
+	HRESULT LoadDDSTextureData12(_In_z_ const wchar_t* szFileName,
+		                         _Out_ DDSTextureData& data,
+		                         _In_ size_t maxsize = 0
+		                         );
+
+	HRESULT CreateDDSTextureFromData12(_In_ ID3D12Device* device,
+		                               _In_ ID3D12GraphicsCommandList* cmdList,
+		                               _In_ const DDSTextureData& data,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap
+		                               );
+
+	// Where CreateDDSTextureFromFileDirect12 put the texels it read.
+	struct DDSDirectLoadStats
+	{
+		// Read from the file straight into their place in the upload heap.
+		uint64_t BytesReadInPlace = 0;
+
+		// Read into a scratch buffer and copied again row by row, for subresources
+		// whose rows the upload heap pads to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+		uint64_t BytesStaged = 0;
+	};
+
+	// CreateDDSTextureFromFile12 without holding the file in memory: reads the
+	// header, lays out the upload heap and reads each subresource into its footprint
+	// there, so most texels are copied once, from the file to upload memory.
+	HRESULT CreateDDSTextureFromFileDirect12(_In_ ID3D12Device* device,
+		                                     _In_ ID3D12GraphicsCommandList* cmdList,
+		                                     _In_z_ const wchar_t* szFileName,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap,
+		                                     _In_ size_t maxsize = 0,
+		                                     _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+		                                     _Out_opt_ DDSDirectLoadStats* stats = nullptr
+		                                     );
+
+	// A range of mips of a 2D texture read by LoadDDSMips12, waiting in an upload
+	// heap to be copied into the texture by CopyDDSMips12.
+	struct DDSMipUpload
+	{
+		// The whole texture, every mip, as the file describes it.
+		D3D12_RESOURCE_DESC Desc = {};
+
+		UINT FirstMip = 0;
+		UINT MipCount = 0;
+
+		// Where each mip read is in UploadHeap.
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Footprints;
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap;
+
+		DDSDirectLoadStats Stats;
+	};
+
+	// Reads the mips of a 2D texture from the largest no larger than maxsize (0 for
+	// the top mip) up to but not including endMip (0 for all of them) straight into a
+	// new upload heap, as CreateDDSTextureFromFileDirect12 does.  Creates no texture
+	// and records nothing, so it can run on a worker thread, for instance to stream
+	// a texture in a few mips at a time.  Cube maps and arrays are not supported.
+	HRESULT LoadDDSMips12(_In_ ID3D12Device* device,
+		                  _In_z_ const wchar_t* szFileName,
+		                  _In_ size_t maxsize,
+		                  _In_ UINT endMip,
+		                  _Out_ DDSMipUpload& mips
+		                  );
+
+	// Records copying the mips of LoadDDSMips12 into the same mips of texture, which
+	// must be laid out as mips.Desc and have those mips in the COPY_DEST state.
+	void CopyDDSMips12(_In_ ID3D12GraphicsCommandList* cmdList,
+		               _In_ ID3D12Resource* texture,
+		               _In_ const DDSMipUpload& mips
+		               );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -0,0 +1,219 @@
+//***************************************************************************************
+// DynamicResolution.cpp
+//***************************************************************************************
+
+#include "DynamicResolution.h"
+#include "SelfCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+DynamicResolutionController::DynamicResolutionController()
+{
+	Reset();
+}
+
+DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings) :
+	mSettings(settings)
+{
+	Reset();
+}
+
+void DynamicResolutionController::SetSettings(const DynamicResolutionSettings& settings)
+{
+	mSettings = settings;
+	Reset();
+}
+
+const DynamicResolutionSettings& DynamicResolutionController::Settings()const
+{
+	return mSettings;
+}
+
+void DynamicResolutionController::Reset()
+{
+	mTelemetry = DynamicResolutionTelemetry();
+	mTelemetry.RequestedScale = mSettings.MaxScale;
+	mTelemetry.Scale = mSettings.MaxScale;
+	mTelemetry.CubeSize = mSettings.MaxCubeSize;
+
+	mPrevError = 0.0f;
+	mFramesSinceChange = 0;
+}
+
+bool DynamicResolutionController::Update(float frameMs)
+{
+	const DynamicResolutionSettings& s = mSettings;
+	DynamicResolutionTelemetry& t = mTelemetry;
+
+	t.FrameMs = frameMs;
+	t.FilteredMs = (t.Frames == 0) ? frameMs : s.Smoothing*t.FilteredMs + (1.0f - s.Smoothing)*frameMs;
+	++t.Frames;
+
+	// Positive error = headroom, negative = over budget.
+	float error = (s.TargetFrameMs - t.FilteredMs) / s.TargetFrameMs;
+	if(fabsf(error) < s.Deadband)
+		error = 0.0f;
+	t.Error = error;
+
+	// The output is an offset below MaxScale, so only an accumulated overload
+	// needs integrating.  Clamp to the range that can actually be reached
+	// (anti-windup).
+	if(s.Ki > 0.0f)
+	{
+		float minIntegral = (s.MinScale - s.MaxScale) / s.Ki;
+		t.Integral = std::min(std::max(t.Integral + error, minIntegral), 0.0f);
+	}
+
+	float derivative = error - mPrevError;
+	mPrevError = error;
+
+	float requested = s.MaxScale + s.Kp*error + s.Ki*t.Integral + s.Kd*derivative;
+	requested = std::min(std::max(requested, s.MinScale), s.MaxScale);
+	t.RequestedScale = requested;
+
+	// Quantize and rate limit.
+	float quantized = requested;
+	if(s.ScaleStep > 0.0f)
+	{
+		quantized = s.MinScale + floorf((requested - s.MinScale) / s.ScaleStep + 0.5f)*s.ScaleStep;
+		quantized = std::min(std::max(quantized, s.MinScale), s.MaxScale);
+	}
+
+	bool changed = false;
+
+	++mFramesSinceChange;
+	if(fabsf(quantized - t.Scale) > 0.5f*s.ScaleStep && mFramesSinceChange >= s.CooldownFrames)
+	{
+		t.Scale = quantized;
+		++t.ScaleChanges;
+		mFramesSinceChange = 0;
+		changed = true;
+	}
+
+	uint32_t cubeSize = CubeSizeForScale(t.Scale);
+	if(cubeSize != t.CubeSize)
+	{
+		t.CubeSize = cubeSize;
+		++t.CubeSizeChanges;
+		changed = true;
+	}
+
+	return changed;
+}
+
+float DynamicResolutionController::ResolutionScale()const
+{
+	return mTelemetry.Scale;
+}
+
+uint32_t DynamicResolutionController::CubeMapSize()const
+{
+	return mTelemetry.CubeSize;
+}
+
+const DynamicResolutionTelemetry& DynamicResolutionController::Telemetry()const
+{
+	return mTelemetry;
+}
+
+uint32_t DynamicResolutionController::CubeSizeForScale(float scale)const
+{
+	const DynamicResolutionSettings& s = mSettings;
+
+	float ideal = log2f(std::max((float)s.MaxCubeSize*scale, 1.0f));
+	float current = log2f((float)mTelemetry.CubeSize);
+
+	// Stay put unless the ideal size is clearly closer to another power of two.
+	if(fabsf(ideal - current) <= 0.5f + s.CubeHysteresis)
+		return mTelemetry.CubeSize;
+
+	uint32_t size = 1u << (uint32_t)floorf(ideal + 0.5f);
+	return std::min(std::max(size, s.MinCubeSize), s.MaxCubeSize);
+}
+
+bool DynamicResolutionController::RunSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	DynamicResolutionController controller;
+	const DynamicResolutionSettings& s = controller.Settings();
+	const float budget = s.TargetFrameMs;
+
+	// Runs frames of frameMs(scale, frame), and checks each change of the scale waits
+	// out the cooldown and goes the way the error asks.
+	bool cooldownHeld = true;
+	bool directionHeld = true;
+	int sinceChange = 0;
+	auto run = [&](int frames, auto frameMs)
+	{
+		for(int i = 0; i < frames; ++i)
+		{
+			float before = controller.ResolutionScale();
+			++sinceChange;
+			controller.Update(frameMs(before, i));
+
+			float after = controller.ResolutionScale();
+			if(after != before)
+			{
+				cooldownHeld &= sinceChange >= s.CooldownFrames;
+				directionHeld &= (after < before) == (controller.Telemetry().Error < 0.0f);
+				sinceChange = 0;
+			}
+		}
+	};
+
+	// Fixed times 50% over budget: the scale falls to the floor and stays there.
+	run(1000, [&](float, int) { return 1.5f*budget; });
+	checks.Check(controller.ResolutionScale() == s.MinScale, "over budget, the scale falls to MinScale");
+	checks.Check(controller.CubeMapSize() < s.MaxCubeSize, "over budget, the cube map shrinks with the scale");
+	checks.Note("  Over budget: scale %.2f, cube map %u, %u scale changes\n",
+		controller.ResolutionScale(), controller.CubeMapSize(), controller.Telemetry().ScaleChanges);
+
+	// Then 40% under: it climbs back to full resolution.
+	run(1000, [&](float, int) { return 0.6f*budget; });
+	checks.Check(controller.ResolutionScale() == s.MaxScale, "under budget, the scale climbs back to MaxScale");
+	checks.Check(controller.CubeMapSize() == s.MaxCubeSize, "under budget, the cube map climbs back to MaxCubeSize");
+
+	// Jitter inside the deadband from full resolution changes nothing.
+	controller.Reset();
+	sinceChange = 0;
+	run(1000, [&](float, int frame) { return ((frame*7) % 3 == 0 ? 1.03f : 0.97f)*budget; });
+	checks.Check(controller.Telemetry().ScaleChanges == 0, "frame times inside the deadband leave the scale alone");
+
+	// Frame time following the pixel count, over budget at full resolution: the
+	// scale settles where the frame fits and then holds.
+	controller.Reset();
+	sinceChange = 0;
+	auto pixelBound = [&](float scale, int) { return budget*(0.35f + 0.9f*scale*scale); };
+	run(2000, pixelBound);
+	uint32_t settledChanges = controller.Telemetry().ScaleChanges;
+	uint32_t settledCubeChanges = controller.Telemetry().CubeSizeChanges;
+	float settledScale = controller.ResolutionScale();
+	run(2000, pixelBound);
+
+	float settledMs = pixelBound(settledScale, 0);
+	checks.Check(settledScale < s.MaxScale && settledScale > s.MinScale, "a pixel bound frame settles between the scale limits");
+	checks.Check(settledMs <= budget*(1.0f + s.Deadband), "the settled scale fits the budget");
+	checks.Check(controller.Telemetry().ScaleChanges == settledChanges, "once settled, the scale does not flip-flop");
+	checks.Check(controller.Telemetry().CubeSizeChanges == settledCubeChanges, "once settled, the cube map size does not flip-flop");
+	checks.Note("  Pixel bound: settled at scale %.2f (%.2f ms of %.2f) after %u changes, cube map %u\n",
+		settledScale, settledMs, budget, settledChanges, controller.CubeMapSize());
+
+	// Scales of 0.70 and 0.75 ask for cube maps either side of the 256/512
+	// rounding point; alternating between them may switch the size once at most.
+	controller.Reset();
+	int cubeChanges = 0;
+	for(int i = 0; i < 100; ++i)
+	{
+		uint32_t size = controller.CubeSizeForScale(i % 2 ? 0.75f : 0.70f);
+		cubeChanges += size != controller.mTelemetry.CubeSize;
+		controller.mTelemetry.CubeSize = size;
+	}
+	checks.Check(cubeChanges <= 1, "a scale hovering at a rounding point does not flip-flop the cube map size");
+
+	checks.Check(cooldownHeld, "the scale never changes within CooldownFrames of the last change");
+	checks.Check(directionHeld, "the scale only falls over budget and rises under it");
+
+	return checks.Finish("Dynamic resolution controller");
+}
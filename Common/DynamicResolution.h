@@ -0,0 +1,94 @@
+//***************************************************************************************
+// DynamicResolution.h
+//
+// Feedback controller for dynamic resolution scaling.  Feed it the measured frame
+// time every frame; it runs a PID loop on the error against the frame budget and
+// decides a main-view resolution scale and a dynamic cube map edge length.  The
+// controller has no D3D dependencies so it can be driven with synthetic timings.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct DynamicResolutionSettings
+{
+	float TargetFrameMs = 1000.0f / 60.0f;
+
+	// PID gains on the normalized error (budget - frameTime) / budget.
+	float Kp = 0.15f;
+	float Ki = 0.02f;
+	float Kd = 0.05f;
+
+	// Exponential smoothing of the measured frame time (0 = none, 1 = frozen).
+	float Smoothing = 0.8f;
+
+	// Errors within +/- Deadband of the budget are treated as on target.
+	float Deadband = 0.05f;
+
+	float MinScale = 0.5f;
+	float MaxScale = 1.0f;
+
+	// The applied scale moves in steps of ScaleStep and no more often than
+	// every CooldownFrames frames.
+	float ScaleStep = 0.05f;
+	int CooldownFrames = 20;
+
+	// The cube map size is MaxCubeSize*scale rounded to a power of two in
+	// [MinCubeSize, MaxCubeSize].  It only switches once log2 of the ideal size
+	// is CubeHysteresis past the rounding point, so it does not flip-flop.
+	uint32_t MinCubeSize = 64;
+	uint32_t MaxCubeSize = 512;
+	float CubeHysteresis = 0.15f;
+};
+
+struct DynamicResolutionTelemetry
+{
+	float FrameMs = 0.0f;         // last measured
+	float FilteredMs = 0.0f;      // smoothed
+	float Error = 0.0f;           // normalized error fed to the PID
+	float Integral = 0.0f;
+	float RequestedScale = 1.0f;  // unquantized PID output
+	float Scale = 1.0f;           // applied
+	uint32_t CubeSize = 0;        // applied
+	uint32_t ScaleChanges = 0;
+	uint32_t CubeSizeChanges = 0;
+	uint64_t Frames = 0;
+};
+
+class DynamicResolutionController
+{
+public:
+	DynamicResolutionController();
+	explicit DynamicResolutionController(const DynamicResolutionSettings& settings);
+
+	void SetSettings(const DynamicResolutionSettings& settings);
+	const DynamicResolutionSettings& Settings()const;
+
+	void Reset();
+
+	// Returns true if the applied scale or cube size changed this frame.
+	bool Update(float frameMs);
+
+	float ResolutionScale()const;
+	uint32_t CubeMapSize()const;
+
+	const DynamicResolutionTelemetry& Telemetry()const;
+
+	// Drives the controller with synthetic frame times, over and under budget and
+	// from a model where the frame time follows the pixel count, and checks the
+	// scale converges, respects the cooldown and does not flip-flop near the
+	// budget.  Returns false and says why in report if any check fails.
+	static bool RunSelfCheck(std::string& report);
+
+private:
+	uint32_t CubeSizeForScale(float scale)const;
+
+private:
+	DynamicResolutionSettings mSettings;
+	DynamicResolutionTelemetry mTelemetry;
+
+	float mPrevError = 0.0f;
+	int mFramesSinceChange = 0;
+};
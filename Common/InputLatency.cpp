@@ -0,0 +1,221 @@
+//***************************************************************************************
+// InputLatency.cpp
+//***************************************************************************************
+
+#include "InputLatency.h"
+#include <mmsystem.h>
+#include <algorithm>
+#include <cstdio>
+
+#pragma comment(lib, "winmm.lib")
+
+static int64_t QpcNow()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+InputLatencyTracker::InputLatencyTracker()
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	mQpcToMs = 1000.0 / (double)freq.QuadPart;
+}
+
+InputLatencyTracker::~InputLatencyTracker()
+{
+	StopSampling();
+}
+
+void InputLatencyTracker::StartSampling(const std::vector<int>& virtualKeys)
+{
+	StopSampling();
+
+	mSampledKeys = virtualKeys;
+	if(mSampledKeys.empty())
+		return;
+
+	mSampling = true;
+	mSampler = std::thread(&InputLatencyTracker::SamplerMain, this);
+}
+
+void InputLatencyTracker::StopSampling()
+{
+	if(!mSampling.exchange(false))
+		return;
+
+	mSampler.join();
+}
+
+void InputLatencyTracker::SamplerMain()
+{
+	// Sleep(1) only has 1 ms resolution with the raised timer frequency.  It is
+	// lowered again as soon as sampling stops.
+	timeBeginPeriod(1);
+
+	std::vector<bool> down(mSampledKeys.size(), false);
+	while(mSampling.load())
+	{
+		for(size_t i = 0; i < mSampledKeys.size(); ++i)
+		{
+			bool isDown = (GetAsyncKeyState(mSampledKeys[i]) & 0x8000) != 0;
+			if(isDown != down[i])
+			{
+				down[i] = isDown;
+				OnInputEvent();
+			}
+		}
+
+		Sleep(1);
+	}
+
+	timeEndPeriod(1);
+}
+
+void InputLatencyTracker::OnInputEvent()
+{
+	OnInputEvent(QpcNow());
+}
+
+void InputLatencyTracker::OnInputEvent(int64_t qpcTimestamp)
+{
+	// Keep the earliest timestamp; later inputs are shown by the same frame.
+	int64_t expected = 0;
+	mPendingInput.compare_exchange_strong(expected, qpcTimestamp);
+}
+
+bool InputLatencyTracker::ChangesState(UINT msg, WPARAM wParam, LPARAM lParam)
+{
+	switch(msg)
+	{
+	case WM_KEYDOWN:
+	case WM_SYSKEYDOWN:
+		// Bit 30 is set when the key was already down: an auto repeat.
+		return (lParam & (1 << 30)) == 0;
+	case WM_KEYUP:
+	case WM_SYSKEYUP:
+	case WM_LBUTTONDOWN:
+	case WM_LBUTTONUP:
+	case WM_RBUTTONDOWN:
+	case WM_RBUTTONUP:
+	case WM_MBUTTONDOWN:
+	case WM_MBUTTONUP:
+	case WM_XBUTTONDOWN:
+	case WM_XBUTTONUP:
+		return true;
+	case WM_MOUSEMOVE:
+		return (wParam & (MK_LBUTTON | MK_RBUTTON | MK_MBUTTON | MK_XBUTTON1 | MK_XBUTTON2)) != 0;
+	default:
+		return false;
+	}
+}
+
+void InputLatencyTracker::DiscardInput()
+{
+	mPendingInput.store(0);
+	mFrameInput = 0;
+}
+
+void InputLatencyTracker::BeginFrame()
+{
+	mFrameInput = mPendingInput.exchange(0);
+}
+
+void InputLatencyTracker::EndFrame(UINT64 fenceValue, bool discard)
+{
+	if(mFrameInput == 0)
+		return;
+
+	if(discard)
+	{
+		mFrameInput = 0;
+		return;
+	}
+
+	PendingFrame frame;
+	frame.InputTimestamp = mFrameInput;
+	frame.PresentTimestamp = QpcNow();
+	frame.Fence = fenceValue;
+	mInFlight.push_back(frame);
+
+	mPresentHistogram.Add(ToMs(frame.PresentTimestamp - frame.InputTimestamp));
+	mFrameInput = 0;
+}
+
+void InputLatencyTracker::Poll(UINT64 completedFenceValue)
+{
+	if(mInFlight.empty())
+		return;
+
+	int64_t now = QpcNow();
+	while(!mInFlight.empty() && mInFlight.front().Fence <= completedFenceValue)
+	{
+		mCompleteHistogram.Add(ToMs(now - mInFlight.front().InputTimestamp));
+		mInFlight.pop_front();
+	}
+}
+
+void InputLatencyTracker::Reset()
+{
+	mPresentHistogram = Histogram();
+	mCompleteHistogram = Histogram();
+}
+
+double InputLatencyTracker::PresentPercentile(double p)const
+{
+	return mPresentHistogram.Percentile(p);
+}
+
+double InputLatencyTracker::CompletePercentile(double p)const
+{
+	return mCompleteHistogram.Percentile(p);
+}
+
+std::string InputLatencyTracker::Report()const
+{
+	char buf[256];
+	sprintf_s(buf,
+		"Input latency over %llu frames (ms)   p50     p90     p99     max\n"
+		"  input -> present            %7.2f %7.2f %7.2f %7.2f\n"
+		"  input -> GPU complete       %7.2f %7.2f %7.2f %7.2f\n",
+		(unsigned long long)mCompleteHistogram.Count,
+		mPresentHistogram.Percentile(0.5), mPresentHistogram.Percentile(0.9),
+		mPresentHistogram.Percentile(0.99), mPresentHistogram.MaxMs,
+		mCompleteHistogram.Percentile(0.5), mCompleteHistogram.Percentile(0.9),
+		mCompleteHistogram.Percentile(0.99), mCompleteHistogram.MaxMs);
+	return buf;
+}
+
+double InputLatencyTracker::ToMs(int64_t qpcDelta)const
+{
+	return (double)qpcDelta * mQpcToMs;
+}
+
+void InputLatencyTracker::Histogram::Add(double ms)
+{
+	int bucket = (int)(ms / BucketMs);
+	bucket = std::min<int>(std::max<int>(bucket, 0), BucketCount - 1);
+
+	++Buckets[bucket];
+	++Count;
+	SumMs += ms;
+	MaxMs = std::max<double>(MaxMs, ms);
+}
+
+double InputLatencyTracker::Histogram::Percentile(double p)const
+{
+	if(Count == 0)
+		return 0.0;
+
+	UINT64 target = (UINT64)(p * (double)(Count - 1)) + 1;
+	UINT64 seen = 0;
+	for(int i = 0; i < BucketCount; ++i)
+	{
+		seen += Buckets[i];
+		if(seen >= target)
+			return (i + 0.5) * BucketMs;
+	}
+
+	return MaxMs;
+}
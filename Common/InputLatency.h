@@ -0,0 +1,107 @@
+//***************************************************************************************
+// InputLatency.h
+//
+// Measures CPU-side input-to-photon latency.  Inputs are timestamped when the OS
+// event is handled (or, optionally, by a 1 kHz GetAsyncKeyState sampling thread),
+// the earliest unconsumed timestamp is picked up by the next frame, and the frame's
+// fence value ties it to the point the GPU finished the frame that showed it.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+class InputLatencyTracker
+{
+public:
+	InputLatencyTracker();
+	InputLatencyTracker(const InputLatencyTracker& rhs) = delete;
+	InputLatencyTracker& operator=(const InputLatencyTracker& rhs) = delete;
+	~InputLatencyTracker();
+
+	// Samples the given virtual keys at ~1 kHz on a dedicated thread and
+	// timestamps every state change.  The system timer resolution is raised to
+	// 1 ms from here until StopSampling.
+	void StartSampling(const std::vector<int>& virtualKeys);
+	void StopSampling();
+
+	// Call where an OS input message is handled.  Thread safe.
+	void OnInputEvent();
+	void OnInputEvent(int64_t qpcTimestamp);
+
+	// True for the messages worth timestamping: key and mouse button transitions,
+	// and mouse moves with a button held (drags).  Hovering and key repeats change
+	// nothing the app shows, so a frame would only look slow for them.
+	static bool ChangesState(UINT msg, WPARAM wParam, LPARAM lParam);
+
+	// Drops the input not yet shown by a frame.  Call while the app is paused, so
+	// the first frame after it does not count the pause as latency.
+	void DiscardInput();
+
+	// Call before the frame's Update: claims the input that arrived since the
+	// previous frame.
+	void BeginFrame();
+
+	// Call after the frame has been submitted and presented, with the fence value
+	// that was signaled for it.  discard == true drops the frame's input unmeasured,
+	// for frames presented while the app was paused.
+	void EndFrame(UINT64 fenceValue, bool discard = false);
+
+	// Call once per frame with the fence's completed value.
+	void Poll(UINT64 completedFenceValue);
+
+	void Reset();
+
+	// Latency percentile in milliseconds (p in [0, 1]).
+	double PresentPercentile(double p)const;
+	double CompletePercentile(double p)const;
+	UINT64 SampleCount()const { return mCompleteHistogram.Count; }
+
+	std::string Report()const;
+
+private:
+	struct Histogram
+	{
+		// 0.1 ms buckets up to 250 ms; the last bucket collects everything slower.
+		static const int BucketCount = 2500;
+		static constexpr double BucketMs = 0.1;
+
+		UINT64 Buckets[BucketCount] = {};
+		UINT64 Count = 0;
+		double MaxMs = 0.0;
+		double SumMs = 0.0;
+
+		void Add(double ms);
+		double Percentile(double p)const;
+	};
+
+	struct PendingFrame
+	{
+		int64_t InputTimestamp;
+		int64_t PresentTimestamp;
+		UINT64 Fence;
+	};
+
+	void SamplerMain();
+	double ToMs(int64_t qpcDelta)const;
+
+	double mQpcToMs = 0.0;
+
+	// Earliest input not yet claimed by a frame; 0 when none.
+	std::atomic<int64_t> mPendingInput{ 0 };
+	int64_t mFrameInput = 0;
+
+	std::deque<PendingFrame> mInFlight;
+	Histogram mPresentHistogram;
+	Histogram mCompleteHistogram;
+
+	std::vector<int> mSampledKeys;
+	std::thread mSampler;
+	std::atomic<bool> mSampling{ false };
+};
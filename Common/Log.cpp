@@ -0,0 +1,458 @@
+//***************************************************************************************
+// Log.cpp
+//***************************************************************************************
+
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+std::atomic<int> Log::sRuntimeLevel{ (int)LogLevel::Trace };
+
+namespace
+{
+	// Single producer (the owning thread), single consumer (the writer thread).
+	struct ThreadRing
+	{
+		static const uint32_t Capacity = 1024; // power of two
+
+		Log::Record Records[Capacity];
+		std::atomic<uint32_t> Head{ 0 };
+		std::atomic<uint32_t> Tail{ 0 };
+		std::atomic<uint64_t> Dropped{ 0 };
+		uint32_t ThreadId = 0;
+
+		// Set when the owning thread exits; the writer frees the ring once it has
+		// drained it for the last time.
+		std::atomic<bool> Retired{ false };
+	};
+
+	// Records are cache line aligned, which plain new does not honor before C++17.
+	ThreadRing* NewRing()
+	{
+		void* memory = _aligned_malloc(sizeof(ThreadRing), alignof(ThreadRing));
+		if(memory == nullptr)
+			throw std::bad_alloc();
+		return new(memory) ThreadRing();
+	}
+
+	void DeleteRing(ThreadRing* ring)
+	{
+		ring->~ThreadRing();
+		_aligned_free(ring);
+	}
+
+	thread_local ThreadRing* tRing = nullptr;
+
+	// Set once the thread's ring has been retired.  Thread locals destroyed after
+	// tRingOwner may still log; their records are dropped rather than written to a
+	// ring the writer is about to free, or to a new ring nothing would retire.
+	thread_local bool tRingRetired = false;
+
+	// Retires the thread's ring when the thread exits.  Kept apart from tRing so
+	// the hot path reads a plain pointer.
+	struct RingOwner
+	{
+		ThreadRing* Ring = nullptr;
+
+		~RingOwner()
+		{
+			tRing = nullptr;
+			tRingRetired = true;
+			if(Ring != nullptr)
+				Ring->Retired.store(true, std::memory_order_release);
+		}
+	};
+
+	thread_local RingOwner tRingOwner;
+
+	std::mutex gRingsMutex;
+	std::vector<ThreadRing*> gRings;
+
+	// Drops counted by rings that have since been freed, and records logged by
+	// exiting threads after their ring was retired.
+	uint64_t gRetiredDrops = 0;
+
+	// Completed drain passes, so Flush can wait for one that started after it.
+	std::atomic<uint64_t> gDrainPasses{ 0 };
+
+	std::thread gWriter;
+	std::atomic<bool> gRunning{ false };
+	std::mutex gWakeMutex;
+	std::condition_variable gWake;
+	FILE* gOut = nullptr;
+	bool gOwnsOut = false;
+
+	// Record timestamps are raw TSC values; they are converted to milliseconds
+	// against QueryPerformanceCounter on the writer thread only.
+	uint64_t gTsc0 = 0;
+	LARGE_INTEGER gQpc0 = {};
+	LARGE_INTEGER gQpcFreq = {};
+
+	ThreadRing* RegisterThread()
+	{
+		ThreadRing* ring = NewRing();
+		ring->ThreadId = GetCurrentThreadId();
+
+		std::lock_guard<std::mutex> lock(gRingsMutex);
+		gRings.push_back(ring);
+		tRing = ring;
+		tRingOwner.Ring = ring;
+		return ring;
+	}
+
+	const char* LevelName(int level)
+	{
+		static const char* names[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+		return (level >= 0 && level < 5) ? names[level] : "?????";
+	}
+
+	void AppendArg(std::string& out, const Log::Record& r, int i)
+	{
+		char buf[64];
+		uint64_t v = r.Args[i];
+		switch(r.ArgTypes[i])
+		{
+		case Log::ArgInt:
+			sprintf_s(buf, "%lld", (long long)(int64_t)v);
+			out += buf;
+			break;
+		case Log::ArgUInt:
+			sprintf_s(buf, "%llu", (unsigned long long)v);
+			out += buf;
+			break;
+		case Log::ArgDouble:
+		{
+			double d;
+			memcpy(&d, &v, sizeof(d));
+			sprintf_s(buf, "%g", d);
+			out += buf;
+			break;
+		}
+		case Log::ArgBool:
+			out += v ? "true" : "false";
+			break;
+		case Log::ArgPointer:
+			sprintf_s(buf, "0x%p", (void*)(uintptr_t)v);
+			out += buf;
+			break;
+		case Log::ArgText:
+			out.append(r.Text + (v >> 8), (size_t)(v & 0xff));
+			break;
+		case Log::ArgOwnedText:
+			out += (const char*)(uintptr_t)v;
+			break;
+		}
+	}
+
+	void FormatRecord(std::string& out, const Log::Record& r, double tscPerMs)
+	{
+		char prefix[64];
+		double ms = (double)(int64_t)(r.Ticks - gTsc0) / tscPerMs;
+		sprintf_s(prefix, "[%10.3f] [%s] [%5u] ", ms, LevelName(r.Level), r.ThreadId);
+		out += prefix;
+
+		int arg = 0;
+		for(const char* p = r.Format; *p != '\0'; ++p)
+		{
+			if(p[0] == '{' && p[1] == '}' && arg < r.ArgCount)
+			{
+				AppendArg(out, r, arg++);
+				++p;
+			}
+			else
+				out += *p;
+		}
+
+		if(out.empty() || out.back() != '\n')
+			out += '\n';
+	}
+
+	void FreeOwnedText(const Log::Record& r)
+	{
+		for(int i = 0; i < r.ArgCount; ++i)
+		{
+			if(r.ArgTypes[i] == Log::ArgOwnedText)
+				delete[] (char*)(uintptr_t)r.Args[i];
+		}
+	}
+
+	// Drains every ring once.  Returns the number of records written.
+	size_t DrainRings()
+	{
+		static std::vector<Log::Record> batch;
+		static std::vector<std::pair<ThreadRing*, uint32_t>> consumed;
+		static std::vector<ThreadRing*> retired;
+		static uint64_t reportedDrops = 0;
+
+		batch.clear();
+		consumed.clear();
+		retired.clear();
+
+		uint64_t drops = 0;
+		{
+			std::lock_guard<std::mutex> lock(gRingsMutex);
+			drops = gRetiredDrops;
+			for(ThreadRing* ring : gRings)
+			{
+				// Read before Head: a ring seen retired has no records past this head.
+				if(ring->Retired.load(std::memory_order_acquire))
+					retired.push_back(ring);
+
+				uint32_t tail = ring->Tail.load(std::memory_order_relaxed);
+				uint32_t head = ring->Head.load(std::memory_order_acquire);
+				for(uint32_t i = tail; i != head; ++i)
+					batch.push_back(ring->Records[i & (ThreadRing::Capacity - 1)]);
+				consumed.push_back(std::make_pair(ring, head));
+				drops += ring->Dropped.load(std::memory_order_relaxed);
+			}
+		}
+
+		// The rings are only ordered per thread; merge them by timestamp.
+		std::stable_sort(batch.begin(), batch.end(),
+			[](const Log::Record& a, const Log::Record& b) { return a.Ticks < b.Ticks; });
+
+		LARGE_INTEGER qpcNow;
+		QueryPerformanceCounter(&qpcNow);
+		uint64_t tscNow = __rdtsc();
+		double elapsedMs = 1000.0 * (double)(qpcNow.QuadPart - gQpc0.QuadPart) / (double)gQpcFreq.QuadPart;
+		double tscPerMs = elapsedMs > 1.0 ? (double)(tscNow - gTsc0) / elapsedMs : 1.0e6;
+
+		std::string text;
+		for(const Log::Record& r : batch)
+		{
+			FormatRecord(text, r, tscPerMs);
+			FreeOwnedText(r);
+		}
+
+		if(drops != reportedDrops)
+		{
+			char buf[96];
+			sprintf_s(buf, "[log] %llu records dropped (ring full or thread exiting)\n", (unsigned long long)(drops - reportedDrops));
+			text += buf;
+			reportedDrops = drops;
+		}
+
+		if(!text.empty())
+		{
+			if(gOut != nullptr)
+			{
+				fwrite(text.data(), 1, text.size(), gOut);
+				fflush(gOut);
+			}
+#if defined(DEBUG) || defined(_DEBUG)
+			OutputDebugStringA(text.c_str());
+#endif
+		}
+
+		// Only hand the slots back once the records have been written, so
+		// Flush() can wait on the tails.
+		for(auto& c : consumed)
+			c.first->Tail.store(c.second, std::memory_order_release);
+
+		if(!retired.empty())
+		{
+			std::lock_guard<std::mutex> lock(gRingsMutex);
+			for(ThreadRing* ring : retired)
+			{
+				gRetiredDrops += ring->Dropped.load(std::memory_order_relaxed);
+				gRings.erase(std::find(gRings.begin(), gRings.end(), ring));
+				DeleteRing(ring);
+			}
+		}
+
+		gDrainPasses.fetch_add(1, std::memory_order_release);
+		return batch.size();
+	}
+
+	void WriterMain()
+	{
+		while(gRunning.load())
+		{
+			if(DrainRings() == 0)
+			{
+				std::unique_lock<std::mutex> lock(gWakeMutex);
+				gWake.wait_for(lock, std::chrono::milliseconds(2));
+			}
+		}
+
+		DrainRings();
+	}
+}
+
+void Log::Start(const wchar_t* filename)
+{
+	if(gRunning.load())
+		return;
+
+	gTsc0 = __rdtsc();
+	QueryPerformanceFrequency(&gQpcFreq);
+	QueryPerformanceCounter(&gQpc0);
+
+	gOut = stderr;
+	gOwnsOut = false;
+	if(filename != nullptr)
+	{
+		FILE* file = nullptr;
+		if(_wfopen_s(&file, filename, L"w") == 0 && file != nullptr)
+		{
+			gOut = file;
+			gOwnsOut = true;
+		}
+	}
+
+	gRunning = true;
+	gWriter = std::thread(WriterMain);
+}
+
+void Log::Stop()
+{
+	if(!gRunning.exchange(false))
+		return;
+
+	gWake.notify_one();
+	gWriter.join();
+
+	if(gOwnsOut)
+		fclose(gOut);
+	gOut = nullptr;
+	gOwnsOut = false;
+}
+
+void Log::Flush()
+{
+	if(!gRunning.load())
+		return;
+
+	// A pass may already be under way with older heads, so wait for the one
+	// after it, which sees every record logged before this call.  Waiting on the
+	// passes rather than on the rings keeps clear of rings being retired.
+	uint64_t target = gDrainPasses.load(std::memory_order_acquire) + 2;
+
+	gWake.notify_one();
+	while(gDrainPasses.load(std::memory_order_acquire) < target && gRunning.load())
+		std::this_thread::yield();
+}
+
+void Log::SetLevel(LogLevel level)
+{
+	sRuntimeLevel.store((int)level, std::memory_order_relaxed);
+}
+
+Log::Record* Log::BeginRecord()
+{
+	ThreadRing* ring = tRing;
+	if(ring == nullptr)
+	{
+		if(tRingRetired)
+		{
+			std::lock_guard<std::mutex> lock(gRingsMutex);
+			++gRetiredDrops;
+			return nullptr;
+		}
+		ring = RegisterThread();
+	}
+
+	uint32_t head = ring->Head.load(std::memory_order_relaxed);
+	if(head - ring->Tail.load(std::memory_order_acquire) >= ThreadRing::Capacity)
+	{
+		ring->Dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Record* r = &ring->Records[head & (ThreadRing::Capacity - 1)];
+	r->Ticks = __rdtsc();
+	r->ThreadId = ring->ThreadId;
+	return r;
+}
+
+void Log::EndRecord()
+{
+	ThreadRing* ring = tRing;
+	ring->Head.store(ring->Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Log::PackText(Record& r, const char* s, size_t length)
+{
+	size_t offset = r.TextUsed;
+	size_t n = std::min<size_t>(length, (size_t)TextCapacity - offset);
+	memcpy(r.Text + offset, s, n);
+	r.TextUsed = (uint8_t)(offset + n);
+	PackValue(r, ArgText, ((uint64_t)offset << 8) | n);
+}
+
+void Log::PackText(Record& r, const wchar_t* s, size_t length)
+{
+	size_t offset = r.TextUsed;
+	size_t n = std::min<size_t>(length, (size_t)TextCapacity - offset);
+	for(size_t i = 0; i < n; ++i)
+		r.Text[offset + i] = s[i] < 128 ? (char)s[i] : '?';
+	r.TextUsed = (uint8_t)(offset + n);
+	PackValue(r, ArgText, ((uint64_t)offset << 8) | n);
+}
+
+void Log::WriteText(LogLevel level, const std::string& text)
+{
+	if(!IsEnabled(level))
+		return;
+
+	char* copy = new char[text.size() + 1];
+	memcpy(copy, text.c_str(), text.size() + 1);
+
+	Record* r = BeginRecord();
+	if(r == nullptr)
+	{
+		delete[] copy;
+		return;
+	}
+
+	r->Format = "{}";
+	r->Level = (uint8_t)level;
+	r->ArgCount = 0;
+	r->TextUsed = 0;
+	PackValue(*r, ArgOwnedText, (uint64_t)(uintptr_t)copy);
+
+	EndRecord();
+}
+
+uint64_t Log::DroppedCount()
+{
+	std::lock_guard<std::mutex> lock(gRingsMutex);
+	uint64_t drops = gRetiredDrops;
+	for(ThreadRing* ring : gRings)
+		drops += ring->Dropped.load(std::memory_order_relaxed);
+	return drops;
+}
+
+double Log::MeasureHotPathCost(int iterations)
+{
+	// Swap in a private ring that nobody drains; we consume it ourselves so it
+	// never fills up.
+	ThreadRing* saved = tRing;
+	ThreadRing* bench = NewRing();
+	tRing = bench;
+
+	LARGE_INTEGER freq, start, stop;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+
+	for(int i = 0; i < iterations; ++i)
+	{
+		Write(LogLevel::Info, "bench {} {} {}", i, 0.5f, "text");
+		bench->Tail.store(bench->Head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	QueryPerformanceCounter(&stop);
+
+	tRing = saved;
+	DeleteRing(bench);
+
+	double seconds = (double)(stop.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+	return 1.0e9 * seconds / (double)std::max<int>(iterations, 1);
+}
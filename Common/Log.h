@@ -0,0 +1,199 @@
+//***************************************************************************************
+// Log.h
+//
+// Low-overhead structured logging.  A log call copies the format string pointer and
+// its arguments into a fixed-size binary record in a lock-free ring owned by the
+// calling thread; a background thread drains the rings, formats the records and
+// writes them to a file or stderr.  Nothing on the calling side allocates, locks
+// or formats.
+//
+//   LOG_INFO("Loaded {} in {} ms", name, ms);
+//
+// The format string must be a string literal (its address is the record id).
+// Each "{}" is replaced by the next argument.  Strings are copied into the record
+// and truncated to Log::TextCapacity bytes in total; use Log::WriteText for long
+// dynamic text such as compiler output.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <intrin.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+enum class LogLevel : int
+{
+	Trace = 0,
+	Debug,
+	Info,
+	Warning,
+	Error,
+	Off
+};
+
+// Calls below this level compile to nothing.
+#ifndef LOG_COMPILE_LEVEL
+#if defined(DEBUG) || defined(_DEBUG)
+#define LOG_COMPILE_LEVEL 1
+#else
+#define LOG_COMPILE_LEVEL 2
+#endif
+#endif
+
+#define LOG_AT(level, ...)                                               \
+	do                                                                   \
+	{                                                                    \
+		if((int)(level) >= LOG_COMPILE_LEVEL && Log::IsEnabled(level))   \
+			Log::Write(level, __VA_ARGS__);                              \
+	} while(0)
+
+#define LOG_TRACE(...) LOG_AT(LogLevel::Trace,   __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug,   __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LogLevel::Info,    __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error,   __VA_ARGS__)
+
+class Log
+{
+public:
+	static const int MaxArgs = 6;
+	static const int TextCapacity = 48;
+
+	enum ArgType : uint8_t
+	{
+		ArgInt,
+		ArgUInt,
+		ArgDouble,
+		ArgBool,
+		ArgPointer,
+		ArgText,      // Value = (offset << 8) | length into Record::Text.
+		ArgOwnedText  // Value = heap char*; freed by the writer thread.
+	};
+
+	// One log call.  128 bytes and cache line aligned, so a record spans exactly
+	// two cache lines.
+	struct alignas(64) Record
+	{
+		const char* Format;
+		uint64_t Ticks;
+		uint32_t ThreadId;
+		uint8_t Level;
+		uint8_t ArgCount;
+		uint8_t TextUsed;
+		uint8_t ArgTypes[MaxArgs];
+		uint64_t Args[MaxArgs];
+		char Text[TextCapacity];
+	};
+
+	// Starts the writer thread.  filename == nullptr logs to stderr.
+	static void Start(const wchar_t* filename = nullptr);
+
+	// Drains everything that has been logged and stops the writer thread.
+	static void Stop();
+
+	// Blocks until every record logged before the call has been written.
+	static void Flush();
+
+	static void SetLevel(LogLevel level);
+	static bool IsEnabled(LogLevel level)
+	{
+		return (int)level >= sRuntimeLevel.load(std::memory_order_relaxed);
+	}
+
+	template<typename... Args>
+	static void Write(LogLevel level, const char* format, const Args&... args)
+	{
+		static_assert(sizeof...(Args) <= MaxArgs, "Too many log arguments.");
+
+		Record* r = BeginRecord();
+		if(r == nullptr)
+			return;
+
+		r->Format = format;
+		r->Level = (uint8_t)level;
+		r->ArgCount = 0;
+		r->TextUsed = 0;
+		int expand[] = { 0, (Pack(*r, args), 0)... };
+		(void)expand;
+
+		EndRecord();
+	}
+
+	static void Write(LogLevel level, const char* format)
+	{
+		Record* r = BeginRecord();
+		if(r == nullptr)
+			return;
+
+		r->Format = format;
+		r->Level = (uint8_t)level;
+		r->ArgCount = 0;
+		r->TextUsed = 0;
+
+		EndRecord();
+	}
+
+	// Slow path for dynamic text of any length: the text is copied to the heap.
+	static void WriteText(LogLevel level, const std::string& text);
+
+	// Records dropped because a thread's ring was full, or because the thread was
+	// exiting and its ring had already been retired.
+	static uint64_t DroppedCount();
+
+	// Average cost in nanoseconds of encoding and queuing one record with three
+	// arguments on the calling thread.  Uses a private ring, so nothing is written.
+	static double MeasureHotPathCost(int iterations = 100000);
+
+private:
+	static Record* BeginRecord();
+	static void EndRecord();
+
+	static void PackText(Record& r, const char* s, size_t length);
+	static void PackText(Record& r, const wchar_t* s, size_t length);
+
+	static void PackValue(Record& r, ArgType type, uint64_t value)
+	{
+		r.ArgTypes[r.ArgCount] = type;
+		r.Args[r.ArgCount] = value;
+		++r.ArgCount;
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+		Pack(Record& r, const T& v) { PackValue(r, ArgInt, (uint64_t)(int64_t)v); }
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+		Pack(Record& r, const T& v) { PackValue(r, ArgUInt, (uint64_t)v); }
+
+	template<typename T>
+	static typename std::enable_if<std::is_enum<T>::value>::type
+		Pack(Record& r, const T& v) { PackValue(r, ArgInt, (uint64_t)(int64_t)v); }
+
+	template<typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+		Pack(Record& r, const T& v)
+	{
+		double d = (double)v;
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		PackValue(r, ArgDouble, bits);
+	}
+
+	template<typename T>
+	static void Pack(Record& r, T* const& p) { PackValue(r, ArgPointer, (uint64_t)(uintptr_t)p); }
+
+	static void Pack(Record& r, const bool& v) { PackValue(r, ArgBool, v ? 1 : 0); }
+	static void Pack(Record& r, char* const& s) { PackText(r, s, s ? strlen(s) : 0); }
+	static void Pack(Record& r, const char* const& s) { PackText(r, s, s ? strlen(s) : 0); }
+	static void Pack(Record& r, wchar_t* const& s) { PackText(r, s, s ? wcslen(s) : 0); }
+	static void Pack(Record& r, const wchar_t* const& s) { PackText(r, s, s ? wcslen(s) : 0); }
+	static void Pack(Record& r, const std::string& s) { PackText(r, s.c_str(), s.size()); }
+	static void Pack(Record& r, const std::wstring& s) { PackText(r, s.c_str(), s.size()); }
+
+	static std::atomic<int> sRuntimeLevel;
+};
@@ -33,6 +33,36 @@ float MathHelper::AngleFromXY(float x, float y)
 	return theta;
 }
 
+XMMATRIX MathHelper::ObliqueProjection(FXMMATRIX proj, FXMVECTOR clipPlaneV, float minEyeDistance)
+{
+	// The eye is the view space origin, so w is its signed distance to the plane.
+	XMVECTOR C = XMPlaneNormalize(clipPlaneV);
+	if(XMVectorGetW(C) > -minEyeDistance)
+		return proj;
+
+	// Corner of the original frustum opposite the clip plane, on the far plane.
+	XMFLOAT4 c;
+	XMStoreFloat4(&c, C);
+	float sx = c.x > 0.0f ? 1.0f : (c.x < 0.0f ? -1.0f : 0.0f);
+	float sy = c.y > 0.0f ? 1.0f : (c.y < 0.0f ? -1.0f : 0.0f);
+
+	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+	XMVECTOR q = XMVector4Transform(XMVectorSet(sx, sy, 1.0f, 1.0f), invProj);
+
+	// Row vectors, so clip z is the dot product with the third column.  Scale the
+	// plane so the far plane (z = w) still passes through q; q's clip w is 1.
+	C = XMVectorScale(C, 1.0f / XMVectorGetX(XMVector4Dot(C, q)));
+
+	XMFLOAT4X4 P;
+	XMStoreFloat4x4(&P, proj);
+	P._13 = XMVectorGetX(C);
+	P._23 = XMVectorGetY(C);
+	P._33 = XMVectorGetZ(C);
+	P._43 = XMVectorGetW(C);
+
+	return XMLoadFloat4x4(&P);
+}
+
 XMVECTOR MathHelper::RandUnitVec3()
 {
 	XMVECTOR One  = XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f);
@@ -89,6 +89,14 @@ public:
         return I;
     }
 
+	// Replaces the near plane of a perspective projection with a view space plane,
+	// keeping its positive side (Lengyel's oblique near-plane clipping).  The far
+	// plane tilts to keep the frustum closed, so depth precision drops as the
+	// clip plane turns away from the view direction.  proj is returned unchanged
+	// if the eye is not at least minEyeDistance behind the plane.
+	static DirectX::XMMATRIX ObliqueProjection(DirectX::FXMMATRIX proj, DirectX::FXMVECTOR clipPlaneV,
+		float minEyeDistance = 1e-3f);
+
     static DirectX::XMVECTOR RandUnitVec3();
     static DirectX::XMVECTOR RandHemisphereUnitVec3(DirectX::XMVECTOR n);
 
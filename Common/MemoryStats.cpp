@@ -0,0 +1,180 @@
+//***************************************************************************************
+// MemoryStats.cpp
+//***************************************************************************************
+
+#include "MemoryStats.h"
+#include "Log.h"
+#include <wrl.h>
+#include <atomic>
+#include <cstdio>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const int CategoryCount = (int)MemoryCategory::Count;
+
+	std::atomic<uint64_t> gCurrent[CategoryCount];
+	std::atomic<uint64_t> gPeak[CategoryCount];
+	std::atomic<uint64_t> gSteady[CategoryCount];
+
+	// {6E1F3A52-8C3B-4C7A-9B0E-2D4F1A7C5B11}
+	const GUID MemoryStatsTokenGuid =
+	{ 0x6e1f3a52, 0x8c3b, 0x4c7a, { 0x9b, 0x0e, 0x2d, 0x4f, 0x1a, 0x7c, 0x5b, 0x11 } };
+
+	// Attached to a tracked resource as private data.  The resource releases its
+	// private data interfaces when it is destroyed, which is when we give the
+	// bytes back to the category.
+	class MemoryStatsToken : public IUnknown
+	{
+	public:
+		MemoryStatsToken(MemoryCategory category, uint64_t byteSize) :
+			mCategory(category), mByteSize(byteSize)
+		{
+			MemoryStats::Add(mCategory, mByteSize);
+		}
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv)override
+		{
+			if(ppv == nullptr)
+				return E_POINTER;
+
+			if(riid == __uuidof(IUnknown))
+			{
+				*ppv = static_cast<IUnknown*>(this);
+				AddRef();
+				return S_OK;
+			}
+
+			*ppv = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		ULONG STDMETHODCALLTYPE AddRef()override
+		{
+			return ++mRefCount;
+		}
+
+		ULONG STDMETHODCALLTYPE Release()override
+		{
+			ULONG count = --mRefCount;
+			if(count == 0)
+				delete this;
+			return count;
+		}
+
+	private:
+		~MemoryStatsToken()
+		{
+			MemoryStats::Remove(mCategory, mByteSize);
+		}
+
+		std::atomic<ULONG> mRefCount{ 1 };
+		MemoryCategory mCategory;
+		uint64_t mByteSize;
+	};
+}
+
+void MemoryStats::Track(MemoryCategory category, ID3D12Resource* resource)
+{
+	if(resource == nullptr)
+		return;
+
+	ComPtr<ID3D12Device> device;
+	if(FAILED(resource->GetDevice(IID_PPV_ARGS(&device))))
+		return;
+
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+
+	// Re-tracking a resource replaces (and so releases) its previous token.
+	MemoryStatsToken* token = new MemoryStatsToken(category, info.SizeInBytes);
+	resource->SetPrivateDataInterface(MemoryStatsTokenGuid, token);
+	token->Release();
+}
+
+void MemoryStats::Add(MemoryCategory category, uint64_t byteSize)
+{
+	int i = (int)category;
+	uint64_t now = gCurrent[i].fetch_add(byteSize) + byteSize;
+
+	uint64_t peak = gPeak[i].load();
+	while(now > peak && !gPeak[i].compare_exchange_weak(peak, now))
+	{
+	}
+}
+
+void MemoryStats::Remove(MemoryCategory category, uint64_t byteSize)
+{
+	gCurrent[(int)category].fetch_sub(byteSize);
+}
+
+uint64_t MemoryStats::Current(MemoryCategory category)
+{
+	return gCurrent[(int)category].load();
+}
+
+uint64_t MemoryStats::Peak(MemoryCategory category)
+{
+	return gPeak[(int)category].load();
+}
+
+uint64_t MemoryStats::SteadyState(MemoryCategory category)
+{
+	return gSteady[(int)category].load();
+}
+
+void MemoryStats::MarkSteadyState()
+{
+	for(int i = 0; i < CategoryCount; ++i)
+		gSteady[i] = gCurrent[i].load();
+}
+
+const char* MemoryStats::CategoryName(MemoryCategory category)
+{
+	switch(category)
+	{
+	case MemoryCategory::Geometry:       return "Geometry";
+	case MemoryCategory::Texture:        return "Texture";
+	case MemoryCategory::RenderTarget:   return "RenderTarget";
+	case MemoryCategory::UploadHeap:     return "UploadHeap";
+	case MemoryCategory::ConstantBuffer: return "ConstantBuffer";
+	case MemoryCategory::CpuGeometry:    return "CpuGeometry";
+	default:                             return "Unknown";
+	}
+}
+
+std::string MemoryStats::Report()
+{
+	const double toKB = 1.0 / 1024.0;
+
+	std::string report = "Memory usage (KB)      current        peak      steady\n";
+
+	uint64_t totals[3] = { 0, 0, 0 };
+	char line[128];
+	for(int i = 0; i < CategoryCount; ++i)
+	{
+		uint64_t cur = gCurrent[i].load();
+		uint64_t peak = gPeak[i].load();
+		uint64_t steady = gSteady[i].load();
+		totals[0] += cur;
+		totals[1] += peak;
+		totals[2] += steady;
+
+		sprintf_s(line, "  %-16s %11.1f %11.1f %11.1f\n",
+			CategoryName((MemoryCategory)i), cur*toKB, peak*toKB, steady*toKB);
+		report += line;
+	}
+
+	// Sum of per-category peaks; the categories need not peak at the same time.
+	sprintf_s(line, "  %-16s %11.1f %11.1f %11.1f\n",
+		"Total", totals[0]*toKB, totals[1]*toKB, totals[2]*toKB);
+	report += line;
+
+	return report;
+}
+
+void MemoryStats::OutputReport()
+{
+	Log::WriteText(LogLevel::Info, Report());
+}
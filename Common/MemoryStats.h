@@ -0,0 +1,51 @@
+//***************************************************************************************
+// MemoryStats.h
+//
+// Process-wide memory accounting by subsystem.  GPU resources are registered when
+// they are created and unregistered automatically when the last reference goes away,
+// so callers never need to pair Track() with an explicit release.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <d3d12.h>
+#include <cstdint>
+#include <string>
+
+enum class MemoryCategory : int
+{
+	Geometry = 0,   // default heap vertex/index buffers
+	Texture,        // default heap textures loaded from disk
+	RenderTarget,   // render targets, depth buffers, swap chain buffers
+	UploadHeap,     // intermediate upload buffers used to initialize the above
+	ConstantBuffer, // persistently mapped per-frame upload buffers
+	CpuGeometry,    // system memory copies of mesh data
+	Count
+};
+
+class MemoryStats
+{
+public:
+	// Registers the allocation size of resource under category.  The bytes are
+	// removed again when the resource is destroyed.
+	static void Track(MemoryCategory category, ID3D12Resource* resource);
+
+	// For memory that is not owned by a D3D12 resource (e.g. CPU blobs).
+	static void Add(MemoryCategory category, uint64_t byteSize);
+	static void Remove(MemoryCategory category, uint64_t byteSize);
+
+	static uint64_t Current(MemoryCategory category);
+	static uint64_t Peak(MemoryCategory category);
+	static uint64_t SteadyState(MemoryCategory category);
+
+	// Records the current usage as the steady-state figure.  Call once start up
+	// has finished and transient memory (upload heaps etc.) has been released.
+	static void MarkSteadyState();
+
+	static const char* CategoryName(MemoryCategory category);
+
+	// Table of current/peak/steady-state usage per category.
+	static std::string Report();
+	static void OutputReport();
+};
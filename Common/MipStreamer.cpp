@@ -0,0 +1,442 @@
+//***************************************************************************************
+// MipStreamer.cpp
+//***************************************************************************************
+
+#include "MipStreamer.h"
+#include "SelfCheck.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+	double NowMs()
+	{
+		static LARGE_INTEGER freq = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return 1000.0 * (double)now.QuadPart / (double)freq.QuadPart;
+	}
+}
+
+MipStreamer::MipStreamer(MipStreamUploader& uploader, bool backgroundReads)
+	: mUploader(uploader)
+{
+	if(backgroundReads)
+		mReadThread = std::thread([this]() { ReadLoop(); });
+}
+
+MipStreamer::~MipStreamer()
+{
+	if(mReadThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mWake.notify_one();
+		mReadThread.join();
+	}
+}
+
+size_t MipStreamer::StageMaxSize(int stage)
+{
+	size_t maxsize = TailSize;
+	for(int i = 0; i < stage; ++i)
+		maxsize *= StageGrowth;
+	return maxsize;
+}
+
+void MipStreamer::Add(int texture)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		Stream s;
+		s.Texture = texture;
+		s.AddMs = NowMs();
+		mStreams.push_back(s);
+	}
+	mWake.notify_one();
+}
+
+int MipStreamer::NextRead()const
+{
+	int next = -1;
+	for(int i = 0; i < (int)mStreams.size(); ++i)
+	{
+		if(mStreams[i].State == Phase::Queued && (next < 0 || mStreams[i].Stage < mStreams[next].Stage))
+			next = i;
+	}
+	return next;
+}
+
+void MipStreamer::ReadStream(std::unique_lock<std::mutex>& lock, int stream)
+{
+	Stream& s = mStreams[stream];
+	s.State = Phase::Reading;
+	int texture = s.Texture;
+	size_t maxsize = StageMaxSize(s.Stage);
+
+	// Add may grow mStreams while the lock is released, so look the stream up again.
+	lock.unlock();
+	MipStreamRead read = mUploader.Read(texture, maxsize);
+	lock.lock();
+
+	mStreams[stream].LastRead = read;
+	mStreams[stream].State = read.Succeeded ? Phase::Read : Phase::Failed;
+}
+
+void MipStreamer::ReadLoop()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(!mStopping)
+	{
+		int stream = NextRead();
+		if(stream < 0)
+		{
+			mWake.wait(lock);
+			continue;
+		}
+
+		ReadStream(lock, stream);
+	}
+}
+
+void MipStreamer::Update(uint64_t uploadBudget)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	// Stages whose uploads the GPU has finished can be drawn; queue the next.
+	uint64_t completed = mUploader.CompletedFence();
+	bool queued = false;
+	for(auto& s : mStreams)
+	{
+		if(s.State != Phase::Uploading || s.Fence > completed)
+			continue;
+
+		mUploader.MakeResident(s.Texture);
+
+		double ms = NowMs() - s.AddMs;
+		if(s.FirstUsableMs < 0.0)
+			s.FirstUsableMs = ms;
+
+		if(s.LastRead.Last)
+		{
+			s.State = Phase::Whole;
+			s.WholeMs = ms;
+		}
+		else
+		{
+			++s.Stage;
+			s.State = Phase::Queued;
+			queued = true;
+		}
+	}
+
+	if(!mReadThread.joinable())
+	{
+		for(int stream = NextRead(); stream >= 0; stream = NextRead())
+			ReadStream(lock, stream);
+	}
+	else if(queued)
+	{
+		mWake.notify_one();
+	}
+
+	// Lower stages first, so every texture gets its tail before any gets more.
+	std::vector<int> ready;
+	for(int i = 0; i < (int)mStreams.size(); ++i)
+	{
+		if(mStreams[i].State == Phase::Read)
+			ready.push_back(i);
+	}
+	std::stable_sort(ready.begin(), ready.end(),
+		[this](int a, int b) { return mStreams[a].Stage < mStreams[b].Stage; });
+
+	uint64_t spent = 0;
+	for(int i : ready)
+	{
+		Stream& s = mStreams[i];
+		if(spent > 0 && spent + s.LastRead.Bytes > uploadBudget)
+			break;
+
+		s.Fence = mUploader.Upload(s.Texture);
+		s.State = Phase::Uploading;
+		spent += s.LastRead.Bytes;
+	}
+
+	mBytesUploaded += spent;
+	mPeakFrameBytes = std::max<uint64_t>(mPeakFrameBytes, spent);
+}
+
+bool MipStreamer::Done()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(const auto& s : mStreams)
+	{
+		if(s.State != Phase::Whole && s.State != Phase::Failed)
+			return false;
+	}
+	return true;
+}
+
+std::string MipStreamer::Report()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	int usable = 0;
+	int whole = 0;
+	int failed = 0;
+	double usableSum = 0.0, usableMax = 0.0;
+	double wholeSum = 0.0, wholeMax = 0.0;
+	for(const auto& s : mStreams)
+	{
+		if(s.FirstUsableMs >= 0.0)
+		{
+			++usable;
+			usableSum += s.FirstUsableMs;
+			usableMax = std::max<double>(usableMax, s.FirstUsableMs);
+		}
+		if(s.WholeMs >= 0.0)
+		{
+			++whole;
+			wholeSum += s.WholeMs;
+			wholeMax = std::max<double>(wholeMax, s.WholeMs);
+		}
+		if(s.State == Phase::Failed)
+			++failed;
+	}
+
+	char text[400];
+	sprintf_s(text, "Mip streaming: %d textures, %d failed\n"
+		"  first usable: %d, average %.2f ms, slowest %.2f ms\n"
+		"  whole:        %d, average %.2f ms, slowest %.2f ms\n"
+		"  %.2f MB uploaded, at most %.2f MB in a frame",
+		(int)mStreams.size(), failed,
+		usable, usable ? usableSum / usable : 0.0, usableMax,
+		whole, whole ? wholeSum / whole : 0.0, wholeMax,
+		mBytesUploaded / (1024.0*1024.0), mPeakFrameBytes / (1024.0*1024.0));
+	return text;
+}
+
+namespace
+{
+	// Square power of two textures, 4 bytes a texel, with a GPU that finishes a
+	// frame's uploads Latency frames later.  Records what the streamer asks for.
+	class StandInUploader : public MipStreamUploader
+	{
+	public:
+		static const uint64_t Latency = 2;
+
+		struct Texture
+		{
+			UINT Size = 0;
+
+			// Mips [ReadMip, ...) have been read, [UploadedMip, ...) uploaded and
+			// [ResidentMip, ...) made resident.  MipCount while none are.
+			UINT ReadMip = 0;
+			UINT UploadedMip = 0;
+			UINT ResidentMip = 0;
+
+			uint64_t PendingBytes = 0;
+			uint64_t UploadFence = 0;
+			int Uploads = 0;
+			int FirstUsableFrame = -1;
+		};
+
+		// A size of 0 fails to read.
+		explicit StandInUploader(const std::vector<UINT>& sizes)
+		{
+			for(UINT size : sizes)
+			{
+				Texture t;
+				t.Size = size;
+				t.ReadMip = t.UploadedMip = t.ResidentMip = MipCount(size);
+				mTextures.push_back(t);
+			}
+		}
+
+		static UINT MipCount(UINT size)
+		{
+			UINT count = 1;
+			while(size > 1)
+			{
+				size >>= 1;
+				++count;
+			}
+			return count;
+		}
+
+		void BeginFrame(uint64_t frame)
+		{
+			mFrame = frame;
+			mFrameBytes = 0;
+			mFrameUploads = 0;
+		}
+
+		void EndFrame(uint64_t budget)
+		{
+			if(mFrameUploads > 1 && mFrameBytes > budget)
+				++OverBudgetFrames;
+		}
+
+		MipStreamRead Read(int texture, size_t maxsize)override
+		{
+			Texture& t = mTextures[texture];
+
+			MipStreamRead read;
+			if(t.Size == 0)
+				return read;
+
+			UINT first = 0;
+			while((t.Size >> first) > maxsize && (t.Size >> first) > 1)
+				++first;
+			first = std::min<UINT>(first, t.ReadMip);
+
+			t.PendingBytes = 0;
+			for(UINT mip = first; mip < t.ReadMip; ++mip)
+				t.PendingBytes += 4ull * (t.Size >> mip) * (t.Size >> mip);
+			t.ReadMip = first;
+
+			read.Succeeded = true;
+			read.Bytes = t.PendingBytes;
+			read.Last = first == 0;
+			return read;
+		}
+
+		uint64_t Upload(int texture)override
+		{
+			Texture& t = mTextures[texture];
+
+			// Every tail goes before any larger stage.
+			if(t.Uploads == 0)
+				LastTailUpload = UploadCount;
+			else if(FirstLaterUpload < 0)
+				FirstLaterUpload = UploadCount;
+			++UploadCount;
+
+			++t.Uploads;
+			t.UploadedMip = t.ReadMip;
+			t.UploadFence = mFrame + 1;
+
+			mFrameBytes += t.PendingBytes;
+			++mFrameUploads;
+			return t.UploadFence;
+		}
+
+		uint64_t CompletedFence()override
+		{
+			return mFrame >= Latency ? mFrame - Latency : 0;
+		}
+
+		void MakeResident(int texture)override
+		{
+			Texture& t = mTextures[texture];
+
+			if(CompletedFence() < t.UploadFence)
+				++EarlyResidents;
+			if(t.UploadedMip >= t.ResidentMip)
+				++NonRefiningResidents;
+
+			t.ResidentMip = t.UploadedMip;
+			if(t.FirstUsableFrame < 0)
+				t.FirstUsableFrame = (int)mFrame;
+		}
+
+		std::vector<Texture> mTextures;
+
+		int UploadCount = 0;
+		int LastTailUpload = -1;
+		int FirstLaterUpload = -1;
+		int OverBudgetFrames = 0;
+		int EarlyResidents = 0;
+		int NonRefiningResidents = 0;
+
+	private:
+		uint64_t mFrame = 0;
+		uint64_t mFrameBytes = 0;
+		int mFrameUploads = 0;
+	};
+}
+
+bool MipStreamer::RunSelfCheck(std::string& report)
+{
+	SelfCheck checks(report);
+
+	// A 2048 texture's top mip alone is over the 1 MB budget.
+	const std::vector<UINT> sizes = { 1024, 512, 2048, 64, 16, 0, 256, 1024 };
+	const int maxFrames = 10000;
+
+	auto run = [&](bool backgroundReads, uint64_t budget)
+	{
+		StandInUploader uploader(sizes);
+		int frame = 0;
+		{
+			MipStreamer streamer(uploader, backgroundReads);
+			for(int i = 0; i < (int)sizes.size(); ++i)
+				streamer.Add(i);
+
+			for(; frame < maxFrames && !streamer.Done(); ++frame)
+			{
+				uploader.BeginFrame(frame);
+				streamer.Update(budget);
+				uploader.EndFrame(budget);
+
+				// Give the read thread time, as a real frame would.
+				if(backgroundReads)
+					Sleep(1);
+			}
+
+			checks.Note("%s reads, %.0f KB budget: done after %d frames\n",
+				backgroundReads ? "Background" : "Inline", budget / 1024.0, frame);
+			report += streamer.Report();
+			report += "\n";
+		}
+
+		checks.Check(frame < maxFrames, "every texture is whole or failed");
+
+		bool whole = true;
+		bool failedStays = true;
+		int slowestUsable = 0;
+		for(const auto& t : uploader.mTextures)
+		{
+			if(t.Size == 0)
+			{
+				failedStays &= t.Uploads == 0;
+				continue;
+			}
+			whole &= t.ResidentMip == 0;
+			slowestUsable = std::max<int>(slowestUsable, t.FirstUsableFrame);
+		}
+		checks.Check(whole, "every readable texture ends with its top mip resident");
+		checks.Check(failedStays, "a texture that fails to read is never uploaded");
+		checks.Check(uploader.EarlyResidents == 0, "no stage is drawn before its upload has finished");
+		checks.Check(uploader.NonRefiningResidents == 0, "each stage adds larger mips");
+		checks.Check(uploader.OverBudgetFrames == 0, "a frame only goes over the budget with a single upload");
+
+		// With background reads a tail may still be reading when others are done.
+		if(!backgroundReads)
+		{
+			checks.Check(uploader.FirstLaterUpload < 0 || uploader.LastTailUpload < uploader.FirstLaterUpload,
+				"every tail is uploaded before any larger stage");
+		}
+
+		return slowestUsable;
+	};
+
+	int slowestUsable = run(false, 1024 * 1024);
+
+	// The tails together fit the budget, so every texture is usable as soon as the
+	// first frame's uploads finish.
+	checks.Check(slowestUsable <= (int)StandInUploader::Latency + 1, "every texture is usable within the GPU latency of the first frame");
+
+	checks.Note("  slowest texture usable in frame %d\n", slowestUsable);
+
+	// A budget that takes one tail a frame: textures whose tails are resident
+	// must wait for the others' tails.
+	run(false, 32 * 1024);
+
+	run(true, 1024 * 1024);
+
+	return checks.Finish("Mip streaming schedule");
+}
@@ -0,0 +1,133 @@
+//***************************************************************************************
+// MipStreamer.h
+//
+// Schedules textures streaming in a few mips at a time: every texture's mip tail
+// first, so each is drawable at low resolution almost at once, then larger mips in
+// stages until the texture is whole.  Reads run on a background thread, uploads are
+// issued on the render thread within a per frame byte budget, and a stage is only
+// drawn once the GPU has finished its upload, so nothing waits on the GPU.  The file
+// and GPU work is done by a MipStreamUploader, so the scheduling can be checked on
+// the CPU with a stand-in.  No D3D dependencies.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MipStreamRead
+{
+	bool Succeeded = false;
+
+	// Bytes the stage uploads.
+	uint64_t Bytes = 0;
+
+	// The stage holds the top mip, so the texture is whole once it is resident.
+	bool Last = false;
+};
+
+class MipStreamUploader
+{
+public:
+	virtual ~MipStreamUploader() = default;
+
+	// Reads the mips of texture no larger than maxsize texels that earlier stages
+	// did not.  Called on the streaming thread, never for a texture with a stage
+	// still in flight.
+	virtual MipStreamRead Read(int texture, size_t maxsize) = 0;
+
+	// Records the upload of the stage Read returned last.  Called on the render
+	// thread; returns the fence value that marks the upload done.
+	virtual uint64_t Upload(int texture) = 0;
+
+	virtual uint64_t CompletedFence() = 0;
+
+	// The last stage uploaded for texture has reached the GPU: draw it with the
+	// mips it now holds.  Called on the render thread.
+	virtual void MakeResident(int texture) = 0;
+};
+
+class MipStreamer
+{
+public:
+	// Stage 0 reads the mips up to TailSize texels; each later stage reads mips up
+	// to StageGrowth times larger than the last.
+	static const size_t TailSize = 64;
+	static const size_t StageGrowth = 4;
+
+	// backgroundReads = false reads on the calling thread inside Update, which
+	// makes the order of events repeatable.
+	MipStreamer(MipStreamUploader& uploader, bool backgroundReads = true);
+	MipStreamer(const MipStreamer& rhs)=delete;
+	MipStreamer& operator=(const MipStreamer& rhs)=delete;
+	~MipStreamer();
+
+	// Starts streaming texture, numbered by the caller.
+	void Add(int texture);
+
+	// Once a frame on the render thread: makes the stages whose uploads have
+	// finished resident, then uploads read stages, lower stages first, until
+	// uploadBudget bytes are spent.  One stage is always uploaded even if it alone
+	// is over the budget, so a large mip cannot stall streaming.
+	void Update(uint64_t uploadBudget);
+
+	// Every texture added is whole or failed to read.
+	bool Done()const;
+
+	// Time to the first usable (tail resident) and whole texture, bytes uploaded.
+	std::string Report()const;
+
+	// Streams synthetic textures through a stand-in uploader with simulated GPU
+	// latency, and checks tails go first, the budget holds and nothing is drawn
+	// before its upload finishes.  Returns false and says why in report if any
+	// check fails.
+	static bool RunSelfCheck(std::string& report);
+
+private:
+	enum class Phase
+	{
+		Queued,
+		Reading,
+		Read,
+		Uploading,
+		Whole,
+		Failed
+	};
+
+	struct Stream
+	{
+		int Texture = 0;
+		int Stage = 0;
+		Phase State = Phase::Queued;
+		MipStreamRead LastRead;
+		uint64_t Fence = 0;
+
+		double AddMs = 0.0;
+		double FirstUsableMs = -1.0;
+		double WholeMs = -1.0;
+	};
+
+	static size_t StageMaxSize(int stage);
+
+	// The queued stream to read next, lowest stage first, or -1.  Call with mMutex held.
+	int NextRead()const;
+	void ReadStream(std::unique_lock<std::mutex>& lock, int stream);
+	void ReadLoop();
+
+	MipStreamUploader& mUploader;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mWake;
+	std::thread mReadThread;
+	bool mStopping = false;
+
+	std::vector<Stream> mStreams;
+
+	uint64_t mBytesUploaded = 0;
+	uint64_t mPeakFrameBytes = 0;
+};
@@ -0,0 +1,255 @@
+//***************************************************************************************
+// MultiViewCuller.cpp
+//***************************************************************************************
+
+#include "MultiViewCuller.h"
+#include "Log.h"
+#include <windows.h>
+#include <cstdio>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	const int PlanesPerView = 6;
+	const int SplatsPerPlane = 7;
+
+	double NowMs()
+	{
+		static LARGE_INTEGER freq = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return 1000.0 * (double)now.QuadPart / (double)freq.QuadPart;
+	}
+}
+
+void MultiViewCuller::ClearViews()
+{
+	mPlanes.clear();
+	mSplatPlanes.clear();
+	mViewCount = 0;
+}
+
+int MultiViewCuller::AddView(const XMFLOAT4X4& viewProj)
+{
+	if(mViewCount == MaxViews)
+	{
+		LOG_ERROR("Multi-view culler is full ({} views); view not culled.", (int)MaxViews);
+		assert(false && "MultiViewCuller::AddView past MaxViews");
+		return -1;
+	}
+
+	// Rows of the transpose are the columns of viewProj.  A clip space point is
+	// inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+	XMMATRIX T = XMMatrixTranspose(XMLoadFloat4x4(&viewProj));
+
+	XMVECTOR planes[PlanesPerView] =
+	{
+		T.r[3] + T.r[0],    // left
+		T.r[3] - T.r[0],    // right
+		T.r[3] + T.r[1],    // bottom
+		T.r[3] - T.r[1],    // top
+		T.r[2],             // near
+		T.r[3] - T.r[2]     // far
+	};
+
+	for(int i = 0; i < PlanesPerView; ++i)
+	{
+		XMFLOAT4 plane;
+		XMStoreFloat4(&plane, XMPlaneNormalize(planes[i]));
+		mPlanes.push_back(plane);
+
+		const float terms[SplatsPerPlane] =
+		{
+			plane.x, plane.y, plane.z,
+			fabsf(plane.x), fabsf(plane.y), fabsf(plane.z),
+			plane.w
+		};
+
+		for(float term : terms)
+			mSplatPlanes.push_back(XMFLOAT4A(term, term, term, term));
+	}
+
+	return mViewCount++;
+}
+
+void MultiViewCuller::ClearItems()
+{
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mExtentX.clear();
+	mExtentY.clear();
+	mExtentZ.clear();
+	mMasks.clear();
+	mItemCount = 0;
+}
+
+int MultiViewCuller::AddItem(const BoundingBox& boundsW)
+{
+	// Grow four lanes at a time so Cull() never reads past the end.
+	if(mItemCount % 4 == 0)
+	{
+		for(std::vector<float>* lane : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ })
+			lane->resize(mItemCount + 4, 0.0f);
+	}
+
+	int item = mItemCount++;
+	mMasks.push_back(0);
+	SetItem(item, boundsW);
+	return item;
+}
+
+void MultiViewCuller::SetItem(int item, const BoundingBox& boundsW)
+{
+	mCenterX[item] = boundsW.Center.x;
+	mCenterY[item] = boundsW.Center.y;
+	mCenterZ[item] = boundsW.Center.z;
+	mExtentX[item] = boundsW.Extents.x;
+	mExtentY[item] = boundsW.Extents.y;
+	mExtentZ[item] = boundsW.Extents.z;
+}
+
+void MultiViewCuller::Cull()
+{
+	const XMVECTOR zero = XMVectorZero();
+
+	for(int i = 0; i < mItemCount; i += 4)
+	{
+		// Four boxes are loaded once and then tested against every view.
+		XMVECTOR cx = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterX[i]));
+		XMVECTOR cy = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterY[i]));
+		XMVECTOR cz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterZ[i]));
+		XMVECTOR ex = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mExtentX[i]));
+		XMVECTOR ey = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mExtentY[i]));
+		XMVECTOR ez = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mExtentZ[i]));
+
+		ViewMask masks[4] = { 0, 0, 0, 0 };
+
+		const XMFLOAT4A* p = mSplatPlanes.data();
+		for(int v = 0; v < mViewCount; ++v)
+		{
+			XMVECTOR inside = XMVectorTrueInt();
+			for(int k = 0; k < PlanesPerView; ++k, p += SplatsPerPlane)
+			{
+				// A box is outside a plane when its center is further behind it
+				// than the box reaches along the normal.
+				XMVECTOR dist = XMLoadFloat4A(&p[6]);
+				dist = XMVectorMultiplyAdd(cx, XMLoadFloat4A(&p[0]), dist);
+				dist = XMVectorMultiplyAdd(cy, XMLoadFloat4A(&p[1]), dist);
+				dist = XMVectorMultiplyAdd(cz, XMLoadFloat4A(&p[2]), dist);
+
+				XMVECTOR reach = XMVectorMultiply(ex, XMLoadFloat4A(&p[3]));
+				reach = XMVectorMultiplyAdd(ey, XMLoadFloat4A(&p[4]), reach);
+				reach = XMVectorMultiplyAdd(ez, XMLoadFloat4A(&p[5]), reach);
+
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorAdd(dist, reach), zero));
+			}
+
+			XMUINT4 lanes;
+			XMStoreUInt4(&lanes, inside);
+			masks[0] |= (ViewMask)(lanes.x & 1) << v;
+			masks[1] |= (ViewMask)(lanes.y & 1) << v;
+			masks[2] |= (ViewMask)(lanes.z & 1) << v;
+			masks[3] |= (ViewMask)(lanes.w & 1) << v;
+		}
+
+		for(int j = 0; j < 4 && i + j < mItemCount; ++j)
+			mMasks[i + j] = masks[j];
+	}
+}
+
+void MultiViewCuller::CullPerView()
+{
+	for(int i = 0; i < mItemCount; ++i)
+		mMasks[i] = 0;
+
+	for(int v = 0; v < mViewCount; ++v)
+	{
+		// ContainedBy wants the plane normals pointing out of the volume.
+		XMVECTOR planes[PlanesPerView];
+		for(int k = 0; k < PlanesPerView; ++k)
+			planes[k] = XMVectorNegate(XMLoadFloat4(&mPlanes[v*PlanesPerView + k]));
+
+		for(int i = 0; i < mItemCount; ++i)
+		{
+			BoundingBox box(
+				XMFLOAT3(mCenterX[i], mCenterY[i], mCenterZ[i]),
+				XMFLOAT3(mExtentX[i], mExtentY[i], mExtentZ[i]));
+
+			if(box.ContainedBy(planes[0], planes[1], planes[2], planes[3], planes[4], planes[5]) != DISJOINT)
+				mMasks[i] |= (ViewMask)1 << v;
+		}
+	}
+}
+
+void MultiViewCuller::VisibleItems(int view, std::vector<int>& visible)const
+{
+	visible.clear();
+
+	assert(view >= 0 && view < mViewCount);
+	if(view < 0 || view >= mViewCount)
+		return;
+
+	const ViewMask bit = (ViewMask)1 << view;
+	for(int i = 0; i < mItemCount; ++i)
+	{
+		if(mMasks[i] & bit)
+			visible.push_back(i);
+	}
+}
+
+std::string MultiViewCuller::Benchmark(int itemCount, int viewCount, int iterations)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> extent(0.5f, 5.0f);
+
+	MultiViewCuller culler;
+	for(int i = 0; i < itemCount; ++i)
+	{
+		BoundingBox box(
+			XMFLOAT3(position(rng), position(rng), position(rng)),
+			XMFLOAT3(extent(rng), extent(rng), extent(rng)));
+		culler.AddItem(box);
+	}
+
+	// Randomly placed 90 degree cameras, the shape of a cube map face.
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.5f*XM_PI, 1.0f, 1.0f, 1000.0f);
+	for(int v = 0; v < viewCount; ++v)
+	{
+		XMVECTOR eye = XMVectorSet(position(rng), position(rng), position(rng), 1.0f);
+		XMVECTOR target = XMVectorSet(position(rng), position(rng), position(rng), 1.0f);
+
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj);
+		culler.AddView(viewProj);
+	}
+
+	double start = NowMs();
+	for(int n = 0; n < iterations; ++n)
+		culler.CullPerView();
+	double perViewMs = (NowMs() - start) / iterations;
+	std::vector<ViewMask> reference = culler.mMasks;
+
+	start = NowMs();
+	for(int n = 0; n < iterations; ++n)
+		culler.Cull();
+	double singlePassMs = (NowMs() - start) / iterations;
+
+	// The two paths only differ in rounding for boxes touching a plane.
+	int mismatches = 0;
+	UINT64 visible = 0;
+	for(int i = 0; i < itemCount; ++i)
+	{
+		mismatches += culler.mMasks[i] != reference[i];
+		for(ViewMask m = culler.mMasks[i]; m != 0; m &= m - 1)
+			++visible;
+	}
+
+	char line[200];
+	sprintf_s(line, "Multi-view cull: %d items x %d views, single pass %.3f ms, per view %.3f ms (%.2fx), %llu visible, %d mismatches",
+		itemCount, viewCount, singlePassMs, perViewMs, perViewMs / singlePassMs, visible, mismatches);
+	return line;
+}
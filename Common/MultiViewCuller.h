@@ -0,0 +1,85 @@
+//***************************************************************************************
+// MultiViewCuller.h
+//
+// Frustum culls a set of items against every view of a frame in one pass.  Views
+// are given by their view-projection matrices (so reflected and oblique views work
+// too) and items by world space boxes.  The boxes are kept structure-of-arrays and
+// tested four at a time against all views, so each box is read once per frame
+// instead of once per view.  The result is a mask of the views that see each item.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MultiViewCuller
+{
+public:
+	// One bit per view.
+	typedef std::uint64_t ViewMask;
+	static const int MaxViews = 64;
+
+	void ClearViews();
+
+	// Adds the frustum of viewProj (row vectors, D3D depth range) and returns the
+	// view index.  Past MaxViews views this asserts, logs an error and returns -1;
+	// the view is not culled and reads as seeing nothing.
+	int AddView(const DirectX::XMFLOAT4X4& viewProj);
+	int ViewCount()const { return mViewCount; }
+
+	void ClearItems();
+	int AddItem(const DirectX::BoundingBox& boundsW);
+	void SetItem(int item, const DirectX::BoundingBox& boundsW);
+	int ItemCount()const { return mItemCount; }
+
+	// Tests every item against every view and fills the masks.
+	void Cull();
+
+	// Same result as Cull() computed the usual way: one view at a time, each
+	// walking every item with BoundingBox::ContainedBy.  Kept for comparison.
+	void CullPerView();
+
+	ViewMask Mask(int item)const
+	{
+		assert(item >= 0 && item < mItemCount);
+		return mMasks[item];
+	}
+
+	// False for a view index AddView did not return (asserts in debug builds).
+	bool Visible(int item, int view)const
+	{
+		assert(item >= 0 && item < mItemCount);
+		assert(view >= 0 && view < mViewCount);
+		if(view < 0 || view >= mViewCount)
+			return false;
+		return (mMasks[item] >> view) & 1;
+	}
+
+	// Replaces visible with the items the view sees, in item order.
+	void VisibleItems(int view, std::vector<int>& visible)const;
+
+	// Times Cull() against CullPerView() on random boxes and views and returns a
+	// one line report.
+	static std::string Benchmark(int itemCount, int viewCount, int iterations);
+
+private:
+	// Frustum planes, normals pointing in, six per view.
+	std::vector<DirectX::XMFLOAT4> mPlanes;
+
+	// The same planes with every term replicated across a vector, seven per plane:
+	// nx, ny, nz, |nx|, |ny|, |nz|, d.
+	std::vector<DirectX::XMFLOAT4A> mSplatPlanes;
+	int mViewCount = 0;
+
+	// Box centers and extents, padded with empty boxes to a multiple of four.
+	std::vector<float> mCenterX, mCenterY, mCenterZ;
+	std::vector<float> mExtentX, mExtentY, mExtentZ;
+	int mItemCount = 0;
+
+	std::vector<ViewMask> mMasks;
+};
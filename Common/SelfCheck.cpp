@@ -0,0 +1,69 @@
+//***************************************************************************************
+// SelfCheck.cpp
+//***************************************************************************************
+
+#include "SelfCheck.h"
+#include "Log.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cwchar>
+#include <vector>
+
+SelfCheck::SelfCheck(std::string& report)
+	: mReport(report)
+{
+	mReport.clear();
+}
+
+bool SelfCheck::Check(bool condition, const char* what, const char* testCase)
+{
+	if(!condition)
+	{
+		mReport += "  FAILED";
+		if(testCase != nullptr)
+			mReport += std::string(" (") + testCase + ")";
+		mReport += std::string(": ") + what + "\n";
+		mPassed = false;
+	}
+
+	return condition;
+}
+
+void SelfCheck::Note(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	va_list sizeArgs;
+	va_copy(sizeArgs, args);
+	int length = vsnprintf(nullptr, 0, format, sizeArgs);
+	va_end(sizeArgs);
+
+	if(length > 0)
+	{
+		std::vector<char> text(length + 1);
+		vsnprintf(text.data(), text.size(), format, args);
+		mReport.append(text.data(), length);
+	}
+	va_end(args);
+}
+
+bool SelfCheck::Finish(const char* title)
+{
+	mReport = std::string(title) + (mPassed ? ": passed\n" : ": FAILED\n") + mReport;
+	return mPassed;
+}
+
+bool SelfCheck::RunIfRequested(const wchar_t* flag, const wchar_t* logFilename, Function check, int& exitCode)
+{
+	if(wcsstr(GetCommandLineW(), flag) == nullptr)
+		return false;
+
+	Log::Start(logFilename);
+	std::string report;
+	bool passed = check(report);
+	Log::WriteText(passed ? LogLevel::Info : LogLevel::Error, report);
+	Log::Stop();
+
+	exitCode = passed ? 0 : 1;
+	return true;
+}
@@ -0,0 +1,44 @@
+//***************************************************************************************
+// SelfCheck.h
+//
+// Shared plumbing of the headless self-checks the samples run instead of their
+// window when given a -...check flag: a report that collects failed checks and
+// measurements, and the command line hook that runs a check into a log file and
+// turns its result into the process exit code.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+
+class SelfCheck
+{
+public:
+	// A check that fills report and returns false if anything failed.
+	typedef bool (*Function)(std::string& report);
+
+	// Clears report; failures and notes are appended to it.
+	explicit SelfCheck(std::string& report);
+
+	// Appends "  FAILED (testCase): what" when condition is false, or without the
+	// parentheses if testCase is null.  Returns condition.
+	bool Check(bool condition, const char* what, const char* testCase = nullptr);
+
+	// Appends printf formatted text as it is.
+	void Note(const char* format, ...);
+
+	bool Passed()const { return mPassed; }
+
+	// Puts "title: passed" or "title: FAILED" in front of the report and returns
+	// Passed().
+	bool Finish(const char* title);
+
+	// If flag is on the command line, runs check, logs its report to logFilename,
+	// sets exitCode to 0 if it passed and 1 if not, and returns true.  Otherwise
+	// returns false without running it.
+	static bool RunIfRequested(const wchar_t* flag, const wchar_t* logFilename, Function check, int& exitCode);
+
+private:
+	std::string& mReport;
+	bool mPassed = true;
+};
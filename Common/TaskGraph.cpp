@@ -0,0 +1,215 @@
+//***************************************************************************************
+// TaskGraph.cpp
+//***************************************************************************************
+
+#include "TaskGraph.h"
+#include <windows.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	double NowMs()
+	{
+		static LARGE_INTEGER freq = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return 1000.0 * (double)now.QuadPart / (double)freq.QuadPart;
+	}
+}
+
+TaskGraph::TaskId TaskGraph::Add(const std::string& name, std::function<void()> work,
+	const std::vector<TaskId>& dependencies, Affinity affinity)
+{
+	TaskId id = (TaskId)mTasks.size();
+
+	Task task;
+	task.Name = name;
+	task.Work = std::move(work);
+	task.DependencyCount = (int)dependencies.size();
+	task.TaskAffinity = affinity;
+	mTasks.push_back(std::move(task));
+
+	for(TaskId dep : dependencies)
+		mTasks[dep].Dependents.push_back(id);
+
+	return id;
+}
+
+void TaskGraph::Run(unsigned workerCount, bool serial)
+{
+	const double startMs = NowMs();
+
+	if(serial)
+	{
+		// Insertion order is a valid topological order because dependencies
+		// must exist before they can be referenced.
+		for(Task& task : mTasks)
+		{
+			task.StartMs = NowMs() - startMs;
+			task.Work();
+			task.EndMs = NowMs() - startMs;
+		}
+
+		mWorkerCount = 0;
+		mWallMs = NowMs() - startMs;
+		return;
+	}
+
+	if(workerCount == 0)
+		workerCount = std::max<unsigned>(2u, std::thread::hardware_concurrency()) - 1;
+	mWorkerCount = workerCount;
+
+	std::mutex mutex;
+	std::condition_variable workerWake;
+	std::condition_variable mainWake;
+	std::deque<TaskId> workerQueue;
+	std::vector<bool> mainReady(mTasks.size(), false);
+	std::vector<int> remaining(mTasks.size());
+	size_t finished = 0;
+	bool failed = false;
+	std::exception_ptr firstError;
+
+	auto enqueue = [&](TaskId id)
+	{
+		if(mTasks[id].TaskAffinity == Affinity::MainThread)
+		{
+			mainReady[id] = true;
+			mainWake.notify_one();
+		}
+		else
+		{
+			workerQueue.push_back(id);
+			workerWake.notify_one();
+		}
+	};
+
+	// Runs task id outside the lock and releases its dependents.
+	auto execute = [&](TaskId id, unsigned thread, std::unique_lock<std::mutex>& lock)
+	{
+		Task& task = mTasks[id];
+		bool skip = failed;
+		lock.unlock();
+
+		task.Thread = thread;
+		task.StartMs = NowMs() - startMs;
+		std::exception_ptr error;
+		if(!skip)
+		{
+			try
+			{
+				task.Work();
+			}
+			catch(...)
+			{
+				error = std::current_exception();
+			}
+		}
+		task.EndMs = NowMs() - startMs;
+
+		lock.lock();
+		if(error && !failed)
+		{
+			failed = true;
+			firstError = error;
+		}
+
+		for(TaskId dependent : task.Dependents)
+		{
+			if(--remaining[dependent] == 0)
+				enqueue(dependent);
+		}
+
+		if(++finished == mTasks.size())
+			workerWake.notify_all();
+	};
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for(size_t i = 0; i < mTasks.size(); ++i)
+	{
+		remaining[i] = mTasks[i].DependencyCount;
+		if(remaining[i] == 0)
+			enqueue((TaskId)i);
+	}
+
+	std::vector<std::thread> workers;
+	for(unsigned w = 0; w < workerCount; ++w)
+	{
+		workers.emplace_back([&, w]()
+		{
+			std::unique_lock<std::mutex> workerLock(mutex);
+			for(;;)
+			{
+				workerWake.wait(workerLock, [&]() { return !workerQueue.empty() || finished == mTasks.size(); });
+				if(workerQueue.empty())
+					break;
+
+				TaskId id = workerQueue.front();
+				workerQueue.pop_front();
+				execute(id, w + 1, workerLock);
+			}
+		});
+	}
+
+	// The calling thread runs the main thread tasks in insertion order, each once it
+	// is ready, so what they record does not depend on how the workers were
+	// scheduled.  A task only depends on earlier tasks, so waiting on the next one
+	// in order cannot deadlock.
+	for(size_t i = 0; i < mTasks.size(); ++i)
+	{
+		if(mTasks[i].TaskAffinity != Affinity::MainThread)
+			continue;
+
+		mainWake.wait(lock, [&]() { return mainReady[i]; });
+		execute((TaskId)i, 0, lock);
+	}
+
+	lock.unlock();
+	for(std::thread& worker : workers)
+		worker.join();
+
+	mWallMs = NowMs() - startMs;
+
+	if(firstError)
+		std::rethrow_exception(firstError);
+}
+
+double TaskGraph::TaskMs(TaskId id)const
+{
+	return mTasks[id].EndMs - mTasks[id].StartMs;
+}
+
+double TaskGraph::WallMs()const
+{
+	return mWallMs;
+}
+
+double TaskGraph::SumTaskMs()const
+{
+	double sum = 0.0;
+	for(const Task& task : mTasks)
+		sum += task.EndMs - task.StartMs;
+	return sum;
+}
+
+std::string TaskGraph::Report()const
+{
+	char line[160];
+	sprintf_s(line, "Task graph: %zu tasks, %u workers, wall %.2f ms, sum of tasks %.2f ms\n",
+		mTasks.size(), mWorkerCount, mWallMs, SumTaskMs());
+	std::string report = line;
+
+	for(const Task& task : mTasks)
+	{
+		sprintf_s(line, "  %-28s thread %2u  %8.2f -> %8.2f ms (%7.2f ms)\n",
+			task.Name.c_str(), task.Thread, task.StartMs, task.EndMs, task.EndMs - task.StartMs);
+		report += line;
+	}
+
+	return report;
+}
@@ -0,0 +1,59 @@
+//***************************************************************************************
+// TaskGraph.h
+//
+// A small dependency graph executed on a thread pool, used to overlap independent
+// start up work (file I/O, shader compilation, mesh generation, PSO creation).
+// Tasks flagged MainThread run on the thread that calls Run(), in insertion order;
+// use them for work that records into a command list that is not free-threaded.
+//***************************************************************************************
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class TaskGraph
+{
+public:
+	typedef int TaskId;
+
+	enum class Affinity
+	{
+		AnyThread,
+		MainThread
+	};
+
+	TaskId Add(const std::string& name, std::function<void()> work,
+		const std::vector<TaskId>& dependencies = {}, Affinity affinity = Affinity::AnyThread);
+
+	// Runs every task once its dependencies have finished.  workerCount == 0 uses
+	// hardware_concurrency - 1 workers, at least one; serial == true runs
+	// everything on the calling thread in insertion order (handy for comparing
+	// results).  The first exception thrown by a task is rethrown here after the
+	// remaining tasks have been skipped.
+	void Run(unsigned workerCount = 0, bool serial = false);
+
+	// Valid after Run().
+	double TaskMs(TaskId id)const;
+	double WallMs()const;
+	double SumTaskMs()const;
+	std::string Report()const;
+
+private:
+	struct Task
+	{
+		std::string Name;
+		std::function<void()> Work;
+		std::vector<TaskId> Dependents;
+		int DependencyCount = 0;
+		Affinity TaskAffinity = Affinity::AnyThread;
+		double StartMs = 0.0;
+		double EndMs = 0.0;
+		unsigned Thread = 0;
+	};
+
+	std::vector<Task> mTasks;
+	double mWallMs = 0.0;
+	unsigned mWorkerCount = 0;
+};
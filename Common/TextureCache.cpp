@@ -0,0 +1,312 @@
+//***************************************************************************************
+// TextureCache.cpp
+//***************************************************************************************
+
+#include "TextureCache.h"
+#include <cstdio>
+#include <cwctype>
+#include <mutex>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	struct Entry
+	{
+		ComPtr<ID3D12Resource> Resource;
+		ComPtr<ID3D12Resource> UploadHeap;
+		D3D12_RESOURCE_DESC Desc = {};
+		UINT64 Bytes = 0;
+
+		int RefCount = 0;
+		std::uint64_t ContentHash = 0;
+
+		// Every normalized path the texture was loaded from.
+		std::vector<std::wstring> Paths;
+	};
+
+	std::mutex gMutex;
+
+	// Entries are indexed by their SRV slot, so both are freed together.
+	Entry gEntries[TextureCache::Capacity];
+	std::vector<int> gFreeEntries;
+	int gLiveCount = 0;
+
+	std::unordered_map<std::wstring, int> gPaths;
+	std::unordered_map<std::uint64_t, int> gContents;
+
+	ComPtr<ID3D12DescriptorHeap> gSrvHeap;
+	UINT gSrvDescriptorSize = 0;
+
+	int gLoads = 0;
+	int gPathHits = 0;
+	int gContentHits = 0;
+	std::uint64_t gDuplicateBytes = 0;
+
+	std::wstring NormalizePath(const std::wstring& filename)
+	{
+		wchar_t full[MAX_PATH];
+		DWORD length = GetFullPathNameW(filename.c_str(), MAX_PATH, full, nullptr);
+		std::wstring path = (length > 0 && length < MAX_PATH) ? std::wstring(full, length) : filename;
+
+		for(auto& c : path)
+			c = (c == L'/') ? L'\\' : (wchar_t)towlower(c);
+
+		return path;
+	}
+
+	// Files with mips skipped by maxsize have the same content but not the same
+	// texture, so the layout is hashed too.
+	std::uint64_t ContentHash(const DirectX::DDSTextureData& data)
+	{
+		std::uint64_t hash = d3dUtil::HashBytes(data.FileData.get(), data.FileSize);
+		hash = d3dUtil::HashBytes(&data.Desc.Width, sizeof(data.Desc.Width), hash);
+		hash = d3dUtil::HashBytes(&data.Desc.Height, sizeof(data.Desc.Height), hash);
+		return d3dUtil::HashBytes(&data.Desc.MipLevels, sizeof(data.Desc.MipLevels), hash);
+	}
+
+	bool SameLayout(const D3D12_RESOURCE_DESC& a, const D3D12_RESOURCE_DESC& b)
+	{
+		return a.Width == b.Width && a.Height == b.Height &&
+			a.DepthOrArraySize == b.DepthOrArraySize && a.MipLevels == b.MipLevels &&
+			a.Format == b.Format;
+	}
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE SrvHandle(int entry)
+	{
+		return CD3DX12_CPU_DESCRIPTOR_HANDLE(gSrvHeap->GetCPUDescriptorHandleForHeapStart(), entry, gSrvDescriptorSize);
+	}
+
+	// Counts a load served by entry.  Called with gMutex held.
+	void Share(int entry, const std::wstring& path, int& hits)
+	{
+		Entry& e = gEntries[entry];
+		++e.RefCount;
+		++hits;
+		gDuplicateBytes += e.Bytes;
+
+		if(std::find(e.Paths.begin(), e.Paths.end(), path) == e.Paths.end())
+			e.Paths.push_back(path);
+		gPaths[path] = entry;
+	}
+}
+
+TextureHandle::TextureHandle(const TextureHandle& rhs) : mEntry(rhs.mEntry)
+{
+	if(mEntry >= 0)
+		TextureCache::AddRef(mEntry);
+}
+
+TextureHandle::TextureHandle(TextureHandle&& rhs) : mEntry(rhs.mEntry)
+{
+	rhs.mEntry = -1;
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle rhs)
+{
+	std::swap(mEntry, rhs.mEntry);
+	return *this;
+}
+
+TextureHandle::~TextureHandle()
+{
+	if(mEntry >= 0)
+		TextureCache::Release(mEntry);
+}
+
+ID3D12Resource* TextureHandle::Resource()const
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return mEntry >= 0 ? gEntries[mEntry].Resource.Get() : nullptr;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE TextureHandle::Srv()const
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	assert(mEntry >= 0);
+	return SrvHandle(mEntry);
+}
+
+HRESULT TextureCache::Load(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::wstring& filename, TextureHandle& texture)
+{
+	texture = TextureHandle();
+
+	// A path hit needs no read at all.
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+
+		std::wstring path = NormalizePath(filename);
+		auto it = gPaths.find(path);
+		if(it != gPaths.end())
+		{
+			++gLoads;
+			Share(it->second, path, gPathHits);
+			texture = TextureHandle(it->second);
+			return S_OK;
+		}
+	}
+
+	DirectX::DDSTextureData data;
+	HRESULT hr = DirectX::LoadDDSTextureData12(filename.c_str(), data);
+	if(FAILED(hr))
+		return hr;
+
+	return Load(device, cmdList, filename, data, texture);
+}
+
+HRESULT TextureCache::Load(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::wstring& filename, const DirectX::DDSTextureData& data, TextureHandle& texture)
+{
+	texture = TextureHandle();
+
+	if(device == nullptr || cmdList == nullptr || data.Subresources.empty())
+		return E_INVALIDARG;
+
+	std::lock_guard<std::mutex> lock(gMutex);
+	++gLoads;
+
+	std::wstring path = NormalizePath(filename);
+	auto pathIt = gPaths.find(path);
+	if(pathIt != gPaths.end() && SameLayout(gEntries[pathIt->second].Desc, data.Desc))
+	{
+		Share(pathIt->second, path, gPathHits);
+		texture = TextureHandle(pathIt->second);
+		return S_OK;
+	}
+
+	std::uint64_t hash = ContentHash(data);
+	auto contentIt = gContents.find(hash);
+	if(contentIt != gContents.end())
+	{
+		Share(contentIt->second, path, gContentHits);
+		texture = TextureHandle(contentIt->second);
+		return S_OK;
+	}
+
+	if(gSrvHeap == nullptr)
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+		srvHeapDesc.NumDescriptors = Capacity;
+		srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		HRESULT hr = device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&gSrvHeap));
+		if(FAILED(hr))
+			return hr;
+
+		gSrvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		gFreeEntries.clear();
+		for(int i = Capacity - 1; i >= 0; --i)
+			gFreeEntries.push_back(i);
+	}
+
+	if(gFreeEntries.empty())
+	{
+		LOG_ERROR("Texture cache is full ({} textures); {} not loaded.", (int)Capacity, filename);
+		return E_OUTOFMEMORY;
+	}
+
+	int entry = gFreeEntries.back();
+	Entry& e = gEntries[entry];
+
+	HRESULT hr = DirectX::CreateDDSTextureFromData12(device, cmdList, data, e.Resource, e.UploadHeap);
+	if(FAILED(hr))
+		return hr;
+
+	gFreeEntries.pop_back();
+	++gLiveCount;
+
+	e.Desc = e.Resource->GetDesc();
+	e.Bytes = device->GetResourceAllocationInfo(0, 1, &e.Desc).SizeInBytes;
+	e.RefCount = 1;
+	e.ContentHash = hash;
+	e.Paths.assign(1, path);
+	gPaths[path] = entry;
+	gContents[hash] = entry;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = e.Desc.Format;
+	if(data.IsCubeMap)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MostDetailedMip = 0;
+		srvDesc.TextureCube.MipLevels = e.Desc.MipLevels;
+		srvDesc.TextureCube.ResourceMinLODClamp = 0.0f;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = e.Desc.MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	}
+	device->CreateShaderResourceView(e.Resource.Get(), &srvDesc, SrvHandle(entry));
+
+	texture = TextureHandle(entry);
+	return S_OK;
+}
+
+void TextureCache::DisposeUploaders()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	for(auto& e : gEntries)
+		e.UploadHeap = nullptr;
+}
+
+int TextureCache::LiveCount()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gLiveCount;
+}
+
+uint64_t TextureCache::DuplicateBytesAvoided()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gDuplicateBytes;
+}
+
+std::string TextureCache::Report()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+
+	char text[256];
+	sprintf_s(text, "Texture cache: %d loads, %d live textures, %d path hits, %d content hits, %.2f MB of duplicates avoided",
+		gLoads, gLiveCount, gPathHits, gContentHits, gDuplicateBytes / (1024.0*1024.0));
+	return text;
+}
+
+void TextureCache::AddRef(int entry)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	++gEntries[entry].RefCount;
+}
+
+void TextureCache::Release(int entry)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+
+	Entry& e = gEntries[entry];
+	assert(e.RefCount > 0);
+	if(--e.RefCount > 0)
+		return;
+
+	for(const auto& path : e.Paths)
+	{
+		auto it = gPaths.find(path);
+		if(it != gPaths.end() && it->second == entry)
+			gPaths.erase(it);
+	}
+
+	auto it = gContents.find(e.ContentHash);
+	if(it != gContents.end() && it->second == entry)
+		gContents.erase(it);
+
+	e = Entry();
+	gFreeEntries.push_back(entry);
+
+	// The SRV heap goes with the last texture, before its device does.
+	if(--gLiveCount == 0)
+		gSrvHeap = nullptr;
+}
@@ -0,0 +1,74 @@
+//***************************************************************************************
+// TextureCache.h
+//
+// Process-wide cache of textures loaded from DDS files.  A file is loaded once per
+// normalized path, and files with the same content share one resource, so textures
+// loaded under several names or from several copies of a file are paid for once.
+// Textures are handed out as reference counted handles and released with the last.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+// A reference to a cached texture.  Copies share the texture; its resource and SRV
+// are released when the last handle goes away, so like any resource the handles
+// must outlive the GPU's use of it.
+class TextureHandle
+{
+public:
+	TextureHandle() = default;
+	TextureHandle(const TextureHandle& rhs);
+	TextureHandle(TextureHandle&& rhs);
+	TextureHandle& operator=(TextureHandle rhs);
+	~TextureHandle();
+
+	explicit operator bool()const { return mEntry >= 0; }
+
+	ID3D12Resource* Resource()const;
+
+	// A view of every mip, as a cube for cube maps, in a heap the shaders cannot
+	// see.  Copy it into a shader visible heap with CopyDescriptorsSimple.
+	D3D12_CPU_DESCRIPTOR_HANDLE Srv()const;
+
+private:
+	friend class TextureCache;
+	explicit TextureHandle(int entry) : mEntry(entry) {}
+
+	int mEntry = -1;
+};
+
+class TextureCache
+{
+public:
+	// Cached textures, and so cached SRVs, at most.
+	static const int Capacity = 256;
+
+	// Returns the texture in filename, loading it and recording its upload into
+	// cmdList unless a texture with the same normalized path or content is cached.
+	static HRESULT Load(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::wstring& filename, TextureHandle& texture);
+
+	// Same for a file already read by LoadDDSTextureData12, e.g. on a worker thread.
+	// The path is only reused if the cached texture was laid out the same way.
+	static HRESULT Load(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::wstring& filename, const DirectX::DDSTextureData& data, TextureHandle& texture);
+
+	// Releases the upload heaps of the loads so far.  Call once their commands have
+	// executed.
+	static void DisposeUploaders();
+
+	static int LiveCount();
+
+	// GPU bytes of the loads that were served by a texture already in the cache.
+	static uint64_t DuplicateBytesAvoided();
+
+	// Loads, path and content hits, and bytes avoided.
+	static std::string Report();
+
+private:
+	friend class TextureHandle;
+
+	static void AddRef(int entry);
+	static void Release(int entry);
+};
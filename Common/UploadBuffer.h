@@ -29,6 +29,8 @@ public:
             nullptr,
             IID_PPV_ARGS(&mUploadBuffer)));
 
+        MemoryStats::Track(MemoryCategory::ConstantBuffer, mUploadBuffer.Get());
+
         ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
 
         // We do not need to unmap until we are done with the resource.  However, we must not write to
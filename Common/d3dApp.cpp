@@ -35,6 +35,13 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	mInputLatency.StopSampling();
+	mInputLatency.Poll(mCurrentFence);
+	LOG_INFO("Frames in flight: {}", gNumFrameResources);
+	Log::WriteText(LogLevel::Info, mInputLatency.Report());
+
+	Log::Stop();
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -91,11 +98,16 @@ int D3DApp::Run()
 			if( !mAppPaused )
 			{
 				CalculateFrameStats();
+				mInputLatency.BeginFrame();
 				Update(mTimer);	
                 Draw(mTimer);
+				// Window messages sent while the frame was drawn may have paused the app.
+				mInputLatency.EndFrame(mCurrentFence, mAppPaused);
+				mInputLatency.Poll(mFence->GetCompletedValue());
 			}
 			else
 			{
+				mInputLatency.DiscardInput();
 				Sleep(100);
 			}
         }
@@ -106,12 +118,20 @@ int D3DApp::Run()
 
 bool D3DApp::Initialize()
 {
+	Log::Start(mLogFilename.c_str());
+	LOG_INFO("Log hot path: {} ns per call", Log::MeasureHotPathCost());
+
 	if(!InitMainWindow())
 		return false;
 
 	if(!InitDirect3D())
 		return false;
 
+	// The sampler raises the system timer resolution while it runs, which costs
+	// power and perturbs every other timing, so it only runs when asked for.
+	if(wcsstr(GetCommandLineW(), L"-inputsampling") != nullptr)
+		mInputLatency.StartSampling(mLatencySampledKeys);
+
     // Do the initial resize code.
     OnResize();
 
@@ -167,6 +187,7 @@ void D3DApp::OnResize()
 	for (UINT i = 0; i < SwapChainBufferCount; i++)
 	{
 		ThrowIfFailed(mSwapChain->GetBuffer(i, IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		MemoryStats::Track(MemoryCategory::RenderTarget, mSwapChainBuffer[i].Get());
 		md3dDevice->CreateRenderTargetView(mSwapChainBuffer[i].Get(), nullptr, rtvHeapHandle);
 		rtvHeapHandle.Offset(1, mRtvDescriptorSize);
 	}
@@ -203,6 +224,7 @@ void D3DApp::OnResize()
 		D3D12_RESOURCE_STATE_COMMON,
         &optClear,
         IID_PPV_ARGS(mDepthStencilBuffer.GetAddressOf())));
+    MemoryStats::Track(MemoryCategory::RenderTarget, mDepthStencilBuffer.Get());
 
     // Create descriptor to mip level 0 of entire resource using the format of the resource.
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
@@ -237,6 +259,10 @@ void D3DApp::OnResize()
  
 LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
+	// Timestamp input that changes what is drawn as soon as the OS hands it to us.
+	if(InputLatencyTracker::ChangesState(msg, wParam, lParam))
+		mInputLatency.OnInputEvent();
+
 	switch( msg )
 	{
 	// WM_ACTIVATE is sent when the window is activated or deactivated.  
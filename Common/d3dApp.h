@@ -11,6 +11,7 @@
 
 #include "d3dUtil.h"
 #include "GameTimer.h"
+#include "InputLatency.h"
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
@@ -90,6 +91,9 @@ protected:
 
 	// Used to keep track of the delta-time and game time (4.4).
 	GameTimer mTimer;
+
+	// Input-to-photon latency of the frames produced by Run().
+	InputLatencyTracker mInputLatency;
 	
     Microsoft::WRL::ComPtr<IDXGIFactory4> mdxgiFactory;
     Microsoft::WRL::ComPtr<IDXGISwapChain> mSwapChain;
@@ -119,6 +123,11 @@ protected:
 
 	// Derived class should set these in derived constructor to customize starting values.
 	std::wstring mMainWndCaption = L"d3d App";
+	std::wstring mLogFilename = L"d3dApp.log";
+	// Keys timestamped by the 1 kHz input sampling thread, which runs with
+	// -inputsampling on the command line; empty disables the thread.
+	std::vector<int> mLatencySampledKeys = { 'W', 'A', 'S', 'D', 'Q', 'E', '1', '2',
+		VK_LEFT, VK_RIGHT, VK_UP, VK_DOWN };
 	D3D_DRIVER_TYPE md3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
     DXGI_FORMAT mBackBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
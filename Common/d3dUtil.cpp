@@ -35,6 +35,22 @@ ComPtr<ID3DBlob> d3dUtil::LoadBinary(const std::wstring& filename)
     return blob;
 }
 
+bool d3dUtil::ReadFileBytes(const std::wstring& filename, std::vector<std::uint8_t>& bytes)
+{
+    std::ifstream fin(filename, std::ios::binary);
+    if(!fin)
+        return false;
+
+    fin.seekg(0, std::ios_base::end);
+    std::streamoff size = fin.tellg();
+    fin.seekg(0, std::ios_base::beg);
+
+    bytes.resize((size_t)size);
+    fin.read((char*)bytes.data(), size);
+
+    return !fin.fail();
+}
+
 Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     ID3D12Device* device,
     ID3D12GraphicsCommandList* cmdList,
@@ -63,6 +79,8 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
         nullptr,
         IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
 
+    MemoryStats::Track(MemoryCategory::Geometry, defaultBuffer.Get());
+    MemoryStats::Track(MemoryCategory::UploadHeap, uploadBuffer.Get());
 
     // Describe the data we want to copy into the default buffer.
     D3D12_SUBRESOURCE_DATA subResourceData = {};
@@ -87,6 +105,25 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     return defaultBuffer;
 }
 
+void MeshGeometry::ApplyCpuGeometryPolicy(CpuGeometryPolicy policy)
+{
+	// The CPU copies are accounted for from the first time a policy is applied.
+	UINT64 before = CpuByteSize();
+	if(!CpuBytesTracked)
+	{
+		MemoryStats::Add(MemoryCategory::CpuGeometry, before);
+		CpuBytesTracked = true;
+	}
+
+	if(policy == CpuGeometryPolicy::ReleaseAll)
+	{
+		VertexBufferCPU = nullptr;
+		IndexBufferCPU = nullptr;
+	}
+
+	MemoryStats::Remove(MemoryCategory::CpuGeometry, before - CpuByteSize());
+}
+
 ComPtr<ID3DBlob> d3dUtil::CompileShader(
 	const std::wstring& filename,
 	const D3D_SHADER_MACRO* defines,
@@ -106,7 +143,16 @@ ComPtr<ID3DBlob> d3dUtil::CompileShader(
 		entrypoint.c_str(), target.c_str(), compileFlags, 0, &byteCode, &errors);
 
 	if(errors != nullptr)
-		OutputDebugStringA((char*)errors->GetBufferPointer());
+	{
+		Log::WriteText(FAILED(hr) ? LogLevel::Error : LogLevel::Warning,
+			std::string((char*)errors->GetBufferPointer(), errors->GetBufferSize()));
+	}
+
+	if(FAILED(hr))
+	{
+		LOG_ERROR("Failed to compile {} ({})", filename, entrypoint);
+		Log::Flush();
+	}
 
 	ThrowIfFailed(hr);
 
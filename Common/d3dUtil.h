@@ -28,6 +28,8 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "MemoryStats.h"
+#include "Log.h"
 
 extern const int gNumFrameResources;
 
@@ -114,6 +116,22 @@ public:
 
     static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
 
+    // Reads a whole file into memory; returns false if it cannot be opened.
+    static bool ReadFileBytes(const std::wstring& filename, std::vector<std::uint8_t>& bytes);
+
+    // 64-bit FNV-1a.  Pass the previous result as hash to combine several buffers.
+    static std::uint64_t HashBytes(const void* data, size_t byteSize,
+        std::uint64_t hash = 14695981039346656037ull)
+    {
+        const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+        for(size_t i = 0; i < byteSize; ++i)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
     static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
         ID3D12Device* device,
         ID3D12GraphicsCommandList* cmdList,
@@ -157,6 +175,13 @@ struct SubmeshGeometry
 	DirectX::BoundingBox Bounds;
 };
 
+// What a MeshGeometry keeps in system memory once its GPU buffers are uploaded.
+enum class CpuGeometryPolicy
+{
+	KeepAll,       // Full vertex/index copies.
+	ReleaseAll     // Nothing; the mesh only lives in GPU memory.
+};
+
 struct MeshGeometry
 {
 	// Give it a name so we can look it up by name.
@@ -210,6 +235,28 @@ struct MeshGeometry
 		VertexBufferUploader = nullptr;
 		IndexBufferUploader = nullptr;
 	}
+
+	// Trims the system memory copies after the upload has executed.
+	void ApplyCpuGeometryPolicy(CpuGeometryPolicy policy);
+
+	UINT64 CpuByteSize()const
+	{
+		UINT64 size = 0;
+		if(VertexBufferCPU != nullptr)
+			size += VertexBufferCPU->GetBufferSize();
+		if(IndexBufferCPU != nullptr)
+			size += IndexBufferCPU->GetBufferSize();
+		return size;
+	}
+
+	~MeshGeometry()
+	{
+		if(CpuBytesTracked)
+			MemoryStats::Remove(MemoryCategory::CpuGeometry, CpuByteSize());
+	}
+
+private:
+	bool CpuBytesTracked = false;
 };
 
 struct Light